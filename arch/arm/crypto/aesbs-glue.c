@@ -1,5 +1,6 @@
 /*
  * linux/arch/arm/crypto/aesbs-glue.c - glue code for NEON bit sliced AES
+ * and GHASH
  *
  * Copyright (C) 2013 Linaro Ltd <ard.biesheuvel@linaro.org>
  *
@@ -9,10 +10,16 @@
  */
 
 #include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/unaligned.h>
 #include <crypto/aes.h>
 #include <crypto/ablk_helper.h>
 #include <crypto/algapi.h>
+#include <crypto/gf128mul.h>
+#include <crypto/internal/hash.h>
+#include <crypto/scatterwalk.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 
 #include "aes_glue.h"
 
@@ -39,6 +46,16 @@ asmlinkage void bsaes_xts_encrypt(u8 const in[], u8 out[], u32 bytes,
 asmlinkage void bsaes_xts_decrypt(u8 const in[], u8 out[], u32 bytes,
 				  struct BS_KEY *key, u8 tweak[]);
 
+#define GHASH_BLOCK_SIZE	16
+#define GHASH_DIGEST_SIZE	16
+#define GCM_IV_SIZE		12
+
+/* bytes of data per kernel_neon_begin() section and per CTR/GHASH pass */
+#define GCM_CHUNK_SIZE		1024
+
+void pmull_ghash_update_p8(int blocks, u64 dg[], const u8 *src,
+			   const u64 k[], const u8 *head);
+
 struct aesbs_cbc_ctx {
 	struct AES_KEY	enc;
 	struct BS_KEY	dec;
@@ -54,6 +71,22 @@ struct aesbs_xts_ctx {
 	struct AES_KEY	twkey;
 };
 
+struct ghash_key {
+	u64		h[2];	/* H * x, as pmull_ghash_update_p8() wants it */
+	be128		k;	/* H, for the gf128mul fallback */
+};
+
+struct ghash_desc_ctx {
+	u64		digest[GHASH_DIGEST_SIZE / sizeof(u64)];
+	u8		buf[GHASH_BLOCK_SIZE];
+	u32		count;
+};
+
+struct aesbs_gcm_ctx {
+	struct BS_KEY		enc;
+	struct ghash_key	ghash;
+};
+
 static int aesbs_cbc_set_key(struct crypto_tfm *tfm, const u8 *in_key,
 			     unsigned int key_len)
 {
@@ -297,6 +330,366 @@ static int aesbs_xts_decrypt(struct blkcipher_desc *desc,
 	return err;
 }
 
+static void ghash_setkey_common(struct ghash_key *key, const u8 *inkey)
+{
+	u64 a, b;
+
+	memcpy(&key->k, inkey, GHASH_BLOCK_SIZE);
+
+	/* perform multiplication by 'x' in GF(2^128) */
+	b = get_unaligned_be64(inkey);
+	a = get_unaligned_be64(inkey + 8);
+
+	key->h[0] = (a << 1) | (b >> 63);
+	key->h[1] = (b << 1) | (a >> 63);
+
+	if (b >> 63)
+		key->h[1] ^= 0xc200000000000000ULL;
+}
+
+/*
+ * Hashes the optional head block and then @blocks blocks at @src into
+ * @dg. The caller holds kernel_neon_begin() if @simd is set.
+ */
+static void ghash_do_update(int blocks, u64 dg[], const u8 *src,
+			    const struct ghash_key *key, const u8 *head,
+			    bool simd)
+{
+	be128 dst;
+
+	if (simd) {
+		pmull_ghash_update_p8(blocks, dg, src, key->h, head);
+		return;
+	}
+
+	dst.a = cpu_to_be64(dg[1]);
+	dst.b = cpu_to_be64(dg[0]);
+	if (head) {
+		crypto_xor((u8 *)&dst, head, GHASH_BLOCK_SIZE);
+		gf128mul_lle(&dst, &key->k);
+	}
+	for (; blocks > 0; blocks--, src += GHASH_BLOCK_SIZE) {
+		crypto_xor((u8 *)&dst, src, GHASH_BLOCK_SIZE);
+		gf128mul_lle(&dst, &key->k);
+	}
+	dg[0] = be64_to_cpu(dst.b);
+	dg[1] = be64_to_cpu(dst.a);
+}
+
+static void ghash_neon_update(int blocks, u64 dg[], const u8 *src,
+			      const struct ghash_key *key, const u8 *head)
+{
+	if (likely(may_use_simd())) {
+		kernel_neon_begin();
+		ghash_do_update(blocks, dg, src, key, head, true);
+		kernel_neon_end();
+	} else {
+		ghash_do_update(blocks, dg, src, key, head, false);
+	}
+}
+
+static int ghash_init(struct shash_desc *desc)
+{
+	struct ghash_desc_ctx *ctx = shash_desc_ctx(desc);
+
+	*ctx = (struct ghash_desc_ctx){};
+	return 0;
+}
+
+static int ghash_update(struct shash_desc *desc, const u8 *src,
+			unsigned int len)
+{
+	struct ghash_desc_ctx *ctx = shash_desc_ctx(desc);
+	unsigned int partial = ctx->count % GHASH_BLOCK_SIZE;
+
+	ctx->count += len;
+
+	if ((partial + len) >= GHASH_BLOCK_SIZE) {
+		struct ghash_key *key = crypto_shash_ctx(desc->tfm);
+		int blocks;
+
+		if (partial) {
+			int p = GHASH_BLOCK_SIZE - partial;
+
+			memcpy(ctx->buf + partial, src, p);
+			src += p;
+			len -= p;
+		}
+
+		blocks = len / GHASH_BLOCK_SIZE;
+		len %= GHASH_BLOCK_SIZE;
+
+		ghash_neon_update(blocks, ctx->digest, src, key,
+				  partial ? ctx->buf : NULL);
+		src += blocks * GHASH_BLOCK_SIZE;
+		partial = 0;
+	}
+	if (len)
+		memcpy(ctx->buf + partial, src, len);
+	return 0;
+}
+
+static int ghash_final(struct shash_desc *desc, u8 *dst)
+{
+	struct ghash_desc_ctx *ctx = shash_desc_ctx(desc);
+	unsigned int partial = ctx->count % GHASH_BLOCK_SIZE;
+
+	if (partial) {
+		struct ghash_key *key = crypto_shash_ctx(desc->tfm);
+
+		memset(ctx->buf + partial, 0, GHASH_BLOCK_SIZE - partial);
+		ghash_neon_update(0, ctx->digest, NULL, key, ctx->buf);
+	}
+	put_unaligned_be64(ctx->digest[1], dst);
+	put_unaligned_be64(ctx->digest[0], dst + 8);
+
+	*ctx = (struct ghash_desc_ctx){};
+	return 0;
+}
+
+static int ghash_setkey(struct crypto_shash *tfm,
+			const u8 *inkey, unsigned int keylen)
+{
+	struct ghash_key *key = crypto_shash_ctx(tfm);
+
+	if (keylen != GHASH_BLOCK_SIZE) {
+		crypto_shash_set_flags(tfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	ghash_setkey_common(key, inkey);
+	return 0;
+}
+
+static int aesbs_gcm_setkey(struct crypto_aead *tfm, const u8 *in_key,
+			    unsigned int key_len)
+{
+	struct aesbs_gcm_ctx *ctx = crypto_aead_ctx(tfm);
+	u8 h[GHASH_BLOCK_SIZE] = {};
+
+	if (private_AES_set_encrypt_key(in_key, key_len * 8, &ctx->enc.rk)) {
+		crypto_aead_set_flags(tfm, CRYPTO_TFM_RES_BAD_KEY_LEN);
+		return -EINVAL;
+	}
+	ctx->enc.converted = 0;
+
+	AES_encrypt(h, h, &ctx->enc.rk);
+	ghash_setkey_common(&ctx->ghash, h);
+	return 0;
+}
+
+static int aesbs_gcm_setauthsize(struct crypto_aead *tfm,
+				 unsigned int authsize)
+{
+	switch (authsize) {
+	case 4:
+	case 8:
+	case 12:
+	case 13:
+	case 14:
+	case 15:
+	case 16:
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Hashes @len bytes at @src, the last block padded with zeroes */
+static void aesbs_gcm_ghash(struct aesbs_gcm_ctx *ctx, u64 dg[],
+			    const u8 *src, unsigned int len, bool simd)
+{
+	u8 buf[GHASH_BLOCK_SIZE];
+	unsigned int tail = len % GHASH_BLOCK_SIZE;
+
+	if (len >= GHASH_BLOCK_SIZE)
+		ghash_do_update(len / GHASH_BLOCK_SIZE, dg, src, &ctx->ghash,
+				NULL, simd);
+	if (tail) {
+		memcpy(buf, src + len - tail, tail);
+		memset(buf + tail, 0, GHASH_BLOCK_SIZE - tail);
+		ghash_do_update(0, dg, NULL, &ctx->ghash, buf, simd);
+	}
+}
+
+/* CTR mode with the 32 bit counter of GCM, which wraps around */
+static void aesbs_gcm_ctr(struct aesbs_gcm_ctx *ctx, u8 *dst, const u8 *src,
+			  unsigned int len, u8 ctr[], bool simd)
+{
+	u32 blocks = len / AES_BLOCK_SIZE;
+	u8 ks[AES_BLOCK_SIZE];
+
+	if (simd && blocks) {
+		bsaes_ctr32_encrypt_blocks(src, dst, blocks, &ctx->enc, ctr);
+		put_unaligned_be32(get_unaligned_be32(ctr + 12) + blocks,
+				   ctr + 12);
+		src += blocks * AES_BLOCK_SIZE;
+		dst += blocks * AES_BLOCK_SIZE;
+		len %= AES_BLOCK_SIZE;
+	}
+	while (len) {
+		unsigned int n = min_t(unsigned int, len, AES_BLOCK_SIZE);
+
+		AES_encrypt(ctr, ks, &ctx->enc.rk);
+		put_unaligned_be32(get_unaligned_be32(ctr + 12) + 1, ctr + 12);
+		if (dst != src)
+			memcpy(dst, src, n);
+		crypto_xor(dst, ks, n);
+		src += n;
+		dst += n;
+		len -= n;
+	}
+}
+
+/*
+ * Encrypts or decrypts @len bytes and computes the tag. The data goes
+ * through CTR and GHASH a chunk at a time, so that the second pass finds
+ * it in the cache.
+ */
+static void aesbs_gcm_do_crypt(struct aesbs_gcm_ctx *ctx, u8 *dst,
+			       const u8 *src, unsigned int len,
+			       const u8 *assoc, unsigned int assoclen,
+			       const u8 *iv, u8 tag[], bool enc)
+{
+	u8 ctr[AES_BLOCK_SIZE] __aligned(8);
+	u8 buf[GHASH_BLOCK_SIZE];
+	u64 dg[2] = {};
+	be128 lengths;
+	bool simd = may_use_simd();
+
+	lengths.a = cpu_to_be64((u64)assoclen * 8);
+	lengths.b = cpu_to_be64((u64)len * 8);
+
+	memcpy(ctr, iv, GCM_IV_SIZE);
+	put_unaligned_be32(1, ctr + 12);
+	AES_encrypt(ctr, tag, &ctx->enc.rk);
+	put_unaligned_be32(2, ctr + 12);
+
+	if (simd)
+		kernel_neon_begin();
+	aesbs_gcm_ghash(ctx, dg, assoc, assoclen, simd);
+	while (len) {
+		unsigned int n = min_t(unsigned int, len, GCM_CHUNK_SIZE);
+
+		if (!enc)
+			aesbs_gcm_ghash(ctx, dg, src, n, simd);
+		aesbs_gcm_ctr(ctx, dst, src, n, ctr, simd);
+		if (enc)
+			aesbs_gcm_ghash(ctx, dg, dst, n, simd);
+		src += n;
+		dst += n;
+		len -= n;
+
+		if (simd && len) {
+			kernel_neon_end();
+			kernel_neon_begin();
+		}
+	}
+	ghash_do_update(1, dg, (u8 *)&lengths, &ctx->ghash, NULL, simd);
+	if (simd)
+		kernel_neon_end();
+
+	put_unaligned_be64(dg[1], buf);
+	put_unaligned_be64(dg[0], buf + 8);
+	crypto_xor(tag, buf, GHASH_BLOCK_SIZE);
+}
+
+static bool aesbs_gcm_sg_is_linear(struct scatterlist *sg, unsigned int len)
+{
+	return sg_is_last(sg) && sg->length >= len &&
+	       sg->offset + len <= PAGE_SIZE;
+}
+
+/*
+ * Unlike memcmp(), takes the same time wherever the tags differ, so that a
+ * forger cannot learn how many leading bytes of a guessed tag were right.
+ */
+static bool aesbs_gcm_tag_neq(const u8 *a, const u8 *b, unsigned int len)
+{
+	u8 neq = 0;
+
+	while (len--)
+		neq |= *a++ ^ *b++;
+	return neq != 0;
+}
+
+/*
+ * Requests that sit in a single page each are mapped and processed in
+ * place, anything else is copied through a linear buffer.
+ */
+static int aesbs_gcm_crypt(struct aead_request *req, bool enc)
+{
+	struct crypto_aead *aead = crypto_aead_reqtfm(req);
+	struct aesbs_gcm_ctx *ctx = crypto_aead_ctx(aead);
+	unsigned int authsize = crypto_aead_authsize(aead);
+	unsigned int len = req->cryptlen;
+	struct scatter_walk src_walk, dst_walk, assoc_walk;
+	u8 *src, *dst, *assoc, *buf = NULL;
+	u8 tag[AES_BLOCK_SIZE];
+	int err = 0;
+
+	if (!enc) {
+		if (len < authsize)
+			return -EINVAL;
+		len -= authsize;
+	}
+
+	if (aesbs_gcm_sg_is_linear(req->assoc, req->assoclen) &&
+	    aesbs_gcm_sg_is_linear(req->src, len + authsize) &&
+	    aesbs_gcm_sg_is_linear(req->dst, len + authsize)) {
+		scatterwalk_start(&assoc_walk, req->assoc);
+		scatterwalk_start(&src_walk, req->src);
+		assoc = scatterwalk_map(&assoc_walk);
+		src = dst = scatterwalk_map(&src_walk);
+		if (req->dst != req->src) {
+			scatterwalk_start(&dst_walk, req->dst);
+			dst = scatterwalk_map(&dst_walk);
+		}
+	} else {
+		buf = kmalloc(req->assoclen + len + authsize, GFP_ATOMIC);
+		if (!buf)
+			return -ENOMEM;
+		assoc = buf;
+		src = dst = buf + req->assoclen;
+		scatterwalk_map_and_copy(assoc, req->assoc, 0, req->assoclen, 0);
+		scatterwalk_map_and_copy(src, req->src, 0, req->cryptlen, 0);
+	}
+
+	aesbs_gcm_do_crypt(ctx, dst, src, len, assoc, req->assoclen, req->iv,
+			   tag, enc);
+
+	if (enc)
+		memcpy(dst + len, tag, authsize);
+	else if (aesbs_gcm_tag_neq(src + len, tag, authsize))
+		err = -EBADMSG;
+
+	if (buf) {
+		scatterwalk_map_and_copy(dst, req->dst, 0,
+					 enc ? len + authsize : len, 1);
+		kfree(buf);
+	} else {
+		if (req->dst != req->src) {
+			scatterwalk_unmap(dst);
+			scatterwalk_done(&dst_walk, 1, 0);
+		}
+		scatterwalk_unmap(src);
+		scatterwalk_unmap(assoc);
+		scatterwalk_done(&src_walk, req->dst == req->src, 0);
+		scatterwalk_done(&assoc_walk, 0, 0);
+	}
+	return err;
+}
+
+static int aesbs_gcm_encrypt(struct aead_request *req)
+{
+	return aesbs_gcm_crypt(req, true);
+}
+
+static int aesbs_gcm_decrypt(struct aead_request *req)
+{
+	return aesbs_gcm_crypt(req, false);
+}
+
 static struct crypto_alg aesbs_algs[] = { {
 	.cra_name		= "__cbc-aes-neonbs",
 	.cra_driver_name	= "__driver-cbc-aes-neonbs",
@@ -411,24 +804,71 @@ static struct crypto_alg aesbs_algs[] = { {
 		.encrypt	= ablk_encrypt,
 		.decrypt	= ablk_decrypt,
 	}
+}, {
+	.cra_name		= "gcm(aes)",
+	.cra_driver_name	= "gcm-aes-neonbs",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_AEAD,
+	.cra_blocksize		= 1,
+	.cra_ctxsize		= sizeof(struct aesbs_gcm_ctx),
+	.cra_alignmask		= 0,
+	.cra_type		= &crypto_aead_type,
+	.cra_module		= THIS_MODULE,
+	.cra_aead = {
+		.setkey		= aesbs_gcm_setkey,
+		.setauthsize	= aesbs_gcm_setauthsize,
+		.encrypt	= aesbs_gcm_encrypt,
+		.decrypt	= aesbs_gcm_decrypt,
+		.geniv		= "seqiv",
+		.ivsize		= GCM_IV_SIZE,
+		.maxauthsize	= AES_BLOCK_SIZE,
+	}
 } };
 
+static struct shash_alg ghash_alg = {
+	.digestsize	= GHASH_DIGEST_SIZE,
+	.init		= ghash_init,
+	.update		= ghash_update,
+	.final		= ghash_final,
+	.setkey		= ghash_setkey,
+	.descsize	= sizeof(struct ghash_desc_ctx),
+	.base		= {
+		.cra_name		= "ghash",
+		.cra_driver_name	= "ghash-neon",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize		= GHASH_BLOCK_SIZE,
+		.cra_ctxsize		= sizeof(struct ghash_key),
+		.cra_module		= THIS_MODULE,
+	},
+};
+
 static int __init aesbs_mod_init(void)
 {
+	int err;
+
 	if (!cpu_has_neon())
 		return -ENODEV;
 
-	return crypto_register_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
+	err = crypto_register_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
+	if (err)
+		return err;
+
+	err = crypto_register_shash(&ghash_alg);
+	if (err)
+		crypto_unregister_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
+	return err;
 }
 
 static void __exit aesbs_mod_exit(void)
 {
+	crypto_unregister_shash(&ghash_alg);
 	crypto_unregister_algs(aesbs_algs, ARRAY_SIZE(aesbs_algs));
 }
 
 module_init(aesbs_mod_init);
 module_exit(aesbs_mod_exit);
 
-MODULE_DESCRIPTION("Bit sliced AES in CBC/CTR/XTS modes using NEON");
+MODULE_DESCRIPTION("Bit sliced AES in CBC/CTR/XTS/GCM modes and GHASH, NEON");
 MODULE_AUTHOR("Ard Biesheuvel <ard.biesheuvel@linaro.org>");
 MODULE_LICENSE("GPL");
@@ -0,0 +1,145 @@
+/*
+ * linux/arch/arm/crypto/ghash-neon-core.c - GHASH using NEON vmull.p8
+ *
+ * NEON on ARMv7 can only multiply 8x8 bit polynomials, so every 64x64 bit
+ * carry-less multiply is put together from eight vmull.p8 (Camara et al.,
+ * "Fast Software Polynomial Multiplication on ARM Processors Using the
+ * NEON Engine"): one for the products of bytes at the same position, and
+ * for every byte distance k one of a by b rotated by k bytes plus one of
+ * b by a rotated by k bytes. Lane i of the latter holds the products of
+ * bytes i and i + k, which belong k bytes above the lane, or, once i + k
+ * wraps around, those of bytes i and i + k - 8, which belong 8 - k bytes
+ * below it. Distance 4 covers both cases with a single multiply. The
+ * rotations of the hash key are computed once per call.
+ *
+ * The 128x128 bit multiply uses Karatsuba, and the data layout and the
+ * reduction are those of the ARMv8 PMULL version in
+ * arch/arm64/crypto/ghash-ce-core.S, with the multiplies by the reduction
+ * constant done as shifts.
+ *
+ * This file is built with -mfpu=neon, the caller must hold
+ * kernel_neon_begin().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <arm_neon.h>
+
+/* one operand of pmull64(), rotated by 1, 2, 3 and 4 bytes */
+struct pmull_op {
+	uint8x8_t	b;
+	uint8x8_t	b1;
+	uint8x8_t	b2;
+	uint8x8_t	b3;
+	uint8x8_t	b4;
+};
+
+static inline void pmull_op_init(struct pmull_op *op, uint64x1_t b)
+{
+	op->b = vreinterpret_u8_u64(b);
+	op->b1 = vext_u8(op->b, op->b, 1);
+	op->b2 = vext_u8(op->b, op->b, 2);
+	op->b3 = vext_u8(op->b, op->b, 3);
+	op->b4 = vext_u8(op->b, op->b, 4);
+}
+
+static inline uint8x16_t vmull8(uint8x8_t a, uint8x8_t b)
+{
+	return vreinterpretq_u8_p16(vmull_p8(vreinterpret_p8_u8(a),
+					     vreinterpret_p8_u8(b)));
+}
+
+/*
+ * Moves the lanes of a distance k product to their place: the low
+ * 16 - 2k bytes up by k bytes, the rest down by 8 - k bytes.
+ */
+#define pmull_fold(x, mask, k, zero)					\
+	veorq_u8(vextq_u8(zero, vandq_u8(x, mask), 16 - (k)),		\
+		 vextq_u8(vbicq_u8(x, mask), zero, 8 - (k)))
+
+static inline uint64x2_t pmull64(uint64x1_t a64, const struct pmull_op *b)
+{
+	const uint8x16_t zero = vdupq_n_u8(0);
+	const uint8x16_t k1 = vcombine_u8(vcreate_u8(~0ULL),
+					  vcreate_u8(0x0000ffffffffffffULL));
+	const uint8x16_t k2 = vcombine_u8(vcreate_u8(~0ULL),
+					  vcreate_u8(0x00000000ffffffffULL));
+	const uint8x16_t k3 = vcombine_u8(vcreate_u8(~0ULL),
+					  vcreate_u8(0x000000000000ffffULL));
+	const uint8x16_t k4 = vcombine_u8(vcreate_u8(~0ULL), vcreate_u8(0));
+	uint8x8_t a = vreinterpret_u8_u64(a64);
+	uint8x16_t r, t;
+
+	r = vmull8(a, b->b);
+	t = veorq_u8(vmull8(a, b->b1), vmull8(vext_u8(a, a, 1), b->b));
+	r = veorq_u8(r, pmull_fold(t, k1, 1, zero));
+	t = veorq_u8(vmull8(a, b->b2), vmull8(vext_u8(a, a, 2), b->b));
+	r = veorq_u8(r, pmull_fold(t, k2, 2, zero));
+	t = veorq_u8(vmull8(a, b->b3), vmull8(vext_u8(a, a, 3), b->b));
+	r = veorq_u8(r, pmull_fold(t, k3, 3, zero));
+	t = vmull8(a, b->b4);
+	r = veorq_u8(r, pmull_fold(t, k4, 4, zero));
+
+	return vreinterpretq_u64_u8(r);
+}
+
+/* multiply by 0xc200000000000000, the reduction constant */
+static inline uint64x2_t pmull_mask(uint64x1_t a)
+{
+	uint64x1_t lo, hi;
+
+	lo = veor_u64(veor_u64(vshl_n_u64(a, 63), vshl_n_u64(a, 62)),
+		      vshl_n_u64(a, 57));
+	hi = veor_u64(veor_u64(vshr_n_u64(a, 1), vshr_n_u64(a, 2)),
+		      vshr_n_u64(a, 7));
+	return vcombine_u64(lo, hi);
+}
+
+static inline uint64x2_t ghash_block(uint64x2_t xl, const uint8_t *src,
+				     const struct pmull_op *ka,
+				     const struct pmull_op *kb,
+				     const struct pmull_op *kab)
+{
+	uint64x2_t in, xh, xm, t;
+
+	in = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(src)));
+	xl = veorq_u64(xl, vextq_u64(in, in, 1));
+
+	/* Karatsuba */
+	xh = pmull64(vget_high_u64(xl), kb);
+	xm = pmull64(veor_u64(vget_low_u64(xl), vget_high_u64(xl)), kab);
+	xl = pmull64(vget_low_u64(xl), ka);
+	xm = veorq_u64(xm, veorq_u64(xl, xh));
+	xm = veorq_u64(xm, vcombine_u64(vget_high_u64(xl),
+					vget_low_u64(xh)));
+
+	/* reduction */
+	t = pmull_mask(vget_low_u64(xl));
+	xh = vcombine_u64(vget_high_u64(xm), vget_high_u64(xh));
+	xm = vcombine_u64(vget_low_u64(xm), vget_low_u64(xl));
+	xl = veorq_u64(xm, t);
+	t = veorq_u64(vextq_u64(xl, xl, 1), xh);
+	xl = pmull_mask(vget_low_u64(xl));
+	return veorq_u64(xl, t);
+}
+
+void pmull_ghash_update_p8(int blocks, uint64_t dg[], const uint8_t *src,
+			   const uint64_t k[], const uint8_t *head)
+{
+	struct pmull_op ka, kb, kab;
+	uint64x2_t xl, key;
+
+	key = vld1q_u64(k);
+	pmull_op_init(&ka, vget_low_u64(key));
+	pmull_op_init(&kb, vget_high_u64(key));
+	pmull_op_init(&kab, veor_u64(vget_low_u64(key), vget_high_u64(key)));
+
+	xl = vld1q_u64(dg);
+	if (head)
+		xl = ghash_block(xl, head, &ka, &kb, &kab);
+	for (; blocks > 0; blocks--, src += 16)
+		xl = ghash_block(xl, src, &ka, &kb, &kab);
+	vst1q_u64(dg, xl);
+}
@@ -0,0 +1,140 @@
+/*
+ * linux/arch/arm/crypto/sha256-neon-core.c - SHA-256 block function
+ *
+ * The message schedule is computed with NEON four words at a time, and
+ * W[t] + K[t] for all 64 rounds is stored to the stack before the rounds
+ * run in the integer unit. The rounds are a single dependency chain that
+ * NEON cannot speed up, but the schedule is independent of them, so this
+ * takes it off the integer pipeline and leaves only one load and one add
+ * of message data per round.
+ *
+ * This file is built with -mfpu=neon, the caller must hold
+ * kernel_neon_begin().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <arm_neon.h>
+
+static const uint32_t sha256_k[64] __attribute__((aligned(16))) = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define vror(x, n)	vsliq_n_u32(vshrq_n_u32(x, n), x, 32 - (n))
+
+static inline uint32x4_t sigma0(uint32x4_t x)
+{
+	return veorq_u32(veorq_u32(vror(x, 7), vror(x, 18)),
+			 vshrq_n_u32(x, 3));
+}
+
+static inline uint32x4_t sigma1(uint32x4_t x)
+{
+	return veorq_u32(veorq_u32(vror(x, 17), vror(x, 19)),
+			 vshrq_n_u32(x, 10));
+}
+
+/*
+ * W[t..t+3] from x0 = W[t-16..t-13] up to x3 = W[t-4..t-1]. The sigma1
+ * terms of the two upper words depend on the two lower ones, so the sum is
+ * done twice and the correct halves are combined.
+ */
+static inline uint32x4_t sha256_schedule(uint32x4_t x0, uint32x4_t x1,
+					 uint32x4_t x2, uint32x4_t x3)
+{
+	uint32x4_t t, lo, hi;
+
+	t = vaddq_u32(vaddq_u32(x0, sigma0(vextq_u32(x0, x1, 1))),
+		      vextq_u32(x2, x3, 1));
+	lo = vaddq_u32(t, sigma1(vextq_u32(x3, x3, 2)));
+	hi = vaddq_u32(t, sigma1(vextq_u32(lo, lo, 2)));
+	return vcombine_u32(vget_low_u32(lo), vget_high_u32(hi));
+}
+
+static inline uint32_t ror32(uint32_t x, unsigned int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+#define Ch(x, y, z)	((z) ^ ((x) & ((y) ^ (z))))
+#define Maj(x, y, z)	(((x) & (y)) | ((z) & ((x) | (y))))
+#define e0(x)		(ror32(x, 2) ^ ror32(x, 13) ^ ror32(x, 22))
+#define e1(x)		(ror32(x, 6) ^ ror32(x, 11) ^ ror32(x, 25))
+
+void sha256_transform_neon(uint32_t *digest, const uint8_t *data,
+			   unsigned int num_blks)
+{
+	uint32_t wk[64] __attribute__((aligned(16)));
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	uint32x4_t x0, x1, x2, x3, x4;
+	int i;
+
+	while (num_blks--) {
+		x0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data)));
+		x1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		x2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		x3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+		data += 64;
+
+		for (i = 0; i < 48; i += 4) {
+			vst1q_u32(wk + i, vaddq_u32(x0, vld1q_u32(sha256_k + i)));
+			x4 = sha256_schedule(x0, x1, x2, x3);
+			x0 = x1;
+			x1 = x2;
+			x2 = x3;
+			x3 = x4;
+		}
+		vst1q_u32(wk + 48, vaddq_u32(x0, vld1q_u32(sha256_k + 48)));
+		vst1q_u32(wk + 52, vaddq_u32(x1, vld1q_u32(sha256_k + 52)));
+		vst1q_u32(wk + 56, vaddq_u32(x2, vld1q_u32(sha256_k + 56)));
+		vst1q_u32(wk + 60, vaddq_u32(x3, vld1q_u32(sha256_k + 60)));
+
+		a = digest[0];
+		b = digest[1];
+		c = digest[2];
+		d = digest[3];
+		e = digest[4];
+		f = digest[5];
+		g = digest[6];
+		h = digest[7];
+
+		for (i = 0; i < 64; i++) {
+			t1 = h + e1(e) + Ch(e, f, g) + wk[i];
+			t2 = e0(a) + Maj(a, b, c);
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		digest[0] += a;
+		digest[1] += b;
+		digest[2] += c;
+		digest[3] += d;
+		digest[4] += e;
+		digest[5] += f;
+		digest[6] += g;
+		digest[7] += h;
+	}
+}
@@ -57,6 +57,25 @@ struct kprobe_ctlblk {
 	char jprobes_stack[MAX_STACK_SIZE];
 };
 
+/* optinsn template addresses */
+extern kprobe_opcode_t optprobe_template_entry;
+extern kprobe_opcode_t optprobe_template_val;
+extern kprobe_opcode_t optprobe_template_call;
+extern kprobe_opcode_t optprobe_template_end;
+
+#define MAX_OPTIMIZED_LENGTH	4
+#define MAX_OPTINSN_SIZE				\
+	(((unsigned long)&optprobe_template_end -	\
+	  (unsigned long)&optprobe_template_entry) / sizeof(kprobe_opcode_t))
+#define RELATIVEJUMP_SIZE	4
+
+struct arch_optimized_insn {
+	/* Original instruction, replaced by a branch to the detour buffer */
+	kprobe_opcode_t copied_insn[1];
+	/* Detour code buffer */
+	kprobe_opcode_t *insn;
+};
+
 void arch_remove_kprobe(struct kprobe *);
 int kprobe_fault_handler(struct pt_regs *regs, unsigned int fsr);
 int kprobe_exceptions_notify(struct notifier_block *self,
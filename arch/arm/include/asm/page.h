@@ -141,6 +141,10 @@ extern void __cpu_copy_user_highpage(struct page *to, struct page *from,
 
 #define clear_page(page)	memset((void *)(page), 0, PAGE_SIZE)
 extern void copy_page(void *to, const void *from);
+#ifdef CONFIG_KERNEL_MODE_NEON
+/* the integer version, which copy_page() falls back to without NEON */
+extern void __copy_page_arm(void *to, const void *from);
+#endif
 
 #ifdef CONFIG_KUSER_HELPERS
 #define __HAVE_ARCH_GATE_AREA 1
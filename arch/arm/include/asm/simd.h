@@ -0,0 +1,36 @@
+/*
+ * linux/arch/arm/include/asm/simd.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_SIMD_H
+#define __ASM_SIMD_H
+
+#include <linux/hardirq.h>
+#include <linux/percpu.h>
+#include <linux/types.h>
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+DECLARE_PER_CPU(bool, kernel_neon_busy);
+#endif
+
+/*
+ * may_use_simd - whether it is allowable at this time to issue SIMD
+ *                instructions or access the SIMD register file
+ *
+ * Kernel mode NEON is not available in interrupt context, and it does not
+ * nest: the kernel_neon_end() of an inner user would turn the unit off
+ * under the outer one.
+ */
+static __must_check inline bool may_use_simd(void)
+{
+#ifdef CONFIG_KERNEL_MODE_NEON
+	return !in_interrupt() && !this_cpu_read(kernel_neon_busy);
+#else
+	return !in_interrupt();
+#endif
+}
+
+#endif
@@ -26,6 +26,15 @@ extern void * memset(void *, int, __kernel_size_t);
 
 extern void __memzero(void *ptr, __kernel_size_t n);
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+/*
+ * The integer versions, which memcpy() and __memzero() use for small
+ * sizes and wherever kernel mode NEON is not allowed.
+ */
+extern void * __memcpy_arm(void *, const void *, __kernel_size_t);
+extern void __memzero_arm(void *ptr, __kernel_size_t n);
+#endif
+
 #define memset(p,v,n)							\
 	({								\
 	 	void *__p = (p); size_t __n = n;			\
@@ -0,0 +1,254 @@
+/*
+ * arch/arm/kernel/kprobes-opt-arm.c
+ *
+ * Jump optimized kprobes for ARM code.
+ *
+ * An optimized probe replaces the probed instruction with a branch to a
+ * detour buffer instead of an undefined instruction, which saves the
+ * exception entry and exit of every hit. The detour buffer is a copy of
+ * optprobe_template_entry: it builds a struct pt_regs on the stack, calls
+ * optimized_callback() which runs the pre handlers and simulates the probed
+ * instruction, and returns to the address left in regs->ARM_pc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kprobes.h>
+#include <linux/module.h>
+#include <linux/stop_machine.h>
+#include <linux/stringify.h>
+#include <asm/cacheflush.h>
+
+#include "kprobes.h"
+#include "patch.h"
+#include "insn.h"
+
+/*
+ * The detour buffer leaves the same 64 byte hole between the saved
+ * registers and the interrupted stack as __und_svc does, so that simulated
+ * stores below the stack pointer, e.g. "stmdb sp!, {...}", can't overwrite
+ * the register frame.
+ */
+#define OPTPROBE_REGS_SIZE	72	/* sizeof(struct pt_regs) */
+#define OPTPROBE_FRAME_SIZE	(OPTPROBE_REGS_SIZE + 64)
+
+#define TMPL_VAL_IDX						\
+	((unsigned long)&optprobe_template_val -		\
+	 (unsigned long)&optprobe_template_entry)
+#define TMPL_CALL_IDX						\
+	((unsigned long)&optprobe_template_call -		\
+	 (unsigned long)&optprobe_template_entry)
+#define TMPL_END_IDX						\
+	((unsigned long)&optprobe_template_end -		\
+	 (unsigned long)&optprobe_template_entry)
+
+asm (
+	"	.arm\n"
+	"	.global optprobe_template_entry\n"
+	"optprobe_template_entry:\n"
+	"	sub	sp, sp, #" __stringify(OPTPROBE_FRAME_SIZE) "\n"
+	"	stmia	sp, {r0 - r14}\n"
+	"	add	r3, sp, #" __stringify(OPTPROBE_FRAME_SIZE) "\n"
+	"	str	r3, [sp, #52]\n"		/* ARM_sp */
+	"	mrs	r4, cpsr\n"
+	"	str	r4, [sp, #64]\n"		/* ARM_cpsr */
+	"	mov	r1, sp\n"
+	"	ldr	r0, 1f\n"
+	/* AAPCS wants an 8 byte aligned stack */
+	"	and	r4, sp, #4\n"
+	"	sub	sp, sp, r4\n"
+	"	mov	lr, pc\n"
+	"	ldr	pc, 2f\n"
+	"	add	sp, sp, r4\n"
+	"	ldr	r1, [sp, #64]\n"
+	"	msr	cpsr_cxsf, r1\n"
+	/* Restore everything, sp and pc included, in one go */
+	"	ldmia	sp, {r0 - r15}\n"
+	"	.global optprobe_template_val\n"
+	"optprobe_template_val:\n"
+	"1:	.long	0\n"
+	"	.global optprobe_template_call\n"
+	"optprobe_template_call:\n"
+	"2:	.long	0\n"
+	"	.global optprobe_template_end\n"
+	"optprobe_template_end:\n");
+
+static void __kprobes
+optimized_callback(struct optimized_kprobe *op, struct pt_regs *regs)
+{
+	struct kprobe *p = &op->kp;
+	struct kprobe_ctlblk *kcb;
+	unsigned long flags;
+
+	/* The simulation code expects pc to point at the probed instruction */
+	regs->ARM_pc = (unsigned long)p->addr;
+	regs->ARM_ORIG_r0 = ~0UL;
+
+	local_irq_save(flags);
+	kcb = get_kprobe_ctlblk();
+
+	if (kprobe_running()) {
+		kprobes_inc_nmissed_count(p);
+	} else {
+		__this_cpu_write(current_kprobe, p);
+		kcb->kprobe_status = KPROBE_HIT_ACTIVE;
+		opt_pre_handler(p, regs);
+		__this_cpu_write(current_kprobe, NULL);
+	}
+
+	/* The probed instruction must run even if the probe was missed */
+	if (p->ainsn.insn_check_cc(regs->ARM_cpsr))
+		p->ainsn.insn_singlestep(p, regs);
+	else
+		regs->ARM_pc += 4;
+
+	local_irq_restore(flags);
+}
+
+static int __kprobes can_optimize(struct kprobe *p)
+{
+	/*
+	 * A fault in the simulated instruction would be taken in
+	 * optimized_callback(), where the exception table fixup of the
+	 * original instruction can't be found.
+	 */
+	if (search_exception_tables((unsigned long)p->addr))
+		return 0;
+
+	return p->ainsn.insn_singlestep != NULL;
+}
+
+int __kprobes arch_prepared_optinsn(struct arch_optimized_insn *optinsn)
+{
+	return optinsn->insn != NULL;
+}
+
+/* ARM replaces a single instruction, there is nothing else to check. */
+int __kprobes arch_check_optimized_kprobe(struct optimized_kprobe *op)
+{
+	return 0;
+}
+
+int __kprobes arch_within_optimized_kprobe(struct optimized_kprobe *op,
+					   unsigned long addr)
+{
+	return (unsigned long)op->kp.addr <= addr &&
+	       (unsigned long)op->kp.addr + RELATIVEJUMP_SIZE > addr;
+}
+
+int __kprobes arch_prepare_optimized_kprobe(struct optimized_kprobe *op)
+{
+	kprobe_opcode_t *code;
+	long offset;
+
+	BUILD_BUG_ON(sizeof(struct pt_regs) != OPTPROBE_REGS_SIZE);
+
+	if (!can_optimize(&op->kp))
+		return -EILSEQ;
+
+	code = get_optinsn_slot();
+	if (!code)
+		return -ENOMEM;
+
+	/* The probe address must be able to reach the buffer with a "b" */
+	offset = (long)code - ((long)op->kp.addr + 8);
+	if (offset < -33554432 || offset > 33554428) {
+		free_optinsn_slot(code, 0);
+		return -ERANGE;
+	}
+
+	memcpy(code, &optprobe_template_entry, TMPL_END_IDX);
+	code[TMPL_VAL_IDX / sizeof(kprobe_opcode_t)] = (unsigned long)op;
+	code[TMPL_CALL_IDX / sizeof(kprobe_opcode_t)] =
+		(unsigned long)optimized_callback;
+
+	flush_icache_range((unsigned long)code,
+			   (unsigned long)code + TMPL_END_IDX);
+
+	op->optinsn.insn = code;
+	return 0;
+}
+
+struct optprobe_patch {
+	void *addr;
+	unsigned int insn;
+};
+
+/*
+ * Like __arch_disarm_kprobe(), replace the breakpoint under stop_machine so
+ * that no CPU can take the undefined instruction exception for it and then
+ * find a branch when it reads the faulting instruction back.
+ */
+static int __kprobes optprobe_patch_text(void *data)
+{
+	struct optprobe_patch *patch = data;
+
+	__patch_text(patch->addr, patch->insn);
+	return 0;
+}
+
+void __kprobes arch_optimize_kprobes(struct list_head *oplist)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		struct optprobe_patch patch;
+		unsigned long insn;
+
+		WARN_ON(kprobe_disabled(&op->kp));
+
+		op->optinsn.copied_insn[0] = op->kp.opcode;
+
+		insn = arm_gen_branch((unsigned long)op->kp.addr,
+				      (unsigned long)op->optinsn.insn);
+		BUG_ON(!insn);
+
+		/*
+		 * Let the branch inherit the condition of the probed
+		 * instruction, so that the detour is only taken when the
+		 * instruction would have executed. Unconditional instructions
+		 * (condition 0b1111) get an "always" branch.
+		 */
+		if (op->kp.opcode < 0xe0000000)
+			insn = (op->kp.opcode & 0xf0000000) |
+			       (insn & 0x0fffffff);
+
+		patch.addr = op->kp.addr;
+		patch.insn = insn;
+		stop_machine(optprobe_patch_text, &patch, cpu_online_mask);
+
+		list_del_init(&op->list);
+	}
+}
+
+void __kprobes arch_unoptimize_kprobe(struct optimized_kprobe *op)
+{
+	arch_arm_kprobe(&op->kp);
+}
+
+void __kprobes arch_unoptimize_kprobes(struct list_head *oplist,
+				       struct list_head *done_list)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		arch_unoptimize_kprobe(op);
+		list_move(&op->list, done_list);
+	}
+}
+
+void __kprobes arch_remove_optimized_kprobe(struct optimized_kprobe *op)
+{
+	if (op->optinsn.insn) {
+		free_optinsn_slot(op->optinsn.insn, 1);
+		op->optinsn.insn = NULL;
+	}
+}
@@ -201,6 +201,7 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/kprobes.h>
+#include <linux/delay.h>
 
 #include <asm/opcodes.h>
 
@@ -210,6 +211,12 @@
 
 #define BENCHMARKING	1
 
+#if defined(CONFIG_OPTPROBES) && !defined(CONFIG_THUMB2_KERNEL)
+#define OPTPROBE_TESTING	1
+#else
+#define OPTPROBE_TESTING	0
+#endif
+
 
 /*
  * Test basic API
@@ -446,6 +453,70 @@ static int test_kretprobe(long (*func)(long, long))
 	return 0;
 }
 
+#if OPTPROBE_TESTING
+
+/*
+ * Probes without a post handler get optimized by a delayed worker, which
+ * replaces the breakpoint with a branch to the detour buffer.
+ */
+static bool wait_for_optimization(kprobe_opcode_t *addr, kprobe_opcode_t insn)
+{
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		if (*addr != insn && (*addr & 0x0f000000) == 0x0a000000)
+			return true;
+		msleep(10);
+	}
+	return false;
+}
+
+static struct kprobe the_optprobe = {
+	.addr		= 0,
+	.pre_handler	= pre_handler,
+};
+
+static int test_optprobe(long (*func)(long, long))
+{
+	kprobe_opcode_t *addr = (kprobe_opcode_t *)func;
+	kprobe_opcode_t insn = *addr;
+	int ret;
+
+	the_optprobe.addr = addr;
+	ret = register_kprobe(&the_optprobe);
+	if (ret < 0) {
+		pr_err("FAIL: register_kprobe failed with %d\n", ret);
+		return ret;
+	}
+
+	if (wait_for_optimization(addr, insn)) {
+		ret = call_test_func(func, true);
+	} else {
+		pr_err("FAIL: kprobe not optimized\n");
+		ret = false;
+	}
+
+	unregister_kprobe(&the_optprobe);
+	the_optprobe.flags = 0; /* Clear disable flag to allow reuse */
+
+	if (!ret)
+		return -EINVAL;
+	if (pre_handler_called != test_func_instance) {
+		pr_err("FAIL: optimized kprobe pre_handler not called\n");
+		return -EINVAL;
+	}
+	if (!call_test_func(func, false))
+		return -EINVAL;
+	if (pre_handler_called == test_func_instance) {
+		pr_err("FAIL: probe called after unregistering\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+#endif /* OPTPROBE_TESTING */
+
 static int run_api_tests(long (*func)(long, long))
 {
 	int ret;
@@ -465,6 +536,13 @@ static int run_api_tests(long (*func)(long, long))
 	if (ret < 0)
 		return ret;
 
+#if OPTPROBE_TESTING
+	pr_info("    optimized kprobe\n");
+	ret = test_optprobe(func);
+	if (ret < 0)
+		return ret;
+#endif
+
 	return 0;
 }
 
@@ -555,19 +633,41 @@ static int benchmark(void(*fn)(void))
 	return t / n; /* Time for one iteration in nanoseconds */
 };
 
-static int kprobe_benchmark(void(*fn)(void), unsigned offset)
+static void __kprobes
+benchmark_post_handler(struct kprobe *p, struct pt_regs *regs,
+		       unsigned long flags)
+{
+}
+
+static int kprobe_benchmark(void(*fn)(void), unsigned offset, bool optimized)
 {
 	struct kprobe k = {
 		.addr		= (kprobe_opcode_t *)((uintptr_t)fn + offset),
 		.pre_handler	= benchmark_pre_handler,
 	};
+#if OPTPROBE_TESTING
+	kprobe_opcode_t insn = *k.addr;
+#endif
+	int ret;
 
-	int ret = register_kprobe(&k);
+	/* A post handler keeps the probe from being optimized */
+	if (OPTPROBE_TESTING && !optimized)
+		k.post_handler = benchmark_post_handler;
+
+	ret = register_kprobe(&k);
 	if (ret < 0) {
 		pr_err("FAIL: register_kprobe failed with %d\n", ret);
 		return ret;
 	}
 
+#if OPTPROBE_TESTING
+	if (optimized && !wait_for_optimization(k.addr, insn)) {
+		pr_err("FAIL: kprobe not optimized\n");
+		unregister_kprobe(&k);
+		return -EINVAL;
+	}
+#endif
+
 	ret = benchmark(fn);
 
 	unregister_kprobe(&k);
@@ -607,10 +707,17 @@ static int run_benchmarks(void)
 
 	struct benchmarks *b;
 	for (b = list; b->fn; ++b) {
-		ret = kprobe_benchmark(b->fn, b->offset);
+		ret = kprobe_benchmark(b->fn, b->offset, false);
 		if (ret < 0)
 			return ret;
 		pr_info("    %dns for kprobe %s\n", ret, b->title);
+
+		if (!OPTPROBE_TESTING)
+			continue;
+		ret = kprobe_benchmark(b->fn, b->offset, true);
+		if (ret < 0)
+			return ret;
+		pr_info("    %dns for optimized kprobe %s\n", ret, b->title);
 	}
 
 	pr_info("\n");
@@ -118,8 +118,14 @@ int armpmu_event_set_period(struct perf_event *event)
 		ret = 1;
 	}
 
-	if (left > (s64)armpmu->max_period)
-		left = armpmu->max_period;
+	/*
+	 * Keep the programmed value in the upper half of the counter range,
+	 * so that the sign extended raw count moves continuously from -left
+	 * through zero. Self-monitoring tasks rely on this when they add the
+	 * counter to the offset published in the mmap page.
+	 */
+	if (left > (s64)(armpmu->max_period >> 1))
+		left = armpmu->max_period >> 1;
 
 	local64_set(&hwc->prev_count, (u64)-left);
 
@@ -141,7 +147,8 @@ u64 armpmu_event_update(struct perf_event *event)
 
 again:
 	prev_raw_count = local64_read(&hwc->prev_count);
-	new_raw_count = armpmu->read_counter(event);
+	/* Sign extended like the value armpmu_event_set_period() programs */
+	new_raw_count = (u64)(s64)(s32)armpmu->read_counter(event);
 
 	if (local64_cmpxchg(&hwc->prev_count, prev_raw_count,
 			     new_raw_count) != prev_raw_count)
@@ -589,6 +596,21 @@ const struct dev_pm_ops armpmu_dev_pm_ops = {
 	SET_RUNTIME_PM_OPS(armpmu_runtime_suspend, armpmu_runtime_resume, NULL)
 };
 
+/*
+ * Counters are only readable from user space if the PMU driver enables user
+ * mode access and publishes its own index mapping, see armv7pmu_event_idx().
+ */
+static int armpmu_event_idx(struct perf_event *event)
+{
+	return 0;
+}
+
+void arch_perf_update_userpage(struct perf_event_mmap_page *userpg, u64 now)
+{
+	userpg->cap_usr_rdpmc = IS_ENABLED(CONFIG_PERF_EVENTS_USERMODE);
+	userpg->pmc_width = 32;
+}
+
 static void armpmu_init(struct arm_pmu *armpmu)
 {
 	atomic_set(&armpmu->active_events, 0);
@@ -603,6 +625,8 @@ static void armpmu_init(struct arm_pmu *armpmu)
 	armpmu->pmu.stop = armpmu_stop;
 	armpmu->pmu.read = armpmu_read;
 	armpmu->pmu.events_across_hotplug = 1;
+	if (!armpmu->pmu.event_idx)
+		armpmu->pmu.event_idx = armpmu_event_idx;
 }
 
 int armpmu_register(struct arm_pmu *armpmu, int type)
@@ -685,6 +685,7 @@ static int armv7_krait_pmu_init(struct arm_pmu *cpu_pmu)
 	cpu_pmu->map_event		= krait_8960_map_event;
 	cpu_pmu->num_events		= armv7_read_num_pmnc_events();
 	cpu_pmu->pmu.attr_groups	= msm_l1_pmu_attr_grps;
+	cpu_pmu->pmu.event_idx		= armv7pmu_event_idx;
 	krait_clear_pmuregs();
 
 	cpu_pmu->set_event_filter = armv7pmu_set_event_filter,
@@ -823,20 +823,65 @@ static inline int armv7_pmnc_select_counter(int idx)
 	return idx;
 }
 
+#ifdef CONFIG_PERF_EVENTS_USERMODE
+/*
+ * A self-monitoring task may be preempted between selecting its counter in
+ * PMSELR and reading it, so the kernel must leave its selection intact.
+ */
+static inline u32 armv7_pmnc_save_select(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 5" : "=r" (val));
+	return val;
+}
+
+static inline void armv7_pmnc_restore_select(u32 val)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 5" : : "r" (val));
+	isb();
+}
+
+/*
+ * Index published in the perf mmap page: 1 is the cycle counter (PMCCNTR),
+ * n > 1 is event counter n - 2, read through PMSELR and PMXEVCNTR.
+ */
+static int armv7pmu_event_idx(struct perf_event *event)
+{
+	return event->hw.idx + 1;
+}
+#else
+static inline u32 armv7_pmnc_save_select(void)
+{
+	return 0;
+}
+
+static inline void armv7_pmnc_restore_select(u32 val)
+{
+}
+
+#define armv7pmu_event_idx	NULL
+#endif
+
 static inline u32 armv7pmu_read_counter(struct perf_event *event)
 {
 	struct arm_pmu *cpu_pmu = to_arm_pmu(event->pmu);
 	struct hw_perf_event *hwc = &event->hw;
 	int idx = hwc->idx;
 	u32 value = 0;
+	u32 sel;
 
 	if (!armv7_pmnc_counter_valid(cpu_pmu, idx))
 		pr_err("CPU%u reading wrong counter %d\n",
 			smp_processor_id(), idx);
 	else if (idx == ARMV7_IDX_CYCLE_COUNTER)
 		asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (value));
-	else if (armv7_pmnc_select_counter(idx) == idx)
-		asm volatile("mrc p15, 0, %0, c9, c13, 2" : "=r" (value));
+	else {
+		sel = armv7_pmnc_save_select();
+		if (armv7_pmnc_select_counter(idx) == idx)
+			asm volatile("mrc p15, 0, %0, c9, c13, 2" : "=r" (value));
+		armv7_pmnc_restore_select(sel);
+	}
 
 	return value;
 }
@@ -846,22 +891,30 @@ static inline void armv7pmu_write_counter(struct perf_event *event, u32 value)
 	struct arm_pmu *cpu_pmu = to_arm_pmu(event->pmu);
 	struct hw_perf_event *hwc = &event->hw;
 	int idx = hwc->idx;
+	u32 sel;
 
 	if (!armv7_pmnc_counter_valid(cpu_pmu, idx))
 		pr_err("CPU%u writing wrong counter %d\n",
 			smp_processor_id(), idx);
 	else if (idx == ARMV7_IDX_CYCLE_COUNTER)
 		asm volatile("mcr p15, 0, %0, c9, c13, 0" : : "r" (value));
-	else if (armv7_pmnc_select_counter(idx) == idx)
-		asm volatile("mcr p15, 0, %0, c9, c13, 2" : : "r" (value));
+	else {
+		sel = armv7_pmnc_save_select();
+		if (armv7_pmnc_select_counter(idx) == idx)
+			asm volatile("mcr p15, 0, %0, c9, c13, 2" : : "r" (value));
+		armv7_pmnc_restore_select(sel);
+	}
 }
 
 static inline void armv7_pmnc_write_evtsel(int idx, u32 val)
 {
+	u32 sel = armv7_pmnc_save_select();
+
 	if (armv7_pmnc_select_counter(idx) == idx) {
 		val &= ARMV7_EVTYPE_MASK;
 		asm volatile("mcr p15, 0, %0, c9, c13, 1" : : "r" (val));
 	}
+	armv7_pmnc_restore_select(sel);
 }
 
 static inline int armv7_pmnc_enable_counter(int idx)
@@ -1284,6 +1337,7 @@ static void armv7pmu_init(struct arm_pmu *cpu_pmu)
 	cpu_pmu->max_period	= (1LLU << 32) - 1;
 	cpu_pmu->save_pm_registers	= armv7pmu_save_pm_registers;
 	cpu_pmu->restore_pm_registers	= armv7pmu_restore_pm_registers;
+	cpu_pmu->pmu.event_idx	= armv7pmu_event_idx;
 };
 
 static u32 armv7_read_num_pmnc_events(void)
@@ -0,0 +1,87 @@
+/*
+ * crc32_le() and __crc32c_le() using the ARMv8 CRC32 instructions and
+ * the PMULL folding code in crc32-ce.S, whichever the CPU has.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/crc32.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <asm/cputype.h>
+#include <asm/hwcap.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#include <asm/system_info.h>
+
+/* Below this the NEON save and restore costs more than folding gains */
+#define PMULL_MIN_LEN		64
+
+asmlinkage u32 crc32_pmull_le(const u8 *buf, size_t len, u32 crc);
+asmlinkage u32 crc32c_pmull_le(const u8 *buf, size_t len, u32 crc);
+
+asmlinkage u32 crc32_armv8_le(u32 crc, const u8 *p, size_t len);
+asmlinkage u32 crc32c_armv8_le(u32 crc, const u8 *p, size_t len);
+
+static bool have_crc32 __read_mostly;
+static bool have_pmull __read_mostly;
+
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	if (have_pmull && len >= PMULL_MIN_LEN && may_use_simd()) {
+		kernel_neon_begin();
+		crc = crc32_pmull_le(p, len, crc);
+		kernel_neon_end();
+		p += round_down(len, 16);
+		len %= 16;
+		if (!len)
+			return crc;
+	}
+
+	if (have_crc32)
+		return crc32_armv8_le(crc, p, len);
+	return crc32_le_base(crc, p, len);
+}
+
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	if (have_pmull && len >= PMULL_MIN_LEN && may_use_simd()) {
+		kernel_neon_begin();
+		crc = crc32c_pmull_le(p, len, crc);
+		kernel_neon_end();
+		p += round_down(len, 16);
+		len %= 16;
+		if (!len)
+			return crc;
+	}
+
+	if (have_crc32)
+		return crc32c_armv8_le(crc, p, len);
+	return __crc32c_le_base(crc, p, len);
+}
+
+/*
+ * There are no hwcaps for the ARMv8 extensions here, so look at the
+ * instruction set attribute register directly. ARMv7 cores read it as
+ * zero.
+ */
+static int __init crc32_ce_init(void)
+{
+	u32 isar5;
+
+	if (cpu_architecture() < CPU_ARCH_ARMv7)
+		return 0;
+
+	isar5 = read_cpuid_ext(CPUID_EXT_ISAR5);
+	have_crc32 = ((isar5 >> 16) & 0xf) >= 1;
+	have_pmull = ((isar5 >> 4) & 0xf) >= 2 && (elf_hwcap & HWCAP_NEON);
+
+	pr_info("crc32: using%s%s%s\n", have_crc32 ? " CRC32" : "",
+		have_pmull ? " PMULL" : "",
+		have_crc32 || have_pmull ? "" : " generic code");
+	return 0;
+}
+arch_initcall(crc32_ce_init);
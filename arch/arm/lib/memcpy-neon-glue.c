@@ -0,0 +1,83 @@
+/*
+ * linux/arch/arm/lib/memcpy-neon-glue.c
+ *
+ * Large memcpy(), __memzero() and copy_page() using NEON
+ *
+ * memcpy.S and memzero.S branch here for sizes at which the NEON loops
+ * make up for the cost of kernel_neon_begin(), which may have to save the
+ * user's VFP registers, and copy_page() always comes here. Where kernel
+ * mode NEON cannot be used, in interrupt context, inside another kernel
+ * mode NEON section, and before the VFP support code has found a NEON
+ * unit, the integer versions do the work.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <asm/neon.h>
+#include <asm/page.h>
+#include <asm/simd.h>
+
+void __memcpy_neon(void *dest, const void *src, size_t n);
+void __memzero_neon(void *ptr, size_t n);
+void __copy_page_neon(void *to, const void *from);
+
+void *memcpy_neon(void *dest, const void *src, size_t n);
+void memzero_neon(void *ptr, size_t n);
+
+static bool neon_string_enabled __read_mostly;
+
+#ifndef CONFIG_HAS_MACH_MEMUTILS
+
+void *memcpy_neon(void *dest, const void *src, size_t n)
+{
+	if (!neon_string_enabled || !may_use_simd())
+		return __memcpy_arm(dest, src, n);
+
+	kernel_neon_begin();
+	__memcpy_neon(dest, src, n);
+	kernel_neon_end();
+
+	return dest;
+}
+
+#ifdef CONFIG_MMU
+void copy_page(void *to, const void *from)
+{
+	if (!neon_string_enabled || !may_use_simd()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from);
+	kernel_neon_end();
+}
+#endif
+
+#endif /* CONFIG_HAS_MACH_MEMUTILS */
+
+void memzero_neon(void *ptr, size_t n)
+{
+	if (!neon_string_enabled || !may_use_simd()) {
+		__memzero_arm(ptr, n);
+		return;
+	}
+
+	kernel_neon_begin();
+	__memzero_neon(ptr, n);
+	kernel_neon_end();
+}
+
+static int __init neon_string_init(void)
+{
+	/* vfp_init() is a core_initcall and sets HWCAP_NEON */
+	neon_string_enabled = cpu_has_neon();
+	return 0;
+}
+arch_initcall(neon_string_init);
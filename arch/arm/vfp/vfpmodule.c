@@ -14,6 +14,7 @@
 #include <linux/hardirq.h>
 #include <linux/kernel.h>
 #include <linux/notifier.h>
+#include <linux/percpu.h>
 #include <linux/signal.h>
 #include <linux/sched.h>
 #include <linux/smp.h>
@@ -642,6 +643,11 @@ int vfp_restore_user_hwstate(struct user_vfp __user *ufp,
 /*
  * Kernel-side NEON support functions
  */
+
+/* Set while a kernel_neon_begin() section is active, see may_use_simd() */
+DEFINE_PER_CPU(bool, kernel_neon_busy);
+EXPORT_PER_CPU_SYMBOL(kernel_neon_busy);
+
 void kernel_neon_begin(void)
 {
 	struct thread_info *thread = current_thread_info();
@@ -655,6 +661,7 @@ void kernel_neon_begin(void)
 	 */
 	BUG_ON(in_interrupt());
 	cpu = get_cpu();
+	__this_cpu_write(kernel_neon_busy, true);
 
 	fpexc = fmrx(FPEXC) | FPEXC_EN;
 	fmxr(FPEXC, fpexc);
@@ -677,6 +684,7 @@ void kernel_neon_end(void)
 {
 	/* Disable the NEON/VFP unit. */
 	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	__this_cpu_write(kernel_neon_busy, false);
 	put_cpu();
 }
 EXPORT_SYMBOL(kernel_neon_end);
@@ -73,4 +73,8 @@
 
 #define SO_SELECT_ERR_QUEUE	0x4026
 
+#define SO_BUSY_POLL		0x4027
+
+#define SO_MAX_PACING_RATE	0x4048
+
 #endif /* _UAPI_ASM_SOCKET_H */
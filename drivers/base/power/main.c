@@ -204,29 +204,76 @@ static void initcall_debug_report(struct device *dev, ktime_t calltime,
 	}
 }
 
+/**
+ * dpm_async_capable - Check if a device may be handled asynchronously.
+ * @dev: Device to check.
+ */
+static bool dpm_async_capable(struct device *dev)
+{
+	return dev->power.async_suspend || dev->power.async_auto;
+}
+
+static int dpm_has_child_fn(struct device *dev, void *data)
+{
+	return 1;
+}
+
+/**
+ * dpm_async_auto_ok - Check if a device may be made asynchronous by the core.
+ * @dev: Device to check.
+ *
+ * Devices without children only have to be ordered against their parents,
+ * which dpm_wait() takes care of for asynchronous devices.  Devices in power
+ * domains and devices the core has no callbacks to run for are left alone.
+ */
+static bool dpm_async_auto_ok(struct device *dev)
+{
+	if (!pm_async_auto || dev->power.syscore || dev->pm_domain)
+		return false;
+	if (!dev->driver)
+		return false;
+	return !device_for_each_child(dev, NULL, dpm_has_child_fn);
+}
+
 /**
  * dpm_wait - Wait for a PM operation to complete.
  * @dev: Device to wait for.
- * @async: If unset, wait only if the device's power.async_suspend flag is set.
+ * @async: If unset, wait only if the device may be handled asynchronously.
+ * @t: Timing data of the waiting device's callback, may be NULL.
  */
-static void dpm_wait(struct device *dev, bool async)
+static void dpm_wait(struct device *dev, bool async, struct dpm_timing *t)
 {
+	ktime_t start;
+
 	if (!dev)
 		return;
 
-	if (async || (pm_async_enabled && dev->power.async_suspend))
+	if (async || (pm_async_enabled && dpm_async_capable(dev))) {
+		start = dpm_timing_wait_start(t);
 		wait_for_completion(&dev->power.completion);
+		dpm_timing_wait_end(t, dev, start);
+	}
 }
 
-static int dpm_wait_fn(struct device *dev, void *async_ptr)
+struct dpm_wait_args {
+	bool async;
+	struct dpm_timing *timing;
+};
+
+static int dpm_wait_fn(struct device *dev, void *data)
 {
-	dpm_wait(dev, *((bool *)async_ptr));
+	struct dpm_wait_args *args = data;
+
+	dpm_wait(dev, args->async, args->timing);
 	return 0;
 }
 
-static void dpm_wait_for_children(struct device *dev, bool async)
+static void dpm_wait_for_children(struct device *dev, bool async,
+				  struct dpm_timing *t)
 {
-       device_for_each_child(dev, &async, dpm_wait_fn);
+	struct dpm_wait_args args = { .async = async, .timing = t };
+
+	device_for_each_child(dev, &args, dpm_wait_fn);
 }
 
 /**
@@ -469,7 +516,9 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 	pm_callback_t callback = NULL;
 	char *info = NULL;
 	int error = 0;
+	struct dpm_timing t;
 
+	dpm_timing_start(&t);
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
 
@@ -499,6 +548,7 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 
  Out:
 	TRACE_RESUME(error);
+	dpm_timing_record(dev, &t, "noirq ", pm_verb(state.event), false, error);
 	return error;
 }
 
@@ -551,7 +601,9 @@ static int device_resume_early(struct device *dev, pm_message_t state)
 	pm_callback_t callback = NULL;
 	char *info = NULL;
 	int error = 0;
+	struct dpm_timing t;
 
+	dpm_timing_start(&t);
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
 
@@ -581,6 +633,7 @@ static int device_resume_early(struct device *dev, pm_message_t state)
 
  Out:
 	TRACE_RESUME(error);
+	dpm_timing_record(dev, &t, "early ", pm_verb(state.event), false, error);
 
 	pm_runtime_enable(dev);
 	return error;
@@ -645,14 +698,16 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	char *info = NULL;
 	int error = 0;
 	struct dpm_watchdog wd;
+	struct dpm_timing t;
 
+	dpm_timing_start(&t);
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
 
 	if (dev->power.syscore)
 		goto Complete;
 
-	dpm_wait(dev->parent, async);
+	dpm_wait(dev->parent, async, &t);
 	device_lock(dev);
 
 	/*
@@ -718,6 +773,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	complete_all(&dev->power.completion);
 
 	TRACE_RESUME(error);
+	dpm_timing_record(dev, &t, NULL, pm_verb(state.event), async, error);
 
 	return error;
 }
@@ -735,7 +791,7 @@ static void async_resume(void *data, async_cookie_t cookie)
 
 static bool is_async(struct device *dev)
 {
-	return dev->power.async_suspend && pm_async_enabled
+	return dpm_async_capable(dev) && pm_async_enabled
 		&& !pm_trace_is_enabled();
 }
 
@@ -918,6 +974,8 @@ static int device_suspend_noirq(struct device *dev, pm_message_t state)
 {
 	pm_callback_t callback = NULL;
 	char *info = NULL;
+	struct dpm_timing t;
+	int error;
 
 	if (dev->power.syscore)
 		return 0;
@@ -941,7 +999,10 @@ static int device_suspend_noirq(struct device *dev, pm_message_t state)
 		callback = pm_noirq_op(dev->driver->pm, state);
 	}
 
-	return dpm_run_callback(callback, dev, state, info);
+	dpm_timing_start(&t);
+	error = dpm_run_callback(callback, dev, state, info);
+	dpm_timing_record(dev, &t, "noirq ", pm_verb(state.event), false, error);
+	return error;
 }
 
 /**
@@ -1004,6 +1065,8 @@ static int device_suspend_late(struct device *dev, pm_message_t state)
 {
 	pm_callback_t callback = NULL;
 	char *info = NULL;
+	struct dpm_timing t;
+	int error;
 
 	__pm_runtime_disable(dev, false);
 
@@ -1029,7 +1092,10 @@ static int device_suspend_late(struct device *dev, pm_message_t state)
 		callback = pm_late_early_op(dev->driver->pm, state);
 	}
 
-	return dpm_run_callback(callback, dev, state, info);
+	dpm_timing_start(&t);
+	error = dpm_run_callback(callback, dev, state, info);
+	dpm_timing_record(dev, &t, "late ", pm_verb(state.event), false, error);
+	return error;
 }
 
 /**
@@ -1131,8 +1197,10 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	char *info = NULL;
 	int error = 0;
 	struct dpm_watchdog wd;
+	struct dpm_timing t;
 
-	dpm_wait_for_children(dev, async);
+	dpm_timing_start(&t);
+	dpm_wait_for_children(dev, async, &t);
 
 	if (async_error)
 		goto Complete;
@@ -1218,6 +1286,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	if (error)
 		async_error = error;
 
+	dpm_timing_record(dev, &t, NULL, pm_verb(state.event), async, error);
 	return error;
 }
 
@@ -1239,7 +1308,7 @@ static int device_suspend(struct device *dev)
 {
 	INIT_COMPLETION(dev->power.completion);
 
-	if (pm_async_enabled && dev->power.async_suspend) {
+	if (pm_async_enabled && dpm_async_capable(dev)) {
 		get_device(dev);
 		async_schedule(async_suspend, dev);
 		return 0;
@@ -1323,6 +1392,7 @@ static int device_prepare(struct device *dev, pm_message_t state)
 	device_lock(dev);
 
 	dev->power.wakeup_path = device_may_wakeup(dev);
+	dev->power.async_auto = dpm_async_auto_ok(dev);
 
 	if (dev->pm_domain) {
 		info = "preparing power domain ";
@@ -1407,6 +1477,7 @@ int dpm_suspend_start(pm_message_t state)
 {
 	int error;
 
+	dpm_timing_cycle_start();
 	error = dpm_prepare(state);
 	if (error) {
 		suspend_stats.failed_prepare++;
@@ -1431,7 +1502,7 @@ EXPORT_SYMBOL_GPL(__suspend_report_result);
  */
 int device_pm_wait_for_dev(struct device *subordinate, struct device *dev)
 {
-	dpm_wait(dev, subordinate->power.async_suspend);
+	dpm_wait(dev, dpm_async_capable(subordinate), NULL);
 	return async_error;
 }
 EXPORT_SYMBOL_GPL(device_pm_wait_for_dev);
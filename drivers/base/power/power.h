@@ -36,6 +36,7 @@ static inline void pm_runtime_remove(struct device *dev) {}
 
 /* kernel/power/main.c */
 extern int pm_async_enabled;
+extern int pm_async_auto;
 
 /* drivers/base/power/main.c */
 extern struct list_head dpm_list;	/* The active device list */
@@ -71,6 +72,74 @@ static inline void device_pm_move_last(struct device *dev) {}
 
 #endif /* !CONFIG_PM_SLEEP */
 
+#ifdef CONFIG_PM_SLEEP_TIMING
+
+#define DPM_TIMING_NAME_LEN	32
+
+/*
+ * Timing of a single device callback, including the time spent waiting for
+ * other devices in dpm_wait().
+ */
+struct dpm_timing {
+	ktime_t	start;
+	s64	wait_ns;
+	s64	max_wait_ns;
+	char	blocker[DPM_TIMING_NAME_LEN];	/* device waited for longest */
+};
+
+/* drivers/base/power/timing.c */
+extern void dpm_timing_cycle_start(void);
+extern void dpm_timing_record(struct device *dev, struct dpm_timing *t,
+			      const char *info, const char *verb, bool async,
+			      int error);
+
+static inline void dpm_timing_start(struct dpm_timing *t)
+{
+	t->start = ktime_get();
+	t->wait_ns = 0;
+	t->max_wait_ns = 0;
+	t->blocker[0] = '\0';
+}
+
+static inline ktime_t dpm_timing_wait_start(struct dpm_timing *t)
+{
+	return t ? ktime_get() : ktime_set(0, 0);
+}
+
+static inline void dpm_timing_wait_end(struct dpm_timing *t,
+				       struct device *dev, ktime_t start)
+{
+	s64 ns;
+
+	if (!t)
+		return;
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	t->wait_ns += ns;
+	if (ns > t->max_wait_ns) {
+		t->max_wait_ns = ns;
+		strlcpy(t->blocker, dev_name(dev), sizeof(t->blocker));
+	}
+}
+
+#else /* !CONFIG_PM_SLEEP_TIMING */
+
+struct dpm_timing {};
+
+static inline void dpm_timing_cycle_start(void) {}
+static inline void dpm_timing_record(struct device *dev, struct dpm_timing *t,
+				     const char *info, const char *verb,
+				     bool async, int error) {}
+static inline void dpm_timing_start(struct dpm_timing *t) {}
+static inline ktime_t dpm_timing_wait_start(struct dpm_timing *t)
+{
+	return ktime_set(0, 0);
+}
+static inline void dpm_timing_wait_end(struct dpm_timing *t,
+				       struct device *dev, ktime_t start) {}
+
+#endif /* !CONFIG_PM_SLEEP_TIMING */
+
 static inline void device_pm_init(struct device *dev)
 {
 	device_pm_init_common(dev);
@@ -0,0 +1,251 @@
+/*
+ * drivers/base/power/timing.c - Device suspend/resume timing trace.
+ *
+ * Records the duration of every device callback of a system suspend/resume
+ * cycle together with the time the device spent waiting for its parent or
+ * its children in dpm_wait(), and the device it waited for the longest.
+ * The records of the last cycle are exported through debugfs:
+ *
+ *   pm_timing/trace  one line per callback, in completion order
+ *   pm_timing/graph  the wait dependencies in graphviz format, with the
+ *                    critical path of every phase highlighted
+ */
+
+#include <linux/device.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/init.h>
+
+#include "power.h"
+
+#define DPM_TIMING_ENTRIES	1024
+
+struct dpm_timing_entry {
+	char		dev[DPM_TIMING_NAME_LEN];
+	char		parent[DPM_TIMING_NAME_LEN];
+	char		blocker[DPM_TIMING_NAME_LEN];
+	const char	*info;		/* phase prefix, e.g. "noirq " */
+	const char	*verb;		/* PM transition, e.g. "resume" */
+	s64		start_us;	/* relative to the start of the cycle */
+	s64		total_us;
+	s64		wait_us;
+	int		error;
+	bool		async;
+};
+
+static struct dpm_timing_entry *dpm_timing_buf;
+static unsigned int dpm_timing_count;
+static unsigned int dpm_timing_dropped;
+static ktime_t dpm_timing_cycle;
+static DEFINE_SPINLOCK(dpm_timing_lock);
+static DEFINE_MUTEX(dpm_timing_mtx);
+
+/**
+ * dpm_timing_cycle_start - Discard the records of the previous cycle.
+ */
+void dpm_timing_cycle_start(void)
+{
+	mutex_lock(&dpm_timing_mtx);
+	spin_lock_irq(&dpm_timing_lock);
+	dpm_timing_count = 0;
+	dpm_timing_dropped = 0;
+	dpm_timing_cycle = ktime_get();
+	spin_unlock_irq(&dpm_timing_lock);
+	mutex_unlock(&dpm_timing_mtx);
+}
+
+/**
+ * dpm_timing_record - Record the timing of a device callback.
+ * @dev: Device the callback has been run for.
+ * @t: Timing data collected by dpm_timing_start() and dpm_wait().
+ * @info: Phase prefix of the callback.
+ * @verb: PM transition being carried out.
+ * @async: If true, the callback has been run asynchronously.
+ * @error: Return value of the callback.
+ */
+void dpm_timing_record(struct device *dev, struct dpm_timing *t,
+		       const char *info, const char *verb, bool async,
+		       int error)
+{
+	struct dpm_timing_entry *e;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+
+	spin_lock_irqsave(&dpm_timing_lock, flags);
+	if (!dpm_timing_buf || dpm_timing_count >= DPM_TIMING_ENTRIES) {
+		dpm_timing_dropped++;
+		goto out;
+	}
+
+	e = &dpm_timing_buf[dpm_timing_count++];
+	strlcpy(e->dev, dev_name(dev), sizeof(e->dev));
+	strlcpy(e->parent, dev->parent ? dev_name(dev->parent) : "",
+		sizeof(e->parent));
+	strlcpy(e->blocker, t->blocker, sizeof(e->blocker));
+	e->info = info ?: "";
+	e->verb = verb;
+	e->start_us = ktime_to_us(ktime_sub(t->start, dpm_timing_cycle));
+	e->total_us = ktime_to_us(ktime_sub(now, t->start));
+	e->wait_us = div_s64(t->wait_ns, NSEC_PER_USEC);
+	e->error = error;
+	e->async = async;
+ out:
+	spin_unlock_irqrestore(&dpm_timing_lock, flags);
+}
+
+static int dpm_timing_trace_show(struct seq_file *m, void *unused)
+{
+	struct dpm_timing_entry *e;
+	unsigned int i;
+
+	mutex_lock(&dpm_timing_mtx);
+	seq_printf(m, "entries: %u dropped: %u\n",
+		   dpm_timing_count, dpm_timing_dropped);
+	seq_puts(m, "start_us\ttotal_us\twait_us\tasync\terror\t"
+		 "phase\tdevice\tparent\tblocker\n");
+	for (i = 0; i < dpm_timing_count; i++) {
+		e = &dpm_timing_buf[i];
+		seq_printf(m, "%lld\t%lld\t%lld\t%d\t%d\t%s%s\t%s\t%s\t%s\n",
+			   e->start_us, e->total_us, e->wait_us, e->async,
+			   e->error, e->info, e->verb, e->dev,
+			   e->parent[0] ? e->parent : "-",
+			   e->blocker[0] ? e->blocker : "-");
+	}
+	mutex_unlock(&dpm_timing_mtx);
+	return 0;
+}
+
+static bool dpm_timing_same_phase(struct dpm_timing_entry *a,
+				  struct dpm_timing_entry *b)
+{
+	return !strcmp(a->info, b->info) && !strcmp(a->verb, b->verb);
+}
+
+static struct dpm_timing_entry *dpm_timing_find(struct dpm_timing_entry *e,
+						const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < dpm_timing_count; i++) {
+		struct dpm_timing_entry *f = &dpm_timing_buf[i];
+
+		if (f != e && dpm_timing_same_phase(e, f) &&
+		    !strcmp(f->dev, name))
+			return f;
+	}
+	return NULL;
+}
+
+/*
+ * The critical path of a phase ends at the callback completing last and
+ * follows the longest waits backwards from there.
+ */
+static void dpm_timing_mark_critical(unsigned long *critical)
+{
+	struct dpm_timing_entry *e, *last;
+	unsigned int i, j, n;
+
+	for (i = 0; i < dpm_timing_count; i++) {
+		last = &dpm_timing_buf[i];
+		for (j = 0; j < dpm_timing_count; j++) {
+			e = &dpm_timing_buf[j];
+			if (dpm_timing_same_phase(e, last) &&
+			    e->start_us + e->total_us >
+			    last->start_us + last->total_us)
+				last = e;
+		}
+		if (last != &dpm_timing_buf[i])
+			continue;
+
+		for (n = 0, e = last; e && n < dpm_timing_count; n++) {
+			__set_bit(e - dpm_timing_buf, critical);
+			e = e->blocker[0] ? dpm_timing_find(e, e->blocker) : NULL;
+		}
+	}
+}
+
+static int dpm_timing_graph_show(struct seq_file *m, void *unused)
+{
+	struct dpm_timing_entry *e;
+	unsigned long *critical;
+	unsigned int i;
+
+	critical = kcalloc(BITS_TO_LONGS(DPM_TIMING_ENTRIES),
+			   sizeof(*critical), GFP_KERNEL);
+	if (!critical)
+		return -ENOMEM;
+
+	mutex_lock(&dpm_timing_mtx);
+	dpm_timing_mark_critical(critical);
+
+	seq_puts(m, "digraph pm {\n");
+	for (i = 0; i < dpm_timing_count; i++) {
+		const char *color = test_bit(i, critical) ? "red" : "black";
+
+		e = &dpm_timing_buf[i];
+		seq_printf(m, "\t\"%s%s:%s\" [label=\"%s\\n%s%s %lldus\" color=%s%s];\n",
+			   e->info, e->verb, e->dev, e->dev, e->info, e->verb,
+			   e->total_us, color, e->async ? " style=dashed" : "");
+		if (e->blocker[0])
+			seq_printf(m, "\t\"%s%s:%s\" -> \"%s%s:%s\" [label=\"%lldus\" color=%s];\n",
+				   e->info, e->verb, e->blocker,
+				   e->info, e->verb, e->dev,
+				   e->wait_us, color);
+	}
+	seq_puts(m, "}\n");
+	mutex_unlock(&dpm_timing_mtx);
+
+	kfree(critical);
+	return 0;
+}
+
+static int dpm_timing_trace_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_timing_trace_show, NULL);
+}
+
+static int dpm_timing_graph_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_timing_graph_show, NULL);
+}
+
+static const struct file_operations dpm_timing_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = dpm_timing_trace_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static const struct file_operations dpm_timing_graph_fops = {
+	.owner = THIS_MODULE,
+	.open = dpm_timing_graph_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init dpm_timing_init(void)
+{
+	struct dentry *dir;
+
+	dpm_timing_buf = vzalloc(sizeof(*dpm_timing_buf) * DPM_TIMING_ENTRIES);
+	if (!dpm_timing_buf)
+		return -ENOMEM;
+
+	dir = debugfs_create_dir("pm_timing", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file("trace", S_IRUGO, dir, NULL,
+			    &dpm_timing_trace_fops);
+	debugfs_create_file("graph", S_IRUGO, dir, NULL,
+			    &dpm_timing_graph_fops);
+	return 0;
+}
+late_initcall(dpm_timing_init);
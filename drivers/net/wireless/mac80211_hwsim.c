@@ -57,6 +57,10 @@ static bool rctbl = false;
 module_param(rctbl, bool, 0444);
 MODULE_PARM_DESC(rctbl, "Handle rate control table");
 
+static bool use_txq = false;
+module_param(use_txq, bool, 0444);
+MODULE_PARM_DESC(use_txq, "Use the mac80211 intermediate TX queues");
+
 /**
  * enum hwsim_regtest - the type of regulatory tests we offer
  *
@@ -932,6 +936,21 @@ static void mac80211_hwsim_tx(struct ieee80211_hw *hw,
 	ieee80211_tx_status_irqsafe(hw, skb);
 }
 
+/* The simulated medium is never busy, so just drain the queue */
+static void mac80211_hwsim_wake_tx_queue(struct ieee80211_hw *hw,
+					 struct ieee80211_txq *txq)
+{
+	struct ieee80211_tx_control control = {
+		.sta = txq->sta,
+	};
+	struct sk_buff *skb;
+
+	rcu_read_lock();
+	while ((skb = ieee80211_tx_dequeue(hw, txq)))
+		mac80211_hwsim_tx(hw, &control, skb);
+	rcu_read_unlock();
+}
+
 
 static int mac80211_hwsim_start(struct ieee80211_hw *hw)
 {
@@ -2193,6 +2212,9 @@ static int __init init_mac80211_hwsim(void)
 	if (channels < 1)
 		return -EINVAL;
 
+	if (use_txq)
+		mac80211_hwsim_ops.wake_tx_queue = mac80211_hwsim_wake_tx_queue;
+
 	if (channels > 1) {
 		hwsim_if_comb.num_different_channels = channels;
 		mac80211_hwsim_ops.hw_scan = mac80211_hwsim_hw_scan;
@@ -125,9 +125,7 @@ int ipc_log_string(void *ilctxt, const char *fmt, ...) __printf(2, 3);
  * @size:    size of the buffer
  * @returns: 0 if no data read; >0 number of bytes read; < 0 error
  *
- * If no data is available to be read, then the ilctxt::read_avail
- * completion is reinitialized.  This allows clients to block
- * until new log data is save.
+ * Messages logged on different CPUs are merged in timestamp order.
  */
 int ipc_log_extract(void *ilctxt, char *buff, int size);
 
@@ -86,7 +86,8 @@ struct comm_mode_info {
  * @port_lock_lhc3: Lock to protect access to the port information.
  * @mode_info: Communication mode of the port owner.
  * @port_rx_q: Receive queue where incoming messages are queued.
- * @port_rx_q_lock_lhc3: Lock to protect access to the port's rx_q.
+ * @port_rx_q_lock_lhc3: Lock to protect access to the port's rx_q and the
+ *                       wakeup source state.
  * @rx_ws_name: Name of the receive wakeup source.
  * @port_rx_ws: Wakeup source to prevent suspend until the rx_q is empty.
  * @port_rx_wait_q: Wait queue to wait for the incoming messages.
@@ -101,6 +102,7 @@ struct comm_mode_info {
  * @num_tx_bytes: Number of bytes transmitted.
  * @num_rx_bytes: Number of bytes received.
  * @priv: Private information registered by the port owner.
+ * @rcu: Defers freeing the port until lockless lookups are done with it.
  */
 struct msm_ipc_port {
 	struct list_head list;
@@ -117,7 +119,7 @@ struct msm_ipc_port {
 	int conn_status;
 
 	struct list_head port_rx_q;
-	struct mutex port_rx_q_lock_lhc3;
+	spinlock_t port_rx_q_lock_lhc3;
 	char rx_ws_name[MAX_WS_NAME_SZ];
 	struct wakeup_source port_rx_ws;
 	wait_queue_head_t port_rx_wait_q;
@@ -138,6 +140,7 @@ struct msm_ipc_port {
 	unsigned long num_tx_bytes;
 	unsigned long num_rx_bytes;
 	void *priv;
+	struct rcu_head rcu;
 };
 
 #ifdef CONFIG_IPC_ROUTER
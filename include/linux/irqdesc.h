@@ -37,6 +37,10 @@ struct irq_desc;
  * @threads_oneshot:	bitfield to handle shared oneshot threads
  * @threads_active:	number of irqaction threads currently running
  * @wait_for_threads:	wait queue for sync_irq to wait for threaded handlers
+ * @balance_last:	kstat_irqs sum at the last balancer sample
+ * @balance_rate:	interrupts per second seen by the balancer
+ * @balance_moves:	number of migrations done by the balancer
+ * @balance_pinned:	excluded from load balancing by user space
  * @dir:		/proc/irq/ procfs entry
  * @name:		flow handler name for /proc/interrupts output
  */
@@ -71,6 +75,12 @@ struct irq_desc {
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
 	wait_queue_head_t       wait_for_threads;
+#ifdef CONFIG_IRQ_BALANCE
+	unsigned int		balance_last;
+	unsigned int		balance_rate;
+	unsigned int		balance_moves;
+	bool			balance_pinned;
+#endif
 #ifdef CONFIG_PROC_FS
 	struct proc_dir_entry	*dir;
 #endif
@@ -8,9 +8,74 @@
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
+ *
+ * The LZ4_* functions follow the block API of the reference LZ4 library
+ * (http://www.lz4.org), so code written against it ports directly. All
+ * of them produce and take the same LZ4 block format as the lz4_*
+ * functions further down.
  */
-#define LZ4_MEM_COMPRESS	(4096 * sizeof(unsigned char *))
-#define LZ4HC_MEM_COMPRESS	(65538 * sizeof(unsigned char *))
+#include <linux/types.h>
+
+#define LZ4_MEMORY_USAGE	14
+#define LZ4_MAX_INPUT_SIZE	0x7E000000	/* 2 113 929 216 bytes */
+#define LZ4_COMPRESSBOUND(isize)	(\
+	(unsigned int)(isize) > (unsigned int)LZ4_MAX_INPUT_SIZE \
+	? 0 \
+	: (isize) + ((isize)/255) + 16)
+
+#define LZ4_ACCELERATION_DEFAULT 1
+
+#define LZ4_HASHLOG	 (LZ4_MEMORY_USAGE-2)
+#define LZ4_HASH_SIZE_U32 (1 << LZ4_HASHLOG)
+
+struct lz4_stream_internal {
+	u32 hash_table[LZ4_HASH_SIZE_U32];
+	u32 current_offset;
+	u32 init_check;
+	const u8 *dictionary;
+	u8 *buffer_start;
+	u32 dict_size;
+};
+
+#define LZ4_STREAMSIZE_U64	((1 << (LZ4_MEMORY_USAGE - 3)) + 4)
+#define LZ4_STREAMSIZE		(LZ4_STREAMSIZE_U64 * sizeof(u64))
+
+/*
+ * LZ4_stream_t - compression state, for LZ4_compress_fast_continue() and
+ * as the working memory of the one shot compressors. Its size, but not
+ * its layout, is part of the API.
+ */
+typedef union {
+	u64 table[LZ4_STREAMSIZE_U64];
+	struct lz4_stream_internal internal_donotuse;
+} LZ4_stream_t;
+
+struct lz4_stream_decode_internal {
+	const u8 *external_dict;
+	size_t ext_dict_size;
+	const u8 *prefix_end;
+	size_t prefix_size;
+};
+
+#define LZ4_STREAMDECODESIZE_U64	4
+
+/* LZ4_streamDecode_t - state of LZ4_decompress_safe_continue() */
+typedef union {
+	u64 table[LZ4_STREAMDECODESIZE_U64];
+	struct lz4_stream_decode_internal internal_donotuse;
+} LZ4_streamDecode_t;
+
+#define LZ4HC_MIN_CLEVEL	3
+#define LZ4HC_DEFAULT_CLEVEL	9
+#define LZ4HC_MAX_CLEVEL	16
+
+#define LZ4HC_DICTIONARY_LOGSIZE	16
+#define LZ4HC_MAXD		(1 << LZ4HC_DICTIONARY_LOGSIZE)
+#define LZ4HC_HASH_LOG		(LZ4HC_DICTIONARY_LOGSIZE - 1)
+#define LZ4HC_HASHTABLESIZE	(1 << LZ4HC_HASH_LOG)
+
+#define LZ4_MEM_COMPRESS	LZ4_STREAMSIZE
+#define LZ4HC_MEM_COMPRESS	(4 * LZ4HC_HASHTABLESIZE + 2 * LZ4HC_MAXD + 56)
 
 /*
  * lz4_compressbound()
@@ -22,6 +87,107 @@ static inline size_t lz4_compressbound(size_t isize)
 	return isize + (isize / 255) + 16;
 }
 
+/*
+ * LZ4_compress_fast()
+ *	source	: source address of the original data
+ *	dest	: output buffer address of the compressed data
+ *	inputSize : size of the original data, at most LZ4_MAX_INPUT_SIZE
+ *	maxOutputSize : size of dest. With LZ4_COMPRESSBOUND(inputSize) or
+ *		more the compression always succeeds, and runs faster.
+ *	acceleration : 1 gives the best ratio. Every step up skips more of
+ *		the input that looks incompressible, trading ratio for speed
+ *		(roughly +3% speed per step).
+ *	wrkmem	: address of the working memory.
+ *		This requires 'wrkmem' of size LZ4_MEM_COMPRESS.
+ *	return	: number of bytes written to dest, or 0 if it did not fit
+ */
+int LZ4_compress_fast(const char *source, char *dest, int inputSize,
+		int maxOutputSize, int acceleration, void *wrkmem);
+
+/* LZ4_compress_fast() with an acceleration of LZ4_ACCELERATION_DEFAULT */
+int LZ4_compress_default(const char *source, char *dest, int inputSize,
+		int maxOutputSize, void *wrkmem);
+
+/*
+ * LZ4_decompress_safe()
+ *	source	: source address of the compressed data
+ *	dest	: output buffer address of the decompressed data
+ *	compressedSize : exact size of the compressed block
+ *	maxDecompressedSize : size of dest
+ *	return	: number of bytes decompressed into dest, or a negative
+ *		value if the block is malformed. Never reads or writes
+ *		outside of the two buffers, whatever the input.
+ */
+int LZ4_decompress_safe(const char *source, char *dest, int compressedSize,
+		int maxDecompressedSize);
+
+/*
+ * LZ4_decompress_safe_partial()
+ *	Like LZ4_decompress_safe(), but stops once targetOutputSize bytes have
+ *	been decoded. It may decode more, up to maxDecompressedSize.
+ */
+int LZ4_decompress_safe_partial(const char *source, char *dest,
+		int compressedSize, int targetOutputSize,
+		int maxDecompressedSize);
+
+/*
+ * LZ4_decompress_fast()
+ *	source	: source address of the compressed data
+ *	dest	: output buffer address of the decompressed data
+ *	originalSize : exact size of the decompressed data
+ *	return	: number of bytes read from source, or a negative value if
+ *		the block is malformed.
+ *	note	: does not check reads from source, use it on trusted data
+ *		only.
+ */
+int LZ4_decompress_fast(const char *source, char *dest, int originalSize);
+
+/*
+ * Streaming compression: the blocks of a stream may refer to up to 64KB
+ * of the data compressed before them, which must stay where it was, or
+ * be moved out of the way with LZ4_saveDict() first.
+ *
+ * LZ4_resetStream()	: start a new stream
+ * LZ4_loadDict()	: start a new stream that refers to a dictionary, of
+ *			  which the last 64KB are used. Returns that size.
+ * LZ4_saveDict()	: copy the last dictSize (up to 64KB) bytes of the
+ *			  stream to safeBuffer. Returns the size saved.
+ * LZ4_compress_fast_continue() : compress the next block of the stream,
+ *			  returns like LZ4_compress_fast()
+ */
+void LZ4_resetStream(LZ4_stream_t *LZ4_stream);
+int LZ4_loadDict(LZ4_stream_t *LZ4_dict, const char *dictionary,
+		int dictSize);
+int LZ4_saveDict(LZ4_stream_t *LZ4_dict, char *safeBuffer, int dictSize);
+int LZ4_compress_fast_continue(LZ4_stream_t *LZ4_stream, const char *source,
+		char *dest, int inputSize, int maxOutputSize,
+		int acceleration);
+
+/*
+ * Streaming decompression: every block is decoded right behind the
+ * previous one, or the previous 64KB of decoded data must still be where
+ * they were decoded.
+ *
+ * LZ4_setStreamDecode() : start a new stream, optionally with the
+ *			  dictionary the stream was compressed with
+ * LZ4_decompress_*_continue() : decode the next block of the stream,
+ *			  return like LZ4_decompress_safe()/_fast()
+ * LZ4_decompress_*_usingDict() : decode one block compressed with a
+ *			  dictionary, without a stream
+ */
+int LZ4_setStreamDecode(LZ4_streamDecode_t *LZ4_streamDecode,
+		const char *dictionary, int dictSize);
+int LZ4_decompress_safe_continue(LZ4_streamDecode_t *LZ4_streamDecode,
+		const char *source, char *dest, int compressedSize,
+		int maxDecompressedSize);
+int LZ4_decompress_fast_continue(LZ4_streamDecode_t *LZ4_streamDecode,
+		const char *source, char *dest, int originalSize);
+int LZ4_decompress_safe_usingDict(const char *source, char *dest,
+		int compressedSize, int maxDecompressedSize,
+		const char *dictStart, int dictSize);
+int LZ4_decompress_fast_usingDict(const char *source, char *dest,
+		int originalSize, const char *dictStart, int dictSize);
+
 /*
  * lz4_compress()
  *	src     : source address of the original data
@@ -56,6 +222,24 @@ int lz4_compress(const unsigned char *src, size_t src_len,
 int lz4hc_compress(const unsigned char *src, size_t src_len,
 		unsigned char *dst, size_t *dst_len, void *wrkmem);
 
+/*
+ * LZ4_compress_HC()
+ *	src	: source address of the original data
+ *	dst	: output buffer address of the compressed data
+ *	srcSize	: size of the original data, at most LZ4_MAX_INPUT_SIZE
+ *	dstCapacity : size of dst. With LZ4_COMPRESSBOUND(srcSize) or more
+ *		the compression always succeeds.
+ *	compressionLevel : from LZ4HC_MIN_CLEVEL to LZ4HC_MAX_CLEVEL. Every
+ *		level doubles the number of match candidates searched.
+ *		0 selects LZ4HC_DEFAULT_CLEVEL, the level of lz4hc_compress().
+ *	wrkmem	: address of the working memory.
+ *		This requires 'wrkmem' of size LZ4HC_MEM_COMPRESS, aligned
+ *		for pointers.
+ *	return	: number of bytes written to dst, or 0 if it did not fit
+ */
+int LZ4_compress_HC(const char *src, char *dst, int srcSize,
+		int dstCapacity, int compressionLevel, void *wrkmem);
+
 /*
  * lz4_decompress()
  *	src     : source address of the compressed data
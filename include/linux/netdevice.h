@@ -324,12 +324,17 @@ struct napi_struct {
 	struct sk_buff		*gro_list;
 	struct sk_buff		*skb;
 	struct list_head	dev_list;
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	struct hlist_node	napi_hash_node;
+	unsigned int		napi_id;
+#endif
 };
 
 enum {
 	NAPI_STATE_SCHED,	/* Poll is scheduled */
 	NAPI_STATE_DISABLE,	/* Disable pending */
 	NAPI_STATE_NPSVC,	/* Netpoll - don't dequeue from poll_list */
+	NAPI_STATE_HASHED,	/* In NAPI hash, see napi_by_id() */
 };
 
 enum gro_result {
@@ -1500,6 +1505,25 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
  */
 void netif_napi_del(struct napi_struct *napi);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/**
+ *	napi_by_id - look up a napi context by its id
+ *	@napi_id: id, as recorded in skb->napi_id
+ *
+ *	Must be called under rcu_read_lock().
+ */
+struct napi_struct *napi_by_id(unsigned int napi_id);
+
+/**
+ *	napi_busy_poll - poll a napi context from process context
+ *	@napi: napi context
+ *
+ *	Returns the number of packets processed or -1 if the context is
+ *	owned by somebody else. Must be called with BHs disabled.
+ */
+int napi_busy_poll(struct napi_struct *napi);
+#endif
+
 struct napi_gro_cb {
 	/* Virtual address of skb_shinfo(skb)->frags[0].page + offset. */
 	void *frag0;
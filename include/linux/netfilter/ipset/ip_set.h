@@ -165,8 +165,9 @@ extern void ip_set_type_unregister(struct ip_set_type *set_type);
 struct ip_set {
 	/* The name of the set */
 	char name[IPSET_MAXNAMELEN];
-	/* Lock protecting the set data */
-	rwlock_t lock;
+	/* Lock serializing the writers of the set data: lookups from
+	 * the kernel side are done in rcu_read_lock_bh() */
+	spinlock_t lock;
 	/* References to the set */
 	u32 ref;
 	/* The core set type */
@@ -530,6 +530,7 @@ struct dev_pm_info {
 	struct wakeup_source	*wakeup;
 	bool			wakeup_path:1;
 	bool			syscore:1;
+	bool			async_auto:1;	/* Owned by the PM core */
 #else
 	unsigned int		should_wakeup:1;
 #endif
@@ -34,6 +34,7 @@
 #define __LINUX_RCUPDATE_H
 
 #include <linux/types.h>
+#include <linux/init.h>
 #include <linux/cache.h>
 #include <linux/spinlock.h>
 #include <linux/threads.h>
@@ -1011,8 +1012,13 @@ static inline notrace void rcu_read_unlock_sched_notrace(void)
 
 #ifdef CONFIG_RCU_NOCB_CPU
 extern bool rcu_is_nocb_cpu(int cpu);
+extern bool __init rcu_nocb_add_cpus(const struct cpumask *mask);
 #else
 static inline bool rcu_is_nocb_cpu(int cpu) { return false; }
+static inline bool rcu_nocb_add_cpus(const struct cpumask *mask)
+{
+	return false;
+}
 #endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
 
 
@@ -394,6 +394,7 @@ typedef unsigned char *sk_buff_data_t;
  *	@no_fcs:  Request NIC to treat last 4 bytes as Ethernet FCS
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
+ *	@napi_id: id of the NAPI struct this skb came from
  *	@secmark: security marking
  *	@mark: Generic packet mark
  *	@dropcount: total number of sk_receive_queue overflows
@@ -504,8 +505,11 @@ struct sk_buff {
 	/* 7/9 bit hole (depending on ndisc_nodetype presence) */
 	kmemcheck_bitfield_end(flags2);
 
-#ifdef CONFIG_NET_DMA
-	dma_cookie_t		dma_cookie;
+#if defined CONFIG_NET_DMA || defined CONFIG_NET_RX_BUSY_POLL
+	union {
+		unsigned int	napi_id;
+		dma_cookie_t	dma_cookie;
+	};
 #endif
 #ifdef CONFIG_NETWORK_SECMARK
 	__u32			secmark;
@@ -639,6 +643,9 @@ extern void kfree_skb_list(struct sk_buff *segs);
 extern void skb_tx_error(struct sk_buff *skb);
 extern void consume_skb(struct sk_buff *skb);
 extern void	       __kfree_skb(struct sk_buff *skb);
+extern void napi_consume_skb(struct sk_buff *skb, int budget);
+extern void __kfree_skb_defer(struct sk_buff *skb);
+extern void napi_skb_free_stolen_head(struct sk_buff *skb);
 extern struct kmem_cache *skbuff_head_cache;
 
 extern void kfree_skb_partial(struct sk_buff *skb, bool head_stolen);
@@ -2018,6 +2025,23 @@ static inline struct sk_buff *netdev_alloc_skb_ip_align(struct net_device *dev,
 	return __netdev_alloc_skb_ip_align(dev, length, GFP_ATOMIC);
 }
 
+struct napi_struct;
+extern struct sk_buff *__napi_alloc_skb(struct napi_struct *napi,
+					unsigned int length, gfp_t gfp_mask);
+
+/**
+ *	napi_alloc_skb - allocate an skbuff for rx in a NAPI poll routine
+ *	@napi: napi instance this buffer was allocated for
+ *	@length: length to allocate
+ *
+ *	Like netdev_alloc_skb_ip_align(), but from the per-cpu NAPI cache.
+ */
+static inline struct sk_buff *napi_alloc_skb(struct napi_struct *napi,
+					     unsigned int length)
+{
+	return __napi_alloc_skb(napi, length, GFP_ATOMIC);
+}
+
 /*
  *	__skb_alloc_page - allocate pages for ps-rx on a skb and preserve pfmemalloc data
  *	@gfp_mask: alloc_pages_node mask. Set __GFP_NOMEMALLOC if not for network packet RX
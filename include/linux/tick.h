@@ -176,6 +176,7 @@ extern void tick_nohz_full_check(void);
 extern void tick_nohz_full_kick(void);
 extern void tick_nohz_full_kick_all(void);
 extern void tick_nohz_task_switch(struct task_struct *tsk);
+extern void tick_nohz_housekeeping_affine(struct task_struct *t);
 #else
 static inline void tick_nohz_init(void) { }
 static inline int tick_nohz_full_cpu(int cpu) { return 0; }
@@ -183,6 +184,7 @@ static inline void tick_nohz_full_check(void) { }
 static inline void tick_nohz_full_kick(void) { }
 static inline void tick_nohz_full_kick_all(void) { }
 static inline void tick_nohz_task_switch(struct task_struct *tsk) { }
+static inline void tick_nohz_housekeeping_affine(struct task_struct *t) { }
 #endif
 
 
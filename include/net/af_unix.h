@@ -6,8 +6,8 @@
 #include <linux/mutex.h>
 #include <net/sock.h>
 
-void unix_inflight(struct user_struct *user, struct file *fp);
-void unix_notinflight(struct user_struct *user, struct file *fp);
+void unix_inflight(struct sk_buff *skb, struct sock *receiver);
+void unix_notinflight(struct sk_buff *skb);
 extern void unix_gc(void);
 extern void wait_for_unix_gc(void);
 extern struct sock *unix_get_socket(struct file *filp);
@@ -32,6 +32,9 @@ struct unix_skb_parms {
 	kuid_t			uid;
 	kgid_t			gid;
 	struct scm_fp_list	*fp;		/* Passed files		*/
+	struct unix_sock	*gc_rcv;	/* Socket fp is queued on */
+	unsigned int		nr_unix;	/* AF_UNIX sockets in fp */
+	bool			inflight;	/* fp counted in flight */
 #ifdef CONFIG_SECURITY_NETWORK
 	u32			secid;		/* Security ID		*/
 #endif
@@ -56,6 +59,9 @@ struct unix_sock {
 	struct sock		*peer;
 	struct list_head	link;
 	atomic_long_t		inflight;
+	unsigned long		gc_children;	/* in-flight AF_UNIX sockets
+						 * queued on us, under
+						 * unix_gc_lock */
 	spinlock_t		lock;
 	unsigned char		recursion_level;
 	unsigned long		gc_flags;
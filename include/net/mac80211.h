@@ -672,7 +672,9 @@ struct ieee80211_tx_info {
 			/* NB: vif can be NULL for injected frames */
 			struct ieee80211_vif *vif;
 			struct ieee80211_key_conf *hw_key;
-			/* 8 bytes free */
+			/* only used on the intermediate TX queues */
+			u32 enqueue_time;
+			/* 4 bytes free */
 		} control;
 		struct {
 			struct ieee80211_tx_rate rates[IEEE80211_TX_MAX_RATES];
@@ -1079,6 +1081,7 @@ enum ieee80211_vif_flags {
  * @debugfs_dir: debugfs dentry, can be used by drivers to create own per
  *      interface debug files. Note that it will be NULL for the virtual
  *	monitor interface (if that is requested.)
+ * @txq: the multicast data TX queue (if the driver uses the TXQ abstraction)
  * @drv_priv: data area for driver use, will always be aligned to
  *	sizeof(void *).
  */
@@ -1099,6 +1102,8 @@ struct ieee80211_vif {
 	struct dentry *debugfs_dir;
 #endif
 
+	struct ieee80211_txq *txq;
+
 	/* must be last */
 	u8 drv_priv[0] __aligned(sizeof(void *));
 };
@@ -1277,6 +1282,7 @@ struct ieee80211_sta_rates {
  *	the station moves to associated state.
  * @smps_mode: current SMPS mode (off, static or dynamic)
  * @tx_rates: rate control selection table
+ * @txq: per-TID data TX queues (if the driver uses the TXQ abstraction)
  */
 struct ieee80211_sta {
 	u32 supp_rates[IEEE80211_NUM_BANDS];
@@ -1292,6 +1298,31 @@ struct ieee80211_sta {
 	enum ieee80211_smps_mode smps_mode;
 	struct ieee80211_sta_rates __rcu *rates;
 
+	struct ieee80211_txq *txq[IEEE80211_NUM_TIDS];
+
+	/* must be last */
+	u8 drv_priv[0] __aligned(sizeof(void *));
+};
+
+/**
+ * struct ieee80211_txq - Software intermediate tx queue
+ *
+ * @vif: &struct ieee80211_vif pointer from the add_interface callback.
+ * @sta: station table entry, %NULL for per-vif queue
+ * @tid: the TID for this queue (unused for per-vif queue)
+ * @ac: the AC for this queue
+ * @drv_priv: data area for driver use, will always be aligned to
+ *	sizeof(void *).
+ *
+ * The driver can obtain packets from this queue by calling
+ * ieee80211_tx_dequeue().
+ */
+struct ieee80211_txq {
+	struct ieee80211_vif *vif;
+	struct ieee80211_sta *sta;
+	u8 tid;
+	u8 ac;
+
 	/* must be last */
 	u8 drv_priv[0] __aligned(sizeof(void *));
 };
@@ -1531,6 +1562,8 @@ enum ieee80211_hw_flags {
  *	within &struct ieee80211_sta.
  * @chanctx_data_size: size (in bytes) of the drv_priv data area
  *	within &struct ieee80211_chanctx_conf.
+ * @txq_data_size: size (in bytes) of the drv_priv data area
+ *	within @struct ieee80211_txq.
  *
  * @max_rates: maximum number of alternate rate retry stages the hw
  *	can handle.
@@ -1591,6 +1624,7 @@ struct ieee80211_hw {
 	int vif_data_size;
 	int sta_data_size;
 	int chanctx_data_size;
+	int txq_data_size;
 	int napi_weight;
 	u16 queues;
 	u16 max_listen_interval;
@@ -2065,6 +2099,30 @@ void ieee80211_free_txskb(struct ieee80211_hw *hw, struct sk_buff *skb);
  * a queue is stopped/woken even if the interface is not in AP mode.
  */
 
+/**
+ * DOC: Intermediate TX queues
+ *
+ * Frames handed to the driver through the @tx callback end up in a hardware
+ * or firmware queue that is usually much deeper than needed to keep the
+ * medium busy, which adds a lot of latency under load, and in which a bulk
+ * flow to one station delays everybody else.
+ *
+ * A driver implementing the @wake_tx_queue callback instead gets data frames
+ * through per-station, per-TID software queues (&struct ieee80211_txq), plus
+ * one per virtual interface for multicast data. mac80211 keeps the frames of
+ * every queue in a small number of flows that are served round-robin, and
+ * runs CoDel on each flow to keep the standing queue short. The driver is
+ * told about new frames with @wake_tx_queue and pulls them with
+ * ieee80211_tx_dequeue() whenever it has room in the hardware queue for the
+ * AC, typically from @wake_tx_queue itself and from its TX completion path,
+ * so that only as many frames as needed to fill the next aggregate or the
+ * next transmit opportunity leave mac80211.
+ *
+ * Sequence numbers, rate control and encryption are only done at dequeue
+ * time, so the frames returned are in order. Management frames, frames that
+ * need fragmentation and powersave responses still go through @tx.
+ */
+
 /**
  * enum ieee80211_filter_flags - hardware filter flags
  *
@@ -2619,6 +2677,12 @@ enum ieee80211_roc_type {
  * @ipv6_addr_change: IPv6 address assignment on the given interface changed.
  *	Currently, this is only called for managed or P2P client interfaces.
  *	This callback is optional; it must not sleep.
+ *
+ * @wake_tx_queue: Called when new packets have been added to the queue.
+ *	Drivers implementing this pull data frames from the per-station,
+ *	per-TID intermediate queues with ieee80211_tx_dequeue() instead of
+ *	getting them through @tx, see the "Intermediate TX queues" section.
+ *	Must be atomic.
  */
 struct ieee80211_ops {
 	void (*tx)(struct ieee80211_hw *hw,
@@ -2806,6 +2870,9 @@ struct ieee80211_ops {
 				 struct ieee80211_vif *vif,
 				 struct inet6_dev *idev);
 #endif
+
+	void (*wake_tx_queue)(struct ieee80211_hw *hw,
+			      struct ieee80211_txq *txq);
 };
 
 /**
@@ -3484,6 +3551,21 @@ __le16 ieee80211_generic_frame_duration(struct ieee80211_hw *hw,
 struct sk_buff *
 ieee80211_get_buffered_bc(struct ieee80211_hw *hw, struct ieee80211_vif *vif);
 
+/**
+ * ieee80211_tx_dequeue - dequeue a packet from a software tx queue
+ *
+ * @hw: pointer as obtained from ieee80211_alloc_hw()
+ * @txq: pointer obtained from station or virtual interface
+ *
+ * Returns the skb if successful, %NULL if no frame was available. The
+ * frame is ready to be handed to the hardware: its sequence number,
+ * rates and encryption have been set up at dequeue time.
+ *
+ * This must not be called from hard interrupt context.
+ */
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
+				     struct ieee80211_txq *txq);
+
 /**
  * ieee80211_get_tkip_p1k_iv - get a TKIP phase 1 key for IV32
  *
@@ -25,6 +25,7 @@ enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
 	__QDISC_STATE_THROTTLED,
+	__QDISC_STATE_MISSED,
 };
 
 /*
@@ -42,6 +43,13 @@ struct qdisc_size_table {
 	u16			data[];
 };
 
+/* Enqueue side counters of a TCQ_F_NOLOCK qdisc, folded on demand */
+struct qdisc_cpu_stats {
+	int			qlen;
+	int			backlog;
+	__u32			drops;
+};
+
 struct Qdisc {
 	int 			(*enqueue)(struct sk_buff *skb, struct Qdisc *dev);
 	struct sk_buff *	(*dequeue)(struct Qdisc *dev);
@@ -57,6 +65,12 @@ struct Qdisc {
 				      * Its true for MQ/MQPRIO slaves, or non
 				      * multiqueue device.
 				      */
+#define TCQ_F_NOLOCK		0x20 /* qdisc does its own locking: enqueue
+				      * runs without the root lock, dequeue
+				      * is serialized by run_lock, and the
+				      * enqueue side counters are in
+				      * cpu_stats.
+				      */
 #define TCQ_F_WARN_NONWC	(1 << 16)
 	int			padded;
 	const struct Qdisc_ops	*ops;
@@ -90,15 +104,38 @@ struct Qdisc {
 	struct rcu_head		rcu_head;
 	spinlock_t		busylock;
 	u32			limit;
+
+	spinlock_t		run_lock;	/* TCQ_F_NOLOCK "running" state */
+	struct qdisc_cpu_stats __percpu *cpu_stats;
 };
 
-static inline bool qdisc_is_running(const struct Qdisc *qdisc)
+static inline bool qdisc_is_running(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK)
+		return spin_is_locked(&qdisc->run_lock);
 	return (qdisc->__state & __QDISC___STATE_RUNNING) ? true : false;
 }
 
 static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		if (spin_trylock(&qdisc->run_lock))
+			return true;
+		/* Somebody else is already running the qdisc. Only one of
+		 * the CPUs that lost the race needs to tell it about the
+		 * packets they enqueued.
+		 */
+		smp_mb__before_atomic();
+		if (test_bit(__QDISC_STATE_MISSED, &qdisc->state))
+			return false;
+		/* The owner either sees MISSED when it releases run_lock
+		 * and reschedules the qdisc, or released it before we set
+		 * the flag and we can take over.
+		 */
+		set_bit(__QDISC_STATE_MISSED, &qdisc->state);
+		smp_mb__after_atomic();
+		return spin_trylock(&qdisc->run_lock);
+	}
 	if (qdisc_is_running(qdisc))
 		return false;
 	qdisc->__state |= __QDISC___STATE_RUNNING;
@@ -107,6 +144,14 @@ static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 
 static inline void qdisc_run_end(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		spin_unlock(&qdisc->run_lock);
+		/* order the unlock before the MISSED test */
+		smp_mb();
+		if (unlikely(test_bit(__QDISC_STATE_MISSED, &qdisc->state)))
+			__netif_schedule(qdisc);
+		return;
+	}
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
@@ -241,8 +286,12 @@ static inline void qdisc_cb_private_validate(const struct sk_buff *skb, int sz)
 	BUILD_BUG_ON(sizeof(qcb->data) < sz);
 }
 
+extern int qdisc_qlen_sum(const struct Qdisc *q);
+
 static inline int qdisc_qlen(const struct Qdisc *q)
 {
+	if (q->flags & TCQ_F_NOLOCK)
+		return qdisc_qlen_sum(q);
 	return q->q.qlen;
 }
 
@@ -369,6 +418,9 @@ extern struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 				 struct Qdisc_ops *ops);
 extern struct Qdisc *qdisc_create_dflt(struct netdev_queue *dev_queue,
 				       struct Qdisc_ops *ops, u32 parentid);
+extern int qdisc_set_nolock(struct Qdisc *qdisc);
+extern void qdisc_clear_nolock(struct Qdisc *qdisc);
+extern void qdisc_stats_fold(struct Qdisc *qdisc);
 extern void __qdisc_calculate_pkt_len(struct sk_buff *skb,
 				      const struct qdisc_size_table *stab);
 extern void tcf_destroy(struct tcf_proto *tp);
@@ -382,9 +434,15 @@ static inline void qdisc_reset_all_tx_gt(struct net_device *dev, unsigned int i)
 	for (; i < dev->num_tx_queues; i++) {
 		qdisc = netdev_get_tx_queue(dev, i)->qdisc;
 		if (qdisc) {
+			bool nolock = qdisc->flags & TCQ_F_NOLOCK;
+
+			if (nolock)
+				spin_lock_bh(&qdisc->run_lock);
 			spin_lock_bh(qdisc_lock(qdisc));
 			qdisc_reset(qdisc);
 			spin_unlock_bh(qdisc_lock(qdisc));
+			if (nolock)
+				spin_unlock_bh(&qdisc->run_lock);
 		}
 	}
 }
@@ -402,7 +460,7 @@ static inline bool qdisc_all_tx_empty(const struct net_device *dev)
 		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
 		const struct Qdisc *q = txq->qdisc;
 
-		if (q->q.qlen)
+		if (qdisc_qlen(q))
 			return false;
 	}
 	return true;
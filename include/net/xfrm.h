@@ -508,12 +508,18 @@ struct xfrm_policy_queue {
 	unsigned long		timeout;
 };
 
+struct xfrm_pol_inexact_node;
+
 struct xfrm_policy {
 #ifdef CONFIG_NET_NS
 	struct net		*xp_net;
 #endif
 	struct hlist_node	bydst;
 	struct hlist_node	byidx;
+	/* Inexact policies only: the node of the bin they sit in */
+	struct hlist_node	byinexact;
+	struct xfrm_pol_inexact_node *inexact_node;
+	u32			pos;	/* in the inexact list */
 
 	/* This lock only affects elements except for entry. */
 	rwlock_t		lock;
@@ -76,5 +76,9 @@
 
 #define SO_SELECT_ERR_QUEUE	45
 
+#define SO_BUSY_POLL		46
+
+#define SO_MAX_PACING_RATE	47
+
 #define SO_SET_DOMAIN_NAME 51
 #endif /* __ASM_GENERIC_SOCKET_H */
@@ -0,0 +1,362 @@
+/*
+ * linux/kernel/irq/balance.c
+ *
+ * Load aware interrupt affinity balancer.
+ *
+ * Periodically samples the per interrupt rates from the kstat counters,
+ * accounts them to the CPU the interrupt is currently routed to and moves
+ * hot interrupts away from the busiest CPU. Candidate target CPUs are
+ * looked up in the cluster of the busiest CPU first, so an interrupt only
+ * crosses a cluster boundary when its own cluster cannot absorb it.
+ *
+ * Interrupts which are per cpu, marked IRQF_NOBALANCING, pinned by user
+ * space through /proc/irq/<irq>/smp_affinity or disabled through
+ * /proc/irq/<irq>/balance are never touched. An affinity hint, if set,
+ * restricts the set of CPUs an interrupt may be moved to.
+ */
+
+#define pr_fmt(fmt) "irqbalance: " fmt
+
+#include <linux/irq.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/interrupt.h>
+#include <linux/kernel_stat.h>
+#include <linux/percpu.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+
+#include "internals.h"
+
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "irqbalance."
+
+static bool irq_balance_enabled = IS_ENABLED(CONFIG_IRQ_BALANCE_DEFAULT_ON);
+
+/* Sampling period in milliseconds */
+static unsigned int irq_balance_interval = 1000;
+module_param_named(interval_ms, irq_balance_interval, uint, 0644);
+
+/* Busiest CPU must see at least this many interrupts/sec to bother */
+static unsigned int irq_balance_min_load = 1000;
+module_param_named(min_load, irq_balance_min_load, uint, 0644);
+
+/* Required load difference in percent of the busiest CPU's load */
+static unsigned int irq_balance_imbalance_pct = 25;
+module_param_named(imbalance_pct, irq_balance_imbalance_pct, uint, 0644);
+
+/* Upper bound of migrations per sampling period */
+static unsigned int irq_balance_max_moves = 2;
+module_param_named(max_moves, irq_balance_max_moves, uint, 0644);
+
+static DEFINE_PER_CPU(unsigned long, irq_balance_load);
+static DEFINE_MUTEX(irq_balance_mutex);
+/* Serialises writers of the enabled parameter, taken before the above */
+static DEFINE_MUTEX(irq_balance_param_mutex);
+static unsigned long irq_balance_last;
+static bool irq_balance_ready;
+
+static unsigned long irq_balance_passes;
+static unsigned long irq_balance_moves;
+static unsigned long irq_balance_cluster_moves;
+
+static void irq_balance_workfn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(irq_balance_work, irq_balance_workfn);
+
+static inline unsigned int irq_balance_desc_count(struct irq_desc *desc)
+{
+	unsigned int sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(desc->kstat_irqs, cpu);
+	return sum;
+}
+
+/* The CPU the interrupt controller delivers @desc to */
+static inline int irq_balance_desc_cpu(struct irq_desc *desc)
+{
+	return cpumask_first_and(desc->irq_data.affinity, cpu_online_mask);
+}
+
+static bool irq_balance_movable(struct irq_desc *desc)
+{
+	struct irq_data *data = &desc->irq_data;
+	struct irq_chip *chip = irq_data_get_irq_chip(data);
+
+	if (!desc->action || desc->balance_pinned)
+		return false;
+	if (!irqd_can_balance(data) || irqd_irq_disabled(data))
+		return false;
+	/* Slow bus chips need process context for chip_bus_lock() */
+	if (!chip || !chip->irq_set_affinity || chip->irq_bus_lock)
+		return false;
+	return true;
+}
+
+static const struct cpumask *irq_balance_allowed(struct irq_desc *desc)
+{
+	if (desc->affinity_hint &&
+	    cpumask_intersects(desc->affinity_hint, cpu_online_mask))
+		return desc->affinity_hint;
+	return irq_default_affinity;
+}
+
+/*
+ * Sample the interrupt counters and recompute the per CPU load over the
+ * last @period_ms milliseconds. A zero @period_ms only records the counts
+ * as the baseline for the next sample.
+ */
+static void irq_balance_sample(unsigned int period_ms)
+{
+	struct irq_desc *desc;
+	unsigned int irq, count;
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		per_cpu(irq_balance_load, cpu) = 0;
+
+	for_each_irq_desc(irq, desc) {
+		if (!desc || !desc->kstat_irqs)
+			continue;
+
+		count = irq_balance_desc_count(desc);
+		desc->balance_rate = period_ms ?
+			(unsigned long)(count - desc->balance_last) *
+			MSEC_PER_SEC / period_ms : 0;
+		desc->balance_last = count;
+
+		if (!desc->action || irqd_is_per_cpu(&desc->irq_data))
+			continue;
+
+		cpu = irq_balance_desc_cpu(desc);
+		if (cpu < nr_cpu_ids)
+			per_cpu(irq_balance_load, cpu) += desc->balance_rate;
+	}
+}
+
+static int irq_balance_idlest(const struct cpumask *mask, int skip)
+{
+	unsigned long min = ULONG_MAX;
+	int cpu, idlest = nr_cpu_ids;
+
+	for_each_cpu_and(cpu, mask, cpu_online_mask) {
+		if (cpu == skip || !cpumask_test_cpu(cpu, irq_default_affinity))
+			continue;
+		if (per_cpu(irq_balance_load, cpu) < min) {
+			min = per_cpu(irq_balance_load, cpu);
+			idlest = cpu;
+		}
+	}
+	return idlest;
+}
+
+static bool irq_balance_worthwhile(int src, int dst)
+{
+	unsigned long src_load = per_cpu(irq_balance_load, src);
+	unsigned long dst_load = per_cpu(irq_balance_load, dst);
+
+	if (dst >= nr_cpu_ids || dst_load >= src_load)
+		return false;
+	return (src_load - dst_load) * 100 >
+		src_load * irq_balance_imbalance_pct;
+}
+
+/*
+ * Pick the hottest movable interrupt on @src which may run on @dst and
+ * whose move actually reduces the imbalance between the two CPUs.
+ */
+static struct irq_desc *irq_balance_pick(int src, int dst)
+{
+	unsigned long gap = per_cpu(irq_balance_load, src) -
+			    per_cpu(irq_balance_load, dst);
+	struct irq_desc *desc, *best = NULL;
+	unsigned int irq;
+
+	for_each_irq_desc(irq, desc) {
+		if (!desc || !desc->balance_rate || desc->balance_rate >= gap)
+			continue;
+		if (irq_balance_desc_cpu(desc) != src)
+			continue;
+		if (!irq_balance_movable(desc))
+			continue;
+		if (!cpumask_test_cpu(dst, irq_balance_allowed(desc)))
+			continue;
+		if (!best || desc->balance_rate > best->balance_rate)
+			best = desc;
+	}
+	return best;
+}
+
+static bool irq_balance_move(struct irq_desc *desc, int dst)
+{
+	unsigned long flags;
+	int ret = -EINVAL;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	/* Re-check under the lock, user space may have raced with us */
+	if (irq_balance_movable(desc))
+		ret = irq_set_affinity_locked(&desc->irq_data,
+					      cpumask_of(dst), false);
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	if (ret)
+		return false;
+
+	desc->balance_moves++;
+	return true;
+}
+
+static void irq_balance_rebalance(void)
+{
+	unsigned int moves;
+
+	for (moves = 0; moves < irq_balance_max_moves; moves++) {
+		unsigned long max = 0;
+		struct irq_desc *desc = NULL;
+		int cpu, src = nr_cpu_ids, dst;
+
+		for_each_online_cpu(cpu) {
+			if (per_cpu(irq_balance_load, cpu) > max) {
+				max = per_cpu(irq_balance_load, cpu);
+				src = cpu;
+			}
+		}
+		if (src >= nr_cpu_ids || max < irq_balance_min_load)
+			break;
+
+		/* Prefer a CPU sharing the cluster of the busiest one */
+		dst = irq_balance_idlest(topology_core_cpumask(src), src);
+		if (irq_balance_worthwhile(src, dst))
+			desc = irq_balance_pick(src, dst);
+
+		if (!desc) {
+			dst = irq_balance_idlest(cpu_online_mask, src);
+			if (!irq_balance_worthwhile(src, dst))
+				break;
+			desc = irq_balance_pick(src, dst);
+			if (!desc)
+				break;
+		}
+
+		if (!irq_balance_move(desc, dst))
+			break;
+
+		per_cpu(irq_balance_load, src) -= desc->balance_rate;
+		per_cpu(irq_balance_load, dst) += desc->balance_rate;
+		irq_balance_moves++;
+		if (!cpumask_test_cpu(dst, topology_core_cpumask(src)))
+			irq_balance_cluster_moves++;
+
+		pr_debug("moved irq %u (%u/s) from cpu%d to cpu%d\n",
+			 desc->irq_data.irq, desc->balance_rate, src, dst);
+	}
+}
+
+static void irq_balance_workfn(struct work_struct *work)
+{
+	unsigned int period;
+
+	mutex_lock(&irq_balance_mutex);
+	if (!irq_balance_enabled)
+		goto out;
+
+	period = jiffies_to_msecs(jiffies - irq_balance_last);
+	irq_balance_last = jiffies;
+
+	if (period) {
+		get_online_cpus();
+		irq_balance_sample(period);
+		irq_balance_rebalance();
+		put_online_cpus();
+		irq_balance_passes++;
+	}
+
+	schedule_delayed_work(&irq_balance_work,
+			      msecs_to_jiffies(max(irq_balance_interval, 10U)));
+out:
+	mutex_unlock(&irq_balance_mutex);
+}
+
+static void irq_balance_start(void)
+{
+	/*
+	 * The counts were last sampled when the balancer was stopped, if
+	 * ever. Take a fresh baseline so the first pass does not act on
+	 * the interrupts seen since.
+	 */
+	get_online_cpus();
+	irq_balance_sample(0);
+	put_online_cpus();
+	irq_balance_last = jiffies;
+	schedule_delayed_work(&irq_balance_work,
+			      msecs_to_jiffies(max(irq_balance_interval, 10U)));
+}
+
+static int irq_balance_set_enabled(const char *val,
+				   const struct kernel_param *kp)
+{
+	bool enable, cancel;
+	int ret;
+
+	ret = strtobool(val, &enable);
+	if (ret)
+		return ret;
+
+	mutex_lock(&irq_balance_param_mutex);
+	mutex_lock(&irq_balance_mutex);
+	/* Command line parameters are parsed before workqueues exist */
+	if (enable && !irq_balance_enabled && irq_balance_ready)
+		irq_balance_start();
+	cancel = !enable && irq_balance_ready;
+	irq_balance_enabled = enable;
+	mutex_unlock(&irq_balance_mutex);
+
+	/*
+	 * The work takes irq_balance_mutex, so wait for it outside of that
+	 * but before a concurrent enable can schedule it again.
+	 */
+	if (cancel)
+		cancel_delayed_work_sync(&irq_balance_work);
+	mutex_unlock(&irq_balance_param_mutex);
+	return 0;
+}
+
+static struct kernel_param_ops irq_balance_enabled_ops = {
+	.set = irq_balance_set_enabled,
+	.get = param_get_bool,
+};
+module_param_cb(enabled, &irq_balance_enabled_ops, &irq_balance_enabled, 0644);
+
+/**
+ *	irq_balance_show_stats - print the balancer state for /proc/irq/balance
+ *	@m:	seq_file to print to
+ */
+void irq_balance_show_stats(struct seq_file *m)
+{
+	int cpu;
+
+	seq_printf(m, "enabled:        %d\n", irq_balance_enabled);
+	seq_printf(m, "interval_ms:    %u\n", irq_balance_interval);
+	seq_printf(m, "passes:         %lu\n", irq_balance_passes);
+	seq_printf(m, "moves:          %lu\n", irq_balance_moves);
+	seq_printf(m, "cluster_moves:  %lu\n", irq_balance_cluster_moves);
+	for_each_online_cpu(cpu)
+		seq_printf(m, "cpu%-3d load:    %lu\n", cpu,
+			   per_cpu(irq_balance_load, cpu));
+}
+
+static int __init irq_balance_init(void)
+{
+	mutex_lock(&irq_balance_param_mutex);
+	mutex_lock(&irq_balance_mutex);
+	irq_balance_ready = true;
+	if (irq_balance_enabled)
+		irq_balance_start();
+	mutex_unlock(&irq_balance_mutex);
+	mutex_unlock(&irq_balance_param_mutex);
+	return 0;
+}
+late_initcall(irq_balance_init);
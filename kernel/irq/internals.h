@@ -99,6 +99,11 @@ static inline void unregister_handler_proc(unsigned int irq,
 
 extern int irq_select_affinity_usr(unsigned int irq, struct cpumask *mask);
 
+#ifdef CONFIG_IRQ_BALANCE
+struct seq_file;
+extern void irq_balance_show_stats(struct seq_file *m);
+#endif
+
 extern void irq_set_thread_affinity(struct irq_desc *desc);
 
 extern int irq_do_set_affinity(struct irq_data *data,
@@ -97,6 +97,12 @@ static void desc_set_defaults(unsigned int irq, struct irq_desc *desc, int node,
 #ifdef CONFIG_SMP
 	INIT_LIST_HEAD(&desc->affinity_notify);
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	desc->balance_last = 0;
+	desc->balance_rate = 0;
+	desc->balance_moves = 0;
+	desc->balance_pinned = false;
+#endif
 }
 
 int nr_irqs = NR_IRQS;
@@ -109,6 +109,10 @@ static ssize_t write_irq_affinity(int type, struct file *file,
 		err = irq_select_affinity_usr(irq, new_value) ? -EINVAL : count;
 	} else {
 		irq_set_affinity(irq, new_value);
+#ifdef CONFIG_IRQ_BALANCE
+		/* An explicit user setting pins the interrupt */
+		irq_to_desc(irq)->balance_pinned = true;
+#endif
 		err = count;
 	}
 
@@ -223,6 +227,64 @@ static const struct file_operations default_affinity_proc_fops = {
 	.write		= default_affinity_write,
 };
 
+#ifdef CONFIG_IRQ_BALANCE
+static int irq_balance_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+
+	seq_printf(m, "enabled %d\nrate %u\nmoves %u\n",
+		   !desc->balance_pinned, desc->balance_rate,
+		   desc->balance_moves);
+	return 0;
+}
+
+static ssize_t irq_balance_proc_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	struct irq_desc *desc = irq_to_desc((long)PDE_DATA(file_inode(file)));
+	unsigned int enable;
+	int err;
+
+	err = kstrtouint_from_user(buffer, count, 0, &enable);
+	if (err)
+		return err;
+
+	desc->balance_pinned = !enable;
+	return count;
+}
+
+static int irq_balance_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_balance_proc_show, PDE_DATA(inode));
+}
+
+static const struct file_operations irq_balance_proc_fops = {
+	.open		= irq_balance_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= irq_balance_proc_write,
+};
+
+static int balance_stats_show(struct seq_file *m, void *v)
+{
+	irq_balance_show_stats(m);
+	return 0;
+}
+
+static int balance_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, balance_stats_show, NULL);
+}
+
+static const struct file_operations balance_stats_proc_fops = {
+	.open		= balance_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 static int irq_node_proc_show(struct seq_file *m, void *v)
 {
 	struct irq_desc *desc = irq_to_desc((long) m->private);
@@ -377,6 +439,10 @@ void register_irq_proc(unsigned int irq, struct irq_desc *desc)
 	proc_create_data("node", 0444, desc->dir,
 			 &irq_node_proc_fops, (void *)(long)irq);
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	proc_create_data("balance", 0644, desc->dir,
+			 &irq_balance_proc_fops, (void *)(long)irq);
+#endif
 
 	proc_create_data("spurious", 0444, desc->dir,
 			 &irq_spurious_proc_fops, (void *)(long)irq);
@@ -397,6 +463,9 @@ void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
 	remove_proc_entry("affinity_hint", desc->dir);
 	remove_proc_entry("smp_affinity_list", desc->dir);
 	remove_proc_entry("node", desc->dir);
+#endif
+#ifdef CONFIG_IRQ_BALANCE
+	remove_proc_entry("balance", desc->dir);
 #endif
 	remove_proc_entry("spurious", desc->dir);
 
@@ -418,6 +487,9 @@ static void register_default_affinity_proc(void)
 	proc_create("irq/default_smp_affinity", 0600, NULL,
 		    &default_affinity_proc_fops);
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	proc_create("irq/balance", 0444, NULL, &balance_stats_proc_fops);
+#endif
 }
 
 void init_irq_proc(void)
@@ -33,6 +33,7 @@
 
 
 static int nocompress;
+static int compress_lz4 = IS_ENABLED(CONFIG_HIBERNATION_COMP_LZ4);
 static int noresume;
 static int resume_wait;
 static int resume_delay;
@@ -670,6 +671,8 @@ int hibernate(void)
 			flags |= SF_NOCOMPRESS_MODE;
 		else
 		        flags |= SF_CRC32_MODE;
+		if (!nocompress && compress_lz4)
+			flags |= SF_LZ4_MODE;
 
 		pr_debug("PM: writing image.\n");
 		error = swsusp_write(flags);
@@ -1088,6 +1091,10 @@ static int __init hibernate_setup(char *str)
 		noresume = 1;
 	else if (!strncmp(str, "nocompress", 10))
 		nocompress = 1;
+	else if (!strncmp(str, "lz4", 3))
+		compress_lz4 = 1;
+	else if (!strncmp(str, "lzo", 3))
+		compress_lz4 = 0;
 	return 1;
 }
 
@@ -25,6 +25,7 @@
 #include <linux/pm.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/lz4.h>
 #include <linux/vmalloc.h>
 #include <linux/cpumask.h>
 #include <linux/atomic.h>
@@ -413,23 +414,88 @@ static int swap_writer_finish(struct swap_map_handle *handle,
 }
 
 /* We need to remember how much compressed data we need to read. */
-#define LZO_HEADER	sizeof(size_t)
+#define CMP_HEADER	sizeof(size_t)
 
 /* Number of pages/bytes we'll compress at one time. */
-#define LZO_UNC_PAGES	32
-#define LZO_UNC_SIZE	(LZO_UNC_PAGES * PAGE_SIZE)
+#define UNC_PAGES	32
+#define UNC_SIZE	(UNC_PAGES * PAGE_SIZE)
+
+/* Worst case compressed sizes, the latter matches lz4_compressbound(). */
+#define LZO_WORST(x)	lzo1x_worst_compress(x)
+#define LZ4_WORST(x)	((x) + ((x) / 255) + 16)
+#define CMP_WORST(x)	(LZO_WORST(x) > LZ4_WORST(x) ? \
+			 LZO_WORST(x) : LZ4_WORST(x))
 
 /* Number of pages/bytes we need for compressed data (worst case). */
-#define LZO_CMP_PAGES	DIV_ROUND_UP(lzo1x_worst_compress(LZO_UNC_SIZE) + \
-			             LZO_HEADER, PAGE_SIZE)
-#define LZO_CMP_SIZE	(LZO_CMP_PAGES * PAGE_SIZE)
+#define CMP_PAGES	DIV_ROUND_UP(CMP_WORST(UNC_SIZE) + \
+			             CMP_HEADER, PAGE_SIZE)
+#define CMP_SIZE	(CMP_PAGES * PAGE_SIZE)
+
+/* Size of the compression workspace, large enough for either compressor. */
+#define CMP_WRK_SIZE	(LZO1X_1_MEM_COMPRESS > LZ4_MEM_COMPRESS ? \
+			 LZO1X_1_MEM_COMPRESS : LZ4_MEM_COMPRESS)
 
 /* Maximum number of threads for compression/decompression. */
-#define LZO_THREADS	3
+#define CMP_THREADS	8
 
 /* Minimum/maximum number of pages for read buffering. */
-#define LZO_MIN_RD_PAGES	1024
-#define LZO_MAX_RD_PAGES	8192
+#define CMP_MIN_RD_PAGES	1024
+#define CMP_MAX_RD_PAGES	8192
+
+/*
+ * Image compressors. The one used for saving the image is recorded in the
+ * image header flags, so the boot kernel always picks the matching one no
+ * matter how it has been configured itself.
+ */
+struct hib_comp {
+	const char *name;
+	size_t (*worst)(size_t len);
+	int (*compress)(const unsigned char *src, size_t src_len,
+	                unsigned char *dst, size_t *dst_len, void *wrk);
+	int (*decompress)(const unsigned char *src, size_t src_len,
+	                  unsigned char *dst, size_t *dst_len);
+};
+
+static size_t lzo_worst(size_t len)
+{
+	return LZO_WORST(len);
+}
+
+static size_t lz4_worst(size_t len)
+{
+	return lz4_compressbound(len);
+}
+
+static const struct hib_comp hib_comp_lzo = {
+	.name		= "LZO",
+	.worst		= lzo_worst,
+	.compress	= lzo1x_1_compress,
+	.decompress	= lzo1x_decompress_safe,
+};
+
+static const struct hib_comp hib_comp_lz4 = {
+	.name		= "LZ4",
+	.worst		= lz4_worst,
+	.compress	= lz4_compress,
+	.decompress	= lz4_decompress_unknownoutputsize,
+};
+
+static const struct hib_comp *hib_comp_get(unsigned int flags)
+{
+	return (flags & SF_LZ4_MODE) ? &hib_comp_lz4 : &hib_comp_lzo;
+}
+
+/*
+ * Number of compression/decompression threads. One CPU is left for the
+ * thread doing the I/O and one thread per CPU is started on the others,
+ * up to CMP_THREADS to limit the memory footprint.
+ */
+static unsigned hib_comp_threads(void)
+{
+	unsigned nr_threads = num_online_cpus() - 1;
+
+	return clamp_val(nr_threads, 1, CMP_THREADS);
+}
 
 
 /**
@@ -489,8 +555,8 @@ struct crc_data {
 	wait_queue_head_t go;                     /* start crc update */
 	wait_queue_head_t done;                   /* crc update done */
 	u32 *crc32;                               /* points to handle's crc32 */
-	size_t *unc_len[LZO_THREADS];             /* uncompressed lengths */
-	unsigned char *unc[LZO_THREADS];          /* uncompressed data */
+	size_t *unc_len[CMP_THREADS];             /* uncompressed lengths */
+	unsigned char *unc[CMP_THREADS];          /* uncompressed data */
 };
 
 /**
@@ -521,26 +587,27 @@ static int crc32_threadfn(void *data)
 	return 0;
 }
 /**
- * Structure used for LZO data compression.
+ * Structure used for data compression.
  */
 struct cmp_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	const struct hib_comp *comp;              /* compressor */
 	wait_queue_head_t go;                     /* start compression */
 	wait_queue_head_t done;                   /* compression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
-	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
-	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
-	unsigned char wrk[LZO1X_1_MEM_COMPRESS];  /* compression workspace */
+	unsigned char unc[UNC_SIZE];              /* uncompressed buffer */
+	unsigned char cmp[CMP_SIZE];              /* compressed buffer */
+	unsigned char wrk[CMP_WRK_SIZE];          /* compression workspace */
 };
 
 /**
  * Compression function that runs in its own thread.
  */
-static int lzo_compress_threadfn(void *data)
+static int compress_threadfn(void *data)
 {
 	struct cmp_data *d = data;
 
@@ -556,9 +623,9 @@ static int lzo_compress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->ret = lzo1x_1_compress(d->unc, d->unc_len,
-		                          d->cmp + LZO_HEADER, &d->cmp_len,
-		                          d->wrk);
+		d->ret = d->comp->compress(d->unc, d->unc_len,
+		                           d->cmp + CMP_HEADER, &d->cmp_len,
+		                           d->wrk);
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -566,15 +633,18 @@ static int lzo_compress_threadfn(void *data)
 }
 
 /**
- * save_image_lzo - Save the suspend image data compressed with LZO.
+ * save_image_cmp - Save the suspend image data compressed.
  * @handle: Swap mam handle to use for saving the image.
  * @snapshot: Image to read data from.
  * @nr_to_write: Number of pages to save.
+ * @flags: Image flags, select the compressor.
  */
-static int save_image_lzo(struct swap_map_handle *handle,
+static int save_image_cmp(struct swap_map_handle *handle,
                           struct snapshot_handle *snapshot,
-                          unsigned int nr_to_write)
+                          unsigned int nr_to_write,
+                          unsigned int flags)
 {
+	const struct hib_comp *comp = hib_comp_get(flags);
 	unsigned int m;
 	int ret = 0;
 	int nr_pages;
@@ -588,28 +658,25 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	struct cmp_data *data = NULL;
 	struct crc_data *crc = NULL;
 
-	/*
-	 * We'll limit the number of threads for compression to limit memory
-	 * footprint.
-	 */
-	nr_threads = num_online_cpus() - 1;
-	nr_threads = clamp_val(nr_threads, 1, LZO_THREADS);
+	nr_threads = hib_comp_threads();
 
 	page = (void *)__get_free_page(__GFP_WAIT | __GFP_HIGH);
 	if (!page) {
-		printk(KERN_ERR "PM: Failed to allocate LZO page\n");
+		printk(KERN_ERR "PM: Failed to allocate %s page\n", comp->name);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vmalloc(sizeof(*data) * nr_threads);
 	if (!data) {
-		printk(KERN_ERR "PM: Failed to allocate LZO data\n");
+		printk(KERN_ERR "PM: Failed to allocate %s data\n", comp->name);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct cmp_data, go));
+		data[thr].comp = comp;
+	}
 
 	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
 	if (!crc) {
@@ -626,7 +693,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_compress_threadfn,
+		data[thr].thr = kthread_run(compress_threadfn,
 		                            &data[thr],
 		                            "image_compress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -666,9 +733,9 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	handle->reqd_free_pages = reqd_free_pages();
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for compression.\n"
+		"PM: Using %u thread(s) for %s compression.\n"
 		"PM: Compressing and saving image data (%u pages)...\n",
-		nr_threads, nr_to_write);
+		nr_threads, comp->name, nr_to_write);
 	m = nr_to_write / 10;
 	if (!m)
 		m = 1;
@@ -677,7 +744,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 	do_gettimeofday(&start);
 	for (;;) {
 		for (thr = 0; thr < nr_threads; thr++) {
-			for (off = 0; off < LZO_UNC_SIZE; off += PAGE_SIZE) {
+			for (off = 0; off < UNC_SIZE; off += PAGE_SIZE) {
 				ret = snapshot_read_next(snapshot);
 				if (ret < 0)
 					goto out_finish;
@@ -719,15 +786,17 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			ret = data[thr].ret;
 
 			if (ret < 0) {
-				printk(KERN_ERR "PM: LZO compression failed\n");
+				printk(KERN_ERR "PM: %s compression failed\n",
+				       comp->name);
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(data[thr].unc_len))) {
+			             comp->worst(data[thr].unc_len))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid %s compressed length\n",
+				       comp->name);
 				ret = -1;
 				goto out_finish;
 			}
@@ -743,7 +812,7 @@ static int save_image_lzo(struct swap_map_handle *handle,
 			 * read it.
 			 */
 			for (off = 0;
-			     off < LZO_HEADER + data[thr].cmp_len;
+			     off < CMP_HEADER + data[thr].cmp_len;
 			     off += PAGE_SIZE) {
 				memcpy(page, data[thr].cmp + off, PAGE_SIZE);
 
@@ -844,7 +913,7 @@ int swsusp_write(unsigned int flags)
 	if (!error) {
 		error = (flags & SF_NOCOMPRESS_MODE) ?
 			save_image(&handle, &snapshot, pages - 1) :
-			save_image_lzo(&handle, &snapshot, pages - 1);
+			save_image_cmp(&handle, &snapshot, pages - 1, flags);
 	}
 out_finish:
 	error = swap_writer_finish(&handle, flags, error);
@@ -1010,25 +1079,26 @@ static int load_image(struct swap_map_handle *handle,
 }
 
 /**
- * Structure used for LZO data decompression.
+ * Structure used for data decompression.
  */
 struct dec_data {
 	struct task_struct *thr;                  /* thread */
 	atomic_t ready;                           /* ready to start flag */
 	atomic_t stop;                            /* ready to stop flag */
 	int ret;                                  /* return code */
+	const struct hib_comp *comp;              /* decompressor */
 	wait_queue_head_t go;                     /* start decompression */
 	wait_queue_head_t done;                   /* decompression done */
 	size_t unc_len;                           /* uncompressed length */
 	size_t cmp_len;                           /* compressed length */
-	unsigned char unc[LZO_UNC_SIZE];          /* uncompressed buffer */
-	unsigned char cmp[LZO_CMP_SIZE];          /* compressed buffer */
+	unsigned char unc[UNC_SIZE];              /* uncompressed buffer */
+	unsigned char cmp[CMP_SIZE];              /* compressed buffer */
 };
 
 /**
  * Deompression function that runs in its own thread.
  */
-static int lzo_decompress_threadfn(void *data)
+static int decompress_threadfn(void *data)
 {
 	struct dec_data *d = data;
 
@@ -1044,9 +1114,9 @@ static int lzo_decompress_threadfn(void *data)
 		}
 		atomic_set(&d->ready, 0);
 
-		d->unc_len = LZO_UNC_SIZE;
-		d->ret = lzo1x_decompress_safe(d->cmp + LZO_HEADER, d->cmp_len,
-		                               d->unc, &d->unc_len);
+		d->unc_len = UNC_SIZE;
+		d->ret = d->comp->decompress(d->cmp + CMP_HEADER, d->cmp_len,
+		                             d->unc, &d->unc_len);
 		atomic_set(&d->stop, 1);
 		wake_up(&d->done);
 	}
@@ -1054,17 +1124,60 @@ static int lzo_decompress_threadfn(void *data)
 }
 
 /**
- * load_image_lzo - Load compressed image data and decompress them with LZO.
+ * load_image_readahead - Queue reads of compressed image data.
+ * @handle: Swap map handle to use for loading data.
+ * @page: Read ring.
+ * @ring: Next slot of the read ring to fill, updated.
+ * @ring_size: Number of slots in the read ring.
+ * @want: Number of free slots.
+ * @eof: Set once the end of the image data has been reached.
+ * @bio: Bio chain the reads are added to.
+ *
+ * Returns the number of reads queued or a negative error code.
+ */
+static int load_image_readahead(struct swap_map_handle *handle,
+                                unsigned char **page, unsigned *ring,
+                                unsigned ring_size, unsigned want,
+                                int *eof, struct bio **bio)
+{
+	unsigned i;
+	int ret;
+
+	for (i = 0; !*eof && i < want; i++) {
+		ret = swap_read_page(handle, page[*ring], bio);
+		if (ret) {
+			/*
+			 * On real read error, finish. On end of data,
+			 * set EOF flag and just exit the read loop.
+			 */
+			if (handle->cur &&
+			    handle->cur->entries[handle->k])
+				return ret;
+			*eof = 1;
+			break;
+		}
+		if (++*ring >= ring_size)
+			*ring = 0;
+	}
+	return i;
+}
+
+/**
+ * load_image_cmp - Load compressed image data and decompress them.
  * @handle: Swap map handle to use for loading data.
  * @snapshot: Image to copy uncompressed data into.
  * @nr_to_read: Number of pages to load.
+ * @flags: Image flags, select the decompressor.
  */
-static int load_image_lzo(struct swap_map_handle *handle,
+static int load_image_cmp(struct swap_map_handle *handle,
                           struct snapshot_handle *snapshot,
-                          unsigned int nr_to_read)
+                          unsigned int nr_to_read,
+                          unsigned int flags)
 {
+	const struct hib_comp *comp = hib_comp_get(flags);
 	unsigned int m;
 	int ret = 0;
+	int nr;
 	int eof = 0;
 	struct bio *bio;
 	struct timeval start;
@@ -1079,28 +1192,25 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	struct dec_data *data = NULL;
 	struct crc_data *crc = NULL;
 
-	/*
-	 * We'll limit the number of threads for decompression to limit memory
-	 * footprint.
-	 */
-	nr_threads = num_online_cpus() - 1;
-	nr_threads = clamp_val(nr_threads, 1, LZO_THREADS);
+	nr_threads = hib_comp_threads();
 
-	page = vmalloc(sizeof(*page) * LZO_MAX_RD_PAGES);
+	page = vmalloc(sizeof(*page) * CMP_MAX_RD_PAGES);
 	if (!page) {
-		printk(KERN_ERR "PM: Failed to allocate LZO page\n");
+		printk(KERN_ERR "PM: Failed to allocate %s page\n", comp->name);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
 
 	data = vmalloc(sizeof(*data) * nr_threads);
 	if (!data) {
-		printk(KERN_ERR "PM: Failed to allocate LZO data\n");
+		printk(KERN_ERR "PM: Failed to allocate %s data\n", comp->name);
 		ret = -ENOMEM;
 		goto out_clean;
 	}
-	for (thr = 0; thr < nr_threads; thr++)
+	for (thr = 0; thr < nr_threads; thr++) {
 		memset(&data[thr], 0, offsetof(struct dec_data, go));
+		data[thr].comp = comp;
+	}
 
 	crc = kmalloc(sizeof(*crc), GFP_KERNEL);
 	if (!crc) {
@@ -1117,7 +1227,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		init_waitqueue_head(&data[thr].go);
 		init_waitqueue_head(&data[thr].done);
 
-		data[thr].thr = kthread_run(lzo_decompress_threadfn,
+		data[thr].thr = kthread_run(decompress_threadfn,
 		                            &data[thr],
 		                            "image_decompress/%u", thr);
 		if (IS_ERR(data[thr].thr)) {
@@ -1159,19 +1269,20 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	 */
 	if (low_free_pages() > snapshot_get_image_size())
 		read_pages = (low_free_pages() - snapshot_get_image_size()) / 2;
-	read_pages = clamp_val(read_pages, LZO_MIN_RD_PAGES, LZO_MAX_RD_PAGES);
+	read_pages = clamp_val(read_pages, CMP_MIN_RD_PAGES, CMP_MAX_RD_PAGES);
 
 	for (i = 0; i < read_pages; i++) {
-		page[i] = (void *)__get_free_page(i < LZO_CMP_PAGES ?
+		page[i] = (void *)__get_free_page(i < CMP_PAGES ?
 		                                  __GFP_WAIT | __GFP_HIGH :
 		                                  __GFP_WAIT | __GFP_NOWARN |
 		                                  __GFP_NORETRY);
 
 		if (!page[i]) {
-			if (i < LZO_CMP_PAGES) {
+			if (i < CMP_PAGES) {
 				ring_size = i;
 				printk(KERN_ERR
-				       "PM: Failed to allocate LZO pages\n");
+				       "PM: Failed to allocate %s pages\n",
+				       comp->name);
 				ret = -ENOMEM;
 				goto out_clean;
 			} else {
@@ -1182,9 +1293,9 @@ static int load_image_lzo(struct swap_map_handle *handle,
 	want = ring_size = i;
 
 	printk(KERN_INFO
-		"PM: Using %u thread(s) for decompression.\n"
+		"PM: Using %u thread(s) for %s decompression.\n"
 		"PM: Loading and decompressing image data (%u pages)...\n",
-		nr_threads, nr_to_read);
+		nr_threads, comp->name, nr_to_read);
 	m = nr_to_read / 10;
 	if (!m)
 		m = 1;
@@ -1197,26 +1308,14 @@ static int load_image_lzo(struct swap_map_handle *handle,
 		goto out_finish;
 
 	for(;;) {
-		for (i = 0; !eof && i < want; i++) {
-			ret = swap_read_page(handle, page[ring], &bio);
-			if (ret) {
-				/*
-				 * On real read error, finish. On end of data,
-				 * set EOF flag and just exit the read loop.
-				 */
-				if (handle->cur &&
-				    handle->cur->entries[handle->k]) {
-					goto out_finish;
-				} else {
-					eof = 1;
-					break;
-				}
-			}
-			if (++ring >= ring_size)
-				ring = 0;
+		nr = load_image_readahead(handle, page, &ring, ring_size,
+		                          want, &eof, &bio);
+		if (nr < 0) {
+			ret = nr;
+			goto out_finish;
 		}
-		asked += i;
-		want -= i;
+		asked += nr;
+		want -= nr;
 
 		/*
 		 * We are out of data, wait for some more.
@@ -1244,14 +1343,15 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			data[thr].cmp_len = *(size_t *)page[pg];
 			if (unlikely(!data[thr].cmp_len ||
 			             data[thr].cmp_len >
-			             lzo1x_worst_compress(LZO_UNC_SIZE))) {
+			             comp->worst(UNC_SIZE))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO compressed length\n");
+				       "PM: Invalid %s compressed length\n",
+				       comp->name);
 				ret = -1;
 				goto out_finish;
 			}
 
-			need = DIV_ROUND_UP(data[thr].cmp_len + LZO_HEADER,
+			need = DIV_ROUND_UP(data[thr].cmp_len + CMP_HEADER,
 			                    PAGE_SIZE);
 			if (need > have) {
 				if (eof > 1) {
@@ -1262,7 +1362,7 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			}
 
 			for (off = 0;
-			     off < LZO_HEADER + data[thr].cmp_len;
+			     off < CMP_HEADER + data[thr].cmp_len;
 			     off += PAGE_SIZE) {
 				memcpy(data[thr].cmp + off,
 				       page[pg], PAGE_SIZE);
@@ -1276,10 +1376,24 @@ static int load_image_lzo(struct swap_map_handle *handle,
 			wake_up(&data[thr].go);
 		}
 
+		/*
+		 * The ring slots consumed above have been copied out already,
+		 * refill them now so that the reads overlap with decompression
+		 * instead of waiting for all threads to finish first.
+		 */
+		nr = load_image_readahead(handle, page, &ring, ring_size,
+		                          want, &eof, &bio);
+		if (nr < 0) {
+			ret = nr;
+			goto out_finish;
+		}
+		asked += nr;
+		want -= nr;
+
 		/*
 		 * Wait for more data while we are decompressing.
 		 */
-		if (have < LZO_CMP_PAGES && asked) {
+		if (have < CMP_PAGES && asked) {
 			ret = hib_wait_on_bio_chain(&bio);
 			if (ret)
 				goto out_finish;
@@ -1298,15 +1412,17 @@ static int load_image_lzo(struct swap_map_handle *handle,
 
 			if (ret < 0) {
 				printk(KERN_ERR
-				       "PM: LZO decompression failed\n");
+				       "PM: %s decompression failed\n",
+				       comp->name);
 				goto out_finish;
 			}
 
 			if (unlikely(!data[thr].unc_len ||
-			             data[thr].unc_len > LZO_UNC_SIZE ||
+			             data[thr].unc_len > UNC_SIZE ||
 			             data[thr].unc_len & (PAGE_SIZE - 1))) {
 				printk(KERN_ERR
-				       "PM: Invalid LZO uncompressed length\n");
+				       "PM: Invalid %s uncompressed length\n",
+				       comp->name);
 				ret = -1;
 				goto out_finish;
 			}
@@ -1405,7 +1521,8 @@ int swsusp_read(unsigned int *flags_p)
 	if (!error) {
 		error = (*flags_p & SF_NOCOMPRESS_MODE) ?
 			load_image(&handle, &snapshot, header->pages - 1) :
-			load_image_lzo(&handle, &snapshot, header->pages - 1);
+			load_image_cmp(&handle, &snapshot, header->pages - 1,
+			               *flags_p);
 	}
 	swap_reader_finish(&handle);
 end:
@@ -2058,6 +2058,22 @@ bool rcu_is_nocb_cpu(int cpu)
 	return false;
 }
 
+/*
+ * Make the specified CPUs no-CBs CPUs in addition to those selected at
+ * build or boot time.  Used for full dynticks CPUs, must be called before
+ * these CPUs come online.
+ */
+bool __init rcu_nocb_add_cpus(const struct cpumask *mask)
+{
+	if (!have_rcu_nocb_mask) {
+		if (!zalloc_cpumask_var(&rcu_nocb_mask, GFP_KERNEL))
+			return false;
+		have_rcu_nocb_mask = true;
+	}
+	cpumask_or(rcu_nocb_mask, rcu_nocb_mask, mask);
+	return true;
+}
+
 /*
  * Enqueue the specified string of rcu_head structures onto the specified
  * CPU's no-CBs lists.  The CPU is specified by rdp, the head of the
@@ -2275,6 +2291,7 @@ static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp)
 		t = kthread_run(rcu_nocb_kthread, rdp,
 				"rcuo%c/%d", rsp->abbr, cpu);
 		BUG_ON(IS_ERR(t));
+		tick_nohz_housekeeping_affine(t);
 		ACCESS_ONCE(rdp->nocb_kthread) = t;
 	}
 }
@@ -186,6 +186,8 @@ static void tick_sched_handle(struct tick_sched *ts, struct pt_regs *regs)
 
 #ifdef CONFIG_NO_HZ_FULL
 static cpumask_var_t nohz_full_mask;
+static cpumask_var_t housekeeping_mask;
+static bool have_housekeeping_mask;
 bool have_nohz_full_mask;
 
 static bool can_stop_full_tick(void)
@@ -308,6 +310,18 @@ int tick_nohz_full_cpu(int cpu)
 	return cpumask_test_cpu(cpu, nohz_full_mask);
 }
 
+/*
+ * Keep a kernel thread doing deferred work on behalf of the full dynticks
+ * CPUs (RCU callback offloading, ...) away from them.
+ */
+void tick_nohz_housekeeping_affine(struct task_struct *t)
+{
+	if (!have_nohz_full_mask || !have_housekeeping_mask)
+		return;
+
+	set_cpus_allowed_ptr(t, housekeeping_mask);
+}
+
 /* Parse the boot-time nohz CPU list from the kernel parameters. */
 static int __init tick_nohz_full_setup(char *str)
 {
@@ -384,6 +398,15 @@ void __init tick_nohz_init(void)
 
 	cpu_notifier(tick_nohz_cpu_down_callback, 0);
 
+	/*
+	 * Full dynticks CPUs can't be relied on to invoke their RCU
+	 * callbacks without the tick, offload them to the housekeeping
+	 * CPUs. The secondary CPUs are not online yet, so this takes
+	 * effect before any callback is queued there.
+	 */
+	if (!rcu_nocb_add_cpus(nohz_full_mask))
+		pr_warning("NO_HZ: Can't offload RCU callbacks\n");
+
 	/* Make sure full dynticks CPU are also RCU nocbs */
 	for_each_cpu(cpu, nohz_full_mask) {
 		if (!rcu_is_nocb_cpu(cpu)) {
@@ -393,6 +416,12 @@ void __init tick_nohz_init(void)
 		}
 	}
 
+	if (alloc_cpumask_var(&housekeeping_mask, GFP_KERNEL)) {
+		cpumask_andnot(housekeeping_mask,
+			       cpu_possible_mask, nohz_full_mask);
+		have_housekeeping_mask = true;
+	}
+
 	cpulist_scnprintf(nohz_full_buf, sizeof(nohz_full_buf), nohz_full_mask);
 	pr_info("NO_HZ: Full dynticks CPUs: %s.\n", nohz_full_buf);
 }
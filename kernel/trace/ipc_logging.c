@@ -51,184 +51,158 @@ static struct ipc_log_page *get_first_page(struct ipc_log_context *ilctxt)
 	return pg;
 }
 
-/**
- * is_nd_read_empty - Returns true if no data is available to read in log
- *
- * @ilctxt: logging context
- * @returns: > 1 if context is empty; 0 if not empty; <0 for failure
- *
- * This is for the debugfs read pointer which allows for a non-destructive read.
- * There may still be data in the log, but it may have already been read.
+/*
+ * Returns the offset within the ring data that corresponds to the
+ * free running position @pos.
  */
-static int is_nd_read_empty(struct ipc_log_context *ilctxt)
+static inline uint32_t ring_offset(struct ipc_log_cpu_ring *ring,
+				   uint64_t pos)
 {
-	if (!ilctxt)
-		return -EINVAL;
+	return do_div(pos, ring->size);
+}
 
-	return ((ilctxt->nd_read_page == ilctxt->write_page) &&
-		(ilctxt->nd_read_page->hdr.nd_read_offset ==
-		 ilctxt->write_page->hdr.write_offset));
+static inline struct ipc_log_page *ring_page(struct ipc_log_cpu_ring *ring,
+					     uint32_t offset)
+{
+	return ring->pages[offset / LOG_PAGE_DATA_SIZE];
 }
 
 /**
- * is_read_empty - Returns true if no data is available in log
+ * ring_read - copy data out of a ring
  *
- * @ilctxt: logging context
- * @returns: > 1 if context is empty; 0 if not empty; <0 for failure
+ * @ring:  Ring to read from
+ * @pos:  Free running position of the first byte
+ * @data:  Buffer receiving the data
+ * @data_size:  Number of bytes to copy, which never cross a page
  *
- * This is for the actual log contents.  If it is empty, then there
- * is no data at all in the log.
+ * The caller has to check afterwards that the data was not overwritten by
+ * the writer.
  */
-static int is_read_empty(struct ipc_log_context *ilctxt)
+static void ring_read(struct ipc_log_cpu_ring *ring, uint64_t pos,
+		      void *data, int data_size)
 {
-	if (!ilctxt)
-		return -EINVAL;
+	uint32_t offset = ring_offset(ring, pos);
 
-	return ((ilctxt->read_page == ilctxt->write_page) &&
-		(ilctxt->read_page->hdr.read_offset ==
-		 ilctxt->write_page->hdr.write_offset));
+	memcpy(data, ring_page(ring, offset)->data +
+	       offset % LOG_PAGE_DATA_SIZE, data_size);
 }
 
-/**
- * is_nd_read_equal_read - Return true if the non-destructive read is equal to
- * the destructive read
- *
- * @ilctxt: logging context
- * @returns: true if nd read is equal to read; false otherwise
+/*
+ * Returns a consistent snapshot of the write and overwrite positions of a
+ * ring that may be concurrently written by its owning CPU.
  */
-static bool is_nd_read_equal_read(struct ipc_log_context *ilctxt)
+static void ring_snapshot(struct ipc_log_cpu_ring *ring,
+			  uint64_t *head, uint64_t *tail)
 {
-	uint16_t read_offset;
-	uint16_t nd_read_offset;
-
-	if (ilctxt->nd_read_page == ilctxt->read_page) {
-		read_offset = ilctxt->read_page->hdr.read_offset;
-		nd_read_offset = ilctxt->nd_read_page->hdr.nd_read_offset;
-
-		if (read_offset == nd_read_offset)
-			return true;
-	}
+	unsigned seq;
 
-	return false;
+	do {
+		seq = read_seqcount_begin(&ring->seq);
+		*head = ring->head;
+		*tail = ring->tail;
+	} while (read_seqcount_retry(&ring->seq, seq));
 }
 
-
-static struct ipc_log_page *get_next_page(struct ipc_log_context *ilctxt,
-					  struct ipc_log_page *cur_pg)
+static uint64_t ring_tail(struct ipc_log_cpu_ring *ring)
 {
-	struct ipc_log_page_header *p_pghdr;
-	struct ipc_log_page *pg = NULL;
-
-	if (!ilctxt || !cur_pg)
-		return NULL;
+	uint64_t head, tail;
 
-	if (ilctxt->last_page == cur_pg)
-		return ilctxt->first_page;
-
-	p_pghdr = list_first_entry(&cur_pg->hdr.list,
-			struct ipc_log_page_header, list);
-	pg = container_of(p_pghdr, struct ipc_log_page, hdr);
-
-	return pg;
+	ring_snapshot(ring, &head, &tail);
+	return tail;
 }
 
 /**
- * ipc_log_read - do non-destructive read of the log
+ * ring_peek - look at the next unread message of a ring
+ *
+ * @ring:  Ring to look at
+ * @ts:  Receives the timestamp of the message
  *
- * @ilctxt:  Logging context
- * @data:  Data pointer to receive the data
- * @data_size:  Number of bytes to read (must be <= bytes available in log)
+ * @returns 0 - no message available; >0 message size
  *
- * This read will update a runtime read pointer, but will not affect the actual
- * contents of the log which allows for reading the logs continuously while
- * debugging and if the system crashes, then the full logs can still be
- * extracted.
+ * Messages which do not start with a timestamp inherit the timestamp of the
+ * previous message read from the same ring so they keep their relative order
+ * when the rings are merged.
  */
-static void ipc_log_read(struct ipc_log_context *ilctxt,
-			 void *data, int data_size)
+static int ring_peek(struct ipc_log_cpu_ring *ring, uint64_t *ts)
 {
-	int bytes_to_read;
-
-	bytes_to_read = MIN(LOG_PAGE_DATA_SIZE
-				- ilctxt->nd_read_page->hdr.nd_read_offset,
-			      data_size);
-
-	memcpy(data, (ilctxt->nd_read_page->data +
-		ilctxt->nd_read_page->hdr.nd_read_offset), bytes_to_read);
+	struct tsv_header hdr, ts_hdr;
+	struct ipc_log_page *pg;
+	uint64_t head, tail;
+	uint32_t offset, pg_offset;
+
+	for (;;) {
+		ring_snapshot(ring, &head, &tail);
+		if (ring->nd_read < tail)
+			ring->nd_read = tail;
+		if (ring->nd_read == head)
+			return 0;
+
+		/*
+		 * The writer went on to the next page if the rest of this
+		 * one was too short for its message, skip the unused end.
+		 */
+		offset = ring_offset(ring, ring->nd_read);
+		pg = ring_page(ring, offset);
+		pg_offset = offset % LOG_PAGE_DATA_SIZE;
+		if (pg_offset >= ACCESS_ONCE(pg->hdr.write_offset)) {
+			smp_rmb();
+			if (ring_tail(ring) <= ring->nd_read)
+				ring->nd_read += LOG_PAGE_DATA_SIZE - pg_offset;
+			continue;
+		}
 
-	if (bytes_to_read != data_size) {
-		/* not enough space, wrap read to next page */
-		ilctxt->nd_read_page->hdr.nd_read_offset = 0;
-		ilctxt->nd_read_page = get_next_page(ilctxt,
-			ilctxt->nd_read_page);
-		BUG_ON(ilctxt->nd_read_page == NULL);
+		*ts = ring->nd_read_ts;
+		ring_read(ring, ring->nd_read, &hdr, sizeof(hdr));
+		if (hdr.size >= sizeof(ts_hdr) + sizeof(*ts)) {
+			ring_read(ring, ring->nd_read + sizeof(hdr),
+				  &ts_hdr, sizeof(ts_hdr));
+			if (ts_hdr.type == TSV_TYPE_TIMESTAMP)
+				ring_read(ring, ring->nd_read + sizeof(hdr) +
+					  sizeof(ts_hdr), ts, sizeof(*ts));
+		}
 
-		memcpy((data + bytes_to_read),
-			   (ilctxt->nd_read_page->data +
-			ilctxt->nd_read_page->hdr.nd_read_offset),
-			   (data_size - bytes_to_read));
-		bytes_to_read = (data_size - bytes_to_read);
+		/* retry if the writer wrapped over the message meanwhile */
+		smp_rmb();
+		if (ring_tail(ring) <= ring->nd_read)
+			return sizeof(hdr) + hdr.size;
 	}
-	ilctxt->nd_read_page->hdr.nd_read_offset += bytes_to_read;
 }
 
 /**
- * ipc_log_drop - do destructive read of the log
+ * ring_read_msg - read the next message of a ring
+ *
+ * @ring:  Ring to read from, ring_peek() must have found a message
+ * @ectxt:  Message context
+ * @ts:  Timestamp returned by ring_peek()
  *
- * @ilctxt:  Logging context
- * @data:  Data pointer to receive the data (or NULL)
- * @data_size:  Number of bytes to read (must be <= bytes available in log)
+ * @returns >0 message size; -EAGAIN if the message was overwritten
  */
-static void ipc_log_drop(struct ipc_log_context *ilctxt, void *data,
-		int data_size)
-{
-	int bytes_to_read;
-	bool push_nd_read;
-
-	bytes_to_read = MIN(LOG_PAGE_DATA_SIZE
-				- ilctxt->read_page->hdr.read_offset,
-			      data_size);
-	if (data)
-		memcpy(data, (ilctxt->read_page->data +
-			ilctxt->read_page->hdr.read_offset), bytes_to_read);
-
-	if (bytes_to_read != data_size) {
-		/* not enough space, wrap read to next page */
-		push_nd_read = is_nd_read_equal_read(ilctxt);
-
-		ilctxt->read_page->hdr.read_offset = 0;
-		if (push_nd_read) {
-			ilctxt->read_page->hdr.nd_read_offset = 0;
-			ilctxt->read_page = get_next_page(ilctxt,
-				ilctxt->read_page);
-			BUG_ON(ilctxt->read_page == NULL);
-			ilctxt->nd_read_page = ilctxt->read_page;
-		} else {
-			ilctxt->read_page = get_next_page(ilctxt,
-				ilctxt->read_page);
-			BUG_ON(ilctxt->read_page == NULL);
-		}
+static int ring_read_msg(struct ipc_log_cpu_ring *ring,
+			 struct encode_context *ectxt, uint64_t ts)
+{
+	struct tsv_header hdr;
+	int size;
 
-		if (data)
-			memcpy((data + bytes_to_read),
-				   (ilctxt->read_page->data +
-				ilctxt->read_page->hdr.read_offset),
-				   (data_size - bytes_to_read));
+	ring_read(ring, ring->nd_read, &hdr, sizeof(hdr));
+	size = min_t(int, hdr.size, MAX_MSG_SIZE - sizeof(hdr));
+	ring_read(ring, ring->nd_read + sizeof(hdr),
+		  ectxt->buff + sizeof(hdr), size);
 
-		bytes_to_read = (data_size - bytes_to_read);
-	}
+	smp_rmb();
+	if (ring_tail(ring) > ring->nd_read)
+		return -EAGAIN;
 
-	/* update non-destructive read pointer if necessary */
-	push_nd_read = is_nd_read_equal_read(ilctxt);
-	ilctxt->read_page->hdr.read_offset += bytes_to_read;
-	ilctxt->write_avail += data_size;
+	ectxt->hdr.type = hdr.type;
+	ectxt->hdr.size = size;
+	ectxt->offset = sizeof(hdr);
+	ring->nd_read += sizeof(hdr) + hdr.size;
+	ring->nd_read_ts = ts;
 
-	if (push_nd_read)
-		ilctxt->nd_read_page->hdr.nd_read_offset += bytes_to_read;
+	return sizeof(hdr) + size;
 }
 
 /**
- * msg_read - Reads a message.
+ * msg_read - Reads the oldest unread message of all CPUs.
  *
  * If a message is read successfully, then the message context
  * will be set to:
@@ -239,51 +213,92 @@ static void ipc_log_drop(struct ipc_log_context *ilctxt, void *data,
  * @ectxt   Message context
  *
  * @returns 0 - no message available; >0 message size; <0 error
+ *
+ * Must be called with ilctxt::context_lock_lhb1 held.
  */
 static int msg_read(struct ipc_log_context *ilctxt,
 	     struct encode_context *ectxt)
 {
-	struct tsv_header hdr;
+	struct ipc_log_cpu_ring *ring, *oldest;
+	uint64_t ts, oldest_ts = 0;
+	int i, ret;
 
 	if (!ectxt)
 		return -EINVAL;
 
-	if (is_nd_read_empty(ilctxt))
-		return 0;
+	do {
+		oldest = NULL;
+		for (i = 0; i < ilctxt->nr_rings; i++) {
+			ring = &ilctxt->rings[i];
+			if (!ring_peek(ring, &ts))
+				continue;
+			if (!oldest || ts < oldest_ts) {
+				oldest = ring;
+				oldest_ts = ts;
+			}
+		}
+		if (!oldest)
+			return 0;
 
-	ipc_log_read(ilctxt, &hdr, sizeof(hdr));
-	ectxt->hdr.type = hdr.type;
-	ectxt->hdr.size = hdr.size;
-	ectxt->offset = sizeof(hdr);
-	ipc_log_read(ilctxt, (ectxt->buff + ectxt->offset),
-			 (int)hdr.size);
+		ret = ring_read_msg(oldest, ectxt, oldest_ts);
+	} while (ret == -EAGAIN);
 
-	return sizeof(hdr) + (int)hdr.size;
+	return ret;
 }
 
 /**
- * msg_drop - Drops a message.
+ * ipc_log_is_nd_read_empty - Returns true if no unread data is in the log
  *
- * @ilctxt	Logging context
+ * @ilctxt: logging context
+ *
+ * This is for the debugfs read pointers which allow for a non-destructive
+ * read.  There may still be data in the log, but it may have already been
+ * read.
  */
-static void msg_drop(struct ipc_log_context *ilctxt)
+bool ipc_log_is_nd_read_empty(struct ipc_log_context *ilctxt)
 {
-	struct tsv_header hdr;
-
-	if (!is_read_empty(ilctxt)) {
-		ipc_log_drop(ilctxt, &hdr, sizeof(hdr));
-		ipc_log_drop(ilctxt, NULL, (int)hdr.size);
+	struct ipc_log_cpu_ring *ring;
+	uint64_t head, tail;
+	unsigned long flags;
+	bool empty = true;
+	int i;
+
+	spin_lock_irqsave(&ilctxt->context_lock_lhb1, flags);
+	for (i = 0; i < ilctxt->nr_rings; i++) {
+		ring = &ilctxt->rings[i];
+		ring_snapshot(ring, &head, &tail);
+		if (max(ring->nd_read, tail) != head) {
+			empty = false;
+			break;
+		}
 	}
+	spin_unlock_irqrestore(&ilctxt->context_lock_lhb1, flags);
+
+	return empty;
 }
 
 /*
- * Commits messages to the FIFO.  If the FIFO is full, then enough
- * messages are dropped to create space for the new message.
+ * Commits messages to the ring of the current CPU.  If the ring is full,
+ * then its oldest page is dropped to create space for the new message.
+ *
+ * No global or per-context lock is taken.  Each CPU writes its own ring,
+ * whose lock is only ever contended when the context has fewer pages than
+ * there are possible CPUs and some CPUs share a ring.  Interrupts are
+ * disabled so that messages logged from interrupt context cannot
+ * interleave with the one being written.  Readers on other CPUs
+ * synchronize through ring->seq.
+ *
+ * A message never straddles two pages, the end of a page too short for it
+ * is left unused, so that every page of a memory dump can be decoded on
+ * its own from its header.
  */
 void ipc_log_write(void *ctxt, struct encode_context *ectxt)
 {
 	struct ipc_log_context *ilctxt = (struct ipc_log_context *)ctxt;
-	int bytes_to_write;
+	struct ipc_log_cpu_ring *ring;
+	struct ipc_log_page *pg;
+	uint64_t head, tail;
+	uint32_t pg_offset;
 	unsigned long flags;
 
 	if (!ilctxt || !ectxt) {
@@ -291,39 +306,51 @@ void ipc_log_write(void *ctxt, struct encode_context *ectxt)
 		return;
 	}
 
-	read_lock_irqsave(&context_list_lock_lha1, flags);
-	spin_lock(&ilctxt->context_lock_lhb1);
-	while (ilctxt->write_avail <= ectxt->offset)
-		msg_drop(ilctxt);
-
-	bytes_to_write = MIN(LOG_PAGE_DATA_SIZE
-				- ilctxt->write_page->hdr.write_offset,
-				ectxt->offset);
-	memcpy((ilctxt->write_page->data +
-		ilctxt->write_page->hdr.write_offset),
-		ectxt->buff, bytes_to_write);
-
-	if (bytes_to_write != ectxt->offset) {
-		uint64_t t_now = sched_clock();
-
-		ilctxt->write_page->hdr.write_offset += bytes_to_write;
-		ilctxt->write_page->hdr.end_time = t_now;
-
-		ilctxt->write_page = get_next_page(ilctxt, ilctxt->write_page);
-		BUG_ON(ilctxt->write_page == NULL);
-		ilctxt->write_page->hdr.write_offset = 0;
-		ilctxt->write_page->hdr.start_time = t_now;
-		memcpy((ilctxt->write_page->data +
-			ilctxt->write_page->hdr.write_offset),
-		       (ectxt->buff + bytes_to_write),
-		       (ectxt->offset - bytes_to_write));
-		bytes_to_write = (ectxt->offset - bytes_to_write);
+	local_irq_save(flags);
+	ring = &ilctxt->rings[smp_processor_id() % ilctxt->nr_rings];
+	spin_lock(&ring->lock);
+	head = ring->head;
+	tail = ring->tail;
+
+	pg = ring_page(ring, ring_offset(ring, head));
+	pg_offset = ring_offset(ring, head) % LOG_PAGE_DATA_SIZE;
+	if (pg_offset + ectxt->offset > LOG_PAGE_DATA_SIZE) {
+		/* leave the rest of the page unused */
+		pg->hdr.end_time = sched_clock();
+		head += LOG_PAGE_DATA_SIZE - pg_offset;
+		pg = ring_page(ring, ring_offset(ring, head));
+		pg_offset = 0;
+	}
+
+	if (pg_offset == 0) {
+		if (head - tail >= ring->size) {
+			/*
+			 * Drop the oldest page, publishing the new tail
+			 * before its data is overwritten.
+			 */
+			write_seqcount_begin(&ring->seq);
+			ring->tail = head - ring->size + LOG_PAGE_DATA_SIZE;
+			write_seqcount_end(&ring->seq);
+		}
+		pg->hdr.start_time = sched_clock();
+		pg->hdr.read_offset = 0;
+		pg->hdr.write_offset = 0;
 	}
-	ilctxt->write_page->hdr.write_offset += bytes_to_write;
-	ilctxt->write_avail -= ectxt->offset;
-	complete(&ilctxt->read_avail);
-	spin_unlock(&ilctxt->context_lock_lhb1);
-	read_unlock_irqrestore(&context_list_lock_lha1, flags);
+
+	memcpy(pg->data + pg_offset, ectxt->buff, ectxt->offset);
+	pg->hdr.write_offset = pg_offset + ectxt->offset;
+
+	/* commit */
+	write_seqcount_begin(&ring->seq);
+	ring->head = head + ectxt->offset;
+	write_seqcount_end(&ring->seq);
+	spin_unlock(&ring->lock);
+	local_irq_restore(flags);
+
+	/* order the commit against the waitqueue_active() check */
+	smp_mb();
+	if (waitqueue_active(&ilctxt->read_wait))
+		wake_up_interruptible(&ilctxt->read_wait);
 }
 EXPORT_SYMBOL(ipc_log_write);
 
@@ -507,9 +534,8 @@ EXPORT_SYMBOL(ipc_log_string);
  * @size:    size of the buffer
  * @returns: 0 if no data read; >0 number of bytes read; < 0 error
  *
- * If no data is available to be read, then the ilctxt::read_avail
- * completion is reinitialized.  This allows clients to block
- * until new log data is save.
+ * Messages of all CPUs are merged in timestamp order.  Clients that want
+ * to block until new log data is saved can wait on ilctxt::read_wait.
  */
 int ipc_log_extract(void *ctxt, char *buff, int size)
 {
@@ -526,27 +552,20 @@ int ipc_log_extract(void *ctxt, char *buff, int size)
 	dctxt.output_format = OUTPUT_DEBUGFS;
 	dctxt.buff = buff;
 	dctxt.size = size;
-	read_lock_irqsave(&context_list_lock_lha1, flags);
-	spin_lock(&ilctxt->context_lock_lhb1);
+	spin_lock_irqsave(&ilctxt->context_lock_lhb1, flags);
 	while (dctxt.size >= MAX_MSG_DECODED_SIZE &&
-	       !is_nd_read_empty(ilctxt)) {
-		msg_read(ilctxt, &ectxt);
+	       msg_read(ilctxt, &ectxt) > 0) {
 		deserialize_func = get_deserialization_func(ilctxt,
 							ectxt.hdr.type);
-		spin_unlock(&ilctxt->context_lock_lhb1);
-		read_unlock_irqrestore(&context_list_lock_lha1, flags);
+		spin_unlock_irqrestore(&ilctxt->context_lock_lhb1, flags);
 		if (deserialize_func)
 			deserialize_func(&ectxt, &dctxt);
 		else
 			pr_err("%s: unknown message 0x%x\n",
 				__func__, ectxt.hdr.type);
-		read_lock_irqsave(&context_list_lock_lha1, flags);
-		spin_lock(&ilctxt->context_lock_lhb1);
+		spin_lock_irqsave(&ilctxt->context_lock_lhb1, flags);
 	}
-	if ((size - dctxt.size) == 0)
-		INIT_COMPLETION(ilctxt->read_avail);
-	spin_unlock(&ilctxt->context_lock_lhb1);
-	read_unlock_irqrestore(&context_list_lock_lha1, flags);
+	spin_unlock_irqrestore(&ilctxt->context_lock_lhb1, flags);
 	return size - dctxt.size;
 }
 EXPORT_SYMBOL(ipc_log_extract);
@@ -682,13 +701,11 @@ int add_deserialization_func(void *ctxt, int type,
 	if (!df_info)
 		return -ENOSPC;
 
-	read_lock_irqsave(&context_list_lock_lha1, flags);
-	spin_lock(&ilctxt->context_lock_lhb1);
+	spin_lock_irqsave(&ilctxt->context_lock_lhb1, flags);
 	df_info->type = type;
 	df_info->dfunc = dfunc;
 	list_add_tail(&df_info->list, &ilctxt->dfunc_info_list);
-	spin_unlock(&ilctxt->context_lock_lhb1);
-	read_unlock_irqrestore(&context_list_lock_lha1, flags);
+	spin_unlock_irqrestore(&ilctxt->context_lock_lhb1, flags);
 	return 0;
 }
 EXPORT_SYMBOL(add_deserialization_func);
@@ -708,6 +725,64 @@ static void *get_deserialization_func(struct ipc_log_context *ilctxt,
 	return NULL;
 }
 
+static void ipc_log_free_pages(struct ipc_log_context *ilctxt)
+{
+	struct ipc_log_page *pg;
+	int i;
+
+	while (!list_empty(&ilctxt->page_list)) {
+		pg = get_first_page(ilctxt);
+		list_del(&pg->hdr.list);
+		kfree(pg);
+	}
+
+	if (ilctxt->rings) {
+		for (i = 0; i < ilctxt->nr_rings; i++)
+			kfree(ilctxt->rings[i].pages);
+		kfree(ilctxt->rings);
+	}
+}
+
+/*
+ * Spreads the pages of a context evenly over one ring per possible CPU,
+ * or over one ring per page if there are fewer pages than CPUs.  Each
+ * ring takes a run of consecutive pages of the page list.
+ */
+static int ipc_log_setup_rings(struct ipc_log_context *ctxt, int num_pages)
+{
+	struct ipc_log_page_header *p_pghdr;
+	struct ipc_log_cpu_ring *ring;
+	int nr_rings = min_t(int, num_pages, num_possible_cpus());
+	int i, n;
+
+	ctxt->rings = kcalloc(nr_rings, sizeof(*ctxt->rings), GFP_KERNEL);
+	if (!ctxt->rings)
+		return -ENOMEM;
+	ctxt->nr_rings = nr_rings;
+
+	p_pghdr = list_first_entry(&ctxt->page_list,
+				   struct ipc_log_page_header, list);
+	for (n = 0; n < nr_rings; n++) {
+		ring = &ctxt->rings[n];
+		ring->nr_pages = num_pages / nr_rings +
+				 (n < num_pages % nr_rings);
+		ring->pages = kcalloc(ring->nr_pages, sizeof(*ring->pages),
+				      GFP_KERNEL);
+		if (!ring->pages)
+			return -ENOMEM;
+
+		for (i = 0; i < ring->nr_pages; i++) {
+			ring->pages[i] = container_of(p_pghdr,
+						struct ipc_log_page, hdr);
+			p_pghdr = list_next_entry(p_pghdr, list);
+		}
+		ring->size = ring->nr_pages * LOG_PAGE_DATA_SIZE;
+		spin_lock_init(&ring->lock);
+		seqcount_init(&ring->seq);
+	}
+	return 0;
+}
+
 /**
  * ipc_log_context_create: Create a debug log context
  *                         Should not be called from atomic context
@@ -716,6 +791,11 @@ static void *get_deserialization_func(struct ipc_log_context *ilctxt,
  * @mod_name     : Name of the directory entry under DEBUGFS
  * @user_version : Version number of user-defined message formats
  *
+ * The pages are shared out between per-CPU rings, so a CPU which logs
+ * much more than the others keeps a shorter history than it would with
+ * all pages to itself.  With fewer pages than possible CPUs, some CPUs
+ * share a ring.
+ *
  * returns context id on success, NULL on failure
  */
 void *ipc_log_context_create(int max_num_pages,
@@ -732,7 +812,7 @@ void *ipc_log_context_create(int max_num_pages,
 		return 0;
 	}
 
-	init_completion(&ctxt->read_avail);
+	init_waitqueue_head(&ctxt->read_wait);
 	INIT_LIST_HEAD(&ctxt->page_list);
 	INIT_LIST_HEAD(&ctxt->dfunc_info_list);
 	spin_lock_init(&ctxt->context_lock_lhb1);
@@ -751,21 +831,18 @@ void *ipc_log_context_create(int max_num_pages,
 		pg->hdr.magic = IPC_LOGGING_MAGIC_NUM;
 		pg->hdr.nmagic = ~(IPC_LOGGING_MAGIC_NUM);
 
-		spin_lock_irqsave(&ctxt->context_lock_lhb1, flags);
 		list_add_tail(&pg->hdr.list, &ctxt->page_list);
-		spin_unlock_irqrestore(&ctxt->context_lock_lhb1, flags);
+	}
+
+	if (ipc_log_setup_rings(ctxt, max_num_pages)) {
+		pr_err("%s: cannot create ipc_log rings\n", __func__);
+		goto release_ipc_log_context;
 	}
 
 	ctxt->log_id = (uint64_t)(uintptr_t)ctxt;
 	ctxt->version = IPC_LOG_VERSION;
 	strlcpy(ctxt->name, mod_name, IPC_LOG_MAX_CONTEXT_NAME_LEN);
 	ctxt->user_version = user_version;
-	ctxt->first_page = get_first_page(ctxt);
-	ctxt->last_page = pg;
-	ctxt->write_page = ctxt->first_page;
-	ctxt->read_page = ctxt->first_page;
-	ctxt->nd_read_page = ctxt->first_page;
-	ctxt->write_avail = max_num_pages * LOG_PAGE_DATA_SIZE;
 	ctxt->header_size = sizeof(struct ipc_log_page_header);
 	create_ctx_debugfs(ctxt, mod_name);
 
@@ -779,11 +856,7 @@ void *ipc_log_context_create(int max_num_pages,
 	return (void *)ctxt;
 
 release_ipc_log_context:
-	while (page_cnt-- > 0) {
-		pg = get_first_page(ctxt);
-		list_del(&pg->hdr.list);
-		kfree(pg);
-	}
+	ipc_log_free_pages(ctxt);
 	kfree(ctxt);
 	return 0;
 }
@@ -797,22 +870,16 @@ EXPORT_SYMBOL(ipc_log_context_create);
 int ipc_log_context_destroy(void *ctxt)
 {
 	struct ipc_log_context *ilctxt = (struct ipc_log_context *)ctxt;
-	struct ipc_log_page *pg = NULL;
 	unsigned long flags;
 
 	if (!ilctxt)
 		return 0;
 
-	while (!list_empty(&ilctxt->page_list)) {
-		pg = get_first_page(ctxt);
-		list_del(&pg->hdr.list);
-		kfree(pg);
-	}
-
 	write_lock_irqsave(&context_list_lock_lha1, flags);
 	list_del(&ilctxt->list);
 	write_unlock_irqrestore(&context_list_lock_lha1, flags);
 
+	ipc_log_free_pages(ilctxt);
 	kfree(ilctxt);
 	return 0;
 }
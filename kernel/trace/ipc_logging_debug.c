@@ -47,8 +47,8 @@ static int debug_log(struct ipc_log_context *ilctxt,
 	do {
 		i = ipc_log_extract(ilctxt, buff, size - 1);
 		if (cont && i == 0) {
-			ret = wait_for_completion_interruptible(
-				&ilctxt->read_avail);
+			ret = wait_event_interruptible(ilctxt->read_wait,
+					!ipc_log_is_nd_read_empty(ilctxt));
 			if (ret < 0)
 				return ret;
 		}
@@ -14,6 +14,8 @@
 #define _IPC_LOGGING_PRIVATE_H
 
 #include <linux/ipc_logging.h>
+#include <linux/seqlock.h>
+#include <linux/wait.h>
 
 #define IPC_LOG_VERSION 0x0001
 #define IPC_LOG_MAX_CONTEXT_NAME_LEN 20
@@ -33,7 +35,6 @@
  *               optimize ram-dump extraction.
  *
  * @list:  Linked list of pages that make up a log
- * @nd_read_offset:  Non-destructive read offset used for debugfs
  *
  * The first part of the structure defines data that is used to extract the
  * logs from a memory dump and elements in this section should not be changed
@@ -53,7 +54,6 @@ struct ipc_log_page_header {
 
 	/* add local data structures after this point */
 	struct list_head list;
-	uint16_t nd_read_offset;
 };
 
 /**
@@ -70,6 +70,49 @@ struct ipc_log_page {
 	char data[PAGE_SIZE - sizeof(struct ipc_log_page_header)];
 };
 
+/**
+ * struct ipc_log_cpu_ring - per-CPU ring of log pages
+ *
+ * @pages:  Pages making up the ring, in write order
+ * @nr_pages:  Number of entries in @pages
+ * @size:  Number of data bytes in the ring
+ * @head:  Committed write position (bytes written since creation)
+ * @tail:  Position of the oldest message still held by the ring
+ * @lock:  Serializes the writers of the ring
+ * @seq:  Protects @head and @tail against torn reads by other CPUs
+ * @nd_read:  Non-destructive read position used for debugfs
+ * @nd_read_ts:  Timestamp of the last message consumed through @nd_read
+ *
+ * Each CPU writes its own ring, with interrupts disabled, so the write path
+ * never touches a cache line shared with another CPU.  Only a context with
+ * fewer pages than possible CPUs has CPUs share a ring and contend on
+ * @lock.  The positions are free running and map to ring offsets modulo
+ * @size.  The writer publishes a new @tail before overwriting old data and
+ * a new @head after the message data is in place; readers copy
+ * optimistically and re-check @tail afterwards to detect messages
+ * overwritten under them.
+ *
+ * A message never straddles two pages and a full ring drops its oldest
+ * page as a whole, so the header of every page describes complete
+ * messages from read_offset, always 0, up to write_offset.  Ram-dump
+ * extraction can keep decoding the pages one by one as before; only the
+ * order of the messages logged on different CPUs has to be restored from
+ * their timestamps.
+ */
+struct ipc_log_cpu_ring {
+	struct ipc_log_page **pages;
+	unsigned int nr_pages;
+	uint32_t size;
+	uint64_t head;
+	uint64_t tail;
+	spinlock_t lock;
+	seqcount_t seq;
+
+	/* reader state, protected by ipc_log_context::context_lock_lhb1 */
+	uint64_t nd_read;
+	uint64_t nd_read_ts;
+} ____cacheline_aligned_in_smp;
+
 /**
  * struct ipc_log_context - main logging context
  *
@@ -83,18 +126,14 @@ struct ipc_log_page {
  * @name:  Name of the log used to uniquely identify the log during extraction
  *
  * @list:  List of log contexts (struct ipc_log_context)
- * @page_list:  List of log pages (struct ipc_log_page)
- * @first_page:  First page in list of logging pages
- * @last_page:  Last page in list of logging pages
- * @write_page:  Current write page
- * @read_page:  Current read page (for internal reads)
- * @nd_read_page:  Current debugfs extraction page (non-destructive)
+ * @page_list:  List of all log pages (struct ipc_log_page)
+ * @rings:  Per-CPU rings the pages of @page_list are distributed over
+ * @nr_rings:  Number of entries in @rings
  *
- * @write_avail:  Number of bytes available to write in all pages
  * @dent:  Debugfs node for run-time log extraction
  * @dfunc_info_list:  List of deserialization functions
- * @context_lock_lhb1:  Lock for entire structure
- * @read_avail:  Completed when new data is added to the log
+ * @context_lock_lhb1:  Lock for the reader state and @dfunc_info_list
+ * @read_wait:  Woken up when new data is added to the log
  */
 struct ipc_log_context {
 	uint32_t magic;
@@ -108,17 +147,13 @@ struct ipc_log_context {
 	/* add local data structures after this point */
 	struct list_head list;
 	struct list_head page_list;
-	struct ipc_log_page *first_page;
-	struct ipc_log_page *last_page;
-	struct ipc_log_page *write_page;
-	struct ipc_log_page *read_page;
-	struct ipc_log_page *nd_read_page;
+	struct ipc_log_cpu_ring *rings;
+	int nr_rings;
 
-	uint32_t write_avail;
 	struct dentry *dent;
 	struct list_head dfunc_info_list;
 	spinlock_t context_lock_lhb1;
-	struct completion read_avail;
+	wait_queue_head_t read_wait;
 };
 
 struct dfunc_info {
@@ -146,6 +181,8 @@ enum {
 			((x) < TSV_TYPE_MSG_END))
 #define MAX_MSG_DECODED_SIZE (MAX_MSG_SIZE*4)
 
+bool ipc_log_is_nd_read_empty(struct ipc_log_context *ilctxt);
+
 #if (defined(CONFIG_DEBUG_FS))
 void check_and_create_debugfs(void);
 
@@ -177,26 +177,42 @@ static inline u32 __pure crc32_le_generic(u32 crc, unsigned char const *p,
 }
 
 #if CRC_LE_BITS == 1
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+u32 __pure crc32_le_base(u32 crc, unsigned char const *p, size_t len)
 {
 	return crc32_le_generic(crc, p, len, NULL, CRCPOLY_LE);
 }
-u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+u32 __pure __crc32c_le_base(u32 crc, unsigned char const *p, size_t len)
 {
 	return crc32_le_generic(crc, p, len, NULL, CRC32C_POLY_LE);
 }
 #else
-u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+u32 __pure crc32_le_base(u32 crc, unsigned char const *p, size_t len)
 {
 	return crc32_le_generic(crc, p, len,
 			(const u32 (*)[256])crc32table_le, CRCPOLY_LE);
 }
-u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+u32 __pure __crc32c_le_base(u32 crc, unsigned char const *p, size_t len)
 {
 	return crc32_le_generic(crc, p, len,
 			(const u32 (*)[256])crc32ctable_le, CRC32C_POLY_LE);
 }
 #endif
+EXPORT_SYMBOL(crc32_le_base);
+EXPORT_SYMBOL(__crc32c_le_base);
+
+/*
+ * An architecture with faster instructions for the little-endian CRCs
+ * overrides these, falling back to the _base versions above for the
+ * cases its code does not cover.
+ */
+u32 __pure __weak crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return crc32_le_base(crc, p, len);
+}
+u32 __pure __weak __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	return __crc32c_le_base(crc, p, len);
+}
 EXPORT_SYMBOL(crc32_le);
 EXPORT_SYMBOL(__crc32c_le);
 
@@ -993,6 +1009,7 @@ static struct crc_test {
 };
 
 #include <linux/time.h>
+#include <linux/math64.h>
 
 static int __init crc32c_test(void)
 {
@@ -1104,10 +1121,75 @@ static int __init crc32_test(void)
 	return 0;
 }
 
+typedef u32 (*crc32_fn)(u32 crc, unsigned char const *p, size_t len);
+
+static u64 __init crc32_bench_one(crc32_fn fn, size_t len, int loops)
+{
+	struct timespec start, stop;
+	static u32 crc;
+	int i;
+
+	getnstimeofday(&start);
+	for (i = 0; i < loops; i++)
+		crc ^= fn(crc, test_buf, len);
+	getnstimeofday(&stop);
+
+	return stop.tv_nsec - start.tv_nsec +
+		1000000000 * (stop.tv_sec - start.tv_sec);
+}
+
+/*
+ * Compare crc32_le() and __crc32c_le() against the generic code they may
+ * have been overridden with an architecture version of, first for every
+ * offset and length in the first bytes of the buffer, then for speed.
+ */
+static int __init crc32_bench(void)
+{
+	static const size_t lens[] = { 64, 512, 4096 };
+	u64 nsec, base_nsec;
+	int i, j, errors = 0;
+	int loops;
+
+	for (i = 0; i < 64; i++) {
+		for (j = 0; j + i <= 256; j++) {
+			if (crc32_le(~0, test_buf + i, j) !=
+			    crc32_le_base(~0, test_buf + i, j))
+				errors++;
+			if (__crc32c_le(~0, test_buf + i, j) !=
+			    __crc32c_le_base(~0, test_buf + i, j))
+				errors++;
+		}
+	}
+	if (errors) {
+		pr_warn("crc32: %d comparisons with the generic code failed\n",
+			errors);
+		return 0;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(lens); i++) {
+		loops = (16 << 20) / lens[i];
+
+		base_nsec = crc32_bench_one(crc32_le_base, lens[i], loops);
+		nsec = crc32_bench_one(crc32_le, lens[i], loops);
+		pr_info("crc32: %zu bytes: %llu MB/s, generic %llu MB/s\n",
+			lens[i], div64_u64(16000ULL << 20, nsec ?: 1),
+			div64_u64(16000ULL << 20, base_nsec ?: 1));
+
+		base_nsec = crc32_bench_one(__crc32c_le_base, lens[i], loops);
+		nsec = crc32_bench_one(__crc32c_le, lens[i], loops);
+		pr_info("crc32c: %zu bytes: %llu MB/s, generic %llu MB/s\n",
+			lens[i], div64_u64(16000ULL << 20, nsec ?: 1),
+			div64_u64(16000ULL << 20, base_nsec ?: 1));
+	}
+
+	return 0;
+}
+
 static int __init crc32test_init(void)
 {
 	crc32_test();
 	crc32c_test();
+	crc32_bench();
 	return 0;
 }
 
@@ -18,139 +18,154 @@
 #define LZ4_ARCH64 0
 #endif
 
-/*
- * Architecture-specific macros
- */
-#define BYTE	u8
-typedef struct _U16_S { u16 v; } U16_S;
-typedef struct _U32_S { u32 v; } U32_S;
-typedef struct _U64_S { u64 v; } U64_S;
-#if defined(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS)		\
-	|| defined(CONFIG_ARM) && __LINUX_ARM_ARCH__ >= 6	\
-	&& defined(ARM_EFFICIENT_UNALIGNED_ACCESS)
-
-#define A16(x) (((U16_S *)(x))->v)
-#define A32(x) (((U32_S *)(x))->v)
-#define A64(x) (((U64_S *)(x))->v)
-
-#define PUT4(s, d) (A32(d) = A32(s))
-#define PUT8(s, d) (A64(d) = A64(s))
-#define LZ4_WRITE_LITTLEENDIAN_16(p, v)	\
-	do {	\
-		A16(p) = v; \
-		p += 2; \
-	} while (0)
-#else /* CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS */
-
-#define A64(x) get_unaligned((u64 *)&(((U16_S *)(x))->v))
-#define A32(x) get_unaligned((u32 *)&(((U16_S *)(x))->v))
-#define A16(x) get_unaligned((u16 *)&(((U16_S *)(x))->v))
-
-#define PUT4(s, d) \
-	put_unaligned(get_unaligned((const u32 *) s), (u32 *) d)
-#define PUT8(s, d) \
-	put_unaligned(get_unaligned((const u64 *) s), (u64 *) d)
-
-#define LZ4_WRITE_LITTLEENDIAN_16(p, v)	\
-	do {	\
-		put_unaligned(v, (u16 *)(p)); \
-		p += 2; \
-	} while (0)
+#ifdef __LITTLE_ENDIAN
+#define LZ4_LITTLE_ENDIAN 1
+#else
+#define LZ4_LITTLE_ENDIAN 0
 #endif
 
-#define COPYLENGTH 8
-#define ML_BITS  4
-#define ML_MASK  ((1U << ML_BITS) - 1)
-#define RUN_BITS (8 - ML_BITS)
-#define RUN_MASK ((1U << RUN_BITS) - 1)
-#define MEMORY_USAGE	14
+#define FORCE_INLINE __always_inline
+
+#define BYTE	u8
+
+/*
+ * Block format constants
+ */
 #define MINMATCH	4
-#define SKIPSTRENGTH	6
+#define WILDCOPYLENGTH	8
 #define LASTLITERALS	5
-#define MFLIMIT		(COPYLENGTH + MINMATCH)
-#define MINLENGTH	(MFLIMIT + 1)
+#define MFLIMIT		(WILDCOPYLENGTH + MINMATCH)
+#define LZ4_MIN_LENGTH	(MFLIMIT + 1)
 #define MAXD_LOG	16
-#define MAXD		(1 << MAXD_LOG)
-#define MAXD_MASK	(u32)(MAXD - 1)
-#define MAX_DISTANCE	(MAXD - 1)
-#define HASH_LOG	(MAXD_LOG - 1)
-#define HASHTABLESIZE	(1 << HASH_LOG)
-#define MAX_NB_ATTEMPTS	256
-#define OPTIMAL_ML	(int)((ML_MASK-1)+MINMATCH)
-#define LZ4_64KLIMIT	((1<<16) + (MFLIMIT - 1))
-#define HASHLOG64K	((MEMORY_USAGE - 2) + 1)
-#define HASH64KTABLESIZE	(1U << HASHLOG64K)
-#define LZ4_HASH_VALUE(p)	(((A32(p)) * 2654435761U) >> \
-				((MINMATCH * 8) - (MEMORY_USAGE-2)))
-#define LZ4_HASH64K_VALUE(p)	(((A32(p)) * 2654435761U) >> \
-				((MINMATCH * 8) - HASHLOG64K))
-#define HASH_VALUE(p)		(((A32(p)) * 2654435761U) >> \
-				((MINMATCH * 8) - HASH_LOG))
-
-#if LZ4_ARCH64/* 64-bit */
-#define STEPSIZE 8
-
-#define LZ4_COPYSTEP(s, d)	\
-	do {			\
-		PUT8(s, d);	\
-		d += 8;		\
-		s += 8;		\
-	} while (0)
-
-#define LZ4_COPYPACKET(s, d)	LZ4_COPYSTEP(s, d)
-
-#define LZ4_SECURECOPY(s, d, e)			\
-	do {					\
-		if (d < e) {			\
-			LZ4_WILDCOPY(s, d, e);	\
-		}				\
-	} while (0)
-#define HTYPE u32
-
-#ifdef __BIG_ENDIAN
-#define LZ4_NBCOMMONBYTES(val) (__builtin_clzll(val) >> 3)
+#define MAX_DISTANCE	((1 << MAXD_LOG) - 1)
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+#define OPTIMAL_ML	(int)((ML_MASK - 1) + MINMATCH)
+#define STEPSIZE	sizeof(size_t)
+#define HASH_UNIT	sizeof(size_t)
+
+/* Increase this value ==> compression runs slower on incompressible data */
+#define LZ4_SKIPTRIGGER	6
+#define LZ4_64K_LIMIT	((64 * 1024) + (MFLIMIT - 1))
+
+/*
+ * Memory access helpers of the block codec
+ */
+static FORCE_INLINE u16 LZ4_read16(const void *ptr)
+{
+	return get_unaligned((const u16 *)ptr);
+}
+
+static FORCE_INLINE u32 LZ4_read32(const void *ptr)
+{
+	return get_unaligned((const u32 *)ptr);
+}
+
+static FORCE_INLINE size_t LZ4_read_ARCH(const void *ptr)
+{
+	return get_unaligned((const size_t *)ptr);
+}
+
+static FORCE_INLINE void LZ4_write32(void *ptr, u32 value)
+{
+	put_unaligned(value, (u32 *)ptr);
+}
+
+static FORCE_INLINE u16 LZ4_readLE16(const void *ptr)
+{
+	return get_unaligned_le16(ptr);
+}
+
+static FORCE_INLINE void LZ4_writeLE16(void *ptr, u16 value)
+{
+	put_unaligned_le16(value, ptr);
+}
+
+static FORCE_INLINE void LZ4_copy8(void *dst, const void *src)
+{
+#if LZ4_ARCH64
+	put_unaligned(get_unaligned((const u64 *)src), (u64 *)dst);
 #else
-#define LZ4_NBCOMMONBYTES(val) (__builtin_ctzll(val) >> 3)
+	put_unaligned(get_unaligned((const u32 *)src), (u32 *)dst);
+	put_unaligned(get_unaligned((const u32 *)src + 1), (u32 *)dst + 1);
 #endif
+}
 
-#else	/* 32-bit */
-#define STEPSIZE 4
-
-#define LZ4_COPYSTEP(s, d)	\
-	do {			\
-		PUT4(s, d);	\
-		d += 4;		\
-		s += 4;		\
-	} while (0)
-
-#define LZ4_COPYPACKET(s, d)		\
-	do {				\
-		LZ4_COPYSTEP(s, d);	\
-		LZ4_COPYSTEP(s, d);	\
-	} while (0)
-
-#define LZ4_SECURECOPY	LZ4_WILDCOPY
-#define HTYPE const u8*
-
-#ifdef __BIG_ENDIAN
-#define LZ4_NBCOMMONBYTES(val) (__builtin_clz(val) >> 3)
+/*
+ * Copies 8 bytes at a time up to and possibly 7 bytes past dst_end, the
+ * callers leave room for that at the end of their buffers.
+ */
+static FORCE_INLINE void LZ4_wildCopy(void *dst, const void *src,
+				      void *dst_end)
+{
+	BYTE *d = (BYTE *)dst;
+	const BYTE *s = (const BYTE *)src;
+	BYTE *const e = (BYTE *)dst_end;
+
+	do {
+		LZ4_copy8(d, s);
+		d += 8;
+		s += 8;
+	} while (d < e);
+}
+
+static FORCE_INLINE unsigned int LZ4_NbCommonBytes(size_t val)
+{
+#if LZ4_ARCH64
+#if LZ4_LITTLE_ENDIAN
+	return __builtin_ctzll(val) >> 3;
 #else
-#define LZ4_NBCOMMONBYTES(val) (__builtin_ctz(val) >> 3)
+	return __builtin_clzll(val) >> 3;
 #endif
-
+#else
+#if LZ4_LITTLE_ENDIAN
+	return __builtin_ctz(val) >> 3;
+#else
+	return __builtin_clz(val) >> 3;
 #endif
-
-#define LZ4_READ_LITTLEENDIAN_16(d, s, p) \
-	(d = s - get_unaligned_le16(p))
-
-#define LZ4_WILDCOPY(s, d, e)		\
-	do {				\
-		LZ4_COPYPACKET(s, d);	\
-	} while (d < e)
-
-#define LZ4_BLINDCOPY(s, d, l)	\
-	do {	\
-		u8 *e = (d) + l;	\
-		LZ4_WILDCOPY(s, d, e);	\
-		d = e;	\
-	} while (0)
+#endif
+}
+
+/* Length of the common prefix of in and match, reading no further than limit */
+static FORCE_INLINE unsigned int LZ4_count(const BYTE *in, const BYTE *match,
+					   const BYTE *in_limit)
+{
+	const BYTE *const start = in;
+
+	while (likely(in < in_limit - (STEPSIZE - 1))) {
+		size_t const diff = LZ4_read_ARCH(match) ^ LZ4_read_ARCH(in);
+
+		if (!diff) {
+			in += STEPSIZE;
+			match += STEPSIZE;
+			continue;
+		}
+		in += LZ4_NbCommonBytes(diff);
+		return (unsigned int)(in - start);
+	}
+
+#if LZ4_ARCH64
+	if ((in < (in_limit - 3)) && (LZ4_read32(match) == LZ4_read32(in))) {
+		in += 4;
+		match += 4;
+	}
+#endif
+	if ((in < (in_limit - 1)) && (LZ4_read16(match) == LZ4_read16(in))) {
+		in += 2;
+		match += 2;
+	}
+	if ((in < in_limit) && (*match == *in))
+		in++;
+	return (unsigned int)(in - start);
+}
+
+typedef enum { noLimit = 0, limitedOutput = 1 } limitedOutput_directive;
+typedef enum { byPtr, byU32, byU16 } tableType_t;
+
+typedef enum { noDict = 0, withPrefix64k, usingExtDict } dict_directive;
+typedef enum { noDictIssue = 0, dictSmall } dictIssue_directive;
+
+typedef enum { endOnOutputSize = 0, endOnInputSize = 1 } endCondition_directive;
+typedef enum { full = 0, partial = 1 } earlyEnd_directive;
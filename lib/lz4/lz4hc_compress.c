@@ -1,6 +1,6 @@
 /*
  * LZ4 HC - High Compression Mode of LZ4
- * Copyright (C) 2011-2012, Yann Collet.
+ * Copyright (C) 2011-2016, Yann Collet.
  * BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
  *
  * Redistribution and use in source and binary forms, with or without
@@ -36,312 +36,286 @@
 
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/bug.h>
 #include <linux/lz4.h>
 #include <asm/unaligned.h>
 #include "lz4defs.h"
 
-struct lz4hc_data {
-	const u8 *base;
-	HTYPE hashtable[HASHTABLESIZE];
-	u16 chaintable[MAXD];
-	const u8 *nexttoupdate;
-} __attribute__((__packed__));
+/*
+ * Positions are stored as u32 indexes from base, which sits 64KB below the
+ * start of the input so that index 0 is never a valid match. The chain
+ * table links every position to the previous one with the same hash, as a
+ * 16 bit backward distance.
+ */
+struct lz4hc_ctx_internal {
+	u32 hash_table[LZ4HC_HASHTABLESIZE];
+	u16 chain_table[LZ4HC_MAXD];
+	const BYTE *base;
+	u32 low_limit;
+	u32 next_to_update;
+};
+
+#define DELTANEXTU16(p)	chainTable[(u16)(p)]
+
+static FORCE_INLINE u32 LZ4HC_hashPtr(const void *ptr)
+{
+	return (LZ4_read32(ptr) * 2654435761U)
+		>> ((MINMATCH * 8) - LZ4HC_HASH_LOG);
+}
 
-static inline int lz4hc_init(struct lz4hc_data *hc4, const u8 *base)
+static void LZ4HC_init(struct lz4hc_ctx_internal *hc4, const BYTE *start)
 {
-	memset((void *)hc4->hashtable, 0, sizeof(hc4->hashtable));
-	memset(hc4->chaintable, 0xFF, sizeof(hc4->chaintable));
-
-#if LZ4_ARCH64
-	hc4->nexttoupdate = base + 1;
-#else
-	hc4->nexttoupdate = base;
-#endif
-	hc4->base = base;
-	return 1;
+	memset(hc4->hash_table, 0, sizeof(hc4->hash_table));
+	memset(hc4->chain_table, 0xFF, sizeof(hc4->chain_table));
+	hc4->next_to_update = 64 * 1024;
+	hc4->base = start - 64 * 1024;
+	hc4->low_limit = 64 * 1024;
 }
 
 /* Update chains up to ip (excluded) */
-static inline void lz4hc_insert(struct lz4hc_data *hc4, const u8 *ip)
+static FORCE_INLINE void LZ4HC_Insert(struct lz4hc_ctx_internal *hc4,
+				      const BYTE *ip)
 {
-	u16 *chaintable = hc4->chaintable;
-	HTYPE *hashtable  = hc4->hashtable;
-#if LZ4_ARCH64
+	u16 * const chainTable = hc4->chain_table;
+	u32 * const hashTable = hc4->hash_table;
 	const BYTE * const base = hc4->base;
-#else
-	const int base = 0;
-#endif
+	u32 const target = (u32)(ip - base);
+	u32 idx = hc4->next_to_update;
+
+	while (idx < target) {
+		u32 const h = LZ4HC_hashPtr(base + idx);
+		size_t delta = idx - hashTable[h];
 
-	while (hc4->nexttoupdate < ip) {
-		const u8 *p = hc4->nexttoupdate;
-		size_t delta = p - (hashtable[HASH_VALUE(p)] + base);
 		if (delta > MAX_DISTANCE)
 			delta = MAX_DISTANCE;
-		chaintable[(size_t)(p) & MAXD_MASK] = (u16)delta;
-		hashtable[HASH_VALUE(p)] = (p) - base;
-		hc4->nexttoupdate++;
+		DELTANEXTU16(idx) = (u16)delta;
+		hashTable[h] = idx;
+		idx++;
 	}
+
+	hc4->next_to_update = target;
 }
 
-static inline size_t lz4hc_commonlength(const u8 *p1, const u8 *p2,
-		const u8 *const matchlimit)
+/* Lowest index a match for ip may start at */
+static FORCE_INLINE u32 LZ4HC_lowLimit(const struct lz4hc_ctx_internal *hc4,
+				       const BYTE *ip)
 {
-	const u8 *p1t = p1;
-
-	while (p1t < matchlimit - (STEPSIZE - 1)) {
-#if LZ4_ARCH64
-		u64 diff = A64(p2) ^ A64(p1t);
-#else
-		u32 diff = A32(p2) ^ A32(p1t);
-#endif
-		if (!diff) {
-			p1t += STEPSIZE;
-			p2 += STEPSIZE;
-			continue;
-		}
-		p1t += LZ4_NBCOMMONBYTES(diff);
-		return p1t - p1;
-	}
-#if LZ4_ARCH64
-	if ((p1t < (matchlimit-3)) && (A32(p2) == A32(p1t))) {
-		p1t += 4;
-		p2 += 4;
-	}
-#endif
+	u32 const current = (u32)(ip - hc4->base);
 
-	if ((p1t < (matchlimit - 1)) && (A16(p2) == A16(p1t))) {
-		p1t += 2;
-		p2 += 2;
-	}
-	if ((p1t < matchlimit) && (*p2 == *p1t))
-		p1t++;
-	return p1t - p1;
+	if (hc4->low_limit + 64 * 1024 > current)
+		return hc4->low_limit;
+	return current - (64 * 1024 - 1);
 }
 
-static inline int lz4hc_insertandfindbestmatch(struct lz4hc_data *hc4,
-		const u8 *ip, const u8 *const matchlimit, const u8 **matchpos)
+static FORCE_INLINE int LZ4HC_InsertAndFindBestMatch(
+	struct lz4hc_ctx_internal *hc4,
+	const BYTE *ip,
+	const BYTE * const iLimit,
+	const BYTE **matchpos,
+	const int maxNbAttempts)
 {
-	u16 *const chaintable = hc4->chaintable;
-	HTYPE *const hashtable = hc4->hashtable;
-	const u8 *ref;
-#if LZ4_ARCH64
+	u16 * const chainTable = hc4->chain_table;
 	const BYTE * const base = hc4->base;
-#else
-	const int base = 0;
-#endif
-	int nbattempts = MAX_NB_ATTEMPTS;
-	size_t repl = 0, ml = 0;
-	u16 delta;
-
-	/* HC4 match finder */
-	lz4hc_insert(hc4, ip);
-	ref = hashtable[HASH_VALUE(ip)] + base;
-
-	/* potential repetition */
-	if (ref >= ip-4) {
-		/* confirmed */
-		if (A32(ref) == A32(ip)) {
-			delta = (u16)(ip-ref);
-			repl = ml  = lz4hc_commonlength(ip + MINMATCH,
-					ref + MINMATCH, matchlimit) + MINMATCH;
-			*matchpos = ref;
-		}
-		ref -= (size_t)chaintable[(size_t)(ref) & MAXD_MASK];
-	}
-
-	while ((ref >= ip - MAX_DISTANCE) && nbattempts) {
-		nbattempts--;
-		if (*(ref + ml) == *(ip + ml)) {
-			if (A32(ref) == A32(ip)) {
-				size_t mlt =
-					lz4hc_commonlength(ip + MINMATCH,
-					ref + MINMATCH, matchlimit) + MINMATCH;
-				if (mlt > ml) {
-					ml = mlt;
-					*matchpos = ref;
-				}
+	const u32 lowLimit = LZ4HC_lowLimit(hc4, ip);
+	int nbAttempts = maxNbAttempts;
+	size_t ml = 0;
+	u32 matchIndex;
+
+	LZ4HC_Insert(hc4, ip);
+	matchIndex = hc4->hash_table[LZ4HC_hashPtr(ip)];
+
+	while ((matchIndex >= lowLimit) && nbAttempts) {
+		const BYTE * const match = base + matchIndex;
+
+		nbAttempts--;
+		if (*(match + ml) == *(ip + ml)
+			&& (LZ4_read32(match) == LZ4_read32(ip))) {
+			size_t const mlt = LZ4_count(ip + MINMATCH,
+				match + MINMATCH, iLimit) + MINMATCH;
+
+			if (mlt > ml) {
+				ml = mlt;
+				*matchpos = match;
 			}
 		}
-		ref -= (size_t)chaintable[(size_t)(ref) & MAXD_MASK];
-	}
-
-	/* Complete table */
-	if (repl) {
-		const BYTE *ptr = ip;
-		const BYTE *end;
-		end = ip + repl - (MINMATCH-1);
-		/* Pre-Load */
-		while (ptr < end - delta) {
-			chaintable[(size_t)(ptr) & MAXD_MASK] = delta;
-			ptr++;
-		}
-		do {
-			chaintable[(size_t)(ptr) & MAXD_MASK] = delta;
-			/* Head of chain */
-			hashtable[HASH_VALUE(ptr)] = (ptr) - base;
-			ptr++;
-		} while (ptr < end);
-		hc4->nexttoupdate = end;
+		matchIndex -= DELTANEXTU16(matchIndex);
 	}
 
 	return (int)ml;
 }
 
-static inline int lz4hc_insertandgetwidermatch(struct lz4hc_data *hc4,
-	const u8 *ip, const u8 *startlimit, const u8 *matchlimit, int longest,
-	const u8 **matchpos, const u8 **startpos)
+/*
+ * Looks for a match at ip longer than 'longest', allowed to start back down
+ * to iLowLimit. Returns the new longest length, with its start in *startpos
+ * and its reference in *matchpos, or 'longest' if there is none.
+ */
+static FORCE_INLINE int LZ4HC_InsertAndGetWiderMatch(
+	struct lz4hc_ctx_internal *hc4,
+	const BYTE * const ip,
+	const BYTE * const iLowLimit,
+	const BYTE * const iHighLimit,
+	int longest,
+	const BYTE **matchpos,
+	const BYTE **startpos,
+	const int maxNbAttempts)
 {
-	u16 *const chaintable = hc4->chaintable;
-	HTYPE *const hashtable = hc4->hashtable;
-#if LZ4_ARCH64
+	u16 * const chainTable = hc4->chain_table;
 	const BYTE * const base = hc4->base;
-#else
-	const int base = 0;
-#endif
-	const u8 *ref;
-	int nbattempts = MAX_NB_ATTEMPTS;
-	int delta = (int)(ip - startlimit);
-
-	/* First Match */
-	lz4hc_insert(hc4, ip);
-	ref = hashtable[HASH_VALUE(ip)] + base;
-
-	while ((ref >= ip - MAX_DISTANCE) && (ref >= hc4->base)
-		&& (nbattempts)) {
-		nbattempts--;
-		if (*(startlimit + longest) == *(ref - delta + longest)) {
-			if (A32(ref) == A32(ip)) {
-				const u8 *reft = ref + MINMATCH;
-				const u8 *ipt = ip + MINMATCH;
-				const u8 *startt = ip;
-
-				while (ipt < matchlimit-(STEPSIZE - 1)) {
-					#if LZ4_ARCH64
-					u64 diff = A64(reft) ^ A64(ipt);
-					#else
-					u32 diff = A32(reft) ^ A32(ipt);
-					#endif
-
-					if (!diff) {
-						ipt += STEPSIZE;
-						reft += STEPSIZE;
-						continue;
-					}
-					ipt += LZ4_NBCOMMONBYTES(diff);
-					goto _endcount;
-				}
-				#if LZ4_ARCH64
-				if ((ipt < (matchlimit - 3))
-					&& (A32(reft) == A32(ipt))) {
-					ipt += 4;
-					reft += 4;
-				}
-				ipt += 2;
-				#endif
-				if ((ipt < (matchlimit - 1))
-					&& (A16(reft) == A16(ipt))) {
-					reft += 2;
-				}
-				if ((ipt < matchlimit) && (*reft == *ipt))
-					ipt++;
-_endcount:
-				reft = ref;
-
-				while ((startt > startlimit)
-					&& (reft > hc4->base)
-					&& (startt[-1] == reft[-1])) {
-					startt--;
-					reft--;
-				}
-
-				if ((ipt - startt) > longest) {
-					longest = (int)(ipt - startt);
-					*matchpos = reft;
-					*startpos = startt;
-				}
+	const BYTE * const lowPrefixPtr = base + hc4->low_limit;
+	const u32 lowLimit = LZ4HC_lowLimit(hc4, ip);
+	int const delta = (int)(ip - iLowLimit);
+	int nbAttempts = maxNbAttempts;
+	u32 matchIndex;
+
+	LZ4HC_Insert(hc4, ip);
+	matchIndex = hc4->hash_table[LZ4HC_hashPtr(ip)];
+
+	while ((matchIndex >= lowLimit) && nbAttempts) {
+		const BYTE * const matchPtr = base + matchIndex;
+
+		nbAttempts--;
+		if (*(iLowLimit + longest) == *(matchPtr - delta + longest)
+			&& (LZ4_read32(matchPtr) == LZ4_read32(ip))) {
+			int mlt = MINMATCH + LZ4_count(ip + MINMATCH,
+				matchPtr + MINMATCH, iHighLimit);
+			int back = 0;
+
+			while ((ip + back > iLowLimit)
+				&& (matchPtr + back > lowPrefixPtr)
+				&& (ip[back - 1] == matchPtr[back - 1]))
+				back--;
+
+			mlt -= back;
+
+			if (mlt > longest) {
+				longest = mlt;
+				*matchpos = matchPtr + back;
+				*startpos = ip + back;
 			}
 		}
-		ref -= (size_t)chaintable[(size_t)(ref) & MAXD_MASK];
+		matchIndex -= DELTANEXTU16(matchIndex);
 	}
+
 	return longest;
 }
 
-static inline int lz4_encodesequence(const u8 **ip, u8 **op, const u8 **anchor,
-		int ml, const u8 *ref)
+/*
+ * Writes the literals from *anchor to *ip and a match of matchLength at
+ * match, then moves *ip and *anchor past it. Returns 1 if the sequence
+ * does not fit before oend.
+ */
+static FORCE_INLINE int LZ4HC_encodeSequence(
+	const BYTE **ip,
+	BYTE **op,
+	const BYTE **anchor,
+	int matchLength,
+	const BYTE * const match,
+	limitedOutput_directive limitedOutputBuffer,
+	BYTE *oend)
 {
-	int length, len;
-	u8 *token;
+	int length;
+	BYTE *token;
 
 	/* Encode Literal length */
 	length = (int)(*ip - *anchor);
 	token = (*op)++;
+
+	if ((limitedOutputBuffer)
+		&& ((*op + (length + 240) / 255
+			+ length + (2 + 1 + LASTLITERALS)) > oend))
+		return 1;
+
 	if (length >= (int)RUN_MASK) {
+		int len = length - RUN_MASK;
+
 		*token = (RUN_MASK << ML_BITS);
-		len = length - RUN_MASK;
 		for (; len > 254 ; len -= 255)
 			*(*op)++ = 255;
-		*(*op)++ = (u8)len;
+		*(*op)++ = (BYTE)len;
 	} else
-		*token = (length << ML_BITS);
+		*token = (BYTE)(length << ML_BITS);
 
 	/* Copy Literals */
-	LZ4_BLINDCOPY(*anchor, *op, length);
+	LZ4_wildCopy(*op, *anchor, (*op) + length);
+	*op += length;
 
 	/* Encode Offset */
-	LZ4_WRITE_LITTLEENDIAN_16(*op, (u16)(*ip - ref));
+	LZ4_writeLE16(*op, (u16)(*ip - match));
+	*op += 2;
 
 	/* Encode MatchLength */
-	len = (int)(ml - MINMATCH);
-	if (len >= (int)ML_MASK) {
+	length = (int)(matchLength - MINMATCH);
+
+	if ((limitedOutputBuffer)
+		&& (*op + (length + 240) / 255 + (1 + LASTLITERALS) > oend))
+		return 1;
+
+	if (length >= (int)ML_MASK) {
 		*token += ML_MASK;
-		len -= ML_MASK;
-		for (; len > 509 ; len -= 510) {
+		length -= ML_MASK;
+		for (; length > 509 ; length -= 510) {
 			*(*op)++ = 255;
 			*(*op)++ = 255;
 		}
-		if (len > 254) {
-			len -= 255;
+		if (length > 254) {
+			length -= 255;
 			*(*op)++ = 255;
 		}
-		*(*op)++ = (u8)len;
+		*(*op)++ = (BYTE)length;
 	} else
-		*token += len;
+		*token += (BYTE)(length);
 
 	/* Prepare next loop */
-	*ip += ml;
+	*ip += matchLength;
 	*anchor = *ip;
 
 	return 0;
 }
 
-static int lz4_compresshcctx(struct lz4hc_data *ctx,
-		const char *source,
-		char *dest,
-		int isize)
+static int LZ4HC_compress_generic(
+	struct lz4hc_ctx_internal *const ctx,
+	const char * const source,
+	char * const dest,
+	int const inputSize,
+	int const maxOutputSize,
+	int compressionLevel,
+	limitedOutput_directive limit)
 {
-	const u8 *ip = (const u8 *)source;
-	const u8 *anchor = ip;
-	const u8 *const iend = ip + isize;
-	const u8 *const mflimit = iend - MFLIMIT;
-	const u8 *const matchlimit = (iend - LASTLITERALS);
+	const BYTE *ip = (const BYTE *)source;
+	const BYTE *anchor = ip;
+	const BYTE * const iend = ip + inputSize;
+	const BYTE * const mflimit = iend - MFLIMIT;
+	const BYTE * const matchlimit = (iend - LASTLITERALS);
 
-	u8 *op = (u8 *)dest;
+	BYTE *op = (BYTE *)dest;
+	BYTE * const oend = op + maxOutputSize;
 
+	unsigned int maxNbAttempts;
 	int ml, ml2, ml3, ml0;
-	const u8 *ref = NULL;
-	const u8 *start2 = NULL;
-	const u8 *ref2 = NULL;
-	const u8 *start3 = NULL;
-	const u8 *ref3 = NULL;
-	const u8 *start0;
-	const u8 *ref0;
-	int lastrun;
+	const BYTE *ref = NULL;
+	const BYTE *start2 = NULL;
+	const BYTE *ref2 = NULL;
+	const BYTE *start3 = NULL;
+	const BYTE *ref3 = NULL;
+	const BYTE *start0;
+	const BYTE *ref0;
+
+	if (compressionLevel > LZ4HC_MAX_CLEVEL)
+		compressionLevel = LZ4HC_MAX_CLEVEL;
+	if (compressionLevel < 1)
+		compressionLevel = LZ4HC_DEFAULT_CLEVEL;
+	maxNbAttempts = 1 << (compressionLevel - 1);
+
+	if (inputSize < LZ4_MIN_LENGTH)
+		goto _last_literals;
 
 	ip++;
 
 	/* Main Loop */
 	while (ip < mflimit) {
-		ml = lz4hc_insertandfindbestmatch(ctx, ip, matchlimit, (&ref));
+		ml = LZ4HC_InsertAndFindBestMatch(ctx, ip, matchlimit,
+			&ref, maxNbAttempts);
 		if (!ml) {
 			ip++;
 			continue;
@@ -351,31 +325,35 @@ static int lz4_compresshcctx(struct lz4hc_data *ctx,
 		start0 = ip;
 		ref0 = ref;
 		ml0 = ml;
+
 _search2:
-		if (ip+ml < mflimit)
-			ml2 = lz4hc_insertandgetwidermatch(ctx, ip + ml - 2,
-				ip + 1, matchlimit, ml, &ref2, &start2);
+		if (ip + ml < mflimit)
+			ml2 = LZ4HC_InsertAndGetWiderMatch(ctx,
+				ip + ml - 2, ip + 0, matchlimit, ml, &ref2,
+				&start2, maxNbAttempts);
 		else
 			ml2 = ml;
-		/* No better match */
+
 		if (ml2 == ml) {
-			lz4_encodesequence(&ip, &op, &anchor, ml, ref);
+			/* No better match */
+			if (LZ4HC_encodeSequence(&ip, &op, &anchor, ml, ref,
+				limit, oend))
+				return 0;
 			continue;
 		}
 
 		if (start0 < ip) {
-			/* empirical */
 			if (start2 < ip + ml0) {
+				/* empirical */
 				ip = start0;
 				ref = ref0;
 				ml = ml0;
 			}
 		}
-		/*
-		 * Here, start0==ip
-		 * First Match too small : removed
-		 */
+
+		/* Here, start0 == ip */
 		if ((start2 - ip) < 3) {
+			/* First Match too small : removed */
 			ml = ml2;
 			ip = start2;
 			ref = ref2;
@@ -386,11 +364,12 @@ _search3:
 		/*
 		 * Currently we have :
 		 * ml2 > ml1, and
-		 * ip1+3 <= ip2 (usually < ip1+ml1)
+		 * ip1 + 3 <= ip2 (usually < ip1 + ml1)
 		 */
 		if ((start2 - ip) < OPTIMAL_ML) {
 			int correction;
 			int new_ml = ml;
+
 			if (new_ml > OPTIMAL_ML)
 				new_ml = OPTIMAL_ML;
 			if (ip + new_ml > start2 + ml2 - MINMATCH)
@@ -403,39 +382,44 @@ _search3:
 			}
 		}
 		/*
-		 * Now, we have start2 = ip+new_ml,
-		 * with new_ml=min(ml, OPTIMAL_ML=18)
+		 * Now, we have start2 = ip + new_ml,
+		 * with new_ml = min(ml, OPTIMAL_ML = 18)
 		 */
+
 		if (start2 + ml2 < mflimit)
-			ml3 = lz4hc_insertandgetwidermatch(ctx,
-				start2 + ml2 - 3, start2, matchlimit,
-				ml2, &ref3, &start3);
+			ml3 = LZ4HC_InsertAndGetWiderMatch(ctx,
+				start2 + ml2 - 3, start2, matchlimit, ml2,
+				&ref3, &start3, maxNbAttempts);
 		else
 			ml3 = ml2;
 
-		/* No better match : 2 sequences to encode */
 		if (ml3 == ml2) {
+			/* No better match : 2 sequences to encode */
 			/* ip & ref are known; Now for ml */
-			if (start2 < ip+ml)
+			if (start2 < ip + ml)
 				ml = (int)(start2 - ip);
-
 			/* Now, encode 2 sequences */
-			lz4_encodesequence(&ip, &op, &anchor, ml, ref);
+			if (LZ4HC_encodeSequence(&ip, &op, &anchor, ml, ref,
+				limit, oend))
+				return 0;
 			ip = start2;
-			lz4_encodesequence(&ip, &op, &anchor, ml2, ref2);
+			if (LZ4HC_encodeSequence(&ip, &op, &anchor, ml2, ref2,
+				limit, oend))
+				return 0;
 			continue;
 		}
 
-		/* Not enough space for match 2 : remove it */
 		if (start3 < ip + ml + 3) {
-			/*
-			 * can write Seq1 immediately ==> Seq2 is removed,
-			 * so Seq3 becomes Seq1
-			 */
+			/* Not enough space for match 2 : remove it */
 			if (start3 >= (ip + ml)) {
+				/*
+				 * can write Seq1 immediately
+				 * ==> Seq2 is removed,
+				 * so Seq3 becomes Seq1
+				 */
 				if (start2 < ip + ml) {
-					int correction =
-						(int)(ip + ml - start2);
+					int correction = (int)(ip + ml - start2);
+
 					start2 += correction;
 					ref2 += correction;
 					ml2 -= correction;
@@ -446,10 +430,12 @@ _search3:
 					}
 				}
 
-				lz4_encodesequence(&ip, &op, &anchor, ml, ref);
-				ip  = start3;
+				if (LZ4HC_encodeSequence(&ip, &op, &anchor,
+					ml, ref, limit, oend))
+					return 0;
+				ip = start3;
 				ref = ref3;
-				ml  = ml3;
+				ml = ml3;
 
 				start0 = start2;
 				ref0 = ref2;
@@ -470,6 +456,7 @@ _search3:
 		if (start2 < ip + ml) {
 			if ((start2 - ip) < (int)ML_MASK) {
 				int correction;
+
 				if (ml > OPTIMAL_ML)
 					ml = OPTIMAL_ML;
 				if (ip + ml > start2 + ml2 - MINMATCH)
@@ -484,7 +471,9 @@ _search3:
 			} else
 				ml = (int)(start2 - ip);
 		}
-		lz4_encodesequence(&ip, &op, &anchor, ml, ref);
+		if (LZ4HC_encodeSequence(&ip, &op, &anchor, ml, ref, limit,
+			oend))
+			return 0;
 
 		ip = start2;
 		ref = ref2;
@@ -497,41 +486,72 @@ _search3:
 		goto _search3;
 	}
 
+_last_literals:
 	/* Encode Last Literals */
-	lastrun = (int)(iend - anchor);
-	if (lastrun >= (int)RUN_MASK) {
-		*op++ = (RUN_MASK << ML_BITS);
-		lastrun -= RUN_MASK;
-		for (; lastrun > 254 ; lastrun -= 255)
-			*op++ = 255;
-		*op++ = (u8) lastrun;
-	} else
-		*op++ = (lastrun << ML_BITS);
-	memcpy(op, anchor, iend - anchor);
-	op += iend - anchor;
+	{
+		size_t lastRun = (size_t)(iend - anchor);
+
+		if ((limit)
+			&& (((char *)op - dest) + lastRun + 1
+				+ ((lastRun + 255 - RUN_MASK) / 255)
+					> (u32)maxOutputSize))
+			return 0;
+
+		if (lastRun >= RUN_MASK) {
+			size_t accumulator = lastRun - RUN_MASK;
+
+			*op++ = RUN_MASK << ML_BITS;
+			for (; accumulator >= 255 ; accumulator -= 255)
+				*op++ = 255;
+			*op++ = (BYTE)accumulator;
+		} else
+			*op++ = (BYTE)(lastRun << ML_BITS);
+		memcpy(op, anchor, lastRun);
+		op += lastRun;
+	}
+
 	/* End */
-	return (int) (((char *)op) - dest);
+	return (int)(((char *)op) - dest);
 }
 
+int LZ4_compress_HC(const char *src, char *dst, int srcSize,
+	int dstCapacity, int compressionLevel, void *wrkmem)
+{
+	struct lz4hc_ctx_internal *ctx = wrkmem;
+
+	BUILD_BUG_ON(sizeof(struct lz4hc_ctx_internal) > LZ4HC_MEM_COMPRESS);
+
+	if (((size_t)wrkmem & (sizeof(void *) - 1)) != 0) {
+		/* Error : wrkmem is not aligned for pointers */
+		return 0;
+	}
+	if ((u32)srcSize > (u32)LZ4_MAX_INPUT_SIZE)
+		return 0;
+
+	LZ4HC_init(ctx, (const BYTE *)src);
+
+	if (dstCapacity < LZ4_COMPRESSBOUND(srcSize))
+		return LZ4HC_compress_generic(ctx, src, dst, srcSize,
+			dstCapacity, compressionLevel, limitedOutput);
+	else
+		return LZ4HC_compress_generic(ctx, src, dst, srcSize,
+			dstCapacity, compressionLevel, noLimit);
+}
+EXPORT_SYMBOL(LZ4_compress_HC);
+
 int lz4hc_compress(const unsigned char *src, size_t src_len,
 			unsigned char *dst, size_t *dst_len, void *wrkmem)
 {
-	int ret = -1;
-	int out_len = 0;
-
-	struct lz4hc_data *hc4 = (struct lz4hc_data *)wrkmem;
-	lz4hc_init(hc4, (const u8 *)src);
-	out_len = lz4_compresshcctx((struct lz4hc_data *)hc4, (const u8 *)src,
-		(char *)dst, (int)src_len);
+	int out_len;
 
-	if (out_len < 0)
-		goto exit;
+	out_len = LZ4_compress_HC((const char *)src, (char *)dst, src_len,
+			lz4_compressbound(src_len), LZ4HC_DEFAULT_CLEVEL,
+			wrkmem);
+	if (!out_len)
+		return -1;
 
 	*dst_len = out_len;
 	return 0;
-
-exit:
-	return ret;
 }
 EXPORT_SYMBOL(lz4hc_compress);
 
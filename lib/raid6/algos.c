@@ -65,6 +65,12 @@ const struct raid6_calls * const raid6_algos[] = {
 	&raid6_altivec2,
 	&raid6_altivec4,
 	&raid6_altivec8,
+#endif
+#ifdef CONFIG_KERNEL_MODE_NEON
+	&raid6_neonx1,
+	&raid6_neonx2,
+	&raid6_neonx4,
+	&raid6_neonx8,
 #endif
 	&raid6_intx1,
 	&raid6_intx2,
@@ -85,6 +91,9 @@ const struct raid6_recov_calls *const raid6_recov_algos[] = {
 	&raid6_recov_avx2,
 #endif
 	&raid6_recov_ssse3,
+#endif
+#ifdef CONFIG_KERNEL_MODE_NEON
+	&raid6_recov_neon,
 #endif
 	&raid6_recov_intx1,
 	NULL
@@ -123,6 +132,7 @@ static inline const struct raid6_calls *raid6_choose_gen(
 	void *(*const dptrs)[(65536/PAGE_SIZE)+2], const int disks)
 {
 	unsigned long perf, bestperf, j0, j1;
+	int start = (disks>>1)-1, stop = disks-3;	/* work on the second half */
 	const struct raid6_calls *const *algo;
 	const struct raid6_calls *best;
 
@@ -150,6 +160,27 @@ static inline const struct raid6_calls *raid6_choose_gen(
 			}
 			printk("raid6: %-8s %5ld MB/s\n", (*algo)->name,
 			       (perf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2));
+
+			if (!(*algo)->xor_syndrome)
+				continue;
+
+			perf = 0;
+
+			preempt_disable();
+			j0 = jiffies;
+			while ((j1 = jiffies) == j0)
+				cpu_relax();
+			while (time_before(jiffies,
+					    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+				(*algo)->xor_syndrome(disks, start, stop,
+						      PAGE_SIZE, *dptrs);
+				perf++;
+			}
+			preempt_enable();
+
+			/* Only half of the data disks were read */
+			printk("raid6: %-8s xor() %5ld MB/s\n", (*algo)->name,
+			       (perf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2+1));
 		}
 	}
 
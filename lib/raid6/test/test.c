@@ -28,11 +28,11 @@ char *dataptrs[NDISKS];
 char data[NDISKS][PAGE_SIZE];
 char recovi[PAGE_SIZE], recovj[PAGE_SIZE];
 
-static void makedata(void)
+static void makedata(int start, int stop)
 {
 	int i, j;
 
-	for (i = 0; i < NDISKS; i++) {
+	for (i = start; i <= stop; i++) {
 		for (j = 0; j < PAGE_SIZE; j++)
 			data[i][j] = rand();
 
@@ -91,10 +91,10 @@ int main(int argc, char *argv[])
 {
 	const struct raid6_calls *const *algo;
 	const struct raid6_recov_calls *const *ra;
-	int i, j;
+	int i, j, p1, p2;
 	int err = 0;
 
-	makedata();
+	makedata(0, NDISKS-1);
 
 	for (ra = raid6_recov_algos; *ra; ra++) {
 		if ((*ra)->valid  && !(*ra)->valid())
@@ -118,6 +118,25 @@ int main(int argc, char *argv[])
 				for (i = 0; i < NDISKS-1; i++)
 					for (j = i+1; j < NDISKS; j++)
 						err += test_disks(i, j);
+
+				if (!raid6_call.xor_syndrome)
+					continue;
+
+				for (p1 = 0; p1 < NDISKS-2; p1++)
+					for (p2 = p1; p2 < NDISKS-2; p2++) {
+						/* Simulate a rmw run */
+						raid6_call.xor_syndrome(NDISKS,
+							p1, p2, PAGE_SIZE,
+							(void **)&dataptrs);
+						makedata(p1, p2);
+						raid6_call.xor_syndrome(NDISKS,
+							p1, p2, PAGE_SIZE,
+							(void **)&dataptrs);
+
+						for (i = 0; i < NDISKS-1; i++)
+							for (j = i+1; j < NDISKS; j++)
+								err += test_disks(i, j);
+					}
 			}
 		}
 		printf("\n");
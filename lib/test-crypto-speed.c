@@ -0,0 +1,251 @@
+/*
+ * Throughput of the hashes and AEADs that have architecture specific
+ * versions, in the manner of the speed modes of tcrypt.
+ *
+ * Every algorithm runs for sec seconds per buffer size, one request per
+ * buffer, and its output is compared with that of the generic C version
+ * where the latter is available. Load with alg=<name> to measure only one
+ * of them, e.g. alg=sha256-generic to get the numbers to compare with.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/jiffies.h>
+#include <linux/random.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <crypto/aead.h>
+#include <crypto/hash.h>
+
+#define TEST_MAX_LEN	8192
+#define TEST_ASSOC_LEN	16
+#define TEST_AUTHSIZE	16
+
+static char *alg;
+module_param(alg, charp, 0);
+MODULE_PARM_DESC(alg, "Only measure this algorithm or driver");
+
+static unsigned int sec = 1;
+module_param(sec, uint, 0);
+MODULE_PARM_DESC(sec, "Seconds to spend on every buffer size");
+
+struct speed_test {
+	const char *name;
+	const char *generic;
+	bool aead;
+	unsigned int keylen;
+};
+
+static const struct speed_test tests[] __initconst = {
+	{ "sha256", "sha256-generic", false, 0 },
+	{ "ghash", "ghash-generic", false, 16 },
+	{ "gcm(aes)", "gcm_base(ctr(aes-generic),ghash-generic)", true, 16 },
+	{ "gcm(aes)", "gcm_base(ctr(aes-generic),ghash-generic)", true, 32 },
+};
+
+static const unsigned int test_lens[] __initconst = {
+	16, 64, 256, 1024, 1420, 4096, TEST_MAX_LEN
+};
+
+struct speed_ctx {
+	struct crypto_shash *shash;
+	struct shash_desc *desc;
+	struct crypto_aead *aead;
+	struct aead_request *req;
+	struct scatterlist sg_assoc, sg_src, sg_dst;
+};
+
+static u8 *src, *dst, *ref;
+static u8 key[32], iv[16];
+static int errors;
+
+static void __init speed_ctx_free(struct speed_ctx *ctx)
+{
+	if (ctx->req)
+		aead_request_free(ctx->req);
+	if (ctx->aead)
+		crypto_free_aead(ctx->aead);
+	kfree(ctx->desc);
+	if (ctx->shash)
+		crypto_free_shash(ctx->shash);
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+static int __init speed_ctx_init(struct speed_ctx *ctx, const char *name,
+				 const struct speed_test *t)
+{
+	int err;
+
+	memset(ctx, 0, sizeof(*ctx));
+
+	if (t->aead) {
+		ctx->aead = crypto_alloc_aead(name, 0, CRYPTO_ALG_ASYNC);
+		if (IS_ERR(ctx->aead)) {
+			err = PTR_ERR(ctx->aead);
+			ctx->aead = NULL;
+			return err;
+		}
+		err = crypto_aead_setkey(ctx->aead, key, t->keylen);
+		if (!err)
+			err = crypto_aead_setauthsize(ctx->aead, TEST_AUTHSIZE);
+		if (err)
+			goto out;
+		ctx->req = aead_request_alloc(ctx->aead, GFP_KERNEL);
+		if (!ctx->req) {
+			err = -ENOMEM;
+			goto out;
+		}
+		aead_request_set_callback(ctx->req, 0, NULL, NULL);
+		sg_init_one(&ctx->sg_assoc, src + TEST_MAX_LEN, TEST_ASSOC_LEN);
+		aead_request_set_assoc(ctx->req, &ctx->sg_assoc,
+				       TEST_ASSOC_LEN);
+		return 0;
+	}
+
+	ctx->shash = crypto_alloc_shash(name, 0, 0);
+	if (IS_ERR(ctx->shash)) {
+		err = PTR_ERR(ctx->shash);
+		ctx->shash = NULL;
+		return err;
+	}
+	if (t->keylen) {
+		err = crypto_shash_setkey(ctx->shash, key, t->keylen);
+		if (err)
+			goto out;
+	}
+	ctx->desc = kmalloc(sizeof(*ctx->desc) +
+			    crypto_shash_descsize(ctx->shash), GFP_KERNEL);
+	if (!ctx->desc) {
+		err = -ENOMEM;
+		goto out;
+	}
+	ctx->desc->tfm = ctx->shash;
+	ctx->desc->flags = 0;
+	return 0;
+
+out:
+	speed_ctx_free(ctx);
+	return err;
+}
+
+static const char * __init speed_ctx_driver(struct speed_ctx *ctx)
+{
+	if (ctx->aead)
+		return crypto_tfm_alg_driver_name(crypto_aead_tfm(ctx->aead));
+	return crypto_tfm_alg_driver_name(crypto_shash_tfm(ctx->shash));
+}
+
+/* Hashes or encrypts len bytes of src to out, returns the output length */
+static int __init speed_ctx_run(struct speed_ctx *ctx, unsigned int len,
+				u8 *out)
+{
+	int err;
+
+	if (ctx->shash) {
+		err = crypto_shash_digest(ctx->desc, src, len, out);
+		return err ?: crypto_shash_digestsize(ctx->shash);
+	}
+
+	sg_init_one(&ctx->sg_src, src, len);
+	sg_init_one(&ctx->sg_dst, out, len + TEST_AUTHSIZE);
+	aead_request_set_crypt(ctx->req, &ctx->sg_src, &ctx->sg_dst, len, iv);
+	err = crypto_aead_encrypt(ctx->req);
+	return err ?: len + TEST_AUTHSIZE;
+}
+
+static unsigned long __init speed_ctx_ops(struct speed_ctx *ctx,
+					  unsigned int len)
+{
+	unsigned long end, ops = 0;
+
+	end = jiffies + sec * HZ;
+	while (time_before(jiffies, end)) {
+		if (speed_ctx_run(ctx, len, dst) < 0)
+			return 0;
+		ops++;
+		cond_resched();
+	}
+	return ops / sec;
+}
+
+static void __init test_speed(const struct speed_test *t, const char *name)
+{
+	struct speed_ctx ctx, gen;
+	unsigned long ops;
+	int i, len, ret;
+
+	ret = speed_ctx_init(&ctx, name, t);
+	if (ret) {
+		pr_info("%s: not available (%d)\n", name, ret);
+		return;
+	}
+	/* nothing to check the generic version against */
+	if (!strcmp(name, t->generic) || speed_ctx_init(&gen, t->generic, t))
+		memset(&gen, 0, sizeof(gen));
+
+	pr_info("%s (%s), %u byte key:\n", name, speed_ctx_driver(&ctx),
+		t->keylen);
+	for (i = 0; i < ARRAY_SIZE(test_lens); i++) {
+		len = speed_ctx_run(&ctx, test_lens[i], dst);
+		if (len > 0 && (gen.shash || gen.aead) &&
+		    (speed_ctx_run(&gen, test_lens[i], ref) != len ||
+		     memcmp(dst, ref, len))) {
+			pr_warn("%s: %u bytes: differs from %s\n", name,
+				test_lens[i], t->generic);
+			errors++;
+		}
+		if (len < 0) {
+			pr_warn("%s: %u bytes: returned %d\n", name,
+				test_lens[i], len);
+			errors++;
+			break;
+		}
+
+		ops = speed_ctx_ops(&ctx, test_lens[i]);
+		pr_info("%5u bytes: %8lu ops/s, %6lu MB/s\n", test_lens[i],
+			ops, (ops * test_lens[i]) >> 20);
+	}
+
+	speed_ctx_free(&gen);
+	speed_ctx_free(&ctx);
+}
+
+static int __init test_crypto_speed_init(void)
+{
+	const char *name;
+	int i;
+
+	src = kmalloc(TEST_MAX_LEN + TEST_ASSOC_LEN, GFP_KERNEL);
+	dst = kmalloc(TEST_MAX_LEN + TEST_AUTHSIZE, GFP_KERNEL);
+	ref = kmalloc(TEST_MAX_LEN + TEST_AUTHSIZE, GFP_KERNEL);
+	if (!src || !dst || !ref)
+		goto out;
+
+	get_random_bytes(src, TEST_MAX_LEN + TEST_ASSOC_LEN);
+	get_random_bytes(key, sizeof(key));
+	get_random_bytes(iv, sizeof(iv));
+	if (!sec)
+		sec = 1;
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		name = tests[i].name;
+		if (alg && !strcmp(alg, tests[i].generic))
+			name = tests[i].generic;
+		else if (alg && strcmp(alg, name))
+			continue;
+		test_speed(&tests[i], name);
+	}
+	if (errors)
+		pr_warn("%d tests failed\n", errors);
+
+out:
+	kfree(ref);
+	kfree(dst);
+	kfree(src);
+	return -EINVAL;
+}
+module_init(test_crypto_speed_init);
+MODULE_LICENSE("GPL");
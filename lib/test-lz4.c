@@ -0,0 +1,343 @@
+/*
+ * Test cases and throughput of the LZ4 compressors and decompressors.
+ *
+ * Every block is compressed with the fast compressor at a few accelerations
+ * and with the HC compressor at a few levels, then decompressed with each
+ * decoder. Truncated and corrupted blocks must be rejected by the safe
+ * decoder without writing past the end of its output.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/lz4.h>
+
+#define TEST_MAX_LEN	(128 * 1024)
+#define TEST_CANARY	0xa5
+#define TEST_SLACK	64
+
+enum test_input {
+	INPUT_TEXT,
+	INPUT_RANDOM,
+	INPUT_ZERO,
+	INPUT_RUNS,
+	NR_INPUTS
+};
+
+static const char * const input_names[NR_INPUTS] __initconst = {
+	"text", "random", "zero", "runs"
+};
+
+static const int test_lens[] __initconst = {
+	0, 1, 12, 13, 100, 4096, 65535, 65536, 65548, TEST_MAX_LEN
+};
+
+static const int test_accels[] __initconst = { 1, 4, 16, 64 };
+static const int test_levels[] __initconst = {
+	LZ4HC_MIN_CLEVEL, LZ4HC_DEFAULT_CLEVEL, LZ4HC_MAX_CLEVEL
+};
+
+static char *src, *cmp, *dst;
+static void *wrkmem, *hc_wrkmem;
+static struct rnd_state rnd;
+static int errors;
+
+static void __init fill_input(char *buf, int len, enum test_input input)
+{
+	static const char * const words[] __initconst = {
+		"the ", "kernel ", "block ", "page ", "swap ", "lz4 ",
+		"compress ", "\n", "0123456789 "
+	};
+	const char *w;
+	int i = 0;
+
+	switch (input) {
+	case INPUT_TEXT:
+		while (i < len) {
+			w = words[prandom_u32_state(&rnd) % ARRAY_SIZE(words)];
+			while (*w && i < len)
+				buf[i++] = *w++;
+		}
+		break;
+	case INPUT_RANDOM:
+		prandom_bytes_state(&rnd, buf, len);
+		break;
+	case INPUT_ZERO:
+		memset(buf, 0, len);
+		break;
+	case INPUT_RUNS:
+		for (; i < len; i++)
+			buf[i] = (i % 3 || !i) ?
+				prandom_u32_state(&rnd) : buf[i - 1];
+		break;
+	default:
+		break;
+	}
+}
+
+static void __init test_fail(const char *what, enum test_input input,
+			     int len, int arg, int ret)
+{
+	pr_warn("Test failed: %s, %s input, %d bytes, %d: returned %d\n",
+		what, input_names[input], len, arg, ret);
+	errors++;
+}
+
+/* Decompresses the block in cmp with every decoder and checks the result */
+static void __init test_decompress(const char *what, enum test_input input,
+				   int len, int arg, int clen)
+{
+	int ret;
+
+	memset(dst, TEST_CANARY, len + TEST_SLACK);
+	ret = LZ4_decompress_safe(cmp, dst, clen, len);
+	if (ret != len || memcmp(src, dst, len) ||
+	    (u8)dst[len] != TEST_CANARY)
+		test_fail(what, input, len, arg, ret);
+
+	memset(dst, TEST_CANARY, len + TEST_SLACK);
+	ret = LZ4_decompress_fast(cmp, dst, len);
+	if (ret != clen || memcmp(src, dst, len) ||
+	    (u8)dst[len] != TEST_CANARY)
+		test_fail(what, input, len, arg, ret);
+
+	if (len > 1) {
+		/* the output buffer is one byte short */
+		memset(dst, TEST_CANARY, len + TEST_SLACK);
+		ret = LZ4_decompress_safe(cmp, dst, clen, len - 1);
+		if (ret >= 0 || (u8)dst[len - 1] != TEST_CANARY)
+			test_fail(what, input, len, arg, ret);
+
+		/* only the first half is wanted */
+		memset(dst, TEST_CANARY, len + TEST_SLACK);
+		ret = LZ4_decompress_safe_partial(cmp, dst, clen, len / 2,
+						  len);
+		if (ret < len / 2 || memcmp(src, dst, len / 2))
+			test_fail(what, input, len, arg, ret);
+	}
+
+	if (clen > 1) {
+		/* the block is truncated */
+		ret = LZ4_decompress_safe(cmp, dst, clen - 1, len);
+		if (ret == len && !memcmp(src, dst, len))
+			test_fail(what, input, len, arg, ret);
+	}
+}
+
+static void __init test_roundtrip(enum test_input input, int len)
+{
+	size_t legacy_len, out_len;
+	int i, clen, limit;
+
+	fill_input(src, len, input);
+
+	for (i = 0; i < ARRAY_SIZE(test_accels); i++) {
+		clen = LZ4_compress_fast(src, cmp, len, LZ4_COMPRESSBOUND(len),
+					 test_accels[i], wrkmem);
+		if (clen <= 0) {
+			test_fail("compress", input, len, test_accels[i], clen);
+			continue;
+		}
+		test_decompress("compress", input, len, test_accels[i], clen);
+
+		/* a too small output buffer fails cleanly */
+		if (clen > 1) {
+			limit = clen - 1;
+			memset(cmp, TEST_CANARY, clen);
+			clen = LZ4_compress_fast(src, cmp, len, limit,
+						 test_accels[i], wrkmem);
+			if (clen != 0 || (u8)cmp[limit] != TEST_CANARY)
+				test_fail("compress limited", input, len,
+					  test_accels[i], clen);
+		}
+	}
+
+	for (i = 0; i < ARRAY_SIZE(test_levels); i++) {
+		clen = LZ4_compress_HC(src, cmp, len, LZ4_COMPRESSBOUND(len),
+				       test_levels[i], hc_wrkmem);
+		if (clen <= 0) {
+			test_fail("compress HC", input, len, test_levels[i],
+				  clen);
+			continue;
+		}
+		test_decompress("compress HC", input, len, test_levels[i],
+				clen);
+	}
+
+	/* the original interface */
+	if (lz4_compress((u8 *)src, len, (u8 *)cmp, &legacy_len, wrkmem)) {
+		test_fail("lz4_compress", input, len, 0, -1);
+		return;
+	}
+	out_len = len;
+	if (lz4_decompress_unknownoutputsize((u8 *)cmp, legacy_len,
+					     (u8 *)dst, &out_len) ||
+	    out_len != len || memcmp(src, dst, len))
+		test_fail("lz4_decompress_unknownoutputsize", input, len, 0,
+			  out_len);
+}
+
+/* Random bytes flipped in a valid block must never overrun the output */
+static void __init test_corrupted(void)
+{
+	int len = 4096, clen, ret, i;
+
+	fill_input(src, len, INPUT_TEXT);
+	clen = LZ4_compress_default(src, cmp, len, LZ4_COMPRESSBOUND(len),
+				    wrkmem);
+
+	for (i = 0; i < 10000; i++) {
+		int pos = prandom_u32_state(&rnd) % clen;
+		char old = cmp[pos];
+
+		cmp[pos] = prandom_u32_state(&rnd);
+		memset(dst, TEST_CANARY, len + TEST_SLACK);
+		ret = LZ4_decompress_safe(cmp, dst, clen, len);
+		if (ret > len || (u8)dst[len] != TEST_CANARY)
+			test_fail("corrupted", INPUT_TEXT, len, pos, ret);
+		cmp[pos] = old;
+	}
+}
+
+/* Consecutive blocks that refer back to each other */
+static void __init test_stream(void)
+{
+	static LZ4_streamDecode_t decode __initdata;
+	LZ4_stream_t *stream = wrkmem;
+	int block = 4096, len = 16 * block;
+	int off, clen, ret;
+
+	fill_input(src, len, INPUT_TEXT);
+	LZ4_resetStream(stream);
+	LZ4_setStreamDecode(&decode, NULL, 0);
+
+	for (off = 0; off < len; off += block) {
+		clen = LZ4_compress_fast_continue(stream, src + off, cmp,
+						  block, LZ4_COMPRESSBOUND(block),
+						  LZ4_ACCELERATION_DEFAULT);
+		if (clen <= 0) {
+			test_fail("stream compress", INPUT_TEXT, block, off,
+				  clen);
+			return;
+		}
+		ret = LZ4_decompress_safe_continue(&decode, cmp, dst + off,
+						   clen, block);
+		if (ret != block || memcmp(src + off, dst + off, block)) {
+			test_fail("stream decompress", INPUT_TEXT, block, off,
+				  ret);
+			return;
+		}
+	}
+
+	/* a block compressed against a dictionary */
+	LZ4_loadDict(stream, src, 8 * block);
+	clen = LZ4_compress_fast_continue(stream, src + 8 * block, cmp,
+					  block, LZ4_COMPRESSBOUND(block),
+					  LZ4_ACCELERATION_DEFAULT);
+	ret = LZ4_decompress_safe_usingDict(cmp, dst, clen, block, src,
+					    8 * block);
+	if (ret != block || memcmp(src + 8 * block, dst, block))
+		test_fail("dictionary", INPUT_TEXT, block, clen, ret);
+}
+
+static u64 __init test_bench_one(int (*fn)(int len), int len, int loops)
+{
+	ktime_t start;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++)
+		fn(len);
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int bench_clen;
+
+static int __init bench_compress(int len)
+{
+	return bench_clen = LZ4_compress_default(src, cmp, len,
+			LZ4_COMPRESSBOUND(len), wrkmem);
+}
+
+static int __init bench_compress_hc(int len)
+{
+	return LZ4_compress_HC(src, cmp, len, LZ4_COMPRESSBOUND(len),
+			       LZ4HC_DEFAULT_CLEVEL, hc_wrkmem);
+}
+
+static int __init bench_decompress_safe(int len)
+{
+	return LZ4_decompress_safe(cmp, dst, bench_clen, len);
+}
+
+static int __init bench_decompress_fast(int len)
+{
+	return LZ4_decompress_fast(cmp, dst, len);
+}
+
+static void __init test_bench(void)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(int len);
+		int mb;
+	} benches[] __initconst = {
+		{ "compress HC", bench_compress_hc, 4 },
+		{ "compress", bench_compress, 64 },
+		{ "decompress_safe", bench_decompress_safe, 256 },
+		{ "decompress_fast", bench_decompress_fast, 256 },
+	};
+	int len = 4096, i;
+	u64 nsec;
+
+	fill_input(src, len, INPUT_TEXT);
+	for (i = 0; i < ARRAY_SIZE(benches); i++) {
+		nsec = test_bench_one(benches[i].fn, len,
+				      (benches[i].mb << 20) / len);
+		pr_info("%s: %d bytes: %llu MB/s\n", benches[i].name, len,
+			div64_u64((u64)benches[i].mb * NSEC_PER_SEC,
+				  nsec ?: 1));
+	}
+	pr_info("text compresses to %d of %d bytes\n", bench_clen, len);
+}
+
+static int __init test_lz4_init(void)
+{
+	int i, j;
+
+	src = vmalloc(TEST_MAX_LEN);
+	cmp = vmalloc(LZ4_COMPRESSBOUND(TEST_MAX_LEN));
+	dst = vmalloc(TEST_MAX_LEN + TEST_SLACK);
+	wrkmem = vmalloc(LZ4_MEM_COMPRESS);
+	hc_wrkmem = vmalloc(LZ4HC_MEM_COMPRESS);
+	if (!src || !cmp || !dst || !wrkmem || !hc_wrkmem)
+		goto out;
+
+	pr_info("Running tests...\n");
+	prandom_seed_state(&rnd, 42);
+	for (i = 0; i < NR_INPUTS; i++)
+		for (j = 0; j < ARRAY_SIZE(test_lens); j++)
+			test_roundtrip(i, test_lens[j]);
+	test_corrupted();
+	test_stream();
+	if (errors)
+		pr_warn("%d tests failed\n", errors);
+	else
+		test_bench();
+
+out:
+	vfree(hc_wrkmem);
+	vfree(wrkmem);
+	vfree(dst);
+	vfree(cmp);
+	vfree(src);
+	return -EINVAL;
+}
+module_init(test_lz4_init);
+MODULE_LICENSE("Dual BSD/GPL");
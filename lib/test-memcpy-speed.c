@@ -0,0 +1,241 @@
+/*
+ * Test cases and throughput of memcpy(), memset() to zero, copy_page() and
+ * clear_page() by size and alignment.
+ *
+ * Every case runs twice, once in process context and once with bottom
+ * halves disabled. Architectures with SIMD versions of these, like ARM with
+ * kernel mode NEON, can only use them in the former and fall back to their
+ * integer versions in the latter, so the two columns compare both.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bottom_half.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#define TEST_MAX_LEN	(64 * 1024)
+#define TEST_SLACK	64
+#define TEST_CANARY	0xa5
+#define TEST_ORDER	get_order(TEST_MAX_LEN + 2 * TEST_SLACK)
+
+enum test_op {
+	OP_MEMCPY,
+	OP_MEMZERO,
+	OP_COPY_PAGE,
+	OP_CLEAR_PAGE,
+	NR_OPS
+};
+
+static const char * const op_names[NR_OPS] __initconst = {
+	"memcpy", "memset 0", "copy_page", "clear_page"
+};
+
+static const unsigned int test_lens[] __initconst = {
+	64, 256, 512, 1024, 4096, 16384, TEST_MAX_LEN
+};
+
+static const struct {
+	unsigned int src, dst;
+} test_aligns[] __initconst = {
+	{ 0, 0 }, { 1, 1 }, { 0, 3 }, { 3, 0 }
+};
+
+/* the page size and the lengths around which NEON and the tails kick in */
+static const unsigned int check_bases[] __initconst = {
+	1024, PAGE_SIZE, 3 * PAGE_SIZE
+};
+
+static const unsigned int check_offs[] __initconst = { 0, 1, 3, 8, 15 };
+
+static u8 *src, *dst;
+static int errors;
+
+static void __init test_fail(enum test_op op, unsigned int len,
+			     unsigned int soff, unsigned int doff, bool bh)
+{
+	pr_warn("Test failed: %s, %u bytes, src+%u dst+%u%s\n", op_names[op],
+		len, soff, doff, bh ? ", bh off" : "");
+	errors++;
+}
+
+static void __init run_op(enum test_op op, unsigned int len,
+			  unsigned int soff, unsigned int doff)
+{
+	switch (op) {
+	case OP_MEMCPY:
+		memcpy(dst + doff, src + soff, len);
+		break;
+	case OP_MEMZERO:
+		memset(dst + doff, 0, len);
+		break;
+	case OP_COPY_PAGE:
+		copy_page(dst, src);
+		break;
+	case OP_CLEAR_PAGE:
+		clear_page(dst);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Checks the result of op and that the bytes next to it are untouched */
+static void __init check_op(enum test_op op, unsigned int len,
+			    unsigned int soff, unsigned int doff, bool bh)
+{
+	unsigned int i;
+	u8 *d;
+
+	memset(dst, TEST_CANARY, len + doff + 2 * TEST_SLACK);
+	d = dst + TEST_SLACK + doff;
+	if (bh)
+		local_bh_disable();
+	run_op(op, len, soff, TEST_SLACK + doff);
+	if (bh)
+		local_bh_enable();
+
+	if (d[-1] != TEST_CANARY || d[len] != TEST_CANARY) {
+		test_fail(op, len, soff, doff, bh);
+		return;
+	}
+	for (i = 0; i < len; i++) {
+		if (d[i] != (op == OP_MEMCPY ? src[soff + i] : 0)) {
+			test_fail(op, len, soff, doff, bh);
+			return;
+		}
+	}
+}
+
+static void __init check_page_op(enum test_op op, bool bh)
+{
+	memset(dst, TEST_CANARY, 2 * PAGE_SIZE);
+	if (bh)
+		local_bh_disable();
+	run_op(op, PAGE_SIZE, 0, 0);
+	if (bh)
+		local_bh_enable();
+
+	if (dst[PAGE_SIZE] != TEST_CANARY ||
+	    (op == OP_COPY_PAGE ? memcmp(dst, src, PAGE_SIZE) != 0 :
+	     memchr_inv(dst, 0, PAGE_SIZE) != NULL))
+		test_fail(op, PAGE_SIZE, 0, 0, bh);
+}
+
+static void __init check_len(unsigned int len, bool bh)
+{
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(check_offs); i++) {
+		for (j = 0; j < ARRAY_SIZE(check_offs); j++)
+			check_op(OP_MEMCPY, len, check_offs[i], check_offs[j],
+				 bh);
+		check_op(OP_MEMZERO, len, 0, check_offs[i], bh);
+	}
+	cond_resched();
+}
+
+static void __init test_check(bool bh)
+{
+	unsigned int len;
+	int i;
+
+	for (len = 0; len <= 256; len++)
+		check_len(len, bh);
+	for (i = 0; i < ARRAY_SIZE(check_bases); i++)
+		for (len = check_bases[i] - 66; len <= check_bases[i] + 66;
+		     len++)
+			check_len(len, bh);
+
+	check_page_op(OP_COPY_PAGE, bh);
+	check_page_op(OP_CLEAR_PAGE, bh);
+}
+
+/* Returns MB/s of op over 16MB worth of calls */
+static u64 __init bench_op(enum test_op op, unsigned int len,
+			   unsigned int soff, unsigned int doff, bool bh)
+{
+	unsigned int loops = (16 << 20) / len, i;
+	ktime_t start;
+	u64 nsec;
+
+	if (bh)
+		local_bh_disable();
+	start = ktime_get();
+	for (i = 0; i < loops; i++)
+		run_op(op, len, soff, doff);
+	nsec = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (bh)
+		local_bh_enable();
+
+	return div64_u64((u64)loops * len * NSEC_PER_SEC, nsec ?: 1) >> 20;
+}
+
+static void __init test_bench(void)
+{
+	unsigned int len, soff, doff;
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(test_lens); i++) {
+		len = test_lens[i];
+		for (j = 0; j < ARRAY_SIZE(test_aligns); j++) {
+			soff = test_aligns[j].src;
+			doff = test_aligns[j].dst;
+			pr_info("%-10s %5u bytes, src+%u dst+%u: %5llu MB/s, %5llu MB/s with bh off\n",
+				op_names[OP_MEMCPY], len, soff, doff,
+				bench_op(OP_MEMCPY, len, soff, doff, false),
+				bench_op(OP_MEMCPY, len, soff, doff, true));
+			cond_resched();
+		}
+		for (j = 0; j < ARRAY_SIZE(test_aligns); j++) {
+			/* src+1 dst+1 again has dst+1 */
+			if (test_aligns[j].src)
+				continue;
+			doff = test_aligns[j].dst;
+			pr_info("%-10s %5u bytes, dst+%u: %5llu MB/s, %5llu MB/s with bh off\n",
+				op_names[OP_MEMZERO], len, doff,
+				bench_op(OP_MEMZERO, len, 0, doff, false),
+				bench_op(OP_MEMZERO, len, 0, doff, true));
+			cond_resched();
+		}
+	}
+
+	for (i = OP_COPY_PAGE; i <= OP_CLEAR_PAGE; i++)
+		pr_info("%-10s %5lu bytes: %5llu MB/s, %5llu MB/s with bh off\n",
+			op_names[i], PAGE_SIZE,
+			bench_op(i, PAGE_SIZE, 0, 0, false),
+			bench_op(i, PAGE_SIZE, 0, 0, true));
+}
+
+static int __init test_memcpy_speed_init(void)
+{
+	src = (u8 *)__get_free_pages(GFP_KERNEL, TEST_ORDER);
+	dst = (u8 *)__get_free_pages(GFP_KERNEL, TEST_ORDER);
+	if (!src || !dst)
+		goto out;
+
+	get_random_bytes(src, TEST_MAX_LEN + 2 * TEST_SLACK);
+
+	pr_info("Running tests...\n");
+	test_check(false);
+	test_check(true);
+	if (errors)
+		pr_warn("%d tests failed\n", errors);
+	else
+		test_bench();
+
+out:
+	if (dst)
+		free_pages((unsigned long)dst, TEST_ORDER);
+	if (src)
+		free_pages((unsigned long)src, TEST_ORDER);
+	return -EINVAL;
+}
+module_init(test_memcpy_speed_init);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,196 @@
+/*
+ * Test cases of the lockless pfifo_fast qdisc on a fake single queue
+ * device whose transmit queue the test stops and wakes.
+ *
+ * While the queue is stopped the qdisc must go idle, even with
+ * __QDISC_STATE_MISSED set by a sender that lost the race for run_lock,
+ * both with packets left in the rings and with a packet the driver handed
+ * back. Rescheduling it would only spin in net_tx_action() until the
+ * driver wakes the queue, which in turn must get every packet out.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bottom_half.h>
+#include <linux/delay.h>
+#include <linux/if_arp.h>
+#include <linux/netdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/skbuff.h>
+#include <net/sch_generic.h>
+#include <net/pkt_sched.h>
+
+#define TEST_MARK	0x71d15c
+
+struct test_priv {
+	atomic_t	sent;
+	bool		busy;
+};
+
+static struct net_device *test_dev;
+static int errors;
+
+static netdev_tx_t test_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct test_priv *priv = netdev_priv(dev);
+
+	/* a full ring: stop the queue and hand the packet back */
+	if (ACCESS_ONCE(priv->busy)) {
+		netif_stop_queue(dev);
+		return NETDEV_TX_BUSY;
+	}
+
+	if (skb->mark == TEST_MARK)
+		atomic_inc(&priv->sent);
+	dev_kfree_skb(skb);
+	return NETDEV_TX_OK;
+}
+
+static const struct net_device_ops test_netdev_ops = {
+	.ndo_start_xmit	= test_xmit,
+};
+
+static void test_setup(struct net_device *dev)
+{
+	dev->netdev_ops = &test_netdev_ops;
+	dev->type = ARPHRD_NONE;
+	dev->flags = IFF_NOARP;
+	dev->mtu = ETH_DATA_LEN;
+	dev->tx_queue_len = 16;
+}
+
+static void __init test_fail(const char *what, struct Qdisc *q)
+{
+	pr_warn("Test failed: %s, state %lx, %d sent\n", what, q->state,
+		atomic_read(&((struct test_priv *)netdev_priv(test_dev))->sent));
+	errors++;
+}
+
+static void __init test_send(void)
+{
+	struct sk_buff *skb;
+
+	skb = alloc_skb(ETH_ZLEN, GFP_KERNEL);
+	if (!skb) {
+		errors++;
+		return;
+	}
+	memset(skb_put(skb, ETH_ZLEN), 0, ETH_ZLEN);
+	skb->dev = test_dev;
+	skb->mark = TEST_MARK;
+	dev_queue_xmit(skb);
+}
+
+/* Runs q with MISSED set and tells whether it stayed idle afterwards */
+static bool __init test_run_missed(struct Qdisc *q)
+{
+	bool idle;
+
+	/* keep net_tx_action() from running before we look */
+	local_bh_disable();
+	set_bit(__QDISC_STATE_MISSED, &q->state);
+	qdisc_run(q);
+	idle = !test_bit(__QDISC_STATE_MISSED, &q->state) &&
+	       !test_bit(__QDISC_STATE_SCHED, &q->state);
+	local_bh_enable();
+
+	return idle;
+}
+
+static void __init test_wait_sent(struct Qdisc *q, int n, const char *what)
+{
+	struct test_priv *priv = netdev_priv(test_dev);
+	int i;
+
+	for (i = 0; i < 100 && atomic_read(&priv->sent) < n; i++)
+		msleep(1);
+	if (atomic_read(&priv->sent) < n)
+		test_fail(what, q);
+}
+
+/* Packets in the rings, and dequeue_skb() does not call ->dequeue */
+static void __init test_stopped(struct Qdisc *q, struct netdev_queue *txq)
+{
+	struct test_priv *priv = netdev_priv(test_dev);
+	int sent = atomic_read(&priv->sent);
+
+	netif_tx_stop_queue(txq);
+	test_send();
+	test_send();
+	if (!test_run_missed(q))
+		test_fail("stopped queue rescheduled", q);
+
+	netif_tx_wake_queue(txq);
+	test_wait_sent(q, sent + 2, "stopped queue not woken");
+}
+
+/* A packet the driver handed back, waiting in q->gso_skb */
+static void __init test_requeued(struct Qdisc *q, struct netdev_queue *txq)
+{
+	struct test_priv *priv = netdev_priv(test_dev);
+	int sent = atomic_read(&priv->sent);
+
+	ACCESS_ONCE(priv->busy) = true;
+	test_send();
+	/* let the run scheduled by the requeue go by */
+	msleep(10);
+	if (!q->gso_skb || !netif_xmit_stopped(txq)) {
+		test_fail("no packet requeued", q);
+		ACCESS_ONCE(priv->busy) = false;
+		netif_tx_wake_queue(txq);
+		return;
+	}
+	if (!test_run_missed(q))
+		test_fail("requeued packet rescheduled", q);
+
+	ACCESS_ONCE(priv->busy) = false;
+	netif_tx_wake_queue(txq);
+	test_wait_sent(q, sent + 1, "requeued packet not woken");
+}
+
+static int __init test_qdisc_nolock_init(void)
+{
+	struct netdev_queue *txq;
+	struct Qdisc *q;
+	int err;
+
+	test_dev = alloc_netdev(sizeof(struct test_priv), "qdtest%d",
+				test_setup);
+	if (!test_dev)
+		return -ENOMEM;
+	err = register_netdev(test_dev);
+	if (err) {
+		free_netdev(test_dev);
+		return err;
+	}
+	rtnl_lock();
+	err = dev_open(test_dev);
+	rtnl_unlock();
+	if (err)
+		goto out;
+
+	txq = netdev_get_tx_queue(test_dev, 0);
+	q = txq->qdisc_sleeping;
+	if (!(q->flags & TCQ_F_NOLOCK)) {
+		pr_warn("%s is not a lockless qdisc\n", q->ops->id);
+		errors++;
+		goto out;
+	}
+
+	pr_info("Running tests...\n");
+	test_stopped(q, txq);
+	test_requeued(q, txq);
+	if (errors)
+		pr_warn("%d tests failed\n", errors);
+	else
+		pr_info("all tests passed\n");
+
+out:
+	unregister_netdev(test_dev);
+	free_netdev(test_dev);
+	return -EINVAL;
+}
+module_init(test_qdisc_nolock_init);
+MODULE_LICENSE("GPL");
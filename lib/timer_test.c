@@ -0,0 +1,131 @@
+/*
+ * Synthetic timer wheel load: arm many timeouts, push them forward and
+ * cancel them before they ever expire, the way network and driver
+ * timeouts behave.  Reports the cost of each operation and how much timer
+ * softirq activity a wheel full of never-expiring timers causes.
+ */
+#include <linux/module.h>
+#include <linux/timer.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/delay.h>
+#include <linux/interrupt.h>
+#include <linux/kernel_stat.h>
+#include <asm/timex.h>
+
+static unsigned int nr_timers = 10000;
+module_param(nr_timers, uint, 0444);
+MODULE_PARM_DESC(nr_timers, "number of concurrently armed timers");
+
+static unsigned int max_timeout_ms = 120000;
+module_param(max_timeout_ms, uint, 0444);
+MODULE_PARM_DESC(max_timeout_ms, "upper bound of the random timeouts");
+
+static unsigned int rearm_loops = 10;
+module_param(rearm_loops, uint, 0444);
+MODULE_PARM_DESC(rearm_loops, "number of times every timer is pushed forward");
+
+static unsigned int hold_ms = 5000;
+module_param(hold_ms, uint, 0444);
+MODULE_PARM_DESC(hold_ms, "time the timers stay armed before cancelling");
+
+static struct timer_list *timers;
+static atomic_t fired;
+static struct rnd_state rnd;
+
+static void timer_test_fn(unsigned long data)
+{
+	atomic_inc(&fired);
+}
+
+static unsigned long random_timeout(void)
+{
+	u32 ms = prandom_u32_state(&rnd) % max_timeout_ms;
+
+	return jiffies + msecs_to_jiffies(ms) + 1;
+}
+
+static unsigned long timer_softirqs(void)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += kstat_softirqs_cpu(TIMER_SOFTIRQ, cpu);
+	return sum;
+}
+
+static void report(const char *what, cycles_t time, unsigned long ops)
+{
+	printk(KERN_ALERT "timer test: %-8s %llu cycles/op\n", what,
+	       (unsigned long long)div_u64(time, ops ? ops : 1));
+}
+
+static int __init timer_test_init(void)
+{
+	cycles_t time1, time2;
+	unsigned long softirqs;
+	unsigned int i, j;
+
+	if (!nr_timers || !max_timeout_ms)
+		return -EINVAL;
+
+	timers = vmalloc(nr_timers * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	prandom_seed_state(&rnd, 3141592653589793238ULL);
+	atomic_set(&fired, 0);
+	for (i = 0; i < nr_timers; i++)
+		setup_timer(&timers[i], timer_test_fn, i);
+
+	printk(KERN_ALERT "timer test: %u timers, timeouts up to %u ms\n",
+	       nr_timers, max_timeout_ms);
+
+	/* arm */
+	time1 = get_cycles();
+	for (i = 0; i < nr_timers; i++)
+		mod_timer(&timers[i], random_timeout());
+	time2 = get_cycles();
+	report("arm", time2 - time1, nr_timers);
+
+	/* push pending timers forward, like retransmit and keepalive timers */
+	time1 = get_cycles();
+	for (j = 0; j < rearm_loops; j++)
+		for (i = 0; i < nr_timers; i++)
+			mod_timer_pending(&timers[i], random_timeout());
+	time2 = get_cycles();
+	report("rearm", time2 - time1, nr_timers * rearm_loops);
+
+	/* let the wheel carry the timers for a while */
+	softirqs = timer_softirqs();
+	msleep(hold_ms);
+	softirqs = timer_softirqs() - softirqs;
+
+	/* cancel before they expire */
+	time1 = get_cycles();
+	for (i = 0; i < nr_timers; i++)
+		del_timer(&timers[i]);
+	time2 = get_cycles();
+	report("cancel", time2 - time1, nr_timers);
+
+	printk(KERN_ALERT "timer test: %lu timer softirqs in %u ms, %d timers expired\n",
+	       softirqs, hold_ms, atomic_read(&fired));
+
+	for (i = 0; i < nr_timers; i++)
+		del_timer_sync(&timers[i]);
+	vfree(timers);
+
+	return -EAGAIN; /* Fail will directly unload the module */
+}
+
+static void __exit timer_test_exit(void)
+{
+	printk(KERN_ALERT "test exit\n");
+}
+
+module_init(timer_test_init)
+module_exit(timer_test_exit)
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Timer wheel arm/cancel benchmark");
@@ -129,6 +129,8 @@
 #include <linux/inetdevice.h>
 #include <linux/cpu_rmap.h>
 #include <linux/static_key.h>
+#include <linux/hashtable.h>
+#include <net/busy_poll.h>
 
 #include "net-sysfs.h"
 
@@ -2625,6 +2627,7 @@ out_kfree_skb:
 out:
 	return rc;
 }
+EXPORT_SYMBOL_GPL(dev_hard_start_xmit);
 
 static void qdisc_pkt_len_init(struct sk_buff *skb)
 {
@@ -2666,6 +2669,22 @@ static inline int __dev_xmit_skb(struct sk_buff *skb, struct Qdisc *q,
 
 	qdisc_pkt_len_init(skb);
 	qdisc_calculate_pkt_len(skb, q);
+
+	if (q->flags & TCQ_F_NOLOCK) {
+		/* enqueue is safe against other CPUs, and whoever owns the
+		 * qdisc will find our packet if qdisc_run() can't take it
+		 */
+		if (unlikely(test_bit(__QDISC_STATE_DEACTIVATED, &q->state))) {
+			kfree_skb(skb);
+			rc = NET_XMIT_DROP;
+		} else {
+			skb_dst_force(skb);
+			rc = q->enqueue(skb, q) & NET_XMIT_MASK;
+			qdisc_run(q);
+		}
+		return rc;
+	}
+
 	/*
 	 * Heuristic to force contended enqueues to serialize on a
 	 * separate lock before trying to get qdisc main lock.
@@ -3234,7 +3253,7 @@ static void net_tx_action(struct softirq_action *h)
 
 			WARN_ON(atomic_read(&skb->users));
 			trace_kfree_skb(skb, net_tx_action);
-			__kfree_skb(skb);
+			__kfree_skb_defer(skb);
 		}
 	}
 
@@ -3253,6 +3272,13 @@ static void net_tx_action(struct softirq_action *h)
 
 			head = head->next_sched;
 
+			if (q->flags & TCQ_F_NOLOCK) {
+				smp_mb__before_atomic();
+				clear_bit(__QDISC_STATE_SCHED, &q->state);
+				qdisc_run(q);
+				continue;
+			}
+
 			root_lock = qdisc_lock(q);
 			if (spin_trylock(root_lock)) {
 				smp_mb__before_atomic();
@@ -3852,9 +3878,9 @@ static gro_result_t napi_skb_finish(gro_result_t ret, struct sk_buff *skb)
 
 	case GRO_MERGED_FREE:
 		if (NAPI_GRO_CB(skb)->free == NAPI_GRO_FREE_STOLEN_HEAD)
-			kmem_cache_free(skbuff_head_cache, skb);
+			napi_skb_free_stolen_head(skb);
 		else
-			__kfree_skb(skb);
+			__kfree_skb_defer(skb);
 		break;
 
 	case GRO_HELD:
@@ -3884,6 +3910,7 @@ static void skb_gro_reset_offset(struct sk_buff *skb)
 
 gro_result_t napi_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
+	skb_mark_napi_id(skb, napi);
 	skb_gro_reset_offset(skb);
 
 	return napi_skb_finish(dev_gro_receive(napi, skb), skb);
@@ -3985,6 +4012,7 @@ gro_result_t napi_gro_frags(struct napi_struct *napi)
 	if (!skb)
 		return GRO_DROP;
 
+	skb_mark_napi_id(skb, napi);
 	return napi_frags_finish(napi, skb, dev_gro_receive(napi, skb));
 }
 EXPORT_SYMBOL(napi_gro_frags);
@@ -4122,6 +4150,122 @@ void napi_complete(struct napi_struct *n)
 }
 EXPORT_SYMBOL(napi_complete);
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+
+/* Budget of a single busy poll, kept small to bound the spin granularity */
+#define BUSY_POLL_BUDGET 8
+
+static DEFINE_SPINLOCK(napi_hash_lock);
+static unsigned int napi_gen_id;
+static DEFINE_HASHTABLE(napi_hash, 8);
+
+struct napi_struct *napi_by_id(unsigned int napi_id)
+{
+	struct napi_struct *napi;
+
+	hash_for_each_possible_rcu(napi_hash, napi, napi_hash_node, napi_id)
+		if (napi->napi_id == napi_id)
+			return napi;
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(napi_by_id);
+
+static void napi_hash_add(struct napi_struct *napi)
+{
+	if (test_and_set_bit(NAPI_STATE_HASHED, &napi->state))
+		return;
+
+	spin_lock(&napi_hash_lock);
+
+	/* 0 is not a valid id, we also skip an id that is taken.
+	 * We expect both events to be extremely rare.
+	 */
+	do {
+		if (unlikely(++napi_gen_id < 1))
+			napi_gen_id = 1;
+	} while (napi_by_id(napi_gen_id));
+	napi->napi_id = napi_gen_id;
+
+	hash_add_rcu(napi_hash, &napi->napi_hash_node, napi->napi_id);
+
+	spin_unlock(&napi_hash_lock);
+}
+
+/* Warning : caller is responsible to make sure rcu grace period
+ * is respected before freeing memory containing @napi
+ */
+static bool napi_hash_del(struct napi_struct *napi)
+{
+	bool rcu_sync_needed = false;
+
+	spin_lock(&napi_hash_lock);
+
+	if (test_and_clear_bit(NAPI_STATE_HASHED, &napi->state)) {
+		rcu_sync_needed = true;
+		hash_del_rcu(&napi->napi_hash_node);
+	}
+	spin_unlock(&napi_hash_lock);
+	return rcu_sync_needed;
+}
+
+int napi_busy_poll(struct napi_struct *napi)
+{
+	LIST_HEAD(busy_list);
+	void *have;
+	int work;
+
+	/* Take the context the way napi_schedule() would, but run it
+	 * right here instead of queueing it to the softirq.
+	 */
+	if (napi_disable_pending(napi) ||
+	    test_and_set_bit(NAPI_STATE_SCHED, &napi->state))
+		return -1;
+
+	have = netpoll_poll_lock(napi);
+
+	/* __napi_complete() expects the context to be on a poll list */
+	list_add(&napi->poll_list, &busy_list);
+
+	work = napi->poll(napi, BUSY_POLL_BUDGET);
+	trace_napi_poll(napi);
+
+	WARN_ON_ONCE(work > BUSY_POLL_BUDGET);
+
+	/* Driver did not complete, there is more work: let the softirq
+	 * carry on with it, like net_rx_action() does.
+	 */
+	if (work == BUSY_POLL_BUDGET) {
+		list_del_init(&napi->poll_list);
+		napi_gro_flush(napi, HZ >= 1000);
+		__napi_schedule(napi);
+	} else if (WARN_ON_ONCE(!list_empty(&busy_list))) {
+		/* poll() stopped short of the budget without completing,
+		 * the context must not be left linked to this stack frame.
+		 * Hand it to the softirq, which will poll it again.
+		 */
+		list_del_init(&napi->poll_list);
+		__napi_schedule(napi);
+	}
+
+	netpoll_poll_unlock(have);
+	return work;
+}
+EXPORT_SYMBOL_GPL(napi_busy_poll);
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+
+static inline void napi_hash_add(struct napi_struct *napi)
+{
+}
+
+static inline bool napi_hash_del(struct napi_struct *napi)
+{
+	return false;
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		    int (*poll)(struct napi_struct *, int), int weight)
 {
@@ -4141,6 +4285,7 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 	napi->poll_owner = -1;
 #endif
 	set_bit(NAPI_STATE_SCHED, &napi->state);
+	napi_hash_add(napi);
 }
 EXPORT_SYMBOL(netif_napi_add);
 
@@ -4148,6 +4293,9 @@ void netif_napi_del(struct napi_struct *napi)
 {
 	struct sk_buff *skb, *next;
 
+	might_sleep();
+	if (napi_hash_del(napi))
+		synchronize_net();
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
@@ -62,6 +62,7 @@
 #include <linux/scatterlist.h>
 #include <linux/errqueue.h>
 #include <linux/prefetch.h>
+#include <linux/cpu.h>
 
 #include <net/protocol.h>
 #include <net/dst.h>
@@ -296,16 +297,12 @@ EXPORT_SYMBOL(__alloc_skb);
  *  before giving packet to stack.
  *  RX rings only contains data buffers, not full skbs.
  */
-struct sk_buff *build_skb(void *data, unsigned int frag_size)
+static void __build_skb_around(struct sk_buff *skb, void *data,
+			       unsigned int frag_size)
 {
 	struct skb_shared_info *shinfo;
-	struct sk_buff *skb;
 	unsigned int size = frag_size ? : ksize(data);
 
-	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
-	if (!skb)
-		return NULL;
-
 	size -= SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 
 	memset(skb, 0, offsetof(struct sk_buff, tail));
@@ -326,7 +323,17 @@ struct sk_buff *build_skb(void *data, unsigned int frag_size)
 	memset(shinfo, 0, offsetof(struct skb_shared_info, dataref));
 	atomic_set(&shinfo->dataref, 1);
 	kmemcheck_annotate_variable(shinfo->destructor_arg);
+}
+
+struct sk_buff *build_skb(void *data, unsigned int frag_size)
+{
+	struct sk_buff *skb;
+
+	skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
+	if (!skb)
+		return NULL;
 
+	__build_skb_around(skb, data, frag_size);
 	return skb;
 }
 EXPORT_SYMBOL(build_skb);
@@ -340,15 +347,30 @@ struct netdev_alloc_cache {
 };
 static DEFINE_PER_CPU(struct netdev_alloc_cache, netdev_alloc_cache);
 
-static void *__netdev_alloc_frag(unsigned int fragsz, gfp_t gfp_mask)
+/*
+ * NAPI poll routines run in softirq context only, so the NAPI allocation
+ * cache can do without the interrupt disabling of netdev_alloc_cache.
+ * Besides a page to carve fragments from it holds a stack of skb heads,
+ * refilled from and trimmed to skbuff_head_cache NAPI_SKB_CACHE_BULK
+ * heads at a time. Heads of skbs consumed in softirq context go back on
+ * the stack, so at a steady packet rate most heads never see the slab.
+ */
+#define NAPI_SKB_CACHE_SIZE	64
+#define NAPI_SKB_CACHE_BULK	16
+
+struct napi_alloc_cache {
+	struct netdev_alloc_cache page;
+	unsigned int skb_count;
+	void *skb_cache[NAPI_SKB_CACHE_SIZE];
+};
+static DEFINE_PER_CPU(struct napi_alloc_cache, napi_alloc_cache);
+
+static void *__alloc_page_frag(struct netdev_alloc_cache *nc,
+			       unsigned int fragsz, gfp_t gfp_mask)
 {
-	struct netdev_alloc_cache *nc;
 	void *data = NULL;
 	int order;
-	unsigned long flags;
 
-	local_irq_save(flags);
-	nc = &__get_cpu_var(netdev_alloc_cache);
 	if (unlikely(!nc->frag.page)) {
 refill:
 		for (order = NETDEV_FRAG_PAGE_MAX_ORDER; ;) {
@@ -381,6 +403,17 @@ recycle:
 	nc->frag.offset += fragsz;
 	nc->pagecnt_bias--;
 end:
+	return data;
+}
+
+static void *__netdev_alloc_frag(unsigned int fragsz, gfp_t gfp_mask)
+{
+	void *data;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	data = __alloc_page_frag(&__get_cpu_var(netdev_alloc_cache), fragsz,
+				 gfp_mask);
 	local_irq_restore(flags);
 	return data;
 }
@@ -443,6 +476,94 @@ struct sk_buff *__netdev_alloc_skb(struct net_device *dev,
 }
 EXPORT_SYMBOL(__netdev_alloc_skb);
 
+static struct sk_buff *napi_skb_cache_get(void)
+{
+	struct napi_alloc_cache *nc = &__get_cpu_var(napi_alloc_cache);
+	void *skb;
+
+	if (unlikely(!nc->skb_count)) {
+		while (nc->skb_count < NAPI_SKB_CACHE_BULK) {
+			skb = kmem_cache_alloc(skbuff_head_cache, GFP_ATOMIC);
+			if (!skb)
+				break;
+			nc->skb_cache[nc->skb_count++] = skb;
+		}
+		if (unlikely(!nc->skb_count))
+			return NULL;
+	}
+
+	return nc->skb_cache[--nc->skb_count];
+}
+
+static void napi_skb_cache_put(struct sk_buff *skb)
+{
+	struct napi_alloc_cache *nc = &__get_cpu_var(napi_alloc_cache);
+	unsigned int i;
+
+	if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
+		for (i = NAPI_SKB_CACHE_SIZE - NAPI_SKB_CACHE_BULK;
+		     i < NAPI_SKB_CACHE_SIZE; i++)
+			kmem_cache_free(skbuff_head_cache, nc->skb_cache[i]);
+		nc->skb_count -= NAPI_SKB_CACHE_BULK;
+	}
+
+	nc->skb_cache[nc->skb_count++] = skb;
+}
+
+/**
+ *	__napi_alloc_skb - allocate an skbuff for rx in a specific NAPI instance
+ *	@napi: napi instance this buffer was allocated for
+ *	@length: length to allocate
+ *	@gfp_mask: get_free_pages mask, passed to alloc_skb and alloc_pages
+ *
+ *	Like __netdev_alloc_skb(), but the head and the data come from the
+ *	per-cpu NAPI cache. Must only be called from the NAPI poll routine.
+ *	The buffer has NET_SKB_PAD + NET_IP_ALIGN bytes of headroom.
+ *
+ *	%NULL is returned if there is no free memory.
+ */
+struct sk_buff *__napi_alloc_skb(struct napi_struct *napi,
+				 unsigned int length, gfp_t gfp_mask)
+{
+	struct napi_alloc_cache *nc;
+	struct sk_buff *skb;
+	unsigned int fragsz;
+	void *data;
+
+	length += NET_SKB_PAD + NET_IP_ALIGN;
+	fragsz = SKB_DATA_ALIGN(length) +
+		 SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	if (fragsz > PAGE_SIZE || (gfp_mask & (__GFP_WAIT | GFP_DMA))) {
+		skb = __alloc_skb(length, gfp_mask, SKB_ALLOC_RX,
+				  NUMA_NO_NODE);
+		if (unlikely(!skb))
+			return NULL;
+		goto skb_success;
+	}
+
+	if (sk_memalloc_socks())
+		gfp_mask |= __GFP_MEMALLOC;
+
+	nc = &__get_cpu_var(napi_alloc_cache);
+	data = __alloc_page_frag(&nc->page, fragsz, gfp_mask);
+	if (unlikely(!data))
+		return NULL;
+
+	skb = napi_skb_cache_get();
+	if (unlikely(!skb)) {
+		put_page(virt_to_head_page(data));
+		return NULL;
+	}
+	__build_skb_around(skb, data, fragsz);
+
+skb_success:
+	skb_reserve(skb, NET_SKB_PAD + NET_IP_ALIGN);
+	skb->dev = napi->dev;
+	return skb;
+}
+EXPORT_SYMBOL(__napi_alloc_skb);
+
 void skb_add_rx_frag(struct sk_buff *skb, int i, struct page *page, int off,
 		     int size, unsigned int truesize)
 {
@@ -593,6 +714,34 @@ void __kfree_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(__kfree_skb);
 
+/**
+ *	__kfree_skb_defer - free an sk_buff into the NAPI cache
+ *	@skb: buffer
+ *
+ *	Like __kfree_skb(), but the head is kept in the per-cpu NAPI cache
+ *	for the next __napi_alloc_skb(). Must be called from softirq context.
+ */
+void __kfree_skb_defer(struct sk_buff *skb)
+{
+	skb_release_all(skb);
+	if (skb->fclone != SKB_FCLONE_UNAVAILABLE) {
+		kfree_skbmem(skb);
+		return;
+	}
+	napi_skb_cache_put(skb);
+}
+
+/**
+ *	napi_skb_free_stolen_head - free the head of a merged sk_buff
+ *	@skb: buffer whose data was stolen, e.g. by GRO
+ *
+ *	Must be called from softirq context.
+ */
+void napi_skb_free_stolen_head(struct sk_buff *skb)
+{
+	napi_skb_cache_put(skb);
+}
+
 /**
  *	kfree_skb - free an sk_buff
  *	@skb: buffer to free
@@ -665,6 +814,34 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+/**
+ *	napi_consume_skb - free an skbuff from a NAPI poll routine
+ *	@skb: buffer to free
+ *	@budget: budget of the NAPI poll, 0 when called from netpoll
+ *
+ *	Like consume_skb(), but the head goes back to the per-cpu NAPI cache.
+ *	Meant for the TX completion done by many drivers in their NAPI poll.
+ */
+void napi_consume_skb(struct sk_buff *skb, int budget)
+{
+	if (unlikely(!skb))
+		return;
+
+	/* netpoll may call the poll routine with interrupts disabled */
+	if (unlikely(!budget)) {
+		dev_kfree_skb_any(skb);
+		return;
+	}
+
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return;
+	trace_consume_skb(skb);
+	__kfree_skb_defer(skb);
+}
+EXPORT_SYMBOL(napi_consume_skb);
+
 static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 {
 	new->tstamp		= old->tstamp;
@@ -712,6 +889,10 @@ static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 	new->vlan_tci		= old->vlan_tci;
 
 	skb_copy_secmark(new, old);
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	new->napi_id	= old->napi_id;
+#endif
 }
 
 /*
@@ -3054,6 +3235,23 @@ done:
 }
 EXPORT_SYMBOL_GPL(skb_gro_receive);
 
+static int skb_cpu_callback(struct notifier_block *nfb,
+			    unsigned long action, void *hcpu)
+{
+	struct napi_alloc_cache *nc;
+
+	if (action != CPU_DEAD && action != CPU_DEAD_FROZEN)
+		return NOTIFY_OK;
+
+	/* Give the cached heads of the dead cpu back to the slab */
+	nc = &per_cpu(napi_alloc_cache, (unsigned long)hcpu);
+	while (nc->skb_count)
+		kmem_cache_free(skbuff_head_cache,
+				nc->skb_cache[--nc->skb_count]);
+
+	return NOTIFY_OK;
+}
+
 void __init skb_init(void)
 {
 	skbuff_head_cache = kmem_cache_create("skbuff_head_cache",
@@ -3067,6 +3265,7 @@ void __init skb_init(void)
 						0,
 						SLAB_HWCACHE_ALIGN|SLAB_PANIC,
 						NULL);
+	hotcpu_notifier(skb_cpu_callback, 0);
 }
 
 /**
@@ -35,6 +35,7 @@
 #include <linux/ipc_router.h>
 #include <linux/ipc_router_xprt.h>
 #include <linux/kref.h>
+#include <linux/rculist.h>
 #include <soc/qcom/subsystem_notif.h>
 
 #include <asm/byteorder.h>
@@ -106,6 +107,11 @@ if (msm_ipc_router_debug_mask & R2R_RAW_HDR) \
 static LIST_HEAD(control_ports);
 static DECLARE_RWSEM(control_ports_lock_lha5);
 
+/* Local ports, servers and remote ports are looked up for every packet.
+ * Lookups walk the hash chains under rcu_read_lock() and take a reference
+ * with kref_get_unless_zero(), the locks below only serialize the writers.
+ * The structures are freed after a grace period, see the release functions.
+ */
 #define LP_HASH_SIZE 32
 static struct list_head local_ports[LP_HASH_SIZE];
 static DECLARE_RWSEM(local_ports_lock_lhc2);
@@ -128,6 +134,7 @@ struct msm_ipc_server {
 	int next_pdev_id;
 	int synced_sec_rule;
 	struct list_head server_port_list;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_server_port {
@@ -135,6 +142,7 @@ struct msm_ipc_server_port {
 	struct platform_device *pdev;
 	struct msm_ipc_port_addr server_addr;
 	struct msm_ipc_router_xprt_info *xprt_info;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_resume_tx_port {
@@ -166,6 +174,7 @@ struct msm_ipc_router_remote_port {
 	struct list_head conn_info_list;
 	void *sec_rule;
 	struct msm_ipc_server *server;
+	struct rcu_head rcu;
 };
 
 struct msm_ipc_router_xprt_info {
@@ -175,7 +184,7 @@ struct msm_ipc_router_xprt_info {
 	uint32_t initialized;
 	struct list_head pkt_list;
 	struct wakeup_source ws;
-	struct mutex rx_lock_lhb2;
+	spinlock_t rx_lock_lhb2;
 	struct mutex tx_lock_lhb2;
 	uint32_t need_len;
 	uint32_t abort_data_read;
@@ -194,6 +203,7 @@ struct msm_ipc_routing_table_entry {
 	struct rw_semaphore lock_lha4;
 	unsigned long num_tx_bytes;
 	unsigned long num_rx_bytes;
+	struct rcu_head rcu;
 };
 
 static struct list_head routing_table[RT_HASH_SIZE];
@@ -230,14 +240,14 @@ static void init_routing_table(void)
 		INIT_LIST_HEAD(&routing_table[i]);
 }
 
-/* Must be called with routing_table_lock_lha3 locked. */
+/* Must be called with routing_table_lock_lha3 locked or under RCU. */
 static struct msm_ipc_routing_table_entry *lookup_routing_table(
 	uint32_t node_id)
 {
 	uint32_t key = (node_id % RT_HASH_SIZE);
 	struct msm_ipc_routing_table_entry *rt_entry;
 
-	list_for_each_entry(rt_entry, &routing_table[key], list) {
+	list_for_each_entry_rcu(rt_entry, &routing_table[key], list) {
 		if (rt_entry->node_id == node_id)
 			return rt_entry;
 	}
@@ -281,7 +291,7 @@ static struct msm_ipc_routing_table_entry *create_routing_table_entry(
 		rt_entry->neighbor_node_id = xprt_info->remote_node_id;
 
 	key = (node_id % RT_HASH_SIZE);
-	list_add_tail(&rt_entry->list, &routing_table[key]);
+	list_add_tail_rcu(&rt_entry->list, &routing_table[key]);
 out_create_rtentry1:
 	kref_get(&rt_entry->ref);
 out_create_rtentry2:
@@ -303,11 +313,11 @@ static struct msm_ipc_routing_table_entry *ipc_router_get_rtentry_ref(
 {
 	struct msm_ipc_routing_table_entry *rt_entry;
 
-	down_read(&routing_table_lock_lha3);
+	rcu_read_lock();
 	rt_entry = lookup_routing_table(node_id);
-	if (rt_entry)
-		kref_get(&rt_entry->ref);
-	up_read(&routing_table_lock_lha3);
+	if (rt_entry && !kref_get_unless_zero(&rt_entry->ref))
+		rt_entry = NULL;
+	rcu_read_unlock();
 	return rt_entry;
 }
 
@@ -328,7 +338,7 @@ void ipc_router_release_rtentry(struct kref *ref)
 	 * As part of SSR, all the internals of the routing table entry
 	 * are cleaned. So just free the routing table entry.
 	 */
-	kfree(rt_entry);
+	kfree_rcu(rt_entry, rcu);
 }
 
 struct rr_packet *rr_read(struct msm_ipc_router_xprt_info *xprt_info)
@@ -338,16 +348,16 @@ struct rr_packet *rr_read(struct msm_ipc_router_xprt_info *xprt_info)
 	if (!xprt_info)
 		return NULL;
 
-	mutex_lock(&xprt_info->rx_lock_lhb2);
+	spin_lock(&xprt_info->rx_lock_lhb2);
 	if (xprt_info->abort_data_read) {
-		mutex_unlock(&xprt_info->rx_lock_lhb2);
+		spin_unlock(&xprt_info->rx_lock_lhb2);
 		IPC_RTR_ERR("%s detected SSR & exiting now\n",
 			xprt_info->xprt->name);
 		return NULL;
 	}
 
 	if (list_empty(&xprt_info->pkt_list)) {
-		mutex_unlock(&xprt_info->rx_lock_lhb2);
+		spin_unlock(&xprt_info->rx_lock_lhb2);
 		return NULL;
 	}
 
@@ -356,7 +366,7 @@ struct rr_packet *rr_read(struct msm_ipc_router_xprt_info *xprt_info)
 	list_del(&temp_pkt->list);
 	if (list_empty(&xprt_info->pkt_list))
 		__pm_relax(&xprt_info->ws);
-	mutex_unlock(&xprt_info->rx_lock_lhb2);
+	spin_unlock(&xprt_info->rx_lock_lhb2);
 	return temp_pkt;
 }
 
@@ -919,12 +929,17 @@ static int post_pkt_to_port(struct msm_ipc_port *port_ptr,
 		}
 	}
 
-	mutex_lock(&port_ptr->port_rx_q_lock_lhc3);
+	/*
+	 * The lock only covers the queue and the wakeup source, which have to
+	 * agree on whether the port has pending packets. Waking up the reader
+	 * is left to after it is dropped.
+	 */
+	spin_lock(&port_ptr->port_rx_q_lock_lhc3);
 	__pm_stay_awake(&port_ptr->port_rx_ws);
 	list_add_tail(&temp_pkt->list, &port_ptr->port_rx_q);
+	spin_unlock(&port_ptr->port_rx_q_lock_lhc3);
 	wake_up(&port_ptr->port_rx_wait_q);
 	notify = port_ptr->notify;
-	mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
 	if (notify)
 		notify(pkt->hdr.type, NULL, 0, port_ptr->priv);
 	return 0;
@@ -1022,7 +1037,7 @@ void msm_ipc_router_add_local_port(struct msm_ipc_port *port_ptr)
 
 	key = (port_ptr->this_port.port_id & (LP_HASH_SIZE - 1));
 	down_write(&local_ports_lock_lhc2);
-	list_add_tail(&port_ptr->list, &local_ports[key]);
+	list_add_tail_rcu(&port_ptr->list, &local_ports[key]);
 	up_write(&local_ports_lock_lhc2);
 }
 
@@ -1062,7 +1077,7 @@ struct msm_ipc_port *msm_ipc_router_create_raw_port(void *endpoint,
 
 	mutex_init(&port_ptr->port_lock_lhc3);
 	INIT_LIST_HEAD(&port_ptr->port_rx_q);
-	mutex_init(&port_ptr->port_rx_q_lock_lhc3);
+	spin_lock_init(&port_ptr->port_rx_q_lock_lhc3);
 	init_waitqueue_head(&port_ptr->port_rx_wait_q);
 	snprintf(port_ptr->rx_ws_name, MAX_WS_NAME_SZ,
 		 "ipc%08x_%s",
@@ -1092,15 +1107,16 @@ static struct msm_ipc_port *ipc_router_get_port_ref(uint32_t port_id)
 	int key = (port_id & (LP_HASH_SIZE - 1));
 	struct msm_ipc_port *port_ptr;
 
-	down_read(&local_ports_lock_lhc2);
-	list_for_each_entry(port_ptr, &local_ports[key], list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(port_ptr, &local_ports[key], list) {
 		if (port_ptr->this_port.port_id == port_id) {
-			kref_get(&port_ptr->ref);
-			up_read(&local_ports_lock_lhc2);
+			if (!kref_get_unless_zero(&port_ptr->ref))
+				break;
+			rcu_read_unlock();
 			return port_ptr;
 		}
 	}
-	up_read(&local_ports_lock_lhc2);
+	rcu_read_unlock();
 	return NULL;
 }
 
@@ -1109,21 +1125,25 @@ static struct msm_ipc_port *ipc_router_get_port_ref(uint32_t port_id)
  * @ref: Reference to the port.
  *
  * This function is called when all references to the port are released.
+ * The port is already unhashed, but a concurrent lookup may still be
+ * looking at it, so the memory is only freed after a grace period.
  */
 void ipc_router_release_port(struct kref *ref)
 {
 	struct rr_packet *pkt, *temp_pkt;
 	struct msm_ipc_port *port_ptr =
 		container_of(ref, struct msm_ipc_port, ref);
+	LIST_HEAD(rx_q);
 
-	mutex_lock(&port_ptr->port_rx_q_lock_lhc3);
-	list_for_each_entry_safe(pkt, temp_pkt, &port_ptr->port_rx_q, list) {
+	spin_lock(&port_ptr->port_rx_q_lock_lhc3);
+	list_splice_init(&port_ptr->port_rx_q, &rx_q);
+	spin_unlock(&port_ptr->port_rx_q_lock_lhc3);
+	list_for_each_entry_safe(pkt, temp_pkt, &rx_q, list) {
 		list_del(&pkt->list);
 		release_pkt(pkt);
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
 	wakeup_source_trash(&port_ptr->port_rx_ws);
-	kfree(port_ptr);
+	kfree_rcu(port_ptr, rcu);
 }
 
 /**
@@ -1146,17 +1166,18 @@ static struct msm_ipc_router_remote_port *ipc_router_get_rport_ref(
 		return NULL;
 	}
 
-	down_read(&rt_entry->lock_lha4);
-	list_for_each_entry(rport_ptr,
-			    &rt_entry->remote_port_list[key], list) {
+	rcu_read_lock();
+	list_for_each_entry_rcu(rport_ptr,
+				&rt_entry->remote_port_list[key], list) {
 		if (rport_ptr->port_id == port_id) {
-			kref_get(&rport_ptr->ref);
-			goto out_lookup_rmt_port1;
+			if (kref_get_unless_zero(&rport_ptr->ref))
+				goto out_lookup_rmt_port1;
+			break;
 		}
 	}
 	rport_ptr = NULL;
 out_lookup_rmt_port1:
-	up_read(&rt_entry->lock_lha4);
+	rcu_read_unlock();
 	kref_put(&rt_entry->ref, ipc_router_release_rtentry);
 	return rport_ptr;
 }
@@ -1206,8 +1227,8 @@ static struct msm_ipc_router_remote_port *ipc_router_create_rport(
 	mutex_init(&rport_ptr->rport_lock_lhb2);
 	INIT_LIST_HEAD(&rport_ptr->resume_tx_port_list);
 	INIT_LIST_HEAD(&rport_ptr->conn_info_list);
-	list_add_tail(&rport_ptr->list,
-		      &rt_entry->remote_port_list[key]);
+	list_add_tail_rcu(&rport_ptr->list,
+			  &rt_entry->remote_port_list[key]);
 out_create_rmt_port1:
 	kref_get(&rport_ptr->ref);
 out_create_rmt_port2:
@@ -1344,7 +1365,7 @@ static void ipc_router_release_rport(struct kref *ref)
 	mutex_lock(&rport_ptr->rport_lock_lhb2);
 	msm_ipc_router_free_resume_tx_port(rport_ptr);
 	mutex_unlock(&rport_ptr->rport_lock_lhb2);
-	kfree(rport_ptr);
+	kfree_rcu(rport_ptr, rcu);
 }
 
 /**
@@ -1367,7 +1388,7 @@ static void ipc_router_destroy_rport(
 		return;
 	}
 	down_write(&rt_entry->lock_lha4);
-	list_del(&rport_ptr->list);
+	list_del_rcu(&rport_ptr->list);
 	up_write(&rt_entry->lock_lha4);
 	signal_rport_exit(rport_ptr);
 	kref_put(&rport_ptr->ref, ipc_router_release_rport);
@@ -1384,7 +1405,8 @@ static void ipc_router_destroy_rport(
  *
  * @return: If found Pointer to server structure, else NULL.
  *
- * Note1: Lock the server_list_lock_lha2 before accessing this function.
+ * Note1: Lock the server_list_lock_lha2 or hold rcu_read_lock() before
+ *        accessing this function.
  * Note2: If the <node_id:port_id> are <0:0>, then the lookup is restricted
  *        to <service:instance>. Used only when a client wants to send a
  *        message to any QMI server.
@@ -1399,14 +1421,14 @@ static struct msm_ipc_server *msm_ipc_router_lookup_server(
 	struct msm_ipc_server_port *server_port;
 	int key = (service & (SRV_HASH_SIZE - 1));
 
-	list_for_each_entry(server, &server_list[key], list) {
+	list_for_each_entry_rcu(server, &server_list[key], list) {
 		if ((server->name.service != service) ||
 		    (server->name.instance != instance))
 			continue;
 		if ((node_id == 0) && (port_id == 0))
 			return server;
-		list_for_each_entry(server_port, &server->server_port_list,
-				    list) {
+		list_for_each_entry_rcu(server_port,
+					&server->server_port_list, list) {
 			if ((server_port->server_addr.node_id == node_id) &&
 			    (server_port->server_addr.port_id == port_id))
 				return server;
@@ -1429,11 +1451,11 @@ static struct msm_ipc_server *ipc_router_get_server_ref(
 {
 	struct msm_ipc_server *server;
 
-	down_read(&server_list_lock_lha2);
+	rcu_read_lock();
 	server = msm_ipc_router_lookup_server(svc, ins, node_id, port_id);
-	if (server)
-		kref_get(&server->ref);
-	up_read(&server_list_lock_lha2);
+	if (server && !kref_get_unless_zero(&server->ref))
+		server = NULL;
+	rcu_read_unlock();
 	return server;
 }
 
@@ -1448,7 +1470,7 @@ static void ipc_router_release_server(struct kref *ref)
 	struct msm_ipc_server *server =
 		container_of(ref, struct msm_ipc_server, ref);
 
-	kfree(server);
+	kfree_rcu(server, rcu);
 }
 
 /**
@@ -1500,10 +1522,10 @@ static struct msm_ipc_server *msm_ipc_router_create_server(
 	server->synced_sec_rule = 0;
 	INIT_LIST_HEAD(&server->server_port_list);
 	kref_init(&server->ref);
-	list_add_tail(&server->list, &server_list[key]);
 	scnprintf(server->pdev_name, sizeof(server->pdev_name),
 		  "SVC%08x:%08x", service, instance);
 	server->next_pdev_id = 1;
+	list_add_tail_rcu(&server->list, &server_list[key]);
 
 create_srv_port:
 	server_port = kzalloc(sizeof(struct msm_ipc_server_port), GFP_KERNEL);
@@ -1513,8 +1535,8 @@ create_srv_port:
 		if (pdev)
 			platform_device_put(pdev);
 		if (list_empty(&server->server_port_list)) {
-			list_del(&server->list);
-			kfree(server);
+			list_del_rcu(&server->list);
+			kfree_rcu(server, rcu);
 		}
 		up_write(&server_list_lock_lha2);
 		IPC_RTR_ERR("%s: Server Port allocation failed\n", __func__);
@@ -1524,7 +1546,7 @@ create_srv_port:
 	server_port->server_addr.node_id = node_id;
 	server_port->server_addr.port_id = port_id;
 	server_port->xprt_info = xprt_info;
-	list_add_tail(&server_port->list, &server->server_port_list);
+	list_add_tail_rcu(&server_port->list, &server->server_port_list);
 	server->next_pdev_id++;
 	platform_device_add(server_port->pdev);
 
@@ -1564,11 +1586,11 @@ static void ipc_router_destroy_server_nolock(struct msm_ipc_server *server,
 	}
 	if (server_port_found && server_port) {
 		platform_device_unregister(server_port->pdev);
-		list_del(&server_port->list);
-		kfree(server_port);
+		list_del_rcu(&server_port->list);
+		kfree_rcu(server_port, rcu);
 	}
 	if (list_empty(&server->server_port_list)) {
-		list_del(&server->list);
+		list_del_rcu(&server->list);
 		kref_put(&server->ref, ipc_router_release_server);
 	}
 	return;
@@ -1929,7 +1951,7 @@ static void cleanup_rmt_ports(struct msm_ipc_router_xprt_info *xprt_info,
 	for (j = 0; j < RP_HASH_SIZE; j++) {
 		list_for_each_entry_safe(rport_ptr, tmp_rport_ptr,
 				&rt_entry->remote_port_list[j], list) {
-			list_del(&rport_ptr->list);
+			list_del_rcu(&rport_ptr->list);
 			mutex_lock(&rport_ptr->rport_lock_lhb2);
 			server = rport_ptr->server;
 			rport_ptr->server = NULL;
@@ -1975,7 +1997,7 @@ static void msm_ipc_cleanup_routing_table(
 			cleanup_rmt_ports(xprt_info, rt_entry);
 			rt_entry->xprt_info = NULL;
 			up_write(&rt_entry->lock_lha4);
-			list_del(&rt_entry->list);
+			list_del_rcu(&rt_entry->list);
 			kref_put(&rt_entry->ref, ipc_router_release_rtentry);
 		}
 	}
@@ -2972,22 +2994,22 @@ int msm_ipc_router_read(struct msm_ipc_port *port_ptr,
 	if (!port_ptr || !read_pkt)
 		return -EINVAL;
 
-	mutex_lock(&port_ptr->port_rx_q_lock_lhc3);
+	spin_lock(&port_ptr->port_rx_q_lock_lhc3);
 	if (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
+		spin_unlock(&port_ptr->port_rx_q_lock_lhc3);
 		return -EAGAIN;
 	}
 
 	pkt = list_first_entry(&port_ptr->port_rx_q, struct rr_packet, list);
 	if ((buf_len) && (pkt->hdr.size > buf_len)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
+		spin_unlock(&port_ptr->port_rx_q_lock_lhc3);
 		return -ETOOSMALL;
 	}
 	list_del(&pkt->list);
 	if (list_empty(&port_ptr->port_rx_q))
 		__pm_relax(&port_ptr->port_rx_ws);
 	*read_pkt = pkt;
-	mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
+	spin_unlock(&port_ptr->port_rx_q_lock_lhc3);
 	if (pkt->hdr.control_flag & CONTROL_FLAG_CONFIRM_RX)
 		msm_ipc_router_send_resume_tx(&pkt->hdr);
 
@@ -3010,9 +3032,7 @@ int msm_ipc_router_rx_data_wait(struct msm_ipc_port *port_ptr, long timeout)
 {
 	int ret = 0;
 
-	mutex_lock(&port_ptr->port_rx_q_lock_lhc3);
 	while (list_empty(&port_ptr->port_rx_q)) {
-		mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
 		if (timeout < 0) {
 			ret = wait_event_interruptible(
 					port_ptr->port_rx_wait_q,
@@ -3029,9 +3049,7 @@ int msm_ipc_router_rx_data_wait(struct msm_ipc_port *port_ptr, long timeout)
 		}
 		if (timeout == 0)
 			return -ENOMSG;
-		mutex_lock(&port_ptr->port_rx_q_lock_lhc3);
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
 
 	return ret;
 }
@@ -3172,7 +3190,7 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 
 	if (port_ptr->type == SERVER_PORT || port_ptr->type == CLIENT_PORT) {
 		down_write(&local_ports_lock_lhc2);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		up_write(&local_ports_lock_lhc2);
 
 		mutex_lock(&port_ptr->port_lock_lhc3);
@@ -3212,7 +3230,7 @@ int msm_ipc_router_close_port(struct msm_ipc_port *port_ptr)
 		up_write(&control_ports_lock_lha5);
 	} else if (port_ptr->type == IRSC_PORT) {
 		down_write(&local_ports_lock_lhc2);
-		list_del(&port_ptr->list);
+		list_del_rcu(&port_ptr->list);
 		up_write(&local_ports_lock_lhc2);
 		signal_irsc_completion();
 	}
@@ -3250,13 +3268,13 @@ int msm_ipc_router_get_curr_pkt_size(struct msm_ipc_port *port_ptr)
 	if (!port_ptr)
 		return -EINVAL;
 
-	mutex_lock(&port_ptr->port_rx_q_lock_lhc3);
+	spin_lock(&port_ptr->port_rx_q_lock_lhc3);
 	if (!list_empty(&port_ptr->port_rx_q)) {
 		pkt = list_first_entry(&port_ptr->port_rx_q,
 					struct rr_packet, list);
 		rc = pkt->length;
 	}
-	mutex_unlock(&port_ptr->port_rx_q_lock_lhc3);
+	spin_unlock(&port_ptr->port_rx_q_lock_lhc3);
 
 	return rc;
 }
@@ -3267,8 +3285,13 @@ int msm_ipc_router_bind_control_port(struct msm_ipc_port *port_ptr)
 		return -EINVAL;
 
 	down_write(&local_ports_lock_lhc2);
-	list_del(&port_ptr->list);
+	list_del_rcu(&port_ptr->list);
 	up_write(&local_ports_lock_lhc2);
+	/*
+	 * Lookups may still be walking the local port chain through this
+	 * port, wait for them before it is linked into another list.
+	 */
+	synchronize_rcu();
 	port_ptr->type = CONTROL_PORT;
 	down_write(&control_ports_lock_lha5);
 	list_add_tail(&port_ptr->list, &control_ports);
@@ -3296,15 +3319,15 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 		return -EINVAL;
 	}
 
-	down_read(&server_list_lock_lha2);
+	rcu_read_lock();
 	key = (srv_name->service & (SRV_HASH_SIZE - 1));
-	list_for_each_entry(server, &server_list[key], list) {
+	list_for_each_entry_rcu(server, &server_list[key], list) {
 		if ((server->name.service != srv_name->service) ||
 		    ((server->name.instance & lookup_mask) !=
 			srv_name->instance))
 			continue;
 
-		list_for_each_entry(server_port,
+		list_for_each_entry_rcu(server_port,
 			&server->server_port_list, list) {
 			if (i < num_entries_in_array) {
 				srv_info[i].node_id =
@@ -3317,7 +3340,7 @@ int msm_ipc_router_lookup_server_name(struct msm_ipc_port_name *srv_name,
 			i++;
 		}
 	}
-	up_read(&server_list_lock_lha2);
+	rcu_read_unlock();
 
 	return i;
 }
@@ -3576,7 +3599,7 @@ static int msm_ipc_router_add_xprt(struct msm_ipc_router_xprt *xprt)
 	xprt_info->initialized = 0;
 	xprt_info->remote_node_id = -1;
 	INIT_LIST_HEAD(&xprt_info->pkt_list);
-	mutex_init(&xprt_info->rx_lock_lhb2);
+	spin_lock_init(&xprt_info->rx_lock_lhb2);
 	mutex_init(&xprt_info->tx_lock_lhb2);
 	wakeup_source_init(&xprt_info->ws, xprt->name);
 	xprt_info->need_len = 0;
@@ -3618,9 +3641,9 @@ static void msm_ipc_router_remove_xprt(struct msm_ipc_router_xprt *xprt)
 	if (xprt && xprt->priv) {
 		xprt_info = xprt->priv;
 
-		mutex_lock(&xprt_info->rx_lock_lhb2);
+		spin_lock(&xprt_info->rx_lock_lhb2);
 		xprt_info->abort_data_read = 1;
-		mutex_unlock(&xprt_info->rx_lock_lhb2);
+		spin_unlock(&xprt_info->rx_lock_lhb2);
 
 		down_write(&xprt_info_list_lock_lha5);
 		list_del(&xprt_info->list);
@@ -3722,10 +3745,10 @@ void msm_ipc_router_xprt_notify(struct msm_ipc_router_xprt *xprt,
 	if (!pkt)
 		return;
 
-	mutex_lock(&xprt_info->rx_lock_lhb2);
+	spin_lock(&xprt_info->rx_lock_lhb2);
 	list_add_tail(&pkt->list, &xprt_info->pkt_list);
 	__pm_stay_awake(&xprt_info->ws);
-	mutex_unlock(&xprt_info->rx_lock_lhb2);
+	spin_unlock(&xprt_info->rx_lock_lhb2);
 	queue_work(xprt_info->workqueue, &xprt_info->read_data);
 }
 
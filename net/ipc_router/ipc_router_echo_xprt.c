@@ -0,0 +1,288 @@
+/* Copyright (c) 2014, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * IPC Router echo transport
+ *
+ * Emulates a remote processor behind a transport of its own, so that the
+ * whole router path (header handling, routing table, remote port flow
+ * control, local port delivery) can be exercised and measured without any
+ * real hardware link, e.g. in QEMU. The emulated node says HELLO when the
+ * transport comes up, announces one server once the router has replied
+ * and sends every data packet addressed to that server straight back to
+ * its sender.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/slab.h>
+#include <linux/skbuff.h>
+#include <linux/ipc_router.h>
+#include <linux/ipc_router_xprt.h>
+
+#include "ipc_router_private.h"
+
+#define ECHO_XPRT_NAME		"ipc_rtr_echo_xprt"
+#define ECHO_XPRT_LINK_ID	0xe0
+#define ECHO_SERVER_PORT_ID	1
+
+static uint32_t echo_node_id = 100;
+module_param_named(node_id, echo_node_id, uint, S_IRUGO);
+MODULE_PARM_DESC(node_id, "Node ID of the emulated remote processor");
+
+static uint32_t echo_service = 0x4543;
+module_param_named(service, echo_service, uint, S_IRUGO);
+MODULE_PARM_DESC(service, "Service ID of the echo server");
+
+static uint32_t echo_instance = 1;
+module_param_named(instance, echo_instance, uint, S_IRUGO);
+MODULE_PARM_DESC(instance, "Instance ID of the echo server");
+
+static struct msm_ipc_router_xprt echo_xprt;
+
+/**
+ * echo_xprt_deliver() - Hand a packet from the emulated node to the router
+ * @skb: Linear buffer holding the router header and the payload.
+ *
+ * @return: 0 on success, standard Linux error codes on failure.
+ *
+ * The router clones the packet it is notified with, so the packet built
+ * here is released again right away.
+ */
+static int echo_xprt_deliver(struct sk_buff *skb)
+{
+	struct sk_buff_head *pkt_fragment_q;
+	struct rr_packet *pkt;
+
+	pkt_fragment_q = kmalloc(sizeof(struct sk_buff_head), GFP_KERNEL);
+	if (!pkt_fragment_q) {
+		kfree_skb(skb);
+		return -ENOMEM;
+	}
+	skb_queue_head_init(pkt_fragment_q);
+	skb_queue_tail(pkt_fragment_q, skb);
+
+	pkt = create_pkt(pkt_fragment_q);
+	if (!pkt) {
+		kfree_skb(skb);
+		kfree(pkt_fragment_q);
+		return -ENOMEM;
+	}
+
+	msm_ipc_router_xprt_notify(&echo_xprt, IPC_ROUTER_XPRT_EVENT_DATA,
+				   pkt);
+	release_pkt(pkt);
+	return 0;
+}
+
+/**
+ * echo_xprt_send_ctl() - Send a control message from the emulated node
+ * @cmd: Control command to be sent.
+ * @dst_node_id: Destination node of the message.
+ * @dst_port_id: Destination port of the message.
+ *
+ * @return: 0 on success, standard Linux error codes on failure.
+ */
+static int echo_xprt_send_ctl(uint32_t cmd, uint32_t dst_node_id,
+			      uint32_t dst_port_id)
+{
+	struct rr_header_v1 *hdr;
+	union rr_control_msg *msg;
+	struct sk_buff *skb;
+
+	skb = alloc_skb(sizeof(*hdr) + sizeof(*msg), GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+
+	hdr = (struct rr_header_v1 *)skb_put(skb, sizeof(*hdr));
+	hdr->version = IPC_ROUTER_V1;
+	hdr->type = cmd;
+	hdr->src_node_id = echo_node_id;
+	hdr->src_port_id = IPC_ROUTER_ADDRESS;
+	hdr->control_flag = 0;
+	hdr->size = sizeof(*msg);
+	hdr->dst_node_id = dst_node_id;
+	hdr->dst_port_id = dst_port_id;
+
+	msg = (union rr_control_msg *)skb_put(skb, sizeof(*msg));
+	memset(msg, 0, sizeof(*msg));
+	msg->cmd = cmd;
+	switch (cmd) {
+	case IPC_ROUTER_CTRL_CMD_NEW_SERVER:
+		msg->srv.service = echo_service;
+		msg->srv.instance = echo_instance;
+		msg->srv.node_id = echo_node_id;
+		msg->srv.port_id = ECHO_SERVER_PORT_ID;
+		break;
+	case IPC_ROUTER_CTRL_CMD_RESUME_TX:
+		msg->cli.node_id = echo_node_id;
+		msg->cli.port_id = ECHO_SERVER_PORT_ID;
+		break;
+	}
+
+	return echo_xprt_deliver(skb);
+}
+
+/**
+ * echo_xprt_echo_data() - Send a data packet back to where it came from
+ * @skb: Linear copy of the data packet, consumed by this function.
+ *
+ * @return: 0 on success, standard Linux error codes on failure.
+ */
+static int echo_xprt_echo_data(struct sk_buff *skb)
+{
+	struct rr_header_v1 *hdr = (struct rr_header_v1 *)skb->data;
+	uint32_t node_id = hdr->src_node_id;
+	uint32_t port_id = hdr->src_port_id;
+	int ret;
+
+	/* The sender ran out of quota, let it go on like a real peer would */
+	if (hdr->control_flag & CONTROL_FLAG_CONFIRM_RX) {
+		ret = echo_xprt_send_ctl(IPC_ROUTER_CTRL_CMD_RESUME_TX,
+					 node_id, port_id);
+		if (ret < 0) {
+			kfree_skb(skb);
+			return ret;
+		}
+	}
+
+	hdr->control_flag &= ~CONTROL_FLAG_CONFIRM_RX;
+	hdr->src_node_id = hdr->dst_node_id;
+	hdr->src_port_id = hdr->dst_port_id;
+	hdr->dst_node_id = node_id;
+	hdr->dst_port_id = port_id;
+	return echo_xprt_deliver(skb);
+}
+
+static int echo_xprt_get_version(struct msm_ipc_router_xprt *xprt)
+{
+	return IPC_ROUTER_V1;
+}
+
+static int echo_xprt_get_option(struct msm_ipc_router_xprt *xprt)
+{
+	return FRAG_PKT_WRITE_ENABLE;
+}
+
+static int echo_xprt_write_avail(struct msm_ipc_router_xprt *xprt)
+{
+	return INT_MAX;
+}
+
+/**
+ * echo_xprt_write() - Receive a packet on the emulated node
+ * @data: Packet to be written, with the router header prepended.
+ * @len: Length of the packet.
+ * @xprt: Transport the packet is written on.
+ *
+ * @return: @len on success, standard Linux error codes on failure.
+ *
+ * Called with the transmit lock of the transport held. The fragments of
+ * the packet are shared with the router, so the packet is copied before
+ * its header is rewritten.
+ */
+static int echo_xprt_write(void *data, uint32_t len,
+			   struct msm_ipc_router_xprt *xprt)
+{
+	struct rr_packet *pkt = data;
+	struct rr_header_v1 *hdr;
+	struct sk_buff *skb, *frag;
+	int ret = 0;
+
+	if (!pkt || pkt->length != len || len < sizeof(*hdr))
+		return -EINVAL;
+
+	skb = alloc_skb(len, GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+	skb_queue_walk(pkt->pkt_fragment_q, frag)
+		skb_copy_bits(frag, 0, skb_put(skb, frag->len), frag->len);
+
+	hdr = (struct rr_header_v1 *)skb->data;
+	if (hdr->version != IPC_ROUTER_V1) {
+		kfree_skb(skb);
+		return -EINVAL;
+	}
+
+	switch (hdr->type) {
+	case IPC_ROUTER_CTRL_CMD_HELLO:
+		/* The router answered our HELLO, the link is up */
+		kfree_skb(skb);
+		ret = echo_xprt_send_ctl(IPC_ROUTER_CTRL_CMD_NEW_SERVER,
+					 IPC_ROUTER_NID_LOCAL,
+					 IPC_ROUTER_ADDRESS);
+		break;
+	case IPC_ROUTER_CTRL_CMD_DATA:
+		if (hdr->dst_node_id != echo_node_id ||
+		    hdr->dst_port_id != ECHO_SERVER_PORT_ID) {
+			kfree_skb(skb);
+			break;
+		}
+		ret = echo_xprt_echo_data(skb);
+		break;
+	default:
+		/* Server lists and client removals are of no interest */
+		kfree_skb(skb);
+		break;
+	}
+
+	return ret < 0 ? ret : len;
+}
+
+static int echo_xprt_close(struct msm_ipc_router_xprt *xprt)
+{
+	return 0;
+}
+
+static void echo_xprt_sft_close_done(struct msm_ipc_router_xprt *xprt)
+{
+}
+
+static struct msm_ipc_router_xprt echo_xprt = {
+	.name = ECHO_XPRT_NAME,
+	.link_id = ECHO_XPRT_LINK_ID,
+	.get_version = echo_xprt_get_version,
+	.get_option = echo_xprt_get_option,
+	.write_avail = echo_xprt_write_avail,
+	.write = echo_xprt_write,
+	.close = echo_xprt_close,
+	.sft_close_done = echo_xprt_sft_close_done,
+};
+
+static int __init echo_xprt_init(void)
+{
+	int ret;
+
+	if (echo_node_id == IPC_ROUTER_NID_LOCAL) {
+		pr_err("%s: node_id %u is the local node\n", __func__,
+		       echo_node_id);
+		return -EINVAL;
+	}
+
+	msm_ipc_router_xprt_notify(&echo_xprt, IPC_ROUTER_XPRT_EVENT_OPEN,
+				   NULL);
+	/* The router replies to this on the transport, see echo_xprt_write() */
+	ret = echo_xprt_send_ctl(IPC_ROUTER_CTRL_CMD_HELLO,
+				 IPC_ROUTER_NID_LOCAL, IPC_ROUTER_ADDRESS);
+	if (ret < 0) {
+		pr_err("%s: HELLO failed %d\n", __func__, ret);
+		msm_ipc_router_xprt_notify(&echo_xprt,
+					   IPC_ROUTER_XPRT_EVENT_CLOSE, NULL);
+	}
+	return ret;
+}
+
+module_init(echo_xprt_init);
+MODULE_DESCRIPTION("IPC Router echo transport");
+MODULE_LICENSE("GPL v2");
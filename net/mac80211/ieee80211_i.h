@@ -28,6 +28,7 @@
 #include <net/ieee80211_radiotap.h>
 #include <net/cfg80211.h>
 #include <net/mac80211.h>
+#include <net/codel.h>
 #include "key.h"
 #include "sta_info.h"
 #include "debug.h"
@@ -161,6 +162,62 @@ struct ieee80211_tx_data {
 	unsigned int flags;
 };
 
+/*
+ * Every intermediate TX queue hashes its frames into a few flows that are
+ * served by deficit round robin, each with its own CoDel state.
+ */
+#define IEEE80211_TXQ_FLOWS	16
+#define IEEE80211_TXQ_QUANTUM	1514
+#define IEEE80211_TXQ_LIMIT	1024
+
+/**
+ * struct txq_flow - a flow of an intermediate TX queue
+ *
+ * @queue: the frames of the flow, oldest first
+ * @flowchain: entry in the new_flows or old_flows list of the queue while
+ *	the flow is scheduled
+ * @cvars: CoDel state
+ * @deficit: bytes the flow may still send in this round
+ * @backlog: bytes queued
+ */
+struct txq_flow {
+	struct sk_buff_head queue;
+	struct list_head flowchain;
+	struct codel_vars cvars;
+	int deficit;
+	u32 backlog;
+};
+
+/**
+ * struct txq_info - per-TID intermediate TX queue
+ *
+ * @lock: protects the flows and serializes dequeueing
+ * @new_flows: flows that became active, served first
+ * @old_flows: flows that used up their quantum, served round robin
+ * @backlog_packets: frames queued in all flows
+ * @drops: frames dropped by CoDel or because the queue was full
+ * @cstats: CoDel statistics shared by the flows
+ * @flows: the flows
+ * @txq: the part the driver sees, must be last
+ */
+struct txq_info {
+	spinlock_t lock;
+	struct list_head new_flows;
+	struct list_head old_flows;
+	u32 backlog_packets;
+	u32 drops;
+	struct codel_stats cstats;
+	struct txq_flow flows[IEEE80211_TXQ_FLOWS];
+
+	/* keep last! */
+	struct ieee80211_txq txq;
+};
+
+static inline struct txq_info *to_txq_info(struct ieee80211_txq *txq)
+{
+	return container_of(txq, struct txq_info, txq);
+}
+
 
 typedef unsigned __bitwise__ ieee80211_rx_result;
 #define RX_CONTINUE		((__force ieee80211_rx_result) 0u)
@@ -985,6 +1042,9 @@ struct ieee80211_local {
 	struct sk_buff_head pending[IEEE80211_MAX_QUEUES];
 	struct tasklet_struct tx_pending_tasklet;
 
+	/* CoDel parameters of the intermediate TX queues */
+	struct codel_params cparams;
+
 	atomic_t agg_queue_stop[IEEE80211_MAX_QUEUES];
 
 	/* number of interfaces with corresponding IFF_ flags */
@@ -1360,6 +1420,15 @@ static inline bool ieee80211_sdata_running(struct ieee80211_sub_if_data *sdata)
 /* tx handling */
 void ieee80211_clear_tx_pending(struct ieee80211_local *local);
 void ieee80211_tx_pending(unsigned long data);
+void ieee80211_txq_init(struct ieee80211_sub_if_data *sdata,
+			struct sta_info *sta,
+			struct txq_info *txqi, int tid);
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi);
+void ieee80211_txq_kick(struct ieee80211_local *local,
+			struct ieee80211_txq *txq);
+struct sk_buff *ieee80211_txq_ps_dequeue(struct ieee80211_local *local,
+					 struct txq_info *txqi);
 netdev_tx_t ieee80211_monitor_start_xmit(struct sk_buff *skb,
 					 struct net_device *dev);
 netdev_tx_t ieee80211_subif_start_xmit(struct sk_buff *skb,
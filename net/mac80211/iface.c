@@ -895,6 +895,9 @@ static void ieee80211_do_stop(struct ieee80211_sub_if_data *sdata,
 	}
 	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
+	if (sdata->vif.txq)
+		ieee80211_txq_purge(local, to_txq_info(sdata->vif.txq));
+
 	if (local->open_count == 0)
 		ieee80211_clear_tx_pending(local);
 
@@ -1076,12 +1079,21 @@ static const struct net_device_ops ieee80211_monitorif_ops = {
 	.ndo_select_queue	= ieee80211_monitor_select_queue,
 };
 
+static void ieee80211_if_free(struct net_device *dev)
+{
+	struct ieee80211_sub_if_data *sdata = netdev_priv(dev);
+
+	if (sdata->vif.txq)
+		kfree(to_txq_info(sdata->vif.txq));
+	free_netdev(dev);
+}
+
 static void ieee80211_if_setup(struct net_device *dev)
 {
 	ether_setup(dev);
 	dev->priv_flags &= ~IFF_TX_SKB_SHARING;
 	dev->netdev_ops = &ieee80211_dataif_ops;
-	dev->destructor = free_netdev;
+	dev->destructor = ieee80211_if_free;
 }
 
 static void ieee80211_iface_work(struct work_struct *work)
@@ -1612,6 +1624,20 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 		memcpy(sdata->name, ndev->name, IFNAMSIZ);
 
 		sdata->dev = ndev;
+
+		/* the multicast data queue; a VLAN uses the one of its AP */
+		if (local->ops->wake_tx_queue &&
+		    type != NL80211_IFTYPE_AP_VLAN) {
+			struct txq_info *txqi;
+
+			txqi = kzalloc(sizeof(*txqi) + local->hw.txq_data_size,
+				       GFP_KERNEL);
+			if (!txqi) {
+				free_netdev(ndev);
+				return -ENOMEM;
+			}
+			ieee80211_txq_init(sdata, NULL, txqi, 0);
+		}
 	}
 
 	/* initialise type-independent data */
@@ -1664,7 +1690,7 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 
 		ret = register_netdevice(ndev);
 		if (ret) {
-			free_netdev(ndev);
+			ieee80211_if_free(ndev);
 			return ret;
 		}
 	}
@@ -647,6 +647,8 @@ struct ieee80211_hw *ieee80211_alloc_hw(size_t priv_data_len,
 	tasklet_init(&local->tx_pending_tasklet, ieee80211_tx_pending,
 		     (unsigned long)local);
 
+	codel_params_init(&local->cparams);
+
 	tasklet_init(&local->tasklet,
 		     ieee80211_tasklet_handler,
 		     (unsigned long) local);
@@ -1260,6 +1260,21 @@ static void sta_ps_start(struct sta_info *sta)
 		drv_sta_notify(local, sdata, STA_NOTIFY_SLEEP, &sta->sta);
 	ps_dbg(sdata, "STA %pM aid %d enters power save mode\n",
 	       sta->sta.addr, sta->sta.aid);
+
+	/* frames left on the intermediate queues are buffered now */
+	if (sta->sta.txq[0]) {
+		struct txq_info *txqi;
+		int tid;
+
+		for (tid = 0; tid < ARRAY_SIZE(sta->sta.txq); tid++) {
+			txqi = to_txq_info(sta->sta.txq[tid]);
+			if (ACCESS_ONCE(txqi->backlog_packets))
+				set_bit(tid, &sta->txq_buffered_tids);
+			else
+				clear_bit(tid, &sta->txq_buffered_tids);
+		}
+		sta_info_recalc_tim(sta);
+	}
 }
 
 static void sta_ps_end(struct sta_info *sta)
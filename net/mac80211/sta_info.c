@@ -137,6 +137,12 @@ static void cleanup_single_sta(struct sta_info *sta)
 		ieee80211_purge_tx_queue(&local->hw, &sta->tx_filtered[ac]);
 	}
 
+	if (sta->sta.txq[0]) {
+		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++)
+			ieee80211_txq_purge(local,
+					    to_txq_info(sta->sta.txq[i]));
+	}
+
 	if (ieee80211_vif_is_mesh(&sdata->vif))
 		mesh_sta_cleanup(sta);
 
@@ -270,6 +276,8 @@ void sta_info_free(struct ieee80211_local *local, struct sta_info *sta)
 
 	sta_dbg(sta->sdata, "Destroyed STA %pM\n", sta->sta.addr);
 
+	if (sta->sta.txq[0])
+		kfree(to_txq_info(sta->sta.txq[0]));
 	kfree(rcu_dereference_raw(sta->sta.rates));
 	kfree(sta);
 }
@@ -361,11 +369,22 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	sta->last_connected = uptime.tv_sec;
 	ewma_init(&sta->avg_signal, 1024, 8);
 
-	if (sta_prepare_rate_control(local, sta, gfp)) {
-		kfree(sta);
-		return NULL;
+	if (local->ops->wake_tx_queue) {
+		void *txq_data;
+		int size = sizeof(struct txq_info) +
+			   ALIGN(local->hw.txq_data_size, sizeof(void *));
+
+		txq_data = kcalloc(ARRAY_SIZE(sta->sta.txq), size, gfp);
+		if (!txq_data)
+			goto free;
+
+		for (i = 0; i < ARRAY_SIZE(sta->sta.txq); i++)
+			ieee80211_txq_init(sdata, sta, txq_data + i * size, i);
 	}
 
+	if (sta_prepare_rate_control(local, sta, gfp))
+		goto free_txq;
+
 	for (i = 0; i < IEEE80211_NUM_TIDS; i++) {
 		/*
 		 * timer_to_tid must be initialized with identity mapping
@@ -387,6 +406,13 @@ struct sta_info *sta_info_alloc(struct ieee80211_sub_if_data *sdata,
 	sta_dbg(sdata, "Allocated STA %pM\n", sta->sta.addr);
 
 	return sta;
+
+free_txq:
+	if (sta->sta.txq[0])
+		kfree(to_txq_info(sta->sta.txq[0]));
+free:
+	kfree(sta);
+	return NULL;
 }
 
 static int sta_info_insert_check(struct sta_info *sta)
@@ -641,7 +667,8 @@ void sta_info_recalc_tim(struct sta_info *sta)
 		tids = ieee80211_tids_for_ac(ac);
 
 		indicate_tim |=
-			sta->driver_buffered_tids & tids;
+			(sta->driver_buffered_tids | sta->txq_buffered_tids) &
+			tids;
 	}
 
  done:
@@ -1041,6 +1068,7 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 
 	BUILD_BUG_ON(BITS_TO_LONGS(IEEE80211_NUM_TIDS) > 1);
 	sta->driver_buffered_tids = 0;
+	sta->txq_buffered_tids = 0;
 
 	if (!(local->hw.flags & IEEE80211_HW_AP_LINK_PS))
 		drv_sta_notify(local, sdata, STA_NOTIFY_AWAKE, &sta->sta);
@@ -1070,6 +1098,14 @@ void ieee80211_sta_ps_deliver_wakeup(struct sta_info *sta)
 	ieee80211_add_pending_skbs_fn(local, &pending, clear_sta_ps_flags, sta);
 	spin_unlock(&sta->ps_lock);
 
+	/* the intermediate queues may transmit again */
+	if (sta->sta.txq[0]) {
+		int tid;
+
+		for (tid = 0; tid < ARRAY_SIZE(sta->sta.txq); tid++)
+			ieee80211_txq_kick(local, sta->sta.txq[tid]);
+	}
+
 	local->total_ps_buffered -= buffered;
 
 	sta_info_recalc_tim(sta);
@@ -1155,6 +1191,30 @@ static void ieee80211_send_null_response(struct ieee80211_sub_if_data *sdata,
 	rcu_read_unlock();
 }
 
+/*
+ * Takes the next frame of @ac off the intermediate queues of a sleeping
+ * station, clearing the TIDs that have no frames left.
+ */
+static struct sk_buff *sta_ps_txq_dequeue(struct sta_info *sta, int ac)
+{
+	unsigned long tids;
+	struct sk_buff *skb = NULL;
+	struct txq_info *txqi;
+	int tid;
+
+	tids = sta->txq_buffered_tids & ieee80211_tids_for_ac(ac);
+	for_each_set_bit(tid, &tids, IEEE80211_NUM_TIDS) {
+		txqi = to_txq_info(sta->sta.txq[tid]);
+		skb = ieee80211_txq_ps_dequeue(sta->local, txqi);
+		if (!ACCESS_ONCE(txqi->backlog_packets))
+			clear_bit(tid, &sta->txq_buffered_tids);
+		if (skb)
+			break;
+	}
+
+	return skb;
+}
+
 static void
 ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 				  int n_frames, u8 ignored_acs,
@@ -1199,6 +1259,9 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 						if (skb)
 							local->total_ps_buffered--;
 					}
+					if (!skb)
+						skb = sta_ps_txq_dequeue(sta,
+									 ac);
 					if (!skb)
 						break;
 					n_frames--;
@@ -1222,7 +1285,8 @@ ieee80211_sta_ps_deliver_response(struct sta_info *sta,
 		}
 
 		if (!skb_queue_empty(&sta->tx_filtered[ac]) ||
-		    !skb_queue_empty(&sta->ps_tx_buf[ac])) {
+		    !skb_queue_empty(&sta->ps_tx_buf[ac]) ||
+		    (sta->txq_buffered_tids & tids)) {
 			more_data = true;
 			break;
 		}
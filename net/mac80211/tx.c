@@ -1306,14 +1306,23 @@ static bool __ieee80211_tx(struct ieee80211_local *local,
 	return result;
 }
 
-/*
- * Invoke TX handlers, return 0 on success and non-zero if the
- * frame was dropped or queued.
- */
-static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
+static int invoke_tx_handlers_result(struct ieee80211_tx_data *tx,
+				     ieee80211_tx_result res)
 {
-	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
-	ieee80211_tx_result res = TX_DROP;
+	if (unlikely(res == TX_DROP)) {
+		I802_DEBUG_INC(tx->local->tx_handlers_drop);
+		if (tx->skb)
+			ieee80211_free_txskb(&tx->local->hw, tx->skb);
+		else
+			ieee80211_purge_tx_queue(&tx->local->hw, &tx->skbs);
+		return -1;
+	} else if (unlikely(res == TX_QUEUED)) {
+		I802_DEBUG_INC(tx->local->tx_handlers_queued);
+		return -1;
+	}
+
+	return 0;
+}
 
 #define CALL_TXH(txh) \
 	do {				\
@@ -1322,10 +1331,33 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 			goto txh_done;	\
 	} while (0)
 
+/*
+ * Invoke the TX handlers that have to run when the frame is handed to
+ * mac80211, before it may be put on an intermediate TX queue. Returns 0
+ * on success and non-zero if the frame was dropped or queued.
+ */
+static int invoke_tx_handlers_early(struct ieee80211_tx_data *tx)
+{
+	ieee80211_tx_result res = TX_DROP;
+
 	CALL_TXH(ieee80211_tx_h_dynamic_ps);
 	CALL_TXH(ieee80211_tx_h_check_assoc);
 	CALL_TXH(ieee80211_tx_h_ps_buf);
 	CALL_TXH(ieee80211_tx_h_check_control_port_protocol);
+
+ txh_done:
+	return invoke_tx_handlers_result(tx, res);
+}
+
+/*
+ * Invoke the TX handlers that have to run right before the frame goes to
+ * the driver: the key, sequence number and rates are picked here.
+ */
+static int invoke_tx_handlers_late(struct ieee80211_tx_data *tx)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(tx->skb);
+	ieee80211_tx_result res = TX_DROP;
+
 	CALL_TXH(ieee80211_tx_h_select_key);
 	if (!(tx->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
 		CALL_TXH(ieee80211_tx_h_rate_ctrl);
@@ -1344,22 +1376,514 @@ static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
 	CALL_TXH(ieee80211_tx_h_encrypt);
 	if (!(tx->local->hw.flags & IEEE80211_HW_HAS_RATE_CONTROL))
 		CALL_TXH(ieee80211_tx_h_calculate_duration);
-#undef CALL_TXH
 
  txh_done:
-	if (unlikely(res == TX_DROP)) {
-		I802_DEBUG_INC(tx->local->tx_handlers_drop);
-		if (tx->skb)
-			ieee80211_free_txskb(&tx->local->hw, tx->skb);
+	return invoke_tx_handlers_result(tx, res);
+}
+
+#undef CALL_TXH
+
+static int invoke_tx_handlers(struct ieee80211_tx_data *tx)
+{
+	int r = invoke_tx_handlers_early(tx);
+
+	if (r)
+		return r;
+	return invoke_tx_handlers_late(tx);
+}
+
+/* intermediate TX queues */
+
+void ieee80211_txq_init(struct ieee80211_sub_if_data *sdata,
+			struct sta_info *sta,
+			struct txq_info *txqi, int tid)
+{
+	int i;
+
+	spin_lock_init(&txqi->lock);
+	INIT_LIST_HEAD(&txqi->new_flows);
+	INIT_LIST_HEAD(&txqi->old_flows);
+	codel_stats_init(&txqi->cstats);
+
+	for (i = 0; i < IEEE80211_TXQ_FLOWS; i++) {
+		struct txq_flow *flow = &txqi->flows[i];
+
+		__skb_queue_head_init(&flow->queue);
+		INIT_LIST_HEAD(&flow->flowchain);
+		codel_vars_init(&flow->cvars);
+	}
+
+	/* the driver only knows about the AP interface of a VLAN */
+	if (sdata->vif.type == NL80211_IFTYPE_AP_VLAN)
+		sdata = container_of(sdata->bss,
+				     struct ieee80211_sub_if_data, u.ap);
+
+	txqi->txq.vif = &sdata->vif;
+
+	if (sta) {
+		txqi->txq.sta = &sta->sta;
+		sta->sta.txq[tid] = &txqi->txq;
+		txqi->txq.tid = tid;
+		txqi->txq.ac = ieee802_1d_to_ac[tid & 7];
+	} else {
+		sdata->vif.txq = &txqi->txq;
+		txqi->txq.tid = 0;
+		txqi->txq.ac = IEEE80211_AC_BE;
+	}
+}
+
+void ieee80211_txq_purge(struct ieee80211_local *local,
+			 struct txq_info *txqi)
+{
+	struct sk_buff_head frames;
+	int i;
+
+	__skb_queue_head_init(&frames);
+
+	spin_lock_bh(&txqi->lock);
+	for (i = 0; i < IEEE80211_TXQ_FLOWS; i++) {
+		struct txq_flow *flow = &txqi->flows[i];
+
+		skb_queue_splice_tail_init(&flow->queue, &frames);
+		list_del_init(&flow->flowchain);
+		flow->backlog = 0;
+	}
+	txqi->backlog_packets = 0;
+	spin_unlock_bh(&txqi->lock);
+
+	ieee80211_purge_tx_queue(&local->hw, &frames);
+}
+
+static void ieee80211_txq_drop(struct txq_info *txqi, struct sk_buff *skb,
+			       struct sk_buff_head *drops)
+{
+	txqi->drops++;
+	__skb_queue_tail(drops, skb);
+}
+
+static struct sk_buff *ieee80211_txq_flow_dequeue(struct txq_info *txqi,
+						  struct txq_flow *flow)
+{
+	struct sk_buff *skb = __skb_dequeue(&flow->queue);
+
+	if (skb) {
+		flow->backlog -= skb->len;
+		txqi->backlog_packets--;
+	}
+	return skb;
+}
+
+/* On overflow, drop the oldest frame of the flow with the biggest backlog */
+static void ieee80211_txq_drop_fattest(struct txq_info *txqi,
+				       struct sk_buff_head *drops)
+{
+	struct txq_flow *flow = &txqi->flows[0];
+	int i;
+
+	for (i = 1; i < IEEE80211_TXQ_FLOWS; i++)
+		if (txqi->flows[i].backlog > flow->backlog)
+			flow = &txqi->flows[i];
+
+	ieee80211_txq_drop(txqi, ieee80211_txq_flow_dequeue(txqi, flow),
+			   drops);
+}
+
+static void ieee80211_txq_enqueue(struct ieee80211_local *local,
+				  struct txq_info *txqi,
+				  struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct sk_buff_head drops;
+	struct txq_flow *flow;
+
+	flow = &txqi->flows[skb_get_rxhash(skb) & (IEEE80211_TXQ_FLOWS - 1)];
+	info->control.enqueue_time = codel_get_time();
+	__skb_queue_head_init(&drops);
+
+	spin_lock_bh(&txqi->lock);
+	__skb_queue_tail(&flow->queue, skb);
+	flow->backlog += skb->len;
+	txqi->backlog_packets++;
+
+	if (list_empty(&flow->flowchain)) {
+		list_add_tail(&flow->flowchain, &txqi->new_flows);
+		flow->deficit = IEEE80211_TXQ_QUANTUM;
+	}
+
+	if (txqi->backlog_packets > IEEE80211_TXQ_LIMIT)
+		ieee80211_txq_drop_fattest(txqi, &drops);
+	spin_unlock_bh(&txqi->lock);
+
+	ieee80211_purge_tx_queue(&local->hw, &drops);
+}
+
+/*
+ * Same as codel_should_drop(), but with the sojourn time taken from the
+ * tx info and the backlog of the flow instead of the qdisc.
+ */
+static bool ieee80211_txq_should_drop(struct ieee80211_local *local,
+				      struct txq_info *txqi,
+				      struct txq_flow *flow,
+				      struct sk_buff *skb,
+				      codel_time_t now)
+{
+	struct codel_params *params = &local->cparams;
+	struct codel_vars *vars = &flow->cvars;
+	bool ok_to_drop;
+
+	if (!skb) {
+		vars->first_above_time = 0;
+		return false;
+	}
+
+	vars->ldelay = now - IEEE80211_SKB_CB(skb)->control.enqueue_time;
+
+	if (unlikely(skb->len > txqi->cstats.maxpacket))
+		txqi->cstats.maxpacket = skb->len;
+
+	if (codel_time_before(vars->ldelay, params->target) ||
+	    flow->backlog <= txqi->cstats.maxpacket) {
+		/* went below - stay below for at least interval */
+		vars->first_above_time = 0;
+		return false;
+	}
+	ok_to_drop = false;
+	if (vars->first_above_time == 0) {
+		/* just went above from below. If we stay above
+		 * for at least interval we'll say it's ok to drop
+		 */
+		vars->first_above_time = now + params->interval;
+	} else if (codel_time_after(now, vars->first_above_time)) {
+		ok_to_drop = true;
+	}
+	return ok_to_drop;
+}
+
+/*
+ * codel_dequeue() for one flow. There is no ECN marking, the frames
+ * already carry their 802.11 header.
+ */
+static struct sk_buff *
+ieee80211_txq_codel_dequeue(struct ieee80211_local *local,
+			    struct txq_info *txqi, struct txq_flow *flow,
+			    struct sk_buff_head *drops)
+{
+	struct codel_params *params = &local->cparams;
+	struct codel_vars *vars = &flow->cvars;
+	struct sk_buff *skb = ieee80211_txq_flow_dequeue(txqi, flow);
+	codel_time_t now;
+	bool drop;
+
+	if (!skb) {
+		vars->dropping = false;
+		return skb;
+	}
+	now = codel_get_time();
+	drop = ieee80211_txq_should_drop(local, txqi, flow, skb, now);
+	if (vars->dropping) {
+		if (!drop) {
+			/* sojourn time below target - leave dropping state */
+			vars->dropping = false;
+		} else if (codel_time_after_eq(now, vars->drop_next)) {
+			while (vars->dropping &&
+			       codel_time_after_eq(now, vars->drop_next)) {
+				vars->count++;
+				codel_Newton_step(vars);
+				ieee80211_txq_drop(txqi, skb, drops);
+				skb = ieee80211_txq_flow_dequeue(txqi, flow);
+				if (!ieee80211_txq_should_drop(local, txqi, flow,
+							       skb, now)) {
+					/* leave dropping state */
+					vars->dropping = false;
+				} else {
+					/* and schedule the next drop */
+					vars->drop_next =
+						codel_control_law(vars->drop_next,
+								  params->interval,
+								  vars->rec_inv_sqrt);
+				}
+			}
+		}
+	} else if (drop) {
+		u32 delta;
+
+		ieee80211_txq_drop(txqi, skb, drops);
+		skb = ieee80211_txq_flow_dequeue(txqi, flow);
+		ieee80211_txq_should_drop(local, txqi, flow, skb, now);
+
+		vars->dropping = true;
+		delta = vars->count - vars->lastcount;
+		if (delta > 1 &&
+		    codel_time_before(now - vars->drop_next,
+				      16 * params->interval)) {
+			vars->count = delta;
+			codel_Newton_step(vars);
+		} else {
+			vars->count = 1;
+			vars->rec_inv_sqrt = ~0U >> REC_INV_SQRT_SHIFT;
+		}
+		vars->lastcount = vars->count;
+		vars->drop_next = codel_control_law(now, params->interval,
+						    vars->rec_inv_sqrt);
+	}
+	return skb;
+}
+
+/* Deficit round robin over the flows, like fq_codel_dequeue() */
+static struct sk_buff *ieee80211_txq_fq_dequeue(struct ieee80211_local *local,
+						struct txq_info *txqi,
+						struct sk_buff_head *drops)
+{
+	struct txq_flow *flow;
+	struct list_head *head;
+	struct sk_buff *skb;
+
+begin:
+	head = &txqi->new_flows;
+	if (list_empty(head)) {
+		head = &txqi->old_flows;
+		if (list_empty(head))
+			return NULL;
+	}
+	flow = list_first_entry(head, struct txq_flow, flowchain);
+
+	if (flow->deficit <= 0) {
+		flow->deficit += IEEE80211_TXQ_QUANTUM;
+		list_move_tail(&flow->flowchain, &txqi->old_flows);
+		goto begin;
+	}
+
+	skb = ieee80211_txq_codel_dequeue(local, txqi, flow, drops);
+	if (!skb) {
+		/* force a pass through old_flows to prevent starvation */
+		if (head == &txqi->new_flows && !list_empty(&txqi->old_flows))
+			list_move_tail(&flow->flowchain, &txqi->old_flows);
 		else
-			ieee80211_purge_tx_queue(&tx->local->hw, &tx->skbs);
-		return -1;
-	} else if (unlikely(res == TX_QUEUED)) {
-		I802_DEBUG_INC(tx->local->tx_handlers_queued);
-		return -1;
+			list_del_init(&flow->flowchain);
+		goto begin;
 	}
 
-	return 0;
+	flow->deficit -= skb->len;
+	return skb;
+}
+
+/*
+ * Frames stay on the intermediate queue while the hardware queue of its AC
+ * is stopped, e.g. during a scan, and while a BA session for its TID is
+ * being set up or torn down. ieee80211_wake_txqs() kicks the driver again
+ * when that is over.
+ *
+ * They also stay there while the station sleeps. PS-Poll and U-APSD
+ * release them through ieee80211_txq_ps_dequeue() and the station's wakeup
+ * kicks the driver again.
+ */
+static bool ieee80211_txq_may_tx(struct ieee80211_local *local,
+				 struct txq_info *txqi)
+{
+	struct ieee80211_txq *txq = &txqi->txq;
+	struct ieee80211_sub_if_data *sdata = vif_to_sdata(txq->vif);
+	struct tid_ampdu_tx *tid_tx;
+	struct sta_info *sta;
+
+	if (local->queue_stop_reasons[sdata->vif.hw_queue[txq->ac]])
+		return false;
+
+	if (!txq->sta)
+		return true;
+
+	sta = container_of(txq->sta, struct sta_info, sta);
+	if (test_sta_flag(sta, WLAN_STA_PS_STA) ||
+	    test_sta_flag(sta, WLAN_STA_PS_DRIVER))
+		return false;
+
+	tid_tx = rcu_dereference(sta->ampdu_mlme.tid_tx[txq->tid]);
+
+	return !tid_tx || test_bit(HT_AGG_STATE_OPERATIONAL, &tid_tx->state);
+}
+
+/*
+ * Put a data frame on its intermediate TX queue. Returns false if the frame
+ * has to be passed to the driver's tx callback instead.
+ */
+static bool ieee80211_queue_skb(struct ieee80211_local *local,
+				struct ieee80211_sub_if_data *sdata,
+				struct sta_info *sta,
+				struct sk_buff *skb)
+{
+	struct ieee80211_tx_info *info = IEEE80211_SKB_CB(skb);
+	struct ieee80211_hdr *hdr = (struct ieee80211_hdr *)skb->data;
+	struct ieee80211_txq *txq = NULL;
+	struct txq_info *txqi;
+
+	if (!local->ops->wake_tx_queue ||
+	    sdata->vif.type == NL80211_IFTYPE_MONITOR)
+		return false;
+
+	if (!ieee80211_is_data(hdr->frame_control) ||
+	    !(info->flags & IEEE80211_TX_CTL_DONTFRAG) ||
+	    (info->flags & (IEEE80211_TX_CTL_INJECTED |
+			    IEEE80211_TX_CTL_NO_PS_BUFFER |
+			    IEEE80211_TX_CTL_SEND_AFTER_DTIM |
+			    IEEE80211_TX_INTFL_RETRANSMISSION)))
+		return false;
+
+	if (sta) {
+		u8 tid = 0;
+
+		if (!sta->uploaded)
+			return false;
+		if (ieee80211_is_data_qos(hdr->frame_control))
+			tid = *ieee80211_get_qos_ctl(hdr) &
+			      IEEE80211_QOS_CTL_TID_MASK;
+		txq = sta->sta.txq[tid];
+	} else if (sdata->vif.type != NL80211_IFTYPE_AP_VLAN) {
+		txq = sdata->vif.txq;
+	}
+
+	if (!txq)
+		return false;
+
+	txqi = to_txq_info(txq);
+	info->control.vif = txq->vif;
+
+	ieee80211_txq_enqueue(local, txqi, skb);
+
+	/* the station fell asleep after the PS buffering handler ran */
+	if (sta && (test_sta_flag(sta, WLAN_STA_PS_STA) ||
+		    test_sta_flag(sta, WLAN_STA_PS_DRIVER))) {
+		set_bit(txq->tid, &sta->txq_buffered_tids);
+		sta_info_recalc_tim(sta);
+		return true;
+	}
+
+	drv_wake_tx_queue(local, txqi);
+
+	return true;
+}
+
+struct sk_buff *ieee80211_tx_dequeue(struct ieee80211_hw *hw,
+				     struct ieee80211_txq *txq)
+{
+	struct ieee80211_local *local = hw_to_local(hw);
+	struct txq_info *txqi = to_txq_info(txq);
+	struct ieee80211_tx_data tx;
+	struct ieee80211_tx_info *info;
+	struct ieee80211_hdr *hdr;
+	struct sk_buff_head drops;
+	struct sk_buff *skb = NULL;
+
+	__skb_queue_head_init(&drops);
+
+	rcu_read_lock();
+	/* keeps the sequence numbers in the order the frames leave */
+	spin_lock_bh(&txqi->lock);
+
+	if (!ieee80211_txq_may_tx(local, txqi))
+		goto out;
+
+begin:
+	skb = ieee80211_txq_fq_dequeue(local, txqi, &drops);
+	if (!skb)
+		goto out;
+
+	info = IEEE80211_SKB_CB(skb);
+	hdr = (struct ieee80211_hdr *)skb->data;
+
+	memset(&tx, 0, sizeof(tx));
+	__skb_queue_head_init(&tx.skbs);
+	tx.local = local;
+	tx.skb = skb;
+	if (txq->sta) {
+		tx.sta = container_of(txq->sta, struct sta_info, sta);
+		tx.sdata = tx.sta->sdata;
+	} else {
+		tx.sdata = vif_to_sdata(txq->vif);
+	}
+	if (!is_multicast_ether_addr(hdr->addr1))
+		tx.flags |= IEEE80211_TX_UNICAST;
+
+	/* the BA session may have come up while the frame was queued */
+	if (tx.sta && ieee80211_is_data_qos(hdr->frame_control)) {
+		if (rcu_access_pointer(tx.sta->ampdu_mlme.tid_tx[txq->tid]))
+			info->flags |= IEEE80211_TX_CTL_AMPDU;
+		else
+			info->flags &= ~IEEE80211_TX_CTL_AMPDU;
+	}
+
+	/* the key may have been removed, it's looked up again here */
+	info->control.hw_key = NULL;
+	if (invoke_tx_handlers_late(&tx))
+		goto begin;
+
+	skb = __skb_dequeue(&tx.skbs);
+	WARN_ON_ONCE(!skb_queue_empty(&tx.skbs));
+
+	hdr = (struct ieee80211_hdr *)skb->data;
+	ieee80211_tpt_led_trig_tx(local, hdr->frame_control, skb->len);
+	ieee80211_led_tx(local, 1);
+out:
+	spin_unlock_bh(&txqi->lock);
+	rcu_read_unlock();
+
+	ieee80211_purge_tx_queue(hw, &drops);
+	return skb;
+}
+EXPORT_SYMBOL(ieee80211_tx_dequeue);
+
+void ieee80211_txq_kick(struct ieee80211_local *local,
+			struct ieee80211_txq *txq)
+{
+	if (txq && ACCESS_ONCE(to_txq_info(txq)->backlog_packets))
+		drv_wake_tx_queue(local, to_txq_info(txq));
+}
+
+/*
+ * Take a frame of a sleeping station off its intermediate queue, to be sent
+ * in response to a PS-Poll or U-APSD trigger. The frame goes through the
+ * pending queue, so all TX handlers run on it again.
+ */
+struct sk_buff *ieee80211_txq_ps_dequeue(struct ieee80211_local *local,
+					 struct txq_info *txqi)
+{
+	struct sk_buff_head drops;
+	struct sk_buff *skb;
+
+	__skb_queue_head_init(&drops);
+
+	rcu_read_lock();
+	spin_lock_bh(&txqi->lock);
+	skb = ieee80211_txq_fq_dequeue(local, txqi, &drops);
+	spin_unlock_bh(&txqi->lock);
+	rcu_read_unlock();
+
+	ieee80211_purge_tx_queue(&local->hw, &drops);
+
+	if (skb)
+		IEEE80211_SKB_CB(skb)->flags |=
+			IEEE80211_TX_INTFL_NEED_TXPROCESSING;
+	return skb;
+}
+
+/*
+ * Tell the driver about the intermediate queues that still hold frames
+ * once the hardware queues were woken up. Called with RCU held.
+ */
+static void ieee80211_wake_txqs(struct ieee80211_local *local)
+{
+	struct ieee80211_sub_if_data *sdata;
+	struct sta_info *sta;
+	int i;
+
+	list_for_each_entry_rcu(sta, &local->sta_list, list) {
+		if (!sta->uploaded)
+			continue;
+		for (i = 0; i < IEEE80211_NUM_TIDS; i++)
+			ieee80211_txq_kick(local, sta->sta.txq[i]);
+	}
+
+	list_for_each_entry_rcu(sdata, &local->interfaces, list)
+		if (ieee80211_sdata_running(sdata))
+			ieee80211_txq_kick(local, sdata->vif.txq);
 }
 
 /*
@@ -1400,7 +1924,13 @@ static bool ieee80211_tx(struct ieee80211_sub_if_data *sdata,
 		info->hw_queue =
 			sdata->vif.hw_queue[skb_get_queue_mapping(skb)];
 
-	if (!invoke_tx_handlers(&tx))
+	if (invoke_tx_handlers_early(&tx))
+		return true;
+
+	if (ieee80211_queue_skb(local, tx.sdata, tx.sta, tx.skb))
+		return true;
+
+	if (!invoke_tx_handlers_late(&tx))
 		result = __ieee80211_tx(local, &tx.skbs, led_len,
 					tx.sta, txpending);
 
@@ -2253,6 +2783,9 @@ void ieee80211_tx_pending(unsigned long data)
 	}
 	spin_unlock_irqrestore(&local->queue_stop_reason_lock, flags);
 
+	if (local->ops->wake_tx_queue)
+		ieee80211_wake_txqs(local);
+
 	rcu_read_unlock();
 }
 
@@ -10,6 +10,8 @@
 
 #include <linux/rcupdate.h>
 #include <linux/jhash.h>
+#include <linux/bitmap.h>
+#include <linux/err.h>
 #include <linux/netfilter/ipset/ip_set_timeout.h>
 #ifndef rcu_dereference_bh
 #define rcu_dereference_bh(p)	rcu_dereference(p)
@@ -27,16 +29,26 @@
  *
  * Readers and resizing
  *
+ * The kernel side readers run under rcu_read_lock_bh() only, set->lock
+ * serializes the writers. Within a bucket new elements are appended behind
+ * the last used position and become visible when their bit is set in the
+ * used bitmap, deleted ones just get their bit cleared: a position is never
+ * filled with another element while readers may still look at it. When a
+ * bucket runs out of room or is mostly empty, a compacted copy of it is
+ * published and the old one is freed after a grace period.
+ *
  * Resizing can be triggered by userspace command only, and those
- * are serialized by the nfnl mutex. During resizing the set is
- * read-locked, so the only possible concurrent operations are
- * the kernel side readers. Those must be protected by proper RCU locking.
+ * are serialized by the nfnl mutex. The new table is filled while the
+ * writers are locked out, then swapped in: the readers keep using the
+ * old table meanwhile, which is destroyed after a grace period.
  */
 
 /* Number of elements to store in an initial array block */
 #define AHASH_INIT_SIZE			4
 /* Max number of elements to store in an array block */
 #define AHASH_MAX_SIZE			(3*AHASH_INIT_SIZE)
+/* Max number of elements in an array block when tuned */
+#define AHASH_MAX_TUNED			64
 
 /* Max number of elements can be tuned */
 #ifdef IP_SET_HASH_WITH_MULTI
@@ -54,7 +66,7 @@ tune_ahash_max(u8 curr, u32 multi)
 	/* Currently, at listing one hash bucket must fit into a message.
 	 * Therefore we have a hard limit here.
 	 */
-	return n > curr && n <= 64 ? n : curr;
+	return n > curr && n <= AHASH_MAX_TUNED ? n : curr;
 }
 #define TUNE_AHASH_MAX(h, multi)	\
 	((h)->ahash_max = tune_ahash_max((h)->ahash_max, multi))
@@ -65,18 +77,25 @@ tune_ahash_max(u8 curr, u32 multi)
 
 /* A hash bucket */
 struct hbucket {
-	void *value;		/* the array of the values */
+	struct rcu_head rcu;	/* for call_rcu_bh */
+	/* Which positions are used in the array */
+	DECLARE_BITMAP(used, AHASH_MAX_TUNED);
 	u8 size;		/* size of the array */
-	u8 pos;			/* position of the first free entry */
+	u8 pos;			/* position of the first never used entry */
+	unsigned char value[0]	/* the array of the values */
+		__aligned(__alignof__(u64));
 };
 
 /* The hash table: the table size stored here in order to make resizing easy */
 struct htable {
 	u8 htable_bits;		/* size of hash table == 2^htable_bits */
-	struct hbucket bucket[0]; /* hashtable buckets */
+	struct hbucket __rcu *bucket[0]; /* hashtable buckets */
 };
 
-#define hbucket(h, i)		(&((h)->bucket[i]))
+/* Writers hold set->lock, everybody else must be in rcu_read_lock_bh() */
+#define ahash_dereference(p)	rcu_dereference_protected(p, 1)
+#define hbucket(h, i)		rcu_dereference_bh((h)->bucket[i])
+#define hbucket_locked(h, i)	ahash_dereference((h)->bucket[i])
 
 /* Book-keeping of the prefixes added to the set */
 struct net_prefixes {
@@ -94,11 +113,11 @@ htable_size(u8 hbits)
 	if (hbits > 31)
 		return 0;
 	hsize = jhash_size(hbits);
-	if ((((size_t)-1) - sizeof(struct htable))/sizeof(struct hbucket)
+	if ((((size_t)-1) - sizeof(struct htable))/sizeof(struct hbucket *)
 	    < hsize)
 		return 0;
 
-	return hsize * sizeof(struct hbucket) + sizeof(struct htable);
+	return hsize * sizeof(struct hbucket *) + sizeof(struct htable);
 }
 
 /* Compute htable_bits from the user input parameter hashsize */
@@ -114,7 +133,7 @@ htable_bits(u32 hashsize)
 	return bits;
 }
 
-/* Destroy the hashtable part of the set */
+/* Destroy the hashtable part of the set: no reader may use it anymore */
 static void
 ahash_destroy(struct htable *t)
 {
@@ -122,37 +141,127 @@ ahash_destroy(struct htable *t)
 	u32 i;
 
 	for (i = 0; i < jhash_size(t->htable_bits); i++) {
-		n = hbucket(t, i);
-		if (n->size)
+		n = hbucket_locked(t, i);
+		if (n)
 			/* FIXME: use slab cache */
-			kfree(n->value);
+			kfree(n);
 	}
 
 	ip_set_free(t);
 }
 
-static int
-hbucket_elem_add(struct hbucket *n, u8 ahash_max, size_t dsize)
+static void
+hbucket_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct hbucket, rcu));
+}
+
+/* Copy the used elements of bucket n to the start of the new bucket m */
+static void
+hbucket_compact(struct hbucket *m, const struct hbucket *n, size_t dsize)
+{
+	u8 i;
+
+	for (i = 0; i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
+		memcpy(m->value + m->pos * dsize, n->value + i * dsize, dsize);
+		__set_bit(m->pos++, m->used);
+	}
+}
+
+/* Replace bucket n at index key of the table with m and get rid of n.
+ * The readers of a published table may still walk n. */
+static void
+hbucket_replace(struct htable *t, u32 key, struct hbucket *n,
+		struct hbucket *m, bool published)
+{
+	rcu_assign_pointer(t->bucket[key], m);
+	if (!n)
+		return;
+	if (published)
+		call_rcu_bh(&n->rcu, hbucket_free_rcu);
+	else
+		kfree(n);
+}
+
+/* Make sure the bucket at index key has a never used entry at its end:
+ * a full bucket is replaced by a compacted, and if needed larger copy. */
+static struct hbucket *
+hbucket_make_room(struct htable *t, u32 key, u8 ahash_max, size_t dsize,
+		  bool published)
 {
-	if (n->pos >= n->size) {
-		void *tmp;
-
-		if (n->size >= ahash_max)
-			/* Trigger rehashing */
-			return -EAGAIN;
-
-		tmp = kzalloc((n->size + AHASH_INIT_SIZE) * dsize,
-			      GFP_ATOMIC);
-		if (!tmp)
-			return -ENOMEM;
-		if (n->size) {
-			memcpy(tmp, n->value, n->size * dsize);
-			kfree(n->value);
+	struct hbucket *n = hbucket_locked(t, key), *m;
+	u8 size = AHASH_INIT_SIZE;
+
+	if (n) {
+		if (n->pos < n->size)
+			return n;
+		size = n->size;
+		if (bitmap_weight(n->used, n->pos) == n->size) {
+			if (n->size >= ahash_max)
+				/* Trigger rehashing */
+				return ERR_PTR(-EAGAIN);
+			size += AHASH_INIT_SIZE;
 		}
-		n->value = tmp;
-		n->size += AHASH_INIT_SIZE;
 	}
-	return 0;
+	m = kzalloc(sizeof(*m) + size * dsize, GFP_ATOMIC);
+	if (!m)
+		return ERR_PTR(-ENOMEM);
+	m->size = size;
+	if (n)
+		hbucket_compact(m, n, dsize);
+	hbucket_replace(t, key, n, m, published);
+
+	return m;
+}
+
+/* Release the bucket at index key if it is empty, or shrink it
+ * when there are enough unused entries in it */
+static void
+hbucket_shrink(struct htable *t, u32 key, size_t dsize)
+{
+	struct hbucket *n = hbucket_locked(t, key), *m;
+	u8 used;
+
+	if (!n)
+		return;
+	used = bitmap_weight(n->used, n->pos);
+	if (!used) {
+		hbucket_replace(t, key, n, NULL, true);
+		return;
+	}
+	if (used + AHASH_INIT_SIZE >= n->size)
+		return;
+	m = kzalloc(sizeof(*m) + (n->size - AHASH_INIT_SIZE) * dsize,
+		    GFP_ATOMIC);
+	if (!m)
+		/* Keep the larger one */
+		return;
+	m->size = n->size - AHASH_INIT_SIZE;
+	hbucket_compact(m, n, dsize);
+	hbucket_replace(t, key, n, m, true);
+}
+
+/* Make the element at the first never used entry of a bucket visible */
+static inline void
+hbucket_elem_publish(struct hbucket *n)
+{
+	smp_mb__before_atomic();
+	set_bit(n->pos, n->used);
+	smp_mb__after_atomic();
+	n->pos++;
+}
+
+/* Whether a lockless reader may look at an element, pairs with the
+ * barrier in hbucket_elem_publish() */
+static inline bool
+hbucket_elem_used(const struct hbucket *n, int i)
+{
+	if (!test_bit(i, n->used))
+		return false;
+	smp_rmb();
+	return true;
 }
 
 #ifdef IP_SET_HASH_WITH_NETS
@@ -269,7 +378,7 @@ hbucket_elem_add(struct hbucket *n, u8 ahash_max, size_t dsize)
 
 /* The generic hash structure */
 struct htype {
-	struct htable *table;	/* the hash table */
+	struct htable __rcu *table; /* the hash table */
 	u32 maxelem;		/* max elements in the hash */
 	u32 elements;		/* current element (vs timeout) */
 	u32 initval;		/* random jhash init value */
@@ -284,8 +393,8 @@ struct htype {
 #ifdef IP_SET_HASH_WITH_NETMASK
 	u8 netmask;		/* netmask value for subnets to store */
 #endif
-#ifdef IP_SET_HASH_WITH_RBTREE
-	struct rb_root rbtree;
+#ifdef IP_SET_HASH_WITH_IFACE
+	struct hlist_head iface_hash[IFACE_HASH_SIZE]; /* interface names */
 #endif
 #ifdef IP_SET_HASH_WITH_NETS
 	struct net_prefixes nets[0]; /* book-keeping of prefixes */
@@ -347,19 +456,23 @@ mtype_del_cidr(struct htype *h, u8 cidr, u8 nets_length)
 
 /* Calculate the actual memory size of the set data */
 static size_t
-mtype_ahash_memsize(const struct htype *h, u8 nets_length)
+mtype_ahash_memsize(const struct htype *h, const struct htable *t,
+		    u8 nets_length)
 {
 	u32 i;
-	struct htable *t = h->table;
+	struct hbucket *n;
 	size_t memsize = sizeof(*h)
 			 + sizeof(*t)
 #ifdef IP_SET_HASH_WITH_NETS
 			 + sizeof(struct net_prefixes) * nets_length
 #endif
-			 + jhash_size(t->htable_bits) * sizeof(struct hbucket);
+			 + jhash_size(t->htable_bits) * sizeof(struct hbucket *);
 
-	for (i = 0; i < jhash_size(t->htable_bits); i++)
-		memsize += t->bucket[i].size * h->dsize;
+	for (i = 0; i < jhash_size(t->htable_bits); i++) {
+		n = hbucket(t, i);
+		if (n)
+			memsize += sizeof(*n) + n->size * h->dsize;
+	}
 
 	return memsize;
 }
@@ -369,17 +482,14 @@ static void
 mtype_flush(struct ip_set *set)
 {
 	struct htype *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = ahash_dereference(h->table);
 	struct hbucket *n;
 	u32 i;
 
 	for (i = 0; i < jhash_size(t->htable_bits); i++) {
-		n = hbucket(t, i);
-		if (n->size) {
-			n->size = n->pos = 0;
-			/* FIXME: use slab cache */
-			kfree(n->value);
-		}
+		n = hbucket_locked(t, i);
+		if (n)
+			hbucket_replace(t, i, n, NULL, true);
 	}
 #ifdef IP_SET_HASH_WITH_NETS
 	memset(h->nets, 0, sizeof(struct net_prefixes)
@@ -397,9 +507,9 @@ mtype_destroy(struct ip_set *set)
 	if (set->extensions & IPSET_EXT_TIMEOUT)
 		del_timer_sync(&h->gc);
 
-	ahash_destroy(h->table);
-#ifdef IP_SET_HASH_WITH_RBTREE
-	rbtree_destroy(&h->rbtree);
+	ahash_destroy(ahash_dereference(h->table));
+#ifdef IP_SET_HASH_WITH_IFACE
+	iface_destroy(h->iface_hash);
 #endif
 	kfree(h);
 
@@ -443,15 +553,19 @@ mtype_same_set(const struct ip_set *a, const struct ip_set *b)
 static void
 mtype_expire(struct htype *h, u8 nets_length, size_t dsize)
 {
-	struct htable *t = h->table;
+	struct htable *t = ahash_dereference(h->table);
 	struct hbucket *n;
 	struct mtype_elem *data;
 	u32 i;
 	int j;
 
 	for (i = 0; i < jhash_size(t->htable_bits); i++) {
-		n = hbucket(t, i);
+		n = hbucket_locked(t, i);
+		if (!n)
+			continue;
 		for (j = 0; j < n->pos; j++) {
+			if (!test_bit(j, n->used))
+				continue;
 			data = ahash_data(n, j, dsize);
 			if (ip_set_timeout_expired(ext_timeout(data, h))) {
 				pr_debug("expired %u/%u\n", i, j);
@@ -459,27 +573,11 @@ mtype_expire(struct htype *h, u8 nets_length, size_t dsize)
 				mtype_del_cidr(h, CIDR(data->cidr),
 					       nets_length);
 #endif
-				if (j != n->pos - 1)
-					/* Not last one */
-					memcpy(data,
-					       ahash_data(n, n->pos - 1, dsize),
-					       dsize);
-				n->pos--;
+				clear_bit(j, n->used);
 				h->elements--;
 			}
 		}
-		if (n->pos + AHASH_INIT_SIZE < n->size) {
-			void *tmp = kzalloc((n->size - AHASH_INIT_SIZE)
-					    * dsize,
-					    GFP_ATOMIC);
-			if (!tmp)
-				/* Still try to delete expired elements */
-				continue;
-			n->size -= AHASH_INIT_SIZE;
-			memcpy(tmp, n->value, n->size * dsize);
-			kfree(n->value);
-			n->value = tmp;
-		}
+		hbucket_shrink(t, i, dsize);
 	}
 }
 
@@ -490,9 +588,9 @@ mtype_gc(unsigned long ul_set)
 	struct htype *h = set->data;
 
 	pr_debug("called\n");
-	write_lock_bh(&set->lock);
+	spin_lock_bh(&set->lock);
 	mtype_expire(h, NETS_LENGTH(set->family), h->dsize);
-	write_unlock_bh(&set->lock);
+	spin_unlock_bh(&set->lock);
 
 	h->gc.expires = jiffies + IPSET_GC_PERIOD(h->timeout) * HZ;
 	add_timer(&h->gc);
@@ -505,24 +603,26 @@ static int
 mtype_resize(struct ip_set *set, bool retried)
 {
 	struct htype *h = set->data;
-	struct htable *t, *orig = h->table;
+	/* Only resizing replaces the table, no need to lock here */
+	struct htable *t, *orig = ahash_dereference(h->table);
 	u8 htable_bits = orig->htable_bits;
 #ifdef IP_SET_HASH_WITH_NETS
+	struct mtype_elem key_data;
 	u8 flags;
 #endif
 	struct mtype_elem *data;
 	struct mtype_elem *d;
 	struct hbucket *n, *m;
-	u32 i, j;
+	u32 i, j, key;
 	int ret;
 
 	/* Try to cleanup once */
 	if (SET_WITH_TIMEOUT(set) && !retried) {
 		i = h->elements;
-		write_lock_bh(&set->lock);
+		spin_lock_bh(&set->lock);
 		mtype_expire(set->data, NETS_LENGTH(set->family),
 			     h->dsize);
-		write_unlock_bh(&set->lock);
+		spin_unlock_bh(&set->lock);
 		if (h->elements < i)
 			return 0;
 	}
@@ -539,42 +639,49 @@ retry:
 		return -IPSET_ERR_HASH_FULL;
 	}
 	t = ip_set_alloc(sizeof(*t)
-			 + jhash_size(htable_bits) * sizeof(struct hbucket));
+			 + jhash_size(htable_bits) * sizeof(struct hbucket *));
 	if (!t)
 		return -ENOMEM;
 	t->htable_bits = htable_bits;
 
-	read_lock_bh(&set->lock);
+	/* Lock out the writers only, the readers go on with orig */
+	spin_lock_bh(&set->lock);
 	for (i = 0; i < jhash_size(orig->htable_bits); i++) {
-		n = hbucket(orig, i);
+		n = hbucket_locked(orig, i);
+		if (!n)
+			continue;
 		for (j = 0; j < n->pos; j++) {
+			if (!test_bit(j, n->used))
+				continue;
 			data = ahash_data(n, j, h->dsize);
 #ifdef IP_SET_HASH_WITH_NETS
+			/* The key is computed without the flags, but the
+			 * element the readers see must be left intact */
+			memcpy(&key_data, data, sizeof(key_data));
 			flags = 0;
-			mtype_data_reset_flags(data, &flags);
-#endif
-			m = hbucket(t, HKEY(data, h->initval, htable_bits));
-			ret = hbucket_elem_add(m, AHASH_MAX(h), h->dsize);
-			if (ret < 0) {
-#ifdef IP_SET_HASH_WITH_NETS
-				mtype_data_reset_flags(data, &flags);
+			mtype_data_reset_flags(&key_data, &flags);
+			key = HKEY(&key_data, h->initval, htable_bits);
+#else
+			key = HKEY(data, h->initval, htable_bits);
 #endif
-				read_unlock_bh(&set->lock);
+			m = hbucket_make_room(t, key, AHASH_MAX(h), h->dsize,
+					      false);
+			if (IS_ERR(m)) {
+				spin_unlock_bh(&set->lock);
 				ahash_destroy(t);
+				ret = PTR_ERR(m);
 				if (ret == -EAGAIN)
 					goto retry;
 				return ret;
 			}
-			d = ahash_data(m, m->pos++, h->dsize);
+			d = ahash_data(m, m->pos, h->dsize);
 			memcpy(d, data, h->dsize);
-#ifdef IP_SET_HASH_WITH_NETS
-			mtype_data_reset_flags(d, &flags);
-#endif
+			__set_bit(m->pos++, m->used);
 		}
 	}
 
 	rcu_assign_pointer(h->table, t);
-	read_unlock_bh(&set->lock);
+	spin_unlock_bh(&set->lock);
 
 	/* Give time to other readers of the set */
 	synchronize_rcu_bh();
@@ -597,9 +704,8 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	const struct mtype_elem *d = value;
 	struct mtype_elem *data;
 	struct hbucket *n;
-	int i, ret = 0;
-	int j = AHASH_MAX(h) + 1;
-	bool flag_exist = flags & IPSET_FLAG_EXIST;
+	int i;
+	bool flag_exist = flags & IPSET_FLAG_EXIST, reuse = false;
 	u32 key, multi = 0;
 
 	if (SET_WITH_TIMEOUT(set) && h->elements >= h->maxelem)
@@ -613,34 +719,28 @@ mtype_add(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 		return -IPSET_ERR_HASH_FULL;
 	}
 
-	rcu_read_lock_bh();
-	t = rcu_dereference_bh(h->table);
+	t = ahash_dereference(h->table);
 	key = HKEY(value, h->initval, t->htable_bits);
-	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	n = hbucket_locked(t, key);
+	for (i = 0; n && i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
 		data = ahash_data(n, i, h->dsize);
 		if (mtype_data_equal(data, d, &multi)) {
 			if (flag_exist ||
 			    (SET_WITH_TIMEOUT(set) &&
 			     ip_set_timeout_expired(ext_timeout(data, h)))) {
 				/* Just the extensions could be overwritten */
-				j = i;
-				goto reuse_slot;
-			} else {
-				ret = -IPSET_ERR_EXIST;
-				goto out;
-			}
+				reuse = true;
+				break;
+			} else
+				return -IPSET_ERR_EXIST;
 		}
-		/* Reuse first timed out entry */
-		if (SET_WITH_TIMEOUT(set) &&
-		    ip_set_timeout_expired(ext_timeout(data, h)) &&
-		    j != AHASH_MAX(h) + 1)
-			j = i;
+		/* Timed out entries of other elements are left to the
+		 * garbage collector: readers may be looking at them */
 	}
-reuse_slot:
-	if (j != AHASH_MAX(h) + 1) {
+	if (reuse) {
 		/* Fill out reused slot */
-		data = ahash_data(n, j, h->dsize);
 #ifdef IP_SET_HASH_WITH_NETS
 		mtype_del_cidr(h, CIDR(data->cidr), NETS_LENGTH(set->family));
 		mtype_add_cidr(h, CIDR(d->cidr), NETS_LENGTH(set->family));
@@ -648,13 +748,13 @@ reuse_slot:
 	} else {
 		/* Use/create a new slot */
 		TUNE_AHASH_MAX(h, multi);
-		ret = hbucket_elem_add(n, AHASH_MAX(h), h->dsize);
-		if (ret != 0) {
-			if (ret == -EAGAIN)
+		n = hbucket_make_room(t, key, AHASH_MAX(h), h->dsize, true);
+		if (IS_ERR(n)) {
+			if (PTR_ERR(n) == -EAGAIN)
 				mtype_data_next(&h->next, d);
-			goto out;
+			return PTR_ERR(n);
 		}
-		data = ahash_data(n, n->pos++, h->dsize);
+		data = ahash_data(n, n->pos, h->dsize);
 #ifdef IP_SET_HASH_WITH_NETS
 		mtype_add_cidr(h, CIDR(d->cidr), NETS_LENGTH(set->family));
 #endif
@@ -668,21 +768,21 @@ reuse_slot:
 		ip_set_timeout_set(ext_timeout(data, h), ext->timeout);
 	if (SET_WITH_COUNTER(set))
 		ip_set_init_counter(ext_counter(data, h), ext);
+	if (!reuse)
+		hbucket_elem_publish(n);
 
-out:
-	rcu_read_unlock_bh();
-	return ret;
+	return 0;
 }
 
-/* Delete an element from the hash: swap it with the last element
- * and free up space if possible.
+/* Delete an element from the hash: the readers skip it from now on
+ * and the bucket is shrunk if possible.
  */
 static int
 mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	  struct ip_set_ext *mext, u32 flags)
 {
 	struct htype *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = ahash_dereference(h->table);
 	const struct mtype_elem *d = value;
 	struct mtype_elem *data;
 	struct hbucket *n;
@@ -690,35 +790,23 @@ mtype_del(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	u32 key, multi = 0;
 
 	key = HKEY(value, h->initval, t->htable_bits);
-	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	n = hbucket_locked(t, key);
+	for (i = 0; n && i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
 		data = ahash_data(n, i, h->dsize);
 		if (!mtype_data_equal(data, d, &multi))
 			continue;
 		if (SET_WITH_TIMEOUT(set) &&
 		    ip_set_timeout_expired(ext_timeout(data, h)))
 			return -IPSET_ERR_EXIST;
-		if (i != n->pos - 1)
-			/* Not last one */
-			memcpy(data, ahash_data(n, n->pos - 1, h->dsize),
-			       h->dsize);
 
-		n->pos--;
+		clear_bit(i, n->used);
 		h->elements--;
 #ifdef IP_SET_HASH_WITH_NETS
 		mtype_del_cidr(h, CIDR(d->cidr), NETS_LENGTH(set->family));
 #endif
-		if (n->pos + AHASH_INIT_SIZE < n->size) {
-			void *tmp = kzalloc((n->size - AHASH_INIT_SIZE)
-					    * h->dsize,
-					    GFP_ATOMIC);
-			if (!tmp)
-				return 0;
-			n->size -= AHASH_INIT_SIZE;
-			memcpy(tmp, n->value, n->size * h->dsize);
-			kfree(n->value);
-			n->value = tmp;
-		}
+		hbucket_shrink(t, key, h->dsize);
 		return 0;
 	}
 
@@ -745,7 +833,7 @@ mtype_test_cidrs(struct ip_set *set, struct mtype_elem *d,
 		 struct ip_set_ext *mext, u32 flags)
 {
 	struct htype *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = rcu_dereference_bh(h->table);
 	struct hbucket *n;
 	struct mtype_elem *data;
 	int i, j = 0;
@@ -757,7 +845,9 @@ mtype_test_cidrs(struct ip_set *set, struct mtype_elem *d,
 		mtype_data_netmask(d, h->nets[j].cidr);
 		key = HKEY(d, h->initval, t->htable_bits);
 		n = hbucket(t, key);
-		for (i = 0; i < n->pos; i++) {
+		for (i = 0; n && i < n->pos; i++) {
+			if (!hbucket_elem_used(n, i))
+				continue;
 			data = ahash_data(n, i, h->dsize);
 			if (!mtype_data_equal(data, d, &multi))
 				continue;
@@ -785,7 +875,7 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 	   struct ip_set_ext *mext, u32 flags)
 {
 	struct htype *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = rcu_dereference_bh(h->table);
 	struct mtype_elem *d = value;
 	struct hbucket *n;
 	struct mtype_elem *data;
@@ -801,7 +891,9 @@ mtype_test(struct ip_set *set, void *value, const struct ip_set_ext *ext,
 
 	key = HKEY(d, h->initval, t->htable_bits);
 	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	for (i = 0; n && i < n->pos; i++) {
+		if (!hbucket_elem_used(n, i))
+			continue;
 		data = ahash_data(n, i, h->dsize);
 		if (mtype_data_equal(data, d, &multi) &&
 		    !(SET_WITH_TIMEOUT(set) &&
@@ -816,18 +908,22 @@ static int
 mtype_head(struct ip_set *set, struct sk_buff *skb)
 {
 	const struct htype *h = set->data;
+	const struct htable *t;
 	struct nlattr *nested;
 	size_t memsize;
+	u8 htable_bits;
 
-	read_lock_bh(&set->lock);
-	memsize = mtype_ahash_memsize(h, NETS_LENGTH(set->family));
-	read_unlock_bh(&set->lock);
+	rcu_read_lock_bh();
+	t = rcu_dereference_bh(h->table);
+	memsize = mtype_ahash_memsize(h, t, NETS_LENGTH(set->family));
+	htable_bits = t->htable_bits;
+	rcu_read_unlock_bh();
 
 	nested = ipset_nest_start(skb, IPSET_ATTR_DATA);
 	if (!nested)
 		goto nla_put_failure;
 	if (nla_put_net32(skb, IPSET_ATTR_HASHSIZE,
-			  htonl(jhash_size(h->table->htable_bits))) ||
+			  htonl(jhash_size(htable_bits))) ||
 	    nla_put_net32(skb, IPSET_ATTR_MAXELEM, htonl(h->maxelem)))
 		goto nla_put_failure;
 #ifdef IP_SET_HASH_WITH_NETMASK
@@ -856,7 +952,8 @@ mtype_list(const struct ip_set *set,
 	   struct sk_buff *skb, struct netlink_callback *cb)
 {
 	const struct htype *h = set->data;
-	const struct htable *t = h->table;
+	/* Called in rcu_read_lock_bh() */
+	const struct htable *t = rcu_dereference_bh(h->table);
 	struct nlattr *atd, *nested;
 	const struct hbucket *n;
 	const struct mtype_elem *e;
@@ -873,7 +970,9 @@ mtype_list(const struct ip_set *set,
 		incomplete = skb_tail_pointer(skb);
 		n = hbucket(t, cb->args[2]);
 		pr_debug("cb->args[2]: %lu, t %p n %p\n", cb->args[2], t, n);
-		for (i = 0; i < n->pos; i++) {
+		for (i = 0; n && i < n->pos; i++) {
+			if (!hbucket_elem_used(n, i))
+				continue;
 			e = ahash_data(n, i, h->dsize);
 			if (SET_WITH_TIMEOUT(set) &&
 			    ip_set_timeout_expired(ext_timeout(e, h)))
@@ -956,6 +1055,7 @@ TOKEN(HTYPE, _create)(struct ip_set *set, struct nlattr *tb[], u32 flags)
 #endif
 	size_t hsize;
 	struct HTYPE *h;
+	struct htable *t;
 
 	if (!(set->family == NFPROTO_IPV4 || set->family == NFPROTO_IPV6))
 		return -IPSET_ERR_INVALID_FAMILY;
@@ -1013,12 +1113,13 @@ TOKEN(HTYPE, _create)(struct ip_set *set, struct nlattr *tb[], u32 flags)
 		kfree(h);
 		return -ENOMEM;
 	}
-	h->table = ip_set_alloc(hsize);
-	if (!h->table) {
+	t = ip_set_alloc(hsize);
+	if (!t) {
 		kfree(h);
 		return -ENOMEM;
 	}
-	h->table->htable_bits = hbits;
+	t->htable_bits = hbits;
+	RCU_INIT_POINTER(h->table, t);
 
 	set->data = h;
 	if (set->family ==  NFPROTO_IPV4)
@@ -1096,8 +1197,8 @@ TOKEN(HTYPE, _create)(struct ip_set *set, struct nlattr *tb[], u32 flags)
 	}
 
 	pr_debug("create %s hashsize %u (%u) maxelem %u: %p(%p)\n",
-		 set->name, jhash_size(h->table->htable_bits),
-		 h->table->htable_bits, h->maxelem, set->data, h->table);
+		 set->name, jhash_size(t->htable_bits),
+		 t->htable_bits, h->maxelem, set->data, t);
 
 	return 0;
 }
@@ -13,7 +13,7 @@
 #include <linux/skbuff.h>
 #include <linux/errno.h>
 #include <linux/random.h>
-#include <linux/rbtree.h>
+#include <linux/rculist.h>
 #include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/netlink.h>
@@ -33,94 +33,65 @@ MODULE_AUTHOR("Jozsef Kadlecsik <kadlec@blackhole.kfki.hu>");
 IP_SET_MODULE_DESC("hash:net,iface", REVISION_MIN, REVISION_MAX);
 MODULE_ALIAS("ip_set_hash:net,iface");
 
-/* Interface name rbtree */
+/* Interface names
+ *
+ * The packet path looks the names up without the set lock, they are added
+ * with it held and freed only when the set is destroyed.
+ */
+
+#define IFACE_HASH_SIZE	16
 
 struct iface_node {
-	struct rb_node node;
+	struct hlist_node node;
 	char iface[IFNAMSIZ];
 };
 
-#define iface_data(n)	(rb_entry(n, struct iface_node, node)->iface)
+static inline struct hlist_head *
+iface_bucket(struct hlist_head *head, const char *iface)
+{
+	return &head[jhash(iface, strlen(iface), 0) & (IFACE_HASH_SIZE - 1)];
+}
 
 static void
-rbtree_destroy(struct rb_root *root)
+iface_destroy(struct hlist_head *head)
 {
-	struct rb_node *p, *n = root->rb_node;
-	struct iface_node *node;
-
-	/* Non-recursive destroy, like in ext3 */
-	while (n) {
-		if (n->rb_left) {
-			n = n->rb_left;
-			continue;
-		}
-		if (n->rb_right) {
-			n = n->rb_right;
-			continue;
-		}
-		p = rb_parent(n);
-		node = rb_entry(n, struct iface_node, node);
-		if (!p)
-			*root = RB_ROOT;
-		else if (p->rb_left == n)
-			p->rb_left = NULL;
-		else if (p->rb_right == n)
-			p->rb_right = NULL;
-
-		kfree(node);
-		n = p;
-	}
+	struct iface_node *d;
+	struct hlist_node *n;
+	int i;
+
+	for (i = 0; i < IFACE_HASH_SIZE; i++)
+		hlist_for_each_entry_safe(d, n, &head[i], node)
+			kfree(d);
 }
 
 static int
-iface_test(struct rb_root *root, const char **iface)
+iface_test(struct hlist_head *head, const char **iface)
 {
-	struct rb_node *n = root->rb_node;
-
-	while (n) {
-		const char *d = iface_data(n);
-		int res = strcmp(*iface, d);
-
-		if (res < 0)
-			n = n->rb_left;
-		else if (res > 0)
-			n = n->rb_right;
-		else {
-			*iface = d;
+	struct iface_node *d;
+
+	hlist_for_each_entry_rcu(d, iface_bucket(head, *iface), node) {
+		if (strcmp(*iface, d->iface) == 0) {
+			*iface = d->iface;
 			return 1;
 		}
 	}
 	return 0;
 }
 
+/* Called with the set lock held */
 static int
-iface_add(struct rb_root *root, const char **iface)
+iface_add(struct hlist_head *head, const char **iface)
 {
-	struct rb_node **n = &(root->rb_node), *p = NULL;
 	struct iface_node *d;
 
-	while (*n) {
-		char *ifname = iface_data(*n);
-		int res = strcmp(*iface, ifname);
-
-		p = *n;
-		if (res < 0)
-			n = &((*n)->rb_left);
-		else if (res > 0)
-			n = &((*n)->rb_right);
-		else {
-			*iface = ifname;
-			return 0;
-		}
-	}
+	if (iface_test(head, iface))
+		return 0;
 
 	d = kzalloc(sizeof(*d), GFP_ATOMIC);
 	if (!d)
 		return -ENOMEM;
 	strcpy(d->iface, *iface);
-
-	rb_link_node(&d->node, p, n);
-	rb_insert_color(&d->node, root);
+	hlist_add_head_rcu(&d->node, iface_bucket(head, *iface));
 
 	*iface = d->iface;
 	return 0;
@@ -129,7 +100,7 @@ iface_add(struct rb_root *root, const char **iface)
 /* Type specific function prefix */
 #define HTYPE		hash_netiface
 #define IP_SET_HASH_WITH_NETS
-#define IP_SET_HASH_WITH_RBTREE
+#define IP_SET_HASH_WITH_IFACE
 #define IP_SET_HASH_WITH_MULTI
 
 #define STREQ(a, b)	(strcmp(a, b) == 0)
@@ -299,10 +270,10 @@ hash_netiface4_kadt(struct ip_set *set, const struct sk_buff *skb,
 
 	if (!e.iface)
 		return -EINVAL;
-	ret = iface_test(&h->rbtree, &e.iface);
+	ret = iface_test(h->iface_hash, &e.iface);
 	if (adt == IPSET_ADD) {
 		if (!ret) {
-			ret = iface_add(&h->rbtree, &e.iface);
+			ret = iface_add(h->iface_hash, &e.iface);
 			if (ret)
 				return ret;
 		}
@@ -348,10 +319,10 @@ hash_netiface4_uadt(struct ip_set *set, struct nlattr *tb[],
 
 	strcpy(iface, nla_data(tb[IPSET_ATTR_IFACE]));
 	e.iface = iface;
-	ret = iface_test(&h->rbtree, &e.iface);
+	ret = iface_test(h->iface_hash, &e.iface);
 	if (adt == IPSET_ADD) {
 		if (!ret) {
-			ret = iface_add(&h->rbtree, &e.iface);
+			ret = iface_add(h->iface_hash, &e.iface);
 			if (ret)
 				return ret;
 		}
@@ -564,10 +535,10 @@ hash_netiface6_kadt(struct ip_set *set, const struct sk_buff *skb,
 
 	if (!e.iface)
 		return -EINVAL;
-	ret = iface_test(&h->rbtree, &e.iface);
+	ret = iface_test(h->iface_hash, &e.iface);
 	if (adt == IPSET_ADD) {
 		if (!ret) {
-			ret = iface_add(&h->rbtree, &e.iface);
+			ret = iface_add(h->iface_hash, &e.iface);
 			if (ret)
 				return ret;
 		}
@@ -614,10 +585,10 @@ hash_netiface6_uadt(struct ip_set *set, struct nlattr *tb[],
 
 	strcpy(iface, nla_data(tb[IPSET_ATTR_IFACE]));
 	e.iface = iface;
-	ret = iface_test(&h->rbtree, &e.iface);
+	ret = iface_test(h->iface_hash, &e.iface);
 	if (adt == IPSET_ADD) {
 		if (!ret) {
-			ret = iface_add(&h->rbtree, &e.iface);
+			ret = iface_add(h->iface_hash, &e.iface);
 			if (ret)
 				return ret;
 		}
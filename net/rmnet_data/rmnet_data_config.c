@@ -26,6 +26,7 @@
 #include "rmnet_data_vnd.h"
 #include "rmnet_data_private.h"
 #include "rmnet_data_trace.h"
+#include "rmnet_map.h"
 
 RMNET_LOG_MODULE(RMNET_DATA_LOGMASK_CONFIG);
 
@@ -704,6 +705,7 @@ int rmnet_unassociate_network_device(struct net_device *dev)
 	if (!config)
 		return RMNET_CONFIG_UNKNOWN_ERROR;
 
+	rmnet_map_aggregation_exit(config);
 	kfree(config);
 
 	netdev_rx_handler_unregister(dev);
@@ -832,11 +834,13 @@ int rmnet_associate_network_device(struct net_device *dev)
 	memset(config, 0, sizeof(struct rmnet_phys_ep_conf_s));
 	config->dev = dev;
 	spin_lock_init(&config->agg_lock);
+	rmnet_map_aggregation_init(config);
 
 	rc = netdev_rx_handler_register(dev, rmnet_rx_handler, config);
 
 	if (rc) {
 		LOGM("netdev_rx_handler_register returns %d", rc);
+		rmnet_map_aggregation_exit(config);
 		kfree(config);
 		return RMNET_CONFIG_DEVICE_IN_USE;
 	}
@@ -16,6 +16,8 @@
 
 #include <linux/types.h>
 #include <linux/spinlock.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
 
 #ifndef _RMNET_DATA_CONFIG_H_
 #define _RMNET_DATA_CONFIG_H_
@@ -57,6 +59,11 @@ struct rmnet_logical_ep_conf_s {
  *                  Smaller of the two parameters above are chosen for
  *                  aggregation
  * @tail_spacing: Guaranteed padding (bytes) when de-aggregating ingress frames
+ * @agg_timer: Flushes the aggregation buffer at the end of the aggregation
+ *             window
+ * @agg_last: Time the last egress packet was handed to aggregation
+ * @agg_gap_ns: Moving average of the time between egress packets, used to
+ *              size the aggregation window
  */
 struct rmnet_phys_ep_conf_s {
 	struct net_device *dev;
@@ -73,6 +80,9 @@ struct rmnet_phys_ep_conf_s {
 	uint8_t agg_state;
 	uint8_t agg_count;
 	uint8_t tail_spacing;
+	struct tasklet_hrtimer agg_timer;
+	ktime_t agg_last;
+	uint32_t agg_gap_ns;
 };
 
 int rmnet_config_init(void);
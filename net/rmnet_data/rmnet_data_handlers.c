@@ -23,6 +23,7 @@
 #include "rmnet_data_private.h"
 #include "rmnet_data_config.h"
 #include "rmnet_data_vnd.h"
+#include "rmnet_data_handlers.h"
 #include "rmnet_map.h"
 #include "rmnet_data_stats.h"
 #include "rmnet_data_trace.h"
@@ -43,6 +44,17 @@ module_param(dump_pkt_tx, uint, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(dump_pkt_tx, "Dump packets exiting egress handler");
 #endif /* CONFIG_RMNET_DATA_DEBUG_PKT */
 
+/*
+ * Deaggregated downlink packets are fed to a per CPU GRO context, so that
+ * consecutive segments of the same TCP flow reach the stack as a single
+ * packet. These contexts are never scheduled; the MAP ingress handler
+ * flushes them once it has walked the whole aggregate.
+ */
+static struct net_device rmnet_gro_dev;
+static DEFINE_PER_CPU(struct napi_struct, rmnet_gro_napi);
+
+#define RMNET_GRO_WEIGHT 64
+
 /* ***************** Helper Functions *************************************** */
 
 /**
@@ -164,8 +176,21 @@ static rx_handler_result_t rmnet_bridge_handler(struct sk_buff *skb,
 	return RX_HANDLER_CONSUMED;
 }
 
+/**
+ * rmnet_gro_poll() - NAPI poll callback of the GRO contexts
+ *
+ * Never called, as the GRO contexts are not scheduled.
+ */
+static int rmnet_gro_poll(struct napi_struct *napi, int budget)
+{
+	return 0;
+}
+
 /**
  * __rmnet_deliver_skb() - Deliver skb
+ * @skb:      Packet to deliver
+ * @ep:       Logical endpoint the packet belongs to
+ * @napi:     GRO context to pass the packet through, or NULL
  *
  * Determines where to deliver skb. Options are: consume by network stack,
  * pass to bridge handler, or pass to virtual network device
@@ -175,7 +200,8 @@ static rx_handler_result_t rmnet_bridge_handler(struct sk_buff *skb,
  *      - RX_HANDLER_PASS if packet is to be consumed by network stack as-is
  */
 static rx_handler_result_t __rmnet_deliver_skb(struct sk_buff *skb,
-					 struct rmnet_logical_ep_conf_s *ep)
+					 struct rmnet_logical_ep_conf_s *ep,
+					 struct napi_struct *napi)
 {
 	trace___rmnet_deliver_skb(skb);
 	switch (ep->rmnet_mode) {
@@ -194,7 +220,13 @@ static rx_handler_result_t __rmnet_deliver_skb(struct sk_buff *skb,
 
 		case RX_HANDLER_PASS:
 			skb->pkt_type = PACKET_HOST;
-			netif_receive_skb(skb);
+			if (napi) {
+				/* No link layer header for GRO to compare */
+				skb_reset_mac_header(skb);
+				rmnet_stats_gro(napi_gro_receive(napi, skb));
+			} else {
+				netif_receive_skb(skb);
+			}
 			return RX_HANDLER_CONSUMED;
 		}
 		return RX_HANDLER_PASS;
@@ -234,7 +266,7 @@ static rx_handler_result_t rmnet_ingress_deliver_packet(struct sk_buff *skb,
 
 	skb->dev = config->local_ep.egress_dev;
 
-	return __rmnet_deliver_skb(skb, &(config->local_ep));
+	return __rmnet_deliver_skb(skb, &(config->local_ep), NULL);
 }
 
 /* ***************** MAP handler ******************************************** */
@@ -243,6 +275,7 @@ static rx_handler_result_t rmnet_ingress_deliver_packet(struct sk_buff *skb,
  * _rmnet_map_ingress_handler() - Actual MAP ingress handler
  * @skb:        Packet being received
  * @config:     Physical endpoint configuration for the ingress device
+ * @napi:       GRO context for deaggregated packets, or NULL
  *
  * Most MAP ingress functions are processed here. Packets are processed
  * individually; aggregates packets should use rmnet_map_ingress_handler()
@@ -252,7 +285,8 @@ static rx_handler_result_t rmnet_ingress_deliver_packet(struct sk_buff *skb,
  *      - result of __rmnet_deliver_skb() for all other cases
  */
 static rx_handler_result_t _rmnet_map_ingress_handler(struct sk_buff *skb,
-					    struct rmnet_phys_ep_conf_s *config)
+					    struct rmnet_phys_ep_conf_s *config,
+					    struct napi_struct *napi)
 {
 	struct rmnet_logical_ep_conf_s *ep;
 	uint8_t mux_id;
@@ -309,7 +343,7 @@ static rx_handler_result_t _rmnet_map_ingress_handler(struct sk_buff *skb,
 	skb_trim(skb, len);
 	__rmnet_data_set_skb_proto(skb);
 
-	return __rmnet_deliver_skb(skb, ep);
+	return __rmnet_deliver_skb(skb, ep, napi);
 }
 
 /**
@@ -319,7 +353,9 @@ static rx_handler_result_t _rmnet_map_ingress_handler(struct sk_buff *skb,
  *
  * Called if and only if MAP is configured in the ingress device's ingress data
  * format. Deaggregation is done here, actual MAP processing is done in
- * _rmnet_map_ingress_handler().
+ * _rmnet_map_ingress_handler(). If GRO is configured in the ingress data
+ * format, the packets of an aggregate are coalesced before being handed to
+ * the stack.
  *
  * Return:
  *      - RX_HANDLER_CONSUMED for aggregated packets
@@ -329,22 +365,31 @@ static rx_handler_result_t _rmnet_map_ingress_handler(struct sk_buff *skb,
 static rx_handler_result_t rmnet_map_ingress_handler(struct sk_buff *skb,
 					    struct rmnet_phys_ep_conf_s *config)
 {
+	struct napi_struct *napi = NULL;
 	struct sk_buff *skbn;
 	int rc, co = 0;
 
 	if (config->ingress_data_format & RMNET_INGRESS_FORMAT_DEAGGREGATION) {
 		trace_rmnet_start_deaggregation(skb);
+		if (config->ingress_data_format & RMNET_INGRESS_FORMAT_GRO) {
+			local_bh_disable();
+			napi = this_cpu_ptr(&rmnet_gro_napi);
+		}
 		while ((skbn = rmnet_map_deaggregate(skb, config)) != 0) {
-			_rmnet_map_ingress_handler(skbn, config);
+			_rmnet_map_ingress_handler(skbn, config, napi);
 			co++;
 		}
+		if (napi) {
+			napi_gro_flush(napi, false);
+			local_bh_enable();
+		}
 		trace_rmnet_end_deaggregation(skb, co);
 		LOGD("De-aggregated %d packets", co);
 		rmnet_stats_deagg_pkts(co);
 		rmnet_kfree_skb(skb, RMNET_STATS_SKBFREE_MAPINGRESS_AGGBUF);
 		rc = RX_HANDLER_CONSUMED;
 	} else {
-		rc = _rmnet_map_ingress_handler(skb, config);
+		rc = _rmnet_map_ingress_handler(skb, config, NULL);
 	}
 
 	return rc;
@@ -594,3 +639,34 @@ void rmnet_egress_handler(struct sk_buff *skb,
 	}
 	rmnet_stats_queue_xmit(rc, RMNET_STATS_QUEUE_XMIT_EGRESS);
 }
+
+/**
+ * rmnet_handlers_init() - Init hook
+ *
+ * Called by RmNet main on module load. Sets up the per CPU GRO contexts
+ * used for deaggregated downlink packets.
+ *
+ * Return:
+ *      - 0 always
+ */
+int rmnet_handlers_init(void)
+{
+	int cpu;
+
+	init_dummy_netdev(&rmnet_gro_dev);
+	for_each_possible_cpu(cpu)
+		netif_napi_add(&rmnet_gro_dev, &per_cpu(rmnet_gro_napi, cpu),
+			       rmnet_gro_poll, RMNET_GRO_WEIGHT);
+	return 0;
+}
+
+/**
+ * rmnet_handlers_exit() - Exit hook
+ */
+void rmnet_handlers_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		netif_napi_del(&per_cpu(rmnet_gro_napi, cpu));
+}
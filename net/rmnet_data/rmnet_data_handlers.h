@@ -22,4 +22,7 @@ void rmnet_egress_handler(struct sk_buff *skb,
 
 rx_handler_result_t rmnet_rx_handler(struct sk_buff **pskb);
 
+int rmnet_handlers_init(void);
+void rmnet_handlers_exit(void);
+
 #endif /* _RMNET_DATA_HANDLERS_H_ */
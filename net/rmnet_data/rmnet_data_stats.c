@@ -52,6 +52,12 @@ unsigned long int agg_count[RMNET_STATS_AGG_MAX];
 module_param_array(agg_count, ulong, 0, S_IRUGO);
 MODULE_PARM_DESC(agg_count, "SKBs Aggregated");
 
+/* Aggregates of 1, 2-3, 4-7, ... 64 and more packets */
+#define RMNET_STATS_AGG_SIZE_BUCKETS 8
+unsigned long int agg_size[RMNET_STATS_AGG_SIZE_BUCKETS];
+module_param_array(agg_size, ulong, 0, S_IRUGO);
+MODULE_PARM_DESC(agg_size, "Aggregate size histogram");
+
 static DEFINE_SPINLOCK(rmnet_checksum_dl_stats);
 unsigned long int checksum_dl_stats[RMNET_MAP_CHECKSUM_ENUM_LENGTH];
 module_param_array(checksum_dl_stats, ulong, 0, S_IRUGO);
@@ -62,6 +68,11 @@ unsigned long int checksum_ul_stats[RMNET_MAP_CHECKSUM_ENUM_LENGTH];
 module_param_array(checksum_ul_stats, ulong, 0, S_IRUGO);
 MODULE_PARM_DESC(checksum_ul_stats, "Uplink Checksum Statistics");
 
+static DEFINE_SPINLOCK(rmnet_gro_stats);
+unsigned long int gro_stats[GRO_DROP + 1];
+module_param_array(gro_stats, ulong, 0, S_IRUGO);
+MODULE_PARM_DESC(gro_stats, "Downlink GRO results");
+
 void rmnet_kfree_skb(struct sk_buff *skb, unsigned int reason)
 {
 	unsigned long flags;
@@ -94,10 +105,16 @@ void rmnet_stats_queue_xmit(int rc, unsigned int reason)
 void rmnet_stats_agg_pkts(int aggcount)
 {
 	unsigned long flags;
+	int bucket;
+
+	bucket = aggcount > 0 ? ilog2(aggcount) : 0;
+	if (bucket >= RMNET_STATS_AGG_SIZE_BUCKETS)
+		bucket = RMNET_STATS_AGG_SIZE_BUCKETS - 1;
 
 	spin_lock_irqsave(&rmnet_agg_count, flags);
 	agg_count[RMNET_STATS_AGG_BUFF]++;
 	agg_count[RMNET_STATS_AGG_PKT] += aggcount;
+	agg_size[bucket]++;
 	spin_unlock_irqrestore(&rmnet_agg_count, flags);
 }
 
@@ -134,3 +151,15 @@ void rmnet_stats_ul_checksum(unsigned int rc)
 	checksum_ul_stats[rc]++;
 	spin_unlock_irqrestore(&rmnet_checksum_ul_stats, flags);
 }
+
+void rmnet_stats_gro(unsigned int rc)
+{
+	unsigned long flags;
+
+	if (rc > GRO_DROP)
+		rc = GRO_DROP;
+
+	spin_lock_irqsave(&rmnet_gro_stats, flags);
+	gro_stats[rc]++;
+	spin_unlock_irqrestore(&rmnet_gro_stats, flags);
+}
@@ -48,6 +48,9 @@ enum rmnet_queue_xmit_e {
 	RMNET_STATS_QUEUE_XMIT_AGG_FILL_BUFFER,
 	RMNET_STATS_QUEUE_XMIT_AGG_TIMEOUT,
 	RMNET_STATS_QUEUE_XMIT_AGG_CPY_EXP_FAIL,
+	RMNET_STATS_QUEUE_XMIT_AGG_FILL_COUNT,
+	RMNET_STATS_QUEUE_XMIT_AGG_BYPASS,
+	RMNET_STATS_QUEUE_XMIT_AGG_SMALL_PKT,
 	RMNET_STATS_QUEUE_XMIT_MAX
 };
 
@@ -57,4 +60,5 @@ void rmnet_stats_deagg_pkts(int aggcount);
 void rmnet_stats_agg_pkts(int aggcount);
 void rmnet_stats_dl_checksum(unsigned int rc);
 void rmnet_stats_ul_checksum(unsigned int rc);
+void rmnet_stats_gro(unsigned int rc);
 #endif /* _RMNET_DATA_STATS_H_ */
@@ -20,7 +20,7 @@
 #include <linux/netdevice.h>
 #include <linux/rmnet_data.h>
 #include <linux/spinlock.h>
-#include <linux/workqueue.h>
+#include <linux/hrtimer.h>
 #include <linux/net_map.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
@@ -38,11 +38,22 @@
 
 RMNET_LOG_MODULE(RMNET_DATA_LOGMASK_MAPD);
 
-/* ***************** Local Definitions ************************************** */
-struct agg_work {
-	struct delayed_work work;
-	struct rmnet_phys_ep_conf_s *config;
-};
+/* ***************** Module Parameters ************************************** */
+static unsigned int agg_time_min_us = 100;
+module_param(agg_time_min_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(agg_time_min_us, "Lower bound of the aggregation window");
+
+static unsigned int agg_time_max_us = 3000;
+module_param(agg_time_max_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(agg_time_max_us, "Upper bound of the aggregation window");
+
+static unsigned int agg_bypass_us = 10000;
+module_param(agg_bypass_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(agg_bypass_us, "Idle time after which a packet is not aggregated");
+
+static unsigned int agg_small_size = 128;
+module_param(agg_small_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(agg_small_size, "Packets up to this size flush a quiet link");
 
 /******************************************************************************/
 
@@ -168,51 +179,111 @@ struct sk_buff *rmnet_map_deaggregate(struct sk_buff *skb,
 }
 
 /**
- * rmnet_map_flush_packet_queue() - Transmits aggregeted frame on timeout
- * @work:        struct agg_work containing delayed work and skb to flush
+ * rmnet_map_agg_update_rate() - Account an egress packet to the packet rate
+ * @config:     Physical endpoint configuration of the egress device
+ * @now:        Time the packet was handed to aggregation
+ *
+ * Must be called with agg_lock held.
+ *
+ * Return:
+ *      - Time since the previous egress packet, in nanoseconds
+ */
+static s64 rmnet_map_agg_update_rate(struct rmnet_phys_ep_conf_s *config,
+				     ktime_t now)
+{
+	s64 gap, max_gap;
+
+	gap = ktime_to_ns(ktime_sub(now, config->agg_last));
+	config->agg_last = now;
+
+	/* Keep a single idle period from dominating the average */
+	max_gap = (s64)agg_time_max_us * NSEC_PER_USEC;
+	config->agg_gap_ns = ((u64)config->agg_gap_ns * 7 +
+			      (u64)min(gap, max_gap)) >> 3;
+	return gap;
+}
+
+/**
+ * rmnet_map_agg_window() - Aggregation window for a new aggregate
+ * @config:     Physical endpoint configuration of the egress device
+ *
+ * The window is the time it takes to collect egress_agg_count packets at
+ * the current packet rate, bounded by agg_time_max_us, so that bulk uploads
+ * get a window which actually fills the buffer. When fewer than two more
+ * packets are expected within agg_time_max_us there is nothing to gain from
+ * waiting, and the window shrinks to agg_time_min_us.
+ */
+static ktime_t rmnet_map_agg_window(struct rmnet_phys_ep_conf_s *config)
+{
+	u64 min_ns = (u64)agg_time_min_us * NSEC_PER_USEC;
+	u64 max_ns = (u64)agg_time_max_us * NSEC_PER_USEC;
+	u64 ns;
+
+	if ((u64)config->agg_gap_ns * 2 > max_ns)
+		return ns_to_ktime(min_ns);
+
+	ns = (u64)config->agg_gap_ns *
+	     max_t(uint16_t, config->egress_agg_count, 1);
+	return ns_to_ktime(clamp_t(u64, ns, min_ns, max_ns));
+}
+
+/**
+ * rmnet_map_agg_take() - Detach the aggregation buffer
+ * @config:     Physical endpoint configuration of the egress device
+ * @agg_count:  Returns the number of packets in the buffer
  *
- * This function is scheduled to run in a specified number of jiffies after
- * the last frame transmitted by the network stack. When run, the buffer
- * containing aggregated packets is finally transmitted on the underlying link.
+ * Must be called with agg_lock held.
  *
+ * Return:
+ *      - The aggregation buffer
+ *      - 0 (null) if there is no buffer
  */
-static void rmnet_map_flush_packet_queue(struct work_struct *work)
+static struct sk_buff *rmnet_map_agg_take(struct rmnet_phys_ep_conf_s *config,
+					  int *agg_count)
+{
+	struct sk_buff *skb = config->agg_skb;
+
+	*agg_count = config->agg_count;
+	if (skb) {
+		rmnet_stats_agg_pkts(config->agg_count);
+		if (config->agg_count > 1)
+			LOGL("Agg count: %d", config->agg_count);
+	}
+	config->agg_skb = 0;
+	config->agg_count = 0;
+	config->agg_state = RMNET_MAP_AGG_IDLE;
+	return skb;
+}
+
+/**
+ * rmnet_map_flush_packet_queue() - Transmits aggregeted frame on timeout
+ * @t:          agg_timer of the physical endpoint configuration
+ *
+ * This function runs in tasklet context when the aggregation window of the
+ * current buffer expires. When run, the buffer containing aggregated packets
+ * is finally transmitted on the underlying link.
+ */
+static enum hrtimer_restart rmnet_map_flush_packet_queue(struct hrtimer *t)
 {
-	struct agg_work *real_work;
 	struct rmnet_phys_ep_conf_s *config;
 	unsigned long flags;
-	struct sk_buff *skb;
+	struct sk_buff *skb = 0;
 	int rc, agg_count = 0;
 
-	skb = 0;
-	real_work = (struct agg_work *)work;
-	config = real_work->config;
-	LOGD("%s", "Entering flush thread");
+	config = container_of(t, struct rmnet_phys_ep_conf_s, agg_timer.timer);
+	LOGD("%s", "Entering flush timer");
 	spin_lock_irqsave(&config->agg_lock, flags);
-	if (likely(config->agg_state == RMNET_MAP_TXFER_SCHEDULED)) {
-		/* Buffer may have already been shipped out */
-		if (likely(config->agg_skb)) {
-			rmnet_stats_agg_pkts(config->agg_count);
-			if (config->agg_count > 1)
-				LOGL("Agg count: %d", config->agg_count);
-			skb = config->agg_skb;
-			agg_count = config->agg_count;
-			config->agg_skb = 0;
-		}
-		config->agg_state = RMNET_MAP_AGG_IDLE;
-	} else {
-		/* How did we get here? */
-		LOGE("Ran queued command when state %s",
-			"is idle. State machine likely broken");
-	}
-
+	/* The buffer may have been shipped out while the timer was firing */
+	if (likely(config->agg_state == RMNET_MAP_TXFER_SCHEDULED))
+		skb = rmnet_map_agg_take(config, &agg_count);
 	spin_unlock_irqrestore(&config->agg_lock, flags);
+
 	if (skb) {
 		trace_rmnet_map_flush_packet_queue(skb, agg_count);
 		rc = dev_queue_xmit(skb);
 		rmnet_stats_queue_xmit(rc, RMNET_STATS_QUEUE_XMIT_AGG_TIMEOUT);
 	}
-	kfree(work);
+	return HRTIMER_NORESTART;
 }
 
 /**
@@ -223,14 +294,19 @@ static void rmnet_map_flush_packet_queue(struct work_struct *work)
  * Aggregates multiple SKBs into a single large SKB for transmission. MAP
  * protocol is used to separate the packets in the buffer. This funcion consumes
  * the argument SKB and should not be further processed by any other function.
+ *
+ * The buffer is sent when it is full, when it holds egress_agg_count packets
+ * or when its aggregation window expires. The first packet after an idle
+ * period and small packets on a quiet link are sent right away.
  */
 void rmnet_map_aggregate(struct sk_buff *skb,
 			 struct rmnet_phys_ep_conf_s *config) {
 	uint8_t *dest_buff;
-	struct agg_work *work;
 	unsigned long flags;
 	struct sk_buff *agg_skb;
+	unsigned int len, reason;
 	int size, rc, agg_count = 0;
+	s64 gap;
 
 
 	if (!skb || !config)
@@ -242,6 +318,21 @@ void rmnet_map_aggregate(struct sk_buff *skb,
 		return;
 	}
 
+	len = skb->len;
+
+	spin_lock_irqsave(&config->agg_lock, flags);
+	gap = rmnet_map_agg_update_rate(config, ktime_get());
+	if (!config->agg_skb && gap >= (s64)agg_bypass_us * NSEC_PER_USEC) {
+		/* Link was idle, don't delay the first packet of a burst */
+		spin_unlock_irqrestore(&config->agg_lock, flags);
+		rmnet_stats_agg_pkts(1);
+		trace_rmnet_map_aggregate(skb, 0);
+		rc = dev_queue_xmit(skb);
+		rmnet_stats_queue_xmit(rc, RMNET_STATS_QUEUE_XMIT_AGG_BYPASS);
+		return;
+	}
+	spin_unlock_irqrestore(&config->agg_lock, flags);
+
 new_packet:
 	spin_lock_irqsave(&config->agg_lock, flags);
 	if (!config->agg_skb) {
@@ -264,13 +355,8 @@ new_packet:
 	}
 
 	if (skb->len > (config->egress_agg_size - config->agg_skb->len)) {
-		rmnet_stats_agg_pkts(config->agg_count);
-		if (config->agg_count > 1)
-			LOGL("Agg count: %d", config->agg_count);
-		agg_skb = config->agg_skb;
-		agg_count = config->agg_count;
-		config->agg_skb = 0;
-		config->agg_count = 0;
+		agg_skb = rmnet_map_agg_take(config, &agg_count);
+		hrtimer_try_to_cancel(&config->agg_timer.timer);
 		spin_unlock_irqrestore(&config->agg_lock, flags);
 		trace_rmnet_map_aggregate(skb, agg_count);
 		rc = dev_queue_xmit(agg_skb);
@@ -285,26 +371,68 @@ new_packet:
 	rmnet_kfree_skb(skb, RMNET_STATS_SKBFREE_AGG_INTO_BUFF);
 
 schedule:
+	if (config->egress_agg_count &&
+	    config->agg_count >= config->egress_agg_count)
+		reason = RMNET_STATS_QUEUE_XMIT_AGG_FILL_COUNT;
+	else if (len <= agg_small_size &&
+		 config->agg_gap_ns >= (u64)agg_time_min_us * NSEC_PER_USEC)
+		reason = RMNET_STATS_QUEUE_XMIT_AGG_SMALL_PKT;
+	else
+		reason = RMNET_STATS_QUEUE_XMIT_UNKNOWN;
+
+	if (reason != RMNET_STATS_QUEUE_XMIT_UNKNOWN) {
+		agg_skb = rmnet_map_agg_take(config, &agg_count);
+		hrtimer_try_to_cancel(&config->agg_timer.timer);
+		spin_unlock_irqrestore(&config->agg_lock, flags);
+		trace_rmnet_map_flush_packet_queue(agg_skb, agg_count);
+		rc = dev_queue_xmit(agg_skb);
+		rmnet_stats_queue_xmit(rc, reason);
+		return;
+	}
+
 	if (config->agg_state != RMNET_MAP_TXFER_SCHEDULED) {
-		work = (struct agg_work *)
-			kmalloc(sizeof(struct agg_work), GFP_ATOMIC);
-		if (!work) {
-			LOGE("Failed to allocate work item for packet %s",
-			     "transfer. DATA PATH LIKELY BROKEN!");
-			config->agg_state = RMNET_MAP_AGG_IDLE;
-			spin_unlock_irqrestore(&config->agg_lock, flags);
-			return;
-		}
-		INIT_DELAYED_WORK((struct delayed_work *)work,
-				  rmnet_map_flush_packet_queue);
-		work->config = config;
 		config->agg_state = RMNET_MAP_TXFER_SCHEDULED;
-		schedule_delayed_work((struct delayed_work *)work, 1);
+		tasklet_hrtimer_start(&config->agg_timer,
+				      rmnet_map_agg_window(config),
+				      HRTIMER_MODE_REL);
 	}
 	spin_unlock_irqrestore(&config->agg_lock, flags);
 	return;
 }
 
+/**
+ * rmnet_map_aggregation_init() - Set up uplink aggregation
+ * @config:     Physical endpoint configuration of the egress device
+ */
+void rmnet_map_aggregation_init(struct rmnet_phys_ep_conf_s *config)
+{
+	tasklet_hrtimer_init(&config->agg_timer, rmnet_map_flush_packet_queue,
+			     CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	config->agg_last = ktime_get();
+}
+
+/**
+ * rmnet_map_aggregation_exit() - Tear down uplink aggregation
+ * @config:     Physical endpoint configuration of the egress device
+ *
+ * Stops the flush timer and drops a pending aggregation buffer.
+ */
+void rmnet_map_aggregation_exit(struct rmnet_phys_ep_conf_s *config)
+{
+	unsigned long flags;
+	struct sk_buff *skb;
+	int agg_count;
+
+	tasklet_hrtimer_cancel(&config->agg_timer);
+
+	spin_lock_irqsave(&config->agg_lock, flags);
+	skb = rmnet_map_agg_take(config, &agg_count);
+	spin_unlock_irqrestore(&config->agg_lock, flags);
+
+	if (skb)
+		kfree_skb(skb);
+}
+
 
 /* ***************** Checksum Offload ************************************** */
 
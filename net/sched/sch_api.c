@@ -786,6 +786,13 @@ static int qdisc_graft(struct net_device *dev, struct Qdisc *parent,
 	} else {
 		const struct Qdisc_class_ops *cops = parent->ops->cl_ops;
 
+		/* Only mq children run without a lock, a classful parent
+		 * dequeues its children under its own root lock.
+		 */
+		if (new && (new->flags & TCQ_F_NOLOCK) &&
+		    !(parent->flags & TCQ_F_MQROOT))
+			qdisc_clear_nolock(new);
+
 		err = -EOPNOTSUPP;
 		if (cops && cops->graft) {
 			unsigned long cl = cops->get(parent, classid);
@@ -1291,6 +1298,7 @@ static int tc_fill_qdisc(struct sk_buff *skb, struct Qdisc *q, u32 clid,
 		goto nla_put_failure;
 	if (q->ops->dump && q->ops->dump(q, skb) < 0)
 		goto nla_put_failure;
+	qdisc_stats_fold(q);
 	q->qstats.qlen = q->q.qlen;
 
 	stab = rtnl_dereference(q->stab);
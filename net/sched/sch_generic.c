@@ -25,6 +25,8 @@
 #include <linux/rcupdate.h>
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
 #include <net/sch_generic.h>
 #include <net/pkt_sched.h>
 #include <net/dst.h>
@@ -38,19 +40,53 @@
  * - enqueue, dequeue are serialized via qdisc root lock
  * - ingress filtering is also serialized via qdisc root lock
  * - updates to tree and tree walking are only done under the rtnl mutex.
+ *
+ * TCQ_F_NOLOCK qdiscs are the exception: they are enqueued to without the
+ * root lock and dequeued from by the owner of q->run_lock, which replaces
+ * the __QDISC___STATE_RUNNING bit. The gso_skb requeue slot is only used
+ * by that owner.
  */
 
+/* Lockless qdiscs keep no exact qlen, the next dequeue tells if it's empty */
+static inline int qdisc_pending(const struct Qdisc *q)
+{
+	return (q->flags & TCQ_F_NOLOCK) ? 1 : qdisc_qlen(q);
+}
+
 static inline int dev_requeue_skb(struct sk_buff *skb, struct Qdisc *q)
 {
 	skb_dst_force(skb);
 	q->gso_skb = skb;
 	q->qstats.requeues++;
-	q->q.qlen++;	/* it's still part of the queue */
+	if (!(q->flags & TCQ_F_NOLOCK))
+		q->q.qlen++;	/* it's still part of the queue */
 	__netif_schedule(q);
 
 	return 0;
 }
 
+/*
+ * Nothing can be sent while txq is stopped, and netif_tx_wake_queue()
+ * reschedules the qdisc once it can, so a pending MISSED must not make
+ * qdisc_run_end() reschedule it over and over in the meantime.
+ */
+static inline void qdisc_maybe_clear_missed(struct Qdisc *q,
+					    const struct netdev_queue *txq)
+{
+	if (!(q->flags & TCQ_F_NOLOCK))
+		return;
+
+	clear_bit(__QDISC_STATE_MISSED, &q->state);
+	/* order the clear before the second look at txq */
+	smp_mb__after_atomic();
+	/* The queue may have been woken before the clear, and the run of
+	 * the qdisc from that wake-up found us holding run_lock and set
+	 * MISSED, which we just cleared.
+	 */
+	if (!netif_xmit_frozen_or_stopped(txq))
+		set_bit(__QDISC_STATE_MISSED, &q->state);
+}
+
 static inline struct sk_buff *dequeue_skb(struct Qdisc *q)
 {
 	struct sk_buff *skb = q->gso_skb;
@@ -61,12 +97,17 @@ static inline struct sk_buff *dequeue_skb(struct Qdisc *q)
 		txq = netdev_get_tx_queue(txq->dev, skb_get_queue_mapping(skb));
 		if (!netif_xmit_frozen_or_stopped(txq)) {
 			q->gso_skb = NULL;
-			q->q.qlen--;
-		} else
+			if (!(q->flags & TCQ_F_NOLOCK))
+				q->q.qlen--;
+		} else {
 			skb = NULL;
+			qdisc_maybe_clear_missed(q, txq);
+		}
 	} else {
 		if (!(q->flags & TCQ_F_ONETXQUEUE) || !netif_xmit_frozen_or_stopped(txq))
 			skb = q->dequeue(q);
+		else
+			qdisc_maybe_clear_missed(q, txq);
 	}
 
 	return skb;
@@ -88,7 +129,7 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 		kfree_skb(skb);
 		net_warn_ratelimited("Dead loop on netdevice %s, fix it urgently!\n",
 				     dev_queue->dev->name);
-		ret = qdisc_qlen(q);
+		ret = qdisc_pending(q);
 	} else {
 		/*
 		 * Another cpu is holding lock, requeue & delay xmits for
@@ -104,7 +145,7 @@ static inline int handle_dev_cpu_collision(struct sk_buff *skb,
 /*
  * Transmit one skb, and handle the return status as required. Holding the
  * __QDISC_STATE_RUNNING bit guarantees that only one CPU can execute this
- * function.
+ * function. @root_lock is NULL for TCQ_F_NOLOCK qdiscs.
  *
  * Returns to the caller:
  *				0  - queue is empty or throttled.
@@ -117,7 +158,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 	int ret = NETDEV_TX_BUSY;
 
 	/* And release qdisc */
-	spin_unlock(root_lock);
+	if (root_lock)
+		spin_unlock(root_lock);
 
 	HARD_TX_LOCK(dev, txq, smp_processor_id());
 	if (!netif_xmit_frozen_or_stopped(txq))
@@ -125,11 +167,12 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 
 	HARD_TX_UNLOCK(dev, txq);
 
-	spin_lock(root_lock);
+	if (root_lock)
+		spin_lock(root_lock);
 
 	if (dev_xmit_complete(ret)) {
 		/* Driver sent out skb successfully or skb was consumed */
-		ret = qdisc_qlen(q);
+		ret = qdisc_pending(q);
 	} else if (ret == NETDEV_TX_LOCKED) {
 		/* Driver try lock failed */
 		ret = handle_dev_cpu_collision(skb, txq, q);
@@ -149,7 +192,8 @@ int sch_direct_xmit(struct sk_buff *skb, struct Qdisc *q,
 }
 
 /*
- * NOTE: Called under qdisc_lock(q) with locally disabled BH.
+ * NOTE: Called under qdisc_lock(q) with locally disabled BH, or only with
+ * BH disabled and q->run_lock held for TCQ_F_NOLOCK qdiscs.
  *
  * __QDISC_STATE_RUNNING guarantees only one CPU can process
  * this qdisc at a time. qdisc_lock(q) serializes queue accesses for
@@ -179,7 +223,7 @@ static inline int qdisc_restart(struct Qdisc *q)
 	if (unlikely(!skb))
 		return 0;
 	WARN_ON_ONCE(skb_dst_is_noref(skb));
-	root_lock = qdisc_lock(q);
+	root_lock = (q->flags & TCQ_F_NOLOCK) ? NULL : qdisc_lock(q);
 	dev = qdisc_dev(q);
 	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
 
@@ -401,6 +445,120 @@ static const u8 prio2band[TC_PRIO_MAX + 1] = {
 	1, 2, 2, 2, 1, 2, 0, 0 , 1, 1, 1, 1, 1, 1, 1, 1
 };
 
+/*
+ * Bounded multi-producer multi-consumer ring of skbs.
+ *
+ * Every slot carries a sequence number: it is free for the producer that
+ * claims index seq, and holds the skb of the consumer looking for index
+ * seq - 1. Producers and consumers only contend on their own index, with
+ * a cmpxchg, and never on a lock.
+ */
+struct skb_ring_slot {
+	unsigned long		seq;
+	struct sk_buff		*skb;
+};
+
+struct skb_ring {
+	unsigned long		head ____cacheline_aligned_in_smp;
+	unsigned long		tail ____cacheline_aligned_in_smp;
+	unsigned long		mask;
+	struct skb_ring_slot	*slots;
+};
+
+static int skb_ring_init(struct skb_ring *r, unsigned int size)
+{
+	unsigned long i;
+
+	size = roundup_pow_of_two(size);
+	r->slots = kcalloc(size, sizeof(*r->slots), GFP_KERNEL);
+	if (!r->slots)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++)
+		r->slots[i].seq = i;
+	r->mask = size - 1;
+	r->head = 0;
+	r->tail = 0;
+	return 0;
+}
+
+static void skb_ring_free(struct skb_ring *r)
+{
+	kfree(r->slots);
+	r->slots = NULL;
+}
+
+/* Returns false if the ring is full */
+static bool skb_ring_produce(struct skb_ring *r, struct sk_buff *skb)
+{
+	struct skb_ring_slot *slot;
+	unsigned long pos, old;
+	long dif;
+
+	pos = ACCESS_ONCE(r->tail);
+	for (;;) {
+		slot = &r->slots[pos & r->mask];
+		dif = (long)(ACCESS_ONCE(slot->seq) - pos);
+		if (dif == 0) {
+			/* a successful cmpxchg() orders the skb store */
+			old = cmpxchg(&r->tail, pos, pos + 1);
+			if (old == pos)
+				break;
+			pos = old;
+		} else if (dif < 0) {
+			return false;
+		} else {
+			pos = ACCESS_ONCE(r->tail);
+		}
+	}
+
+	slot->skb = skb;
+	smp_wmb();	/* publish the skb before the slot */
+	slot->seq = pos + 1;
+	return true;
+}
+
+/* Returns NULL if the ring is empty */
+static struct sk_buff *skb_ring_consume(struct skb_ring *r)
+{
+	struct skb_ring_slot *slot;
+	unsigned long pos, old;
+	struct sk_buff *skb;
+	long dif;
+
+	pos = ACCESS_ONCE(r->head);
+	for (;;) {
+		slot = &r->slots[pos & r->mask];
+		dif = (long)(ACCESS_ONCE(slot->seq) - (pos + 1));
+		if (dif == 0) {
+			old = cmpxchg(&r->head, pos, pos + 1);
+			if (old == pos)
+				break;
+			pos = old;
+		} else if (dif < 0) {
+			return NULL;
+		} else {
+			pos = ACCESS_ONCE(r->head);
+		}
+	}
+
+	skb = slot->skb;
+	smp_mb();	/* read the skb before handing the slot back */
+	slot->seq = pos + r->mask + 1;
+	return skb;
+}
+
+static struct sk_buff *skb_ring_peek(struct skb_ring *r)
+{
+	unsigned long pos = ACCESS_ONCE(r->head);
+	struct skb_ring_slot *slot = &r->slots[pos & r->mask];
+
+	if (ACCESS_ONCE(slot->seq) != pos + 1)
+		return NULL;
+	smp_rmb();
+	return slot->skb;
+}
+
 /* 3-band FIFO queue: old style, but should be a bit faster than
    generic prio+fifo combination.
  */
@@ -409,85 +567,120 @@ static const u8 prio2band[TC_PRIO_MAX + 1] = {
 
 /*
  * Private data for a pfifo_fast scheduler containing:
- * 	- queues for the three band
- * 	- bitmap indicating which of the bands contain skbs
+ * 	- a ring for each of the three bands, each able to hold
+ * 	  tx_queue_len packets
+ *
+ * The rings let pfifo_fast run as a TCQ_F_NOLOCK qdisc: senders on all
+ * CPUs enqueue concurrently, and only the CPU owning run_lock dequeues.
  */
 struct pfifo_fast_priv {
-	u32 bitmap;
-	struct sk_buff_head q[PFIFO_FAST_BANDS];
+	struct skb_ring q[PFIFO_FAST_BANDS];
 };
 
-/*
- * Convert a bitmap to the first band number where an skb is queued, where:
- * 	bitmap=0 means there are no skbs on any band.
- * 	bitmap=1 means there is an skb on band 0.
- *	bitmap=7 means there are skbs on all 3 bands, etc.
- */
-static const int bitmap2band[] = {-1, 0, 1, 0, 2, 0, 1, 0};
-
-static inline struct sk_buff_head *band2list(struct pfifo_fast_priv *priv,
-					     int band)
+static inline struct skb_ring *band2ring(struct pfifo_fast_priv *priv,
+					 int band)
 {
 	return priv->q + band;
 }
 
+/* Account @n packets of @len bytes entering (or leaving, if < 0) the queue */
+static inline void pfifo_fast_qlen_add(struct Qdisc *qdisc, int n, int len)
+{
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		__this_cpu_add(qdisc->cpu_stats->qlen, n);
+		__this_cpu_add(qdisc->cpu_stats->backlog, len);
+	} else {
+		qdisc->q.qlen += n;
+		qdisc->qstats.backlog += len;
+	}
+}
+
 static int pfifo_fast_enqueue(struct sk_buff *skb, struct Qdisc *qdisc)
 {
-	if (skb_queue_len(&qdisc->q) < qdisc_dev(qdisc)->tx_queue_len) {
-		int band = prio2band[skb->priority & TC_PRIO_MAX];
-		struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-		struct sk_buff_head *list = band2list(priv, band);
+	int band = prio2band[skb->priority & TC_PRIO_MAX];
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	unsigned int len = qdisc_pkt_len(skb);
 
-		priv->bitmap |= (1 << band);
-		qdisc->q.qlen++;
-		return __qdisc_enqueue_tail(skb, qdisc, list);
+	if (unlikely(!skb_ring_produce(band2ring(priv, band), skb))) {
+		if (!(qdisc->flags & TCQ_F_NOLOCK))
+			return qdisc_drop(skb, qdisc);
+
+		__this_cpu_inc(qdisc->cpu_stats->drops);
+		kfree_skb(skb);
+		return NET_XMIT_DROP;
 	}
 
-	return qdisc_drop(skb, qdisc);
+	/* skb may already be gone, dequeued by the run_lock owner */
+	pfifo_fast_qlen_add(qdisc, 1, len);
+	return NET_XMIT_SUCCESS;
 }
 
 static struct sk_buff *pfifo_fast_dequeue(struct Qdisc *qdisc)
 {
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-	int band = bitmap2band[priv->bitmap];
-
-	if (likely(band >= 0)) {
-		struct sk_buff_head *list = band2list(priv, band);
-		struct sk_buff *skb = __qdisc_dequeue_head(qdisc, list);
-
-		qdisc->q.qlen--;
-		if (skb_queue_empty(list))
-			priv->bitmap &= ~(1 << band);
-
-		return skb;
+	struct sk_buff *skb = NULL;
+	bool retry = true;
+	int band;
+
+again:
+	for (band = 0; band < PFIFO_FAST_BANDS && !skb; band++)
+		skb = skb_ring_consume(band2ring(priv, band));
+
+	if (likely(skb)) {
+		qdisc_bstats_update(qdisc, skb);
+		pfifo_fast_qlen_add(qdisc, -1, -(int)qdisc_pkt_len(skb));
+	} else if (retry && (qdisc->flags & TCQ_F_NOLOCK) &&
+		   test_bit(__QDISC_STATE_MISSED, &qdisc->state)) {
+		/* A sender that failed to take run_lock relies on us to
+		 * see its packet. Clear the flag before looking again, a
+		 * later sender sets it anew and qdisc_run_end() will
+		 * reschedule us.
+		 */
+		clear_bit(__QDISC_STATE_MISSED, &qdisc->state);
+		smp_mb__after_atomic();
+		retry = false;
+		goto again;
 	}
 
-	return NULL;
+	return skb;
 }
 
 static struct sk_buff *pfifo_fast_peek(struct Qdisc *qdisc)
 {
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
-	int band = bitmap2band[priv->bitmap];
+	struct sk_buff *skb = NULL;
+	int band;
 
-	if (band >= 0) {
-		struct sk_buff_head *list = band2list(priv, band);
-
-		return skb_peek(list);
-	}
+	for (band = 0; band < PFIFO_FAST_BANDS && !skb; band++)
+		skb = skb_ring_peek(band2ring(priv, band));
 
-	return NULL;
+	return skb;
 }
 
 static void pfifo_fast_reset(struct Qdisc *qdisc)
 {
-	int prio;
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	struct sk_buff *skb;
+	int band, cpu;
 
-	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		__qdisc_reset_queue(qdisc, band2list(priv, prio));
+	for (band = 0; band < PFIFO_FAST_BANDS; band++) {
+		struct skb_ring *r = band2ring(priv, band);
 
-	priv->bitmap = 0;
+		if (!r->slots)
+			continue;
+		while ((skb = skb_ring_consume(r)) != NULL)
+			kfree_skb(skb);
+	}
+
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		for_each_possible_cpu(cpu) {
+			struct qdisc_cpu_stats *st;
+
+			st = per_cpu_ptr(qdisc->cpu_stats, cpu);
+			st->qlen = 0;
+			st->backlog = 0;
+		}
+	}
 	qdisc->qstats.backlog = 0;
 	qdisc->q.qlen = 0;
 }
@@ -505,13 +698,35 @@ nla_put_failure:
 	return -1;
 }
 
-static int pfifo_fast_init(struct Qdisc *qdisc, struct nlattr *opt)
+static void pfifo_fast_destroy(struct Qdisc *qdisc)
 {
-	int prio;
 	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	int prio;
 
 	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++)
-		skb_queue_head_init(band2list(priv, prio));
+		skb_ring_free(band2ring(priv, prio));
+}
+
+static int pfifo_fast_init(struct Qdisc *qdisc, struct nlattr *opt)
+{
+	unsigned int qlen = qdisc_dev(qdisc)->tx_queue_len;
+	struct pfifo_fast_priv *priv = qdisc_priv(qdisc);
+	int prio, err;
+
+	/* a ring can't be empty */
+	if (!qlen)
+		return -EINVAL;
+
+	for (prio = 0; prio < PFIFO_FAST_BANDS; prio++) {
+		err = skb_ring_init(band2ring(priv, prio), qlen);
+		if (err) {
+			pfifo_fast_destroy(qdisc);
+			return err;
+		}
+	}
+
+	/* Without per-cpu counters we simply keep using the root lock */
+	qdisc_set_nolock(qdisc);
 
 	/* Can by-pass the queue discipline */
 	qdisc->flags |= TCQ_F_CAN_BYPASS;
@@ -526,11 +741,91 @@ struct Qdisc_ops pfifo_fast_ops __read_mostly = {
 	.peek		=	pfifo_fast_peek,
 	.init		=	pfifo_fast_init,
 	.reset		=	pfifo_fast_reset,
+	.destroy	=	pfifo_fast_destroy,
 	.dump		=	pfifo_fast_dump,
 	.owner		=	THIS_MODULE,
 };
 EXPORT_SYMBOL(pfifo_fast_ops);
 
+/**
+ * qdisc_set_nolock - let a qdisc run without the root lock
+ * @qdisc: qdisc whose enqueue and dequeue are safe to run concurrently
+ *
+ * Allocates the per-cpu counters the enqueue side accounts to instead of
+ * q.qlen and qstats. Called from ->init().
+ */
+int qdisc_set_nolock(struct Qdisc *qdisc)
+{
+	if (!qdisc->cpu_stats) {
+		qdisc->cpu_stats = alloc_percpu(struct qdisc_cpu_stats);
+		if (!qdisc->cpu_stats)
+			return -ENOMEM;
+	}
+	qdisc->flags |= TCQ_F_NOLOCK;
+	return 0;
+}
+EXPORT_SYMBOL(qdisc_set_nolock);
+
+/**
+ * qdisc_clear_nolock - switch a qdisc back to the root lock
+ * @qdisc: qdisc not attached to a device queue yet
+ *
+ * Parents other than mq and mqprio call into their children under the
+ * root lock and look at q.qlen, so a child grafted to them must account
+ * there again.
+ */
+void qdisc_clear_nolock(struct Qdisc *qdisc)
+{
+	if (!(qdisc->flags & TCQ_F_NOLOCK))
+		return;
+
+	qdisc_stats_fold(qdisc);
+	qdisc->flags &= ~TCQ_F_NOLOCK;
+}
+EXPORT_SYMBOL(qdisc_clear_nolock);
+
+int qdisc_qlen_sum(const struct Qdisc *q)
+{
+	int qlen = q->gso_skb ? 1 : 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		qlen += per_cpu_ptr(q->cpu_stats, cpu)->qlen;
+
+	/* enqueue and dequeue may have been accounted on different CPUs */
+	return max(qlen, 0);
+}
+EXPORT_SYMBOL(qdisc_qlen_sum);
+
+/**
+ * qdisc_stats_fold - sum up the per-cpu counters of a TCQ_F_NOLOCK qdisc
+ * @qdisc: qdisc to update q.qlen, qstats.backlog and qstats.drops of
+ *
+ * Called before the statistics of @qdisc are reported.
+ */
+void qdisc_stats_fold(struct Qdisc *qdisc)
+{
+	int backlog = 0;
+	u32 drops = 0;
+	int cpu;
+
+	if (!(qdisc->flags & TCQ_F_NOLOCK))
+		return;
+
+	for_each_possible_cpu(cpu) {
+		const struct qdisc_cpu_stats *st;
+
+		st = per_cpu_ptr(qdisc->cpu_stats, cpu);
+		backlog += st->backlog;
+		drops += st->drops;
+	}
+
+	qdisc->q.qlen = qdisc_qlen_sum(qdisc);
+	qdisc->qstats.backlog = max(backlog, 0);
+	qdisc->qstats.drops = drops;
+}
+EXPORT_SYMBOL(qdisc_stats_fold);
+
 static struct lock_class_key qdisc_tx_busylock;
 
 struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
@@ -564,6 +859,7 @@ struct Qdisc *qdisc_alloc(struct netdev_queue *dev_queue,
 	spin_lock_init(&sch->busylock);
 	lockdep_set_class(&sch->busylock,
 			  dev->qdisc_tx_busylock ?: &qdisc_tx_busylock);
+	spin_lock_init(&sch->run_lock);
 
 	sch->ops = ops;
 	sch->enqueue = ops->enqueue;
@@ -617,6 +913,7 @@ static void qdisc_rcu_free(struct rcu_head *head)
 {
 	struct Qdisc *qdisc = container_of(head, struct Qdisc, rcu_head);
 
+	free_percpu(qdisc->cpu_stats);
 	kfree((char *) qdisc - qdisc->padded);
 }
 
@@ -771,6 +1068,11 @@ static void dev_deactivate_queue(struct net_device *dev,
 
 	qdisc = dev_queue->qdisc;
 	if (qdisc) {
+		bool nolock = qdisc->flags & TCQ_F_NOLOCK;
+
+		/* keep the run_lock owner off gso_skb and the queue */
+		if (nolock)
+			spin_lock_bh(&qdisc->run_lock);
 		spin_lock_bh(qdisc_lock(qdisc));
 
 		if (!(qdisc->flags & TCQ_F_BUILTIN))
@@ -780,9 +1082,33 @@ static void dev_deactivate_queue(struct net_device *dev,
 		qdisc_reset(qdisc);
 
 		spin_unlock_bh(qdisc_lock(qdisc));
+		if (nolock)
+			spin_unlock_bh(&qdisc->run_lock);
 	}
 }
 
+/*
+ * Senders don't take the root lock of a TCQ_F_NOLOCK qdisc, so some may
+ * have enqueued after dev_deactivate_queue() reset it. Flush the queue
+ * again once they are gone.
+ */
+static void dev_reset_queue(struct net_device *dev,
+			    struct netdev_queue *dev_queue,
+			    void *_unused)
+{
+	struct Qdisc *qdisc = dev_queue->qdisc_sleeping;
+
+	if (!qdisc || !(qdisc->flags & TCQ_F_NOLOCK))
+		return;
+
+	spin_lock_bh(&qdisc->run_lock);
+	spin_lock(qdisc_lock(qdisc));
+	qdisc_reset(qdisc);
+	clear_bit(__QDISC_STATE_MISSED, &qdisc->state);
+	spin_unlock(qdisc_lock(qdisc));
+	spin_unlock_bh(&qdisc->run_lock);
+}
+
 static bool some_qdisc_is_busy(struct net_device *dev)
 {
 	unsigned int i;
@@ -841,9 +1167,11 @@ void dev_deactivate_many(struct list_head *head)
 		synchronize_net();
 
 	/* Wait for outstanding qdisc_run calls. */
-	list_for_each_entry(dev, head, unreg_list)
+	list_for_each_entry(dev, head, unreg_list) {
 		while (some_qdisc_is_busy(dev))
 			yield();
+		netdev_for_each_tx_queue(dev, dev_reset_queue, NULL);
+	}
 }
 
 void dev_deactivate(struct net_device *dev)
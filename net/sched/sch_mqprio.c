@@ -231,6 +231,7 @@ static int mqprio_dump(struct Qdisc *sch, struct sk_buff *skb)
 	for (i = 0; i < dev->num_tx_queues; i++) {
 		qdisc = netdev_get_tx_queue(dev, i)->qdisc;
 		spin_lock_bh(qdisc_lock(qdisc));
+		qdisc_stats_fold(qdisc);
 		sch->q.qlen		+= qdisc->q.qlen;
 		sch->bstats.bytes	+= qdisc->bstats.bytes;
 		sch->bstats.packets	+= qdisc->bstats.packets;
@@ -340,6 +341,7 @@ static int mqprio_dump_class_stats(struct Qdisc *sch, unsigned long cl,
 		for (i = tc.offset; i < tc.offset + tc.count; i++) {
 			qdisc = netdev_get_tx_queue(dev, i)->qdisc;
 			spin_lock_bh(qdisc_lock(qdisc));
+			qdisc_stats_fold(qdisc);
 			bstats.bytes      += qdisc->bstats.bytes;
 			bstats.packets    += qdisc->bstats.packets;
 			qstats.qlen       += qdisc->qstats.qlen;
@@ -358,6 +360,7 @@ static int mqprio_dump_class_stats(struct Qdisc *sch, unsigned long cl,
 		struct netdev_queue *dev_queue = mqprio_queue_get(sch, cl);
 
 		sch = dev_queue->qdisc_sleeping;
+		qdisc_stats_fold(sch);
 		sch->qstats.qlen = sch->q.qlen;
 		if (gnet_stats_copy_basic(d, &sch->bstats) < 0 ||
 		    gnet_stats_copy_queue(d, &sch->qstats) < 0)
@@ -98,6 +98,7 @@
 #include <net/cls_cgroup.h>
 
 #include <net/sock.h>
+#include <net/busy_poll.h>
 #include <linux/netfilter.h>
 
 #include <linux/if_tun.h>
@@ -1167,16 +1168,47 @@ out_release:
 }
 EXPORT_SYMBOL(sock_create_lite);
 
+/*
+ *	select()/poll() is about to sleep on a socket that has nothing to
+ *	read: spin on the socket's NAPI context for up to net.core.busy_poll
+ *	usecs first. The wait queue is only passed in on the first pass over
+ *	the descriptors, so we don't spin again after a wake up.
+ */
+static unsigned int sock_poll_busy_loop(struct file *file,
+					struct socket *sock, poll_table *wait,
+					unsigned int mask)
+{
+	unsigned long end_time;
+
+	if ((mask & (POLLIN | POLLRDNORM)) || poll_does_not_wait(wait) ||
+	    !(poll_requested_events(wait) & (POLLIN | POLLRDNORM)))
+		return mask;
+
+	end_time = busy_loop_end_time();
+	while (sk_can_busy_loop(sock->sk)) {
+		if (sk_busy_loop(sock->sk, 1))
+			return sock->ops->poll(file, sock, NULL);
+		if (busy_loop_timeout(end_time))
+			break;
+	}
+	return mask;
+}
+
 /* No kernel lock held - perfect */
 static unsigned int sock_poll(struct file *file, poll_table *wait)
 {
 	struct socket *sock;
+	unsigned int mask;
 
 	/*
 	 *      We can't return errors to poll, so it's either yes or no.
 	 */
 	sock = file->private_data;
-	return sock->ops->poll(file, sock, wait);
+	mask = sock->ops->poll(file, sock, wait);
+
+	if (net_busy_loop_on())
+		mask = sock_poll_busy_loop(file, sock, wait, mask);
+	return mask;
 }
 
 static int sock_mmap(struct file *file, struct vm_area_struct *vma)
@@ -763,6 +763,7 @@ static struct sock *unix_create1(struct net *net, struct socket *sock)
 	spin_lock_init(&u->lock);
 	atomic_long_set(&u->inflight, 0);
 	INIT_LIST_HEAD(&u->link);
+	u->gc_children = 0;
 	mutex_init(&u->readlock); /* single task reading lock */
 	init_waitqueue_head(&u->peer_wait);
 	init_waitqueue_func_entry(&u->peer_wake, unix_dgram_peer_wake_relay);
@@ -1461,13 +1462,10 @@ out:
 
 static void unix_detach_fds(struct scm_cookie *scm, struct sk_buff *skb)
 {
-	int i;
-
 	scm->fp = UNIXCB(skb).fp;
+	atomic_long_sub(scm->fp->count, &scm->fp->user->unix_inflight);
+	unix_notinflight(skb);
 	UNIXCB(skb).fp = NULL;
-
-	for (i = scm->fp->count-1; i >= 0; i--)
-		unix_notinflight(scm->fp->user, scm->fp->fp[i]);
 }
 
 static void unix_destruct_scm(struct sk_buff *skb)
@@ -1485,16 +1483,16 @@ static void unix_destruct_scm(struct sk_buff *skb)
 }
 
 /*
- * The "user->unix_inflight" variable is protected by the garbage
- * collection lock, and we just read it locklessly here. If you go
- * over the limit, there might be a tiny race in actually noticing
- * it across threads. Tough.
+ * The "user->unix_inflight" counter is only checked here, before the
+ * files are added. If you go over the limit, there might be a tiny
+ * race in actually noticing it across threads. Tough.
  */
 static inline bool too_many_unix_fds(struct task_struct *p)
 {
 	struct user_struct *user = current_user();
 
-	if (unlikely(user->unix_inflight > task_rlimit(p, RLIMIT_NOFILE)))
+	if (unlikely(atomic_long_read(&user->unix_inflight) >
+		     task_rlimit(p, RLIMIT_NOFILE)))
 		return !capable(CAP_SYS_RESOURCE) && !capable(CAP_SYS_ADMIN);
 	return false;
 }
@@ -1531,8 +1529,13 @@ static int unix_attach_fds(struct scm_cookie *scm, struct sk_buff *skb)
 	if (!UNIXCB(skb).fp)
 		return -ENOMEM;
 
-	for (i = scm->fp->count - 1; i >= 0; i--)
-		unix_inflight(scm->fp->user, scm->fp->fp[i]);
+	/*
+	 * The sockets are only counted in flight, and the edges to the
+	 * receiver added, once the skb is queued; see unix_inflight().
+	 */
+	UNIXCB(skb).nr_unix = unix_sock_count;
+	atomic_long_add(UNIXCB(skb).fp->count,
+			&UNIXCB(skb).fp->user->unix_inflight);
 	return max_level;
 }
 
@@ -1544,6 +1547,9 @@ static int unix_scm_to_skb(struct scm_cookie *scm, struct sk_buff *skb, bool sen
 	UNIXCB(skb).uid = scm->creds.uid;
 	UNIXCB(skb).gid = scm->creds.gid;
 	UNIXCB(skb).fp = NULL;
+	UNIXCB(skb).gc_rcv = NULL;
+	UNIXCB(skb).nr_unix = 0;
+	UNIXCB(skb).inflight = false;
 	if (scm->fp && send_fds)
 		err = unix_attach_fds(scm, skb);
 
@@ -1755,6 +1761,7 @@ restart_locked:
 	if (sock_flag(other, SOCK_RCVTSTAMP))
 		__net_timestamp(skb);
 	maybe_add_creds(skb, sock, other);
+	unix_inflight(skb, other);
 	skb_queue_tail(&other->sk_receive_queue, skb);
 	if (max_level > unix_sk(other)->recursion_level)
 		unix_sk(other)->recursion_level = max_level;
@@ -1872,6 +1879,7 @@ static int unix_stream_sendmsg(struct kiocb *kiocb, struct socket *sock,
 			goto pipe_err_free;
 
 		maybe_add_creds(skb, sock, other);
+		unix_inflight(skb, other);
 		skb_queue_tail(&other->sk_receive_queue, skb);
 		if (max_level > unix_sk(other)->recursion_level)
 			unix_sk(other)->recursion_level = max_level;
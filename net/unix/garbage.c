@@ -66,6 +66,21 @@
  *		Reimplement with a cycle collecting algorithm. This should
  *		solve several problems with the previous code, like being racy
  *		wrt receive and holding up unrelated socket operations.
+ *
+ *	Only run the collector when the in-flight graph may have a cycle.
+ *		Every skb that carries AF_UNIX files adds edges from those
+ *		sockets to the receiver it is queued on.  The edges are not
+ *		kept in lists, only counted in the receiver's gc_children,
+ *		and they are added together with the in-flight counts when
+ *		the skb is queued, so sending and receiving each take
+ *		unix_gc_lock once as before.  A cycle needs an in-flight
+ *		socket with in-flight children, so unix_graph_maybe_cyclic is
+ *		set when an edge points at an in-flight socket or a socket
+ *		with children goes in flight, and recomputed after every
+ *		collection.  Listeners and embryos are treated as possibly
+ *		cyclic, their edges are hidden behind the accept queue.
+ *		Passing files that are not AF_UNIX sockets no longer takes
+ *		unix_gc_lock at all.
  */
 
 #include <linux/kernel.h>
@@ -94,6 +109,7 @@ static DEFINE_SPINLOCK(unix_gc_lock);
 static DECLARE_WAIT_QUEUE_HEAD(unix_gc_wait);
 
 unsigned int unix_tot_inflight;
+static bool unix_graph_maybe_cyclic;
 
 
 struct sock *unix_get_socket(struct file *filp)
@@ -117,49 +133,92 @@ struct sock *unix_get_socket(struct file *filp)
 	return u_sock;
 }
 
+static void unix_update_graph(struct unix_sock *u)
+{
+	if (u->gc_children || u->sk.sk_state == TCP_LISTEN)
+		unix_graph_maybe_cyclic = true;
+}
+
 /*
- *	Keep the number of times in flight count for the file
- *	descriptor if it is for an AF_UNIX socket.
+ *	Keep the number of times in flight count for the files of an skb
+ *	that are AF_UNIX sockets, UNIXCB(skb).nr_unix of them, and add
+ *	their edges to @receiver.  Called once per skb, before it becomes
+ *	visible on the receive queue of @receiver.
  */
 
-void unix_inflight(struct user_struct *user, struct file *fp)
+void unix_inflight(struct sk_buff *skb, struct sock *receiver)
 {
-	struct sock *s = unix_get_socket(fp);
+	struct scm_fp_list *fpl = UNIXCB(skb).fp;
+	struct unix_sock *r = unix_sk(receiver);
+	int i;
+
+	if (!fpl || !UNIXCB(skb).nr_unix)
+		return;
 
 	spin_lock(&unix_gc_lock);
+	for (i = 0; i < fpl->count; i++) {
+		struct sock *s = unix_get_socket(fpl->fp[i]);
+		struct unix_sock *u;
 
-	if (s) {
-		struct unix_sock *u = unix_sk(s);
+		if (!s)
+			continue;
 
+		u = unix_sk(s);
 		if (atomic_long_inc_return(&u->inflight) == 1) {
 			BUG_ON(!list_empty(&u->link));
 			list_add_tail(&u->link, &gc_inflight_list);
+			unix_update_graph(u);
 		} else {
 			BUG_ON(list_empty(&u->link));
 		}
 		unix_tot_inflight++;
 	}
-	user->unix_inflight++;
+
+	UNIXCB(skb).inflight = true;
+	UNIXCB(skb).gc_rcv = r;
+	r->gc_children += UNIXCB(skb).nr_unix;
+	/* An embryo is only reachable through its listener's queue */
+	if (atomic_long_read(&r->inflight) || !receiver->sk_socket)
+		unix_graph_maybe_cyclic = true;
 	spin_unlock(&unix_gc_lock);
 }
 
-void unix_notinflight(struct user_struct *user, struct file *fp)
+/* Called with unix_gc_lock held */
+static void __unix_del_edges(struct sk_buff *skb)
 {
-	struct sock *s = unix_get_socket(fp);
+	struct unix_sock *receiver = UNIXCB(skb).gc_rcv;
+
+	if (receiver) {
+		receiver->gc_children -= UNIXCB(skb).nr_unix;
+		UNIXCB(skb).gc_rcv = NULL;
+	}
+}
+
+/* Undoes unix_inflight(), if the skb was ever queued */
+void unix_notinflight(struct sk_buff *skb)
+{
+	struct scm_fp_list *fpl = UNIXCB(skb).fp;
+	int i;
+
+	if (!UNIXCB(skb).inflight)
+		return;
 
 	spin_lock(&unix_gc_lock);
+	__unix_del_edges(skb);
+	for (i = 0; i < fpl->count; i++) {
+		struct sock *s = unix_get_socket(fpl->fp[i]);
+		struct unix_sock *u;
 
-	if (s) {
-		struct unix_sock *u = unix_sk(s);
+		if (!s)
+			continue;
 
+		u = unix_sk(s);
 		BUG_ON(list_empty(&u->link));
 
 		if (atomic_long_dec_and_test(&u->inflight))
 			list_del_init(&u->link);
 		unix_tot_inflight--;
 	}
-	if (user->unix_inflight > 0)
-		user->unix_inflight--;
 	spin_unlock(&unix_gc_lock);
 }
 
@@ -202,6 +261,8 @@ static void scan_inflight(struct sock *x, void (*func)(struct unix_sock *),
 				}
 			}
 			if (hit && hitlist != NULL) {
+				/* x may be gone before the skb is freed */
+				__unix_del_edges(skb);
 				__skb_unlink(skb, &x->sk_receive_queue);
 				__skb_queue_tail(hitlist, skb);
 			}
@@ -274,12 +335,14 @@ static bool gc_in_progress = false;
 void wait_for_unix_gc(void)
 {
 	/*
-	 * If number of inflight sockets is insane,
-	 * force a garbage collect right now.
+	 * If number of inflight sockets is insane and some of them may
+	 * be garbage, force a garbage collect right now.
 	 */
-	if (unix_tot_inflight > UNIX_INFLIGHT_TRIGGER_GC && !gc_in_progress)
+	if (unix_tot_inflight > UNIX_INFLIGHT_TRIGGER_GC &&
+	    ACCESS_ONCE(unix_graph_maybe_cyclic) && !gc_in_progress)
 		unix_gc();
-	wait_event(unix_gc_wait, gc_in_progress == false);
+	if (ACCESS_ONCE(gc_in_progress))
+		wait_event(unix_gc_wait, gc_in_progress == false);
 }
 
 /* The external entry point: unix_gc() */
@@ -291,10 +354,14 @@ void unix_gc(void)
 	struct list_head cursor;
 	LIST_HEAD(not_cycle_list);
 
+	/* Without a cycle every in-flight socket is reachable */
+	if (!ACCESS_ONCE(unix_graph_maybe_cyclic))
+		return;
+
 	spin_lock(&unix_gc_lock);
 
 	/* Avoid a recursive GC. */
-	if (gc_in_progress)
+	if (gc_in_progress || !unix_graph_maybe_cyclic)
 		goto out;
 
 	gc_in_progress = true;
@@ -388,6 +455,12 @@ void unix_gc(void)
 
 	/* All candidates should have been detached by now. */
 	BUG_ON(!list_empty(&gc_candidates));
+
+	/* What is left in flight is reachable, see if a cycle remains */
+	unix_graph_maybe_cyclic = false;
+	list_for_each_entry(u, &gc_inflight_list, link)
+		unix_update_graph(u);
+
 	gc_in_progress = false;
 	wake_up(&unix_gc_wait);
 
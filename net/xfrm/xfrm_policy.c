@@ -17,6 +17,7 @@
 #include <linux/slab.h>
 #include <linux/kmod.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/spinlock.h>
 #include <linux/workqueue.h>
 #include <linux/notifier.h>
@@ -375,6 +376,213 @@ static struct hlist_head *policy_hash_direct(struct net *net,
 	return net->xfrm.policy_bydst[dir].table + hash;
 }
 
+/*
+ * Inexact policies, whose selector has a prefix shorter than a host
+ * address, are kept in the policy_inexact list ordered by priority. They
+ * are also sorted into bins by family and selector prefix lengths, where
+ * a rbtree keyed on the masked destination and source addresses finds the
+ * node holding the policies that may match a flow. A lookup thus visits a
+ * node per bin instead of walking every inexact policy.
+ *
+ * The policies of a node are ordered by their position in the list, and a
+ * lookup returns the candidate the list walk would have stopped at first.
+ */
+struct xfrm_pol_inexact_bin {
+	struct list_head	list;
+	struct rb_root		root;
+	u16			family;
+	u8			prefixlen_d;
+	u8			prefixlen_s;
+};
+
+struct xfrm_pol_inexact_node {
+	struct rb_node		node;
+	struct xfrm_pol_inexact_bin *bin;
+	xfrm_address_t		daddr;
+	xfrm_address_t		saddr;
+	struct hlist_head	policies;
+};
+
+/* Any prefix shorter than the one of the selector would do for a bin,
+ * xfrm_policy_match() has the final word. */
+static u8 xfrm_pol_inexact_prefixlen(u8 prefixlen, u16 family)
+{
+	u8 max = family == AF_INET ? 32 : 128;
+
+	return prefixlen <= max ? prefixlen : 0;
+}
+
+static void xfrm_pol_inexact_mask(xfrm_address_t *dst,
+				  const xfrm_address_t *addr,
+				  u8 prefixlen, u16 family)
+{
+	int pdw = prefixlen >> 5;
+	int pbi = prefixlen & 0x1f;
+	int i;
+
+	memset(dst, 0, sizeof(*dst));
+	if (family == AF_INET) {
+		if (prefixlen)
+			dst->a4 = addr->a4 &
+				  htonl(0xFFFFFFFFu << (32 - prefixlen));
+		return;
+	}
+	for (i = 0; i < pdw; i++)
+		dst->a6[i] = addr->a6[i];
+	if (pbi)
+		dst->a6[pdw] = addr->a6[pdw] & htonl(0xFFFFFFFFu << (32 - pbi));
+}
+
+static int xfrm_pol_inexact_cmp(const xfrm_address_t *daddr,
+				const xfrm_address_t *saddr,
+				const struct xfrm_pol_inexact_node *n)
+{
+	int ret = memcmp(daddr, &n->daddr, sizeof(*daddr));
+
+	return ret ? ret : memcmp(saddr, &n->saddr, sizeof(*saddr));
+}
+
+static struct xfrm_pol_inexact_node *
+xfrm_pol_inexact_find(const struct xfrm_pol_inexact_bin *bin,
+		      const xfrm_address_t *daddr,
+		      const xfrm_address_t *saddr)
+{
+	struct rb_node *p = bin->root.rb_node;
+
+	while (p) {
+		struct xfrm_pol_inexact_node *n;
+		int cmp;
+
+		n = rb_entry(p, struct xfrm_pol_inexact_node, node);
+		cmp = xfrm_pol_inexact_cmp(daddr, saddr, n);
+		if (cmp < 0)
+			p = p->rb_left;
+		else if (cmp > 0)
+			p = p->rb_right;
+		else
+			return n;
+	}
+	return NULL;
+}
+
+/* Find or create the node of an inexact policy, with xfrm_policy_lock
+ * held for writing. */
+static struct xfrm_pol_inexact_node *
+xfrm_pol_inexact_node_get(struct net *net, const struct xfrm_policy *pol,
+			  int dir)
+{
+	const struct xfrm_selector *sel = &pol->selector;
+	u8 dplen = xfrm_pol_inexact_prefixlen(sel->prefixlen_d, pol->family);
+	u8 splen = xfrm_pol_inexact_prefixlen(sel->prefixlen_s, pol->family);
+	struct xfrm_pol_inexact_bin *bin;
+	struct xfrm_pol_inexact_node *n;
+	struct rb_node **p, *parent = NULL;
+	xfrm_address_t daddr, saddr;
+	int cmp;
+
+	list_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir], list) {
+		if (bin->family == pol->family &&
+		    bin->prefixlen_d == dplen &&
+		    bin->prefixlen_s == splen)
+			goto found;
+	}
+	bin = kzalloc(sizeof(*bin), GFP_ATOMIC);
+	if (!bin)
+		return NULL;
+	bin->root = RB_ROOT;
+	bin->family = pol->family;
+	bin->prefixlen_d = dplen;
+	bin->prefixlen_s = splen;
+	list_add_tail(&bin->list, &net->xfrm.policy_inexact_bins[dir]);
+
+found:
+	xfrm_pol_inexact_mask(&daddr, &sel->daddr, dplen, pol->family);
+	xfrm_pol_inexact_mask(&saddr, &sel->saddr, splen, pol->family);
+
+	p = &bin->root.rb_node;
+	while (*p) {
+		parent = *p;
+		n = rb_entry(parent, struct xfrm_pol_inexact_node, node);
+		cmp = xfrm_pol_inexact_cmp(&daddr, &saddr, n);
+		if (cmp < 0)
+			p = &parent->rb_left;
+		else if (cmp > 0)
+			p = &parent->rb_right;
+		else
+			return n;
+	}
+
+	n = kzalloc(sizeof(*n), GFP_ATOMIC);
+	if (!n) {
+		if (RB_EMPTY_ROOT(&bin->root)) {
+			list_del(&bin->list);
+			kfree(bin);
+		}
+		return NULL;
+	}
+	n->bin = bin;
+	n->daddr = daddr;
+	n->saddr = saddr;
+	INIT_HLIST_HEAD(&n->policies);
+	rb_link_node(&n->node, parent, p);
+	rb_insert_color(&n->node, &bin->root);
+
+	return n;
+}
+
+/* Free a node, and its bin, when the last policy has left */
+static void xfrm_pol_inexact_node_put(struct xfrm_pol_inexact_node *n)
+{
+	struct xfrm_pol_inexact_bin *bin = n->bin;
+
+	if (!hlist_empty(&n->policies))
+		return;
+
+	rb_erase(&n->node, &bin->root);
+	kfree(n);
+	if (RB_EMPTY_ROOT(&bin->root)) {
+		list_del(&bin->list);
+		kfree(bin);
+	}
+}
+
+/* pol was just added to the inexact list chain: renumber the list and
+ * add pol to its node. */
+static void xfrm_pol_inexact_insert(struct xfrm_policy *pol,
+				    struct hlist_head *chain,
+				    struct xfrm_pol_inexact_node *n)
+{
+	struct hlist_node *newpos = NULL;
+	struct xfrm_policy *p;
+	u32 pos = 0;
+
+	hlist_for_each_entry(p, chain, bydst)
+		p->pos = pos++;
+
+	hlist_for_each_entry(p, &n->policies, byinexact) {
+		if (p->pos > pol->pos)
+			break;
+		newpos = &p->byinexact;
+	}
+	if (newpos)
+		hlist_add_after(newpos, &pol->byinexact);
+	else
+		hlist_add_head(&pol->byinexact, &n->policies);
+	pol->inexact_node = n;
+}
+
+static void xfrm_pol_inexact_remove(struct xfrm_policy *pol)
+{
+	struct xfrm_pol_inexact_node *n = pol->inexact_node;
+
+	if (!n)
+		return;
+
+	hlist_del(&pol->byinexact);
+	pol->inexact_node = NULL;
+	xfrm_pol_inexact_node_put(n);
+}
+
 static void xfrm_dst_hash_transfer(struct hlist_head *list,
 				   struct hlist_head *ndsttable,
 				   unsigned int nhashmask)
@@ -626,11 +834,19 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 	struct net *net = xp_net(policy);
 	struct xfrm_policy *pol;
 	struct xfrm_policy *delpol;
+	struct xfrm_pol_inexact_node *node = NULL;
 	struct hlist_head *chain;
 	struct hlist_node *newpos;
 
 	write_lock_bh(&xfrm_policy_lock);
 	chain = policy_hash_bysel(net, &policy->selector, policy->family, dir);
+	if (chain == &net->xfrm.policy_inexact[dir]) {
+		node = xfrm_pol_inexact_node_get(net, policy, dir);
+		if (!node) {
+			write_unlock_bh(&xfrm_policy_lock);
+			return -ENOBUFS;
+		}
+	}
 	delpol = NULL;
 	newpos = NULL;
 	hlist_for_each_entry(pol, chain, bydst) {
@@ -640,6 +856,8 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 		    xfrm_sec_ctx_match(pol->security, policy->security) &&
 		    !WARN_ON(delpol)) {
 			if (excl) {
+				if (node)
+					xfrm_pol_inexact_node_put(node);
 				write_unlock_bh(&xfrm_policy_lock);
 				return -EEXIST;
 			}
@@ -657,6 +875,8 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 		hlist_add_after(newpos, &policy->bydst);
 	else
 		hlist_add_head(&policy->bydst, chain);
+	if (node)
+		xfrm_pol_inexact_insert(policy, chain, node);
 	xfrm_pol_hold(policy);
 	net->xfrm.policy_count[dir]++;
 	atomic_inc(&flow_cache_genid);
@@ -968,6 +1188,52 @@ static int xfrm_policy_match(const struct xfrm_policy *pol,
 	return ret;
 }
 
+/*
+ * Same result as walking the inexact list in order and stopping at the
+ * first policy which either is a better match than the exact one of
+ * priority, or makes the security check fail.
+ */
+static struct xfrm_policy *
+xfrm_policy_lookup_inexact(struct net *net, u8 type, const struct flowi *fl,
+			   u16 family, u8 dir, const xfrm_address_t *daddr,
+			   const xfrm_address_t *saddr, u32 priority)
+{
+	struct xfrm_pol_inexact_bin *bin;
+	struct xfrm_pol_inexact_node *n;
+	struct xfrm_policy *pol, *ret = NULL;
+	xfrm_address_t d, s;
+	u32 pos = ~0U;
+	int err;
+
+	list_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir], list) {
+		if (bin->family != family)
+			continue;
+		xfrm_pol_inexact_mask(&d, daddr, bin->prefixlen_d, family);
+		xfrm_pol_inexact_mask(&s, saddr, bin->prefixlen_s, family);
+		n = xfrm_pol_inexact_find(bin, &d, &s);
+		if (!n)
+			continue;
+
+		hlist_for_each_entry(pol, &n->policies, byinexact) {
+			if (pol->pos >= pos)
+				break;
+			err = xfrm_policy_match(pol, fl, type, family, dir);
+			if (err) {
+				if (err == -ESRCH)
+					continue;
+				ret = ERR_PTR(err);
+				pos = pol->pos;
+				break;
+			} else if (pol->priority < priority) {
+				ret = pol;
+				pos = pol->pos;
+				break;
+			}
+		}
+	}
+	return ret;
+}
+
 static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 						     const struct flowi *fl,
 						     u16 family, u8 dir)
@@ -1001,21 +1267,12 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 			break;
 		}
 	}
-	chain = &net->xfrm.policy_inexact[dir];
-	hlist_for_each_entry(pol, chain, bydst) {
-		err = xfrm_policy_match(pol, fl, type, family, dir);
-		if (err) {
-			if (err == -ESRCH)
-				continue;
-			else {
-				ret = ERR_PTR(err);
-				goto fail;
-			}
-		} else if (pol->priority < priority) {
-			ret = pol;
-			break;
-		}
-	}
+	pol = xfrm_policy_lookup_inexact(net, type, fl, family, dir,
+					 daddr, saddr, priority);
+	if (pol)
+		ret = pol;
+	if (IS_ERR(ret))
+		goto fail;
 	if (ret)
 		xfrm_pol_hold(ret);
 fail:
@@ -1150,6 +1407,7 @@ static struct xfrm_policy *__xfrm_policy_unlink(struct xfrm_policy *pol,
 		return NULL;
 
 	hlist_del(&pol->bydst);
+	xfrm_pol_inexact_remove(pol);
 	hlist_del(&pol->byidx);
 	list_del(&pol->walk.all);
 	net->xfrm.policy_count[dir]--;
@@ -2860,6 +3118,8 @@ static int __net_init xfrm_policy_init(struct net *net)
 			goto out_bydst;
 		htab->hmask = hmask;
 	}
+	for (dir = 0; dir < XFRM_POLICY_MAX; dir++)
+		INIT_LIST_HEAD(&net->xfrm.policy_inexact_bins[dir]);
 
 	INIT_LIST_HEAD(&net->xfrm.policy_all);
 	INIT_WORK(&net->xfrm.policy_hash_work, xfrm_hash_resize);
@@ -2903,6 +3163,8 @@ static void xfrm_policy_fini(struct net *net)
 		struct xfrm_policy_hash *htab;
 
 		WARN_ON(!hlist_empty(&net->xfrm.policy_inexact[dir]));
+		if (dir < XFRM_POLICY_MAX)
+			WARN_ON(!list_empty(&net->xfrm.policy_inexact_bins[dir]));
 
 		htab = &net->xfrm.policy_bydst[dir];
 		sz = (htab->hmask + 1) * sizeof(struct hlist_head);
@@ -3262,3 +3524,223 @@ restore_state:
 }
 EXPORT_SYMBOL(xfrm_migrate);
 #endif
+
+#ifdef CONFIG_TEST_XFRM_POLICY_INEXACT
+
+#include <linux/random.h>
+
+#define TEST_XFRM_POLICIES	512
+#define TEST_XFRM_LOOKUPS	4096
+#define TEST_XFRM_DIR		XFRM_POLICY_FWD
+
+static struct xfrm_policy **xfrm_test_pols __initdata;
+
+/*
+ * Few distinct addresses, so that the selectors of the policies overlap,
+ * differing in bits spread over the whole address so that every prefix
+ * length tells some of them apart.
+ */
+#define TEST_XFRM_ADDR_BITS	0x0c30c303
+
+static void __init xfrm_test_addr(xfrm_address_t *addr, u16 family)
+{
+	int i;
+
+	memset(addr, 0, sizeof(*addr));
+	if (family == AF_INET) {
+		addr->a4 = htonl(0x0a000000 |
+				 (prandom_u32() & TEST_XFRM_ADDR_BITS));
+		return;
+	}
+	for (i = 0; i < 4; i++)
+		addr->a6[i] = htonl(prandom_u32() & TEST_XFRM_ADDR_BITS);
+	addr->a6[0] |= htonl(0x20010000);
+}
+
+static u8 __init xfrm_test_prefixlen(u16 family)
+{
+	u8 max = family == AF_INET ? 32 : 128;
+	u8 len;
+
+	if (prandom_u32() & 1)
+		return prandom_u32() % (max + 1);
+
+	/* favour the prefixes of whole bytes and one bit short of them */
+	len = (prandom_u32() % (max / 8 + 1)) * 8;
+	if (len && (prandom_u32() & 1))
+		len--;
+	return len;
+}
+
+static struct xfrm_policy * __init xfrm_test_policy(struct net *net)
+{
+	u16 family = IS_ENABLED(CONFIG_IPV6) && (prandom_u32() & 1) ?
+		     AF_INET6 : AF_INET;
+	u8 max = family == AF_INET ? 32 : 128;
+	struct xfrm_policy *pol;
+	struct xfrm_selector *sel;
+	int err;
+
+	pol = xfrm_policy_alloc(net, GFP_KERNEL);
+	if (!pol)
+		return NULL;
+
+	pol->family = family;
+	pol->type = XFRM_POLICY_TYPE_MAIN;
+	pol->action = XFRM_POLICY_ALLOW;
+	pol->priority = prandom_u32() % 64;
+
+	sel = &pol->selector;
+	sel->family = family;
+	xfrm_test_addr(&sel->daddr, family);
+	xfrm_test_addr(&sel->saddr, family);
+	do {
+		sel->prefixlen_d = xfrm_test_prefixlen(family);
+		sel->prefixlen_s = xfrm_test_prefixlen(family);
+	} while (sel->prefixlen_d == max && sel->prefixlen_s == max);
+	if (!(prandom_u32() % 4)) {
+		sel->dport = htons(1 + prandom_u32() % 4);
+		sel->dport_mask = htons(0xffff);
+	}
+
+	err = xfrm_policy_insert(TEST_XFRM_DIR, pol, 1);
+	if (err) {
+		/* same selector as an earlier one */
+		security_xfrm_policy_free(pol->security);
+		kfree(pol);
+		return err == -EEXIST ? ERR_PTR(err) : NULL;
+	}
+	return pol;
+}
+
+/* The inexact policy lookup as it was before the bins */
+static struct xfrm_policy * __init
+xfrm_test_walk(struct net *net, const struct flowi *fl, u16 family)
+{
+	struct xfrm_policy *pol;
+	int err;
+
+	read_lock_bh(&xfrm_policy_lock);
+	hlist_for_each_entry(pol, &net->xfrm.policy_inexact[TEST_XFRM_DIR],
+			     bydst) {
+		err = xfrm_policy_match(pol, fl, XFRM_POLICY_TYPE_MAIN,
+					family, TEST_XFRM_DIR);
+		if (err) {
+			if (err == -ESRCH)
+				continue;
+			pol = ERR_PTR(err);
+			break;
+		} else if (pol->priority < ~0U) {
+			break;
+		}
+	}
+	read_unlock_bh(&xfrm_policy_lock);
+
+	return pol;
+}
+
+static int __init xfrm_test_lookups(struct net *net)
+{
+	struct xfrm_policy *pol, *want;
+	xfrm_address_t daddr, saddr;
+	struct flowi fl;
+	u16 family;
+	int i, errors = 0;
+
+	for (i = 0; i < TEST_XFRM_LOOKUPS; i++) {
+		family = IS_ENABLED(CONFIG_IPV6) && (prandom_u32() & 1) ?
+			 AF_INET6 : AF_INET;
+		xfrm_test_addr(&daddr, family);
+		xfrm_test_addr(&saddr, family);
+
+		memset(&fl, 0, sizeof(fl));
+		if (family == AF_INET) {
+			fl.u.ip4.daddr = daddr.a4;
+			fl.u.ip4.saddr = saddr.a4;
+			fl.u.ip4.flowi4_proto = IPPROTO_UDP;
+			fl.u.ip4.fl4_dport = htons(1 + prandom_u32() % 4);
+		} else {
+			memcpy(&fl.u.ip6.daddr, &daddr, sizeof(daddr.a6));
+			memcpy(&fl.u.ip6.saddr, &saddr, sizeof(saddr.a6));
+			fl.u.ip6.flowi6_proto = IPPROTO_UDP;
+			fl.u.ip6.fl6_dport = htons(1 + prandom_u32() % 4);
+		}
+
+		want = xfrm_test_walk(net, &fl, family);
+		pol = xfrm_policy_lookup_bytype(net, XFRM_POLICY_TYPE_MAIN,
+						&fl, family, TEST_XFRM_DIR);
+		if (pol != want) {
+			pr_err("xfrm_policy_inexact_test: %s lookup returned policy %u instead of %u\n",
+			       family == AF_INET ? "IPv4" : "IPv6",
+			       IS_ERR_OR_NULL(pol) ? 0 : pol->index,
+			       IS_ERR_OR_NULL(want) ? 0 : want->index);
+			errors++;
+		}
+		if (!IS_ERR_OR_NULL(pol))
+			xfrm_pol_put(pol);
+	}
+	return errors;
+}
+
+static void __init xfrm_test_delete(int i)
+{
+	xfrm_policy_delete(xfrm_test_pols[i], TEST_XFRM_DIR);
+	xfrm_pol_put(xfrm_test_pols[i]);
+	xfrm_test_pols[i] = NULL;
+}
+
+/*
+ * Inserts random overlapping inexact policies and checks that looking
+ * them up through the bins finds the policy the list walk does, also
+ * after deleting some and inserting others in between.
+ */
+static int __init xfrm_policy_inexact_test(void)
+{
+	struct net *net = &init_net;
+	struct xfrm_policy *pol;
+	int round, i, errors = 0;
+
+	xfrm_test_pols = kcalloc(TEST_XFRM_POLICIES, sizeof(*xfrm_test_pols),
+				 GFP_KERNEL);
+	if (!xfrm_test_pols)
+		return -ENOMEM;
+
+	pr_info("xfrm_policy_inexact_test: starting\n");
+	for (round = 0; round < 4; round++) {
+		for (i = 0; i < TEST_XFRM_POLICIES; i++) {
+			if (xfrm_test_pols[i])
+				continue;
+			pol = xfrm_test_policy(net);
+			if (!pol) {
+				errors++;
+				goto out;
+			}
+			if (!IS_ERR(pol))
+				xfrm_test_pols[i] = pol;
+		}
+		errors += xfrm_test_lookups(net);
+
+		for (i = 0; i < TEST_XFRM_POLICIES; i++)
+			if (xfrm_test_pols[i] && (prandom_u32() & 1))
+				xfrm_test_delete(i);
+		errors += xfrm_test_lookups(net);
+	}
+
+out:
+	for (i = 0; i < TEST_XFRM_POLICIES; i++)
+		if (xfrm_test_pols[i])
+			xfrm_test_delete(i);
+	kfree(xfrm_test_pols);
+
+	if (!list_empty(&net->xfrm.policy_inexact_bins[TEST_XFRM_DIR])) {
+		pr_err("xfrm_policy_inexact_test: bins left behind\n");
+		errors++;
+	}
+	if (errors)
+		pr_err("xfrm_policy_inexact_test: %d errors\n", errors);
+	else
+		pr_info("xfrm_policy_inexact_test: passed\n");
+	return errors ? -EINVAL : 0;
+}
+late_initcall(xfrm_policy_inexact_test);
+#endif /* CONFIG_TEST_XFRM_POLICY_INEXACT */
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# Compare the sender side qdisc of a bulk transfer over an emulated long
+# delay link: two network namespaces joined by a veth pair, netem adding
+# the link delay on the return path and the qdisc under test on the data
+# path. Reports throughput, the RTT a ping sees next to the bulk flow and
+# the qdisc statistics.
+#
+# Needs ip, tc with fq support, ping and iperf.
+#
+# usage: fq_netem_bench.sh [delay_ms [seconds [maxrate]]]
+
+DELAY=${1:-50}
+TIME=${2:-10}
+MAXRATE=${3:-10mbit}
+
+TX=fqbench_tx
+RX=fqbench_rx
+
+if [ $(id -u) != 0 ]; then
+	echo $0 must be run as root >&2
+	exit 0
+fi
+
+for tool in ip tc ping iperf; do
+	if ! which $tool > /dev/null 2>&1; then
+		echo "fq_netem_bench: $tool not found [SKIP]"
+		exit 0
+	fi
+done
+
+cleanup() {
+	ip netns del $TX 2> /dev/null
+	ip netns del $RX 2> /dev/null
+}
+trap cleanup EXIT
+
+setup() {
+	cleanup
+	ip netns add $TX
+	ip netns add $RX
+	ip link add veth_tx netns $TX type veth peer name veth_rx netns $RX
+	ip -n $TX addr add 10.99.0.1/24 dev veth_tx
+	ip -n $RX addr add 10.99.0.2/24 dev veth_rx
+	ip -n $TX link set veth_tx up
+	ip -n $RX link set veth_rx up
+	ip -n $TX link set lo up
+	ip -n $RX link set lo up
+	tc -n $RX qdisc add dev veth_rx root netem delay ${DELAY}ms limit 100000
+}
+
+run() {
+	name=$1
+	shift
+
+	setup
+	if ! tc -n $TX qdisc add dev veth_tx root "$@"; then
+		echo "fq_netem_bench: $name: qdisc not supported [SKIP]"
+		return
+	fi
+
+	ip netns exec $RX iperf -s > /dev/null 2>&1 &
+	server=$!
+	sleep 1
+
+	ip netns exec $TX iperf -c 10.99.0.2 -t $TIME -P 4 -f m > /tmp/fq_bench.$$ 2>&1 &
+	client=$!
+	sleep 1
+	rtt=$(ip netns exec $TX ping -q -i 0.2 -w $((TIME - 2)) 10.99.0.2 |
+	      sed -n 's/^rtt.* = [^/]*\/\([^/]*\)\/.*/\1/p')
+	wait $client
+	kill $server 2> /dev/null
+	wait $server 2> /dev/null
+
+	rate=$(sed -n 's/.*SUM.* \([0-9.]* Mbits\/sec\)/\1/p' /tmp/fq_bench.$$)
+	[ -n "$rate" ] || rate=$(sed -n 's/.* \([0-9.]* Mbits\/sec\)/\1/p' /tmp/fq_bench.$$)
+	rm -f /tmp/fq_bench.$$
+
+	echo "--------------------"
+	echo "$name: $rate, ping avg rtt $rtt ms (base ${DELAY} ms)"
+	tc -n $TX -s qdisc show dev veth_tx
+}
+
+run pfifo_fast pfifo_fast
+run fq fq
+run "fq maxrate $MAXRATE" fq maxrate $MAXRATE
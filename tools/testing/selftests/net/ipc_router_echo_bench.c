@@ -0,0 +1,218 @@
+/*
+ * Measure the IPC Router message round trip against the echo transport.
+ *
+ * Sends messages to the server announced by the emulated node of
+ * CONFIG_IPC_ROUTER_ECHO_XPRT and waits for every one to come back, the
+ * way a QMI client waits for the response to a request. Every worker owns
+ * one socket. Reports the round trips per second and the average and the
+ * worst round trip latency.
+ *
+ * usage: ipc_router_echo_bench [-w workers] [-s seconds] [-l msg_len]
+ *                              [-S service] [-I instance]
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <linux/msm_ipc.h>
+
+#define MAX_MSG_LEN	8192
+
+struct result {
+	unsigned long count;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+};
+
+static int nr_workers = 1;
+static int seconds = 5;
+static int msg_len = 64;
+static uint32_t service = 0x4543;
+static uint32_t instance = 1;
+
+static volatile sig_atomic_t stop;
+
+static void on_alarm(int sig)
+{
+	stop = 1;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int open_socket(void)
+{
+	return socket(AF_MSM_IPC, SOCK_DGRAM, 0);
+}
+
+/* Returns 1 if the echo server is known to the router */
+static int lookup_server(int fd)
+{
+	struct {
+		struct server_lookup_args args;
+		struct msm_ipc_server_info info;
+	} lookup;
+
+	memset(&lookup, 0, sizeof(lookup));
+	lookup.args.port_name.service = service;
+	lookup.args.port_name.instance = instance;
+	lookup.args.num_entries_in_array = 1;
+	lookup.args.lookup_mask = 0xffffffff;
+
+	if (ioctl(fd, IPC_ROUTER_IOCTL_LOOKUP_SERVER, &lookup) < 0)
+		return 0;
+	return lookup.args.num_entries_found > 0;
+}
+
+static void worker(struct result *res)
+{
+	char tx[MAX_MSG_LEN], rx[MAX_MSG_LEN];
+	struct sockaddr_msm_ipc dest;
+	unsigned long long start, ns;
+	ssize_t len;
+	int fd;
+
+	fd = open_socket();
+	if (fd < 0)
+		die("socket");
+
+	memset(&dest, 0, sizeof(dest));
+	dest.family = AF_MSM_IPC;
+	dest.address.addrtype = MSM_IPC_ADDR_NAME;
+	dest.address.addr.port_name.service = service;
+	dest.address.addr.port_name.instance = instance;
+	memset(tx, 0x5a, msg_len);
+
+	signal(SIGALRM, on_alarm);
+	alarm(seconds);
+
+	while (!stop) {
+		start = now_ns();
+		if (sendto(fd, tx, msg_len, 0, (struct sockaddr *)&dest,
+			   sizeof(dest)) != msg_len)
+			die("sendto");
+		len = recv(fd, rx, sizeof(rx), 0);
+		if (len < 0 && errno == EINTR)
+			break;
+		if (len != msg_len)
+			die("recv");
+		ns = now_ns() - start;
+
+		res->count++;
+		res->total_ns += ns;
+		if (ns > res->max_ns)
+			res->max_ns = ns;
+	}
+
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long total_ns = 0, max_ns = 0;
+	unsigned long count = 0;
+	struct result *res;
+	int i, c, fd;
+
+	while ((c = getopt(argc, argv, "w:s:l:S:I:")) != -1) {
+		switch (c) {
+		case 'w':
+			nr_workers = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'l':
+			msg_len = atoi(optarg);
+			break;
+		case 'S':
+			service = strtoul(optarg, NULL, 0);
+			break;
+		case 'I':
+			instance = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w workers] [-s seconds] "
+				"[-l msg_len] [-S service] [-I instance]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nr_workers < 1 || msg_len < 1 || msg_len > MAX_MSG_LEN) {
+		fprintf(stderr, "bad workers or msg_len\n");
+		return 1;
+	}
+
+	fd = open_socket();
+	if (fd < 0) {
+		printf("ipc_router_echo_bench: no AF_MSM_IPC [SKIP]\n");
+		return 0;
+	}
+	if (!lookup_server(fd)) {
+		printf("ipc_router_echo_bench: no echo server %x:%x [SKIP]\n",
+		       service, instance);
+		return 0;
+	}
+	close(fd);
+
+	res = mmap(NULL, nr_workers * sizeof(*res), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (res == MAP_FAILED)
+		die("mmap");
+	memset(res, 0, nr_workers * sizeof(*res));
+
+	for (i = 0; i < nr_workers; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork");
+		if (!pid)
+			worker(&res[i]);
+	}
+	for (i = 0; i < nr_workers; i++)
+		wait(NULL);
+
+	for (i = 0; i < nr_workers; i++) {
+		count += res[i].count;
+		total_ns += res[i].total_ns;
+		if (res[i].max_ns > max_ns)
+			max_ns = res[i].max_ns;
+	}
+	if (!count) {
+		printf("ipc_router_echo_bench: no message came back [FAIL]\n");
+		return 1;
+	}
+
+	printf("ipc_router_echo_bench: %d workers, %d bytes: %lu msgs/s, "
+	       "avg %llu us, max %llu us\n", nr_workers, msg_len,
+	       count / seconds, total_ns / count / 1000, max_ns / 1000);
+	return 0;
+}
@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+# Receive packet rate benchmark: pktgen blasts small UDP packets into a
+# veth pair whose other end sits in a network namespace, and the receive
+# rate is read from the counters of the receiving device. Each packet is
+# one skb allocation and one free, so at small packet sizes the rate
+# mostly depends on the skb allocator.
+#
+# Given a device and a destination MAC address, the packets go out of that
+# device instead and the transmit rate is reported. Run that way on the
+# host side of a QEMU tap device it loads the receive path of virtio_net
+# in the guest.
+#
+# Needs ip and the pktgen module.
+#
+# usage: pktgen_rx_bench.sh [seconds [pkt_size [dev dst_mac]]]
+
+TIME=${1:-10}
+PKT_SIZE=${2:-60}
+DEV=$3
+DST_MAC=$4
+
+NS=pktgen_rx
+PG=/proc/net/pktgen
+
+if [ $(id -u) != 0 ]; then
+	echo $0 must be run as root >&2
+	exit 0
+fi
+
+if ! which ip > /dev/null 2>&1; then
+	echo "pktgen_rx_bench: ip not found [SKIP]"
+	exit 0
+fi
+
+if [ ! -d $PG ] && ! modprobe pktgen 2> /dev/null; then
+	echo "pktgen_rx_bench: no pktgen [SKIP]"
+	exit 0
+fi
+
+pgset() {
+	echo "$2" > $PG/$1
+}
+
+cleanup() {
+	[ -e $PG/pgctrl ] && pgset pgctrl "reset"
+	ip netns del $NS 2> /dev/null
+	ip link del veth_pg 2> /dev/null
+}
+trap cleanup EXIT
+
+rx_packets() {
+	if [ -z "$DEV" ]; then
+		ip netns exec $NS cat /sys/class/net/veth_pg_rx/statistics/rx_packets
+	else
+		cat /sys/class/net/$DEV/statistics/tx_packets
+	fi
+}
+
+if [ -z "$DEV" ]; then
+	cleanup
+	ip netns add $NS
+	ip link add veth_pg type veth peer name veth_pg_rx netns $NS
+	ip link set veth_pg up
+	ip -n $NS addr add 10.98.0.2/24 dev veth_pg_rx
+	ip -n $NS link set veth_pg_rx up
+	DEV=veth_pg
+	DST_MAC=$(ip netns exec $NS cat /sys/class/net/veth_pg_rx/address)
+	LOCAL=1
+fi
+
+pgset kpktgend_0 "rem_device_all"
+pgset kpktgend_0 "add_device $DEV"
+pgset $DEV "count 0"
+pgset $DEV "clone_skb 0"
+pgset $DEV "pkt_size $PKT_SIZE"
+pgset $DEV "delay 0"
+pgset $DEV "dst 10.98.0.2"
+pgset $DEV "dst_mac $DST_MAC"
+pgset $DEV "udp_dst_min 9"
+pgset $DEV "udp_dst_max 9"
+
+before=$(rx_packets)
+pgset pgctrl "start" &
+sleep $TIME
+after=$(rx_packets)
+pgset pgctrl "stop"
+wait
+
+echo "pktgen_rx_bench: $DEV, $PKT_SIZE bytes: $(( (after - before) / TIME )) pps"
+[ -n "$LOCAL" ] || exit 0
+grep -E "^skbuff_head_cache " /proc/slabinfo 2> /dev/null
+exit 0
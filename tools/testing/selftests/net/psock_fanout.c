@@ -19,6 +19,10 @@
  *   - PACKET_FANOUT_LB
  *   - PACKET_FANOUT_CPU
  *   - PACKET_FANOUT_ROLLOVER
+ *   - PACKET_FANOUT_QM
+ *
+ *   The rollover modes also check that PACKET_ROLLOVER_STATS accounted
+ *   the packets that moved to another socket.
  *
  * Todo:
  * - functionality: PACKET_FANOUT_FLAG_DEFRAG
@@ -155,6 +159,34 @@ static int sock_fanout_read(int fds[], char *rings[], const int expect[])
 	return 0;
 }
 
+/* Sum the rollover statistics of both sockets */
+static int sock_fanout_read_rollover(int fds[])
+{
+	struct tpacket_rollover_stats rstats;
+	unsigned long long all = 0, failed = 0;
+	socklen_t len;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		len = sizeof(rstats);
+		if (getsockopt(fds[i], SOL_PACKET, PACKET_ROLLOVER_STATS,
+			       &rstats, &len)) {
+			perror("getsockopt rollover stats");
+			return 1;
+		}
+		all += rstats.tp_all;
+		failed += rstats.tp_failed;
+	}
+
+	fprintf(stderr, "info: rollover all=%llu failed=%llu\n", all, failed);
+	if (!all) {
+		fprintf(stderr, "ERROR: no rollover accounted\n");
+		return 1;
+	}
+
+	return 0;
+}
+
 /* Test illegal mode + flag combination */
 static void test_control_single(void)
 {
@@ -235,6 +267,10 @@ static int test_datapath(uint16_t typeflags, int port_off,
 	/* TODO: ensure consistent order between expect1 and expect2 */
 	ret |= sock_fanout_read(fds, rings, expect2);
 
+	if ((typeflags & 0xff) == PACKET_FANOUT_ROLLOVER ||
+	    (typeflags & PACKET_FANOUT_FLAG_ROLLOVER))
+		ret |= sock_fanout_read_rollover(fds);
+
 	if (munmap(rings[1], RING_NUM_FRAMES * getpagesize()) ||
 	    munmap(rings[0], RING_NUM_FRAMES * getpagesize())) {
 		fprintf(stderr, "close rings\n");
@@ -272,7 +308,8 @@ int main(int argc, char **argv)
 	const int expect_hash[2][2]	= { { 15, 5 },  { 20, 5 } };
 	const int expect_hash_rb[2][2]	= { { 15, 5 },  { 20, 15 } };
 	const int expect_lb[2][2]	= { { 10, 10 }, { 18, 17 } };
-	const int expect_rb[2][2]	= { { 20, 0 },  { 20, 15 } };
+	const int expect_rb[2][2]	= { { 15, 5 },  { 20, 15 } };
+	const int expect_qm[2][2]	= { { 20, 0 },  { 20, 0 } };
 	const int expect_cpu0[2][2]	= { { 20, 0 },  { 20, 0 } };
 	const int expect_cpu1[2][2]	= { { 0, 20 },  { 0, 20 } };
 	int port_off = 2, tries = 5, ret;
@@ -295,6 +332,9 @@ int main(int argc, char **argv)
 			     port_off, expect_lb[0], expect_lb[1]);
 	ret |= test_datapath(PACKET_FANOUT_ROLLOVER,
 			     port_off, expect_rb[0], expect_rb[1]);
+	/* loopback has a single queue */
+	ret |= test_datapath(PACKET_FANOUT_QM,
+			     port_off, expect_qm[0], expect_qm[1]);
 
 	set_cpuaffinity(0);
 	ret |= test_datapath(PACKET_FANOUT_CPU, port_off,
@@ -16,7 +16,7 @@
  *
  *   The test currently runs for
  *   - TPACKET_V1: RX_RING, TX_RING
- *   - TPACKET_V2: RX_RING, TX_RING
+ *   - TPACKET_V2: RX_RING, TX_RING, TX_RING with PACKET_QDISC_BYPASS
  *   - TPACKET_V3: RX_RING
  *
  * License (GPLv2):
@@ -357,6 +357,18 @@ static void __v1_v2_set_packet_loss_discard(int sock)
 	}
 }
 
+static void set_qdisc_bypass(int sock)
+{
+	int ret, bypass = 1;
+
+	ret = setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &bypass,
+			 sizeof(bypass));
+	if (ret == -1) {
+		perror("setsockopt");
+		exit(1);
+	}
+}
+
 static void walk_v1_v2_tx(int sock, struct ring *ring)
 {
 	struct pollfd pfd;
@@ -774,13 +786,13 @@ static const char *type_str[] = {
 	[PACKET_TX_RING] = "PACKET_TX_RING",
 };
 
-static int test_tpacket(int version, int type)
+static int test_tpacket(int version, int type, int bypass)
 {
 	int sock;
 	struct ring ring;
 
-	fprintf(stderr, "test: %s with %s ", tpacket_str[version],
-		type_str[type]);
+	fprintf(stderr, "test: %s with %s%s ", tpacket_str[version],
+		type_str[type], bypass ? " (qdisc bypass)" : "");
 	fflush(stderr);
 
 	if (version == TPACKET_V1 &&
@@ -792,6 +804,8 @@ static int test_tpacket(int version, int type)
 	}
 
 	sock = pfsocket(version);
+	if (bypass)
+		set_qdisc_bypass(sock);
 	memset(&ring, 0, sizeof(ring));
 	setup_ring(sock, &ring, version, type);
 	mmap_ring(sock, &ring);
@@ -808,13 +822,14 @@ int main(void)
 {
 	int ret = 0;
 
-	ret |= test_tpacket(TPACKET_V1, PACKET_RX_RING);
-	ret |= test_tpacket(TPACKET_V1, PACKET_TX_RING);
+	ret |= test_tpacket(TPACKET_V1, PACKET_RX_RING, 0);
+	ret |= test_tpacket(TPACKET_V1, PACKET_TX_RING, 0);
 
-	ret |= test_tpacket(TPACKET_V2, PACKET_RX_RING);
-	ret |= test_tpacket(TPACKET_V2, PACKET_TX_RING);
+	ret |= test_tpacket(TPACKET_V2, PACKET_RX_RING, 0);
+	ret |= test_tpacket(TPACKET_V2, PACKET_TX_RING, 0);
+	ret |= test_tpacket(TPACKET_V2, PACKET_TX_RING, 1);
 
-	ret |= test_tpacket(TPACKET_V3, PACKET_RX_RING);
+	ret |= test_tpacket(TPACKET_V3, PACKET_RX_RING, 0);
 
 	if (ret)
 		return 1;
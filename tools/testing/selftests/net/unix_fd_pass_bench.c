@@ -0,0 +1,247 @@
+/*
+ * Stress the AF_UNIX in-flight file accounting and garbage collector.
+ *
+ * Every worker owns a ring of socket pairs and keeps passing file
+ * descriptors across them with SCM_RIGHTS: one end of the next pair in the
+ * ring plus a pipe, so that both the AF_UNIX and the plain file paths are
+ * exercised. Every cycle_every messages a worker also leaves behind a
+ * reference cycle (a socket queued on itself, then closed) that only the
+ * garbage collector can reclaim.
+ *
+ * Reports the number of messages passed per second and checks that the
+ * sockets of the cycles are gone from /proc/net/unix at the end.
+ *
+ * usage: unix_fd_pass_bench [-w workers] [-p pairs] [-s seconds] [-c cycle_every]
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAX_PAIRS	1024
+
+static int nr_workers;
+static int nr_pairs = 64;
+static int seconds = 5;
+static int cycle_every = 64;
+
+static volatile sig_atomic_t stop;
+
+static void on_alarm(int sig)
+{
+	stop = 1;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void send_fds(int sock, int *fds, int nr)
+{
+	char cbuf[CMSG_SPACE(2 * sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	char c = 'x';
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = CMSG_SPACE(nr * sizeof(int));
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(nr * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, nr * sizeof(int));
+
+	if (sendmsg(sock, &msg, 0) != 1)
+		die("sendmsg");
+}
+
+static void recv_and_close_fds(int sock)
+{
+	char cbuf[CMSG_SPACE(2 * sizeof(int))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int fds[2], nr, i;
+	char c;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	if (recvmsg(sock, &msg, 0) != 1)
+		die("recvmsg");
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		nr = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cmsg), nr * sizeof(int));
+		for (i = 0; i < nr; i++)
+			close(fds[i]);
+	}
+}
+
+/* A socket that is only referenced from its own receive queue */
+static void make_garbage(void)
+{
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv))
+		die("socketpair");
+	send_fds(sv[0], &sv[1], 1);
+	close(sv[0]);
+	close(sv[1]);
+}
+
+static void worker(unsigned long *count)
+{
+	int sv[MAX_PAIRS][2], pipefd[2];
+	unsigned long n = 0;
+	int i, fds[2];
+
+	for (i = 0; i < nr_pairs; i++)
+		if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv[i]))
+			die("socketpair");
+	if (pipe(pipefd))
+		die("pipe");
+
+	signal(SIGALRM, on_alarm);
+	alarm(seconds);
+
+	while (!stop) {
+		i = n % nr_pairs;
+		fds[0] = sv[(i + 1) % nr_pairs][1];
+		fds[1] = pipefd[0];
+		send_fds(sv[i][0], fds, 2);
+		recv_and_close_fds(sv[i][1]);
+
+		if (cycle_every && !(n % cycle_every))
+			make_garbage();
+		n++;
+	}
+
+	*count = n;
+	exit(0);
+}
+
+static int count_unix_sockets(void)
+{
+	char line[512];
+	int n = 0;
+	FILE *f;
+
+	f = fopen("/proc/net/unix", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		n++;
+	fclose(f);
+	return n - 1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long *counts, total = 0;
+	int before, after, i, c, sv[2];
+
+	nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "w:p:s:c:")) != -1) {
+		switch (c) {
+		case 'w':
+			nr_workers = atoi(optarg);
+			break;
+		case 'p':
+			nr_pairs = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'c':
+			cycle_every = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w workers] [-p pairs] "
+				"[-s seconds] [-c cycle_every]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_workers < 1 || nr_pairs < 1 || nr_pairs > MAX_PAIRS) {
+		fprintf(stderr, "bad workers or pairs\n");
+		return 1;
+	}
+
+	counts = mmap(NULL, nr_workers * sizeof(*counts),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (counts == MAP_FAILED)
+		die("mmap");
+
+	before = count_unix_sockets();
+
+	for (i = 0; i < nr_workers; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0)
+			die("fork");
+		if (!pid)
+			worker(&counts[i]);
+	}
+	for (i = 0; i < nr_workers; i++)
+		wait(NULL);
+
+	for (i = 0; i < nr_workers; i++)
+		total += counts[i];
+
+	printf("unix_fd_pass_bench: %d workers, %d pairs: %lu msgs/s\n",
+	       nr_workers, nr_pairs, total / seconds);
+
+	/* Closing any AF_UNIX socket runs the collector */
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv))
+		die("socketpair");
+	close(sv[0]);
+	close(sv[1]);
+	sleep(1);
+
+	after = count_unix_sockets();
+	if (before < 0 || after < 0) {
+		printf("unix_fd_pass_bench: no /proc/net/unix [SKIP]\n");
+		return 0;
+	}
+	/* other users of the system may open sockets meanwhile */
+	if (after > before + nr_workers) {
+		printf("unix_fd_pass_bench: %d sockets left behind [FAIL]\n",
+		       after - before);
+		return 1;
+	}
+
+	printf("unix_fd_pass_bench: [PASS]\n");
+	return 0;
+}
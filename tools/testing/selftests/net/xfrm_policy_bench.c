@@ -0,0 +1,85 @@
+/*
+ * Send UDP datagrams over many flows for a while and report the rate, so
+ * that the cost of the IPsec policy lookup done for the flows that miss
+ * the flow cache shows up. Used by xfrm_policy_bench.sh.
+ *
+ * usage: xfrm_policy_bench [-s seconds] [-f flows] daddr
+ *
+ * License (GPLv2):
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ */
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+static volatile sig_atomic_t stop;
+
+static void on_alarm(int sig)
+{
+	stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long n = 0;
+	int seconds = 5, flows = 60000;
+	struct sockaddr_in sin;
+	char c = 'x';
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "s:f:")) != -1) {
+		switch (opt) {
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'f':
+			flows = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || seconds < 1 || flows < 1 || flows > 64511)
+		goto usage;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	if (inet_pton(AF_INET, argv[optind], &sin.sin_addr) != 1)
+		goto usage;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	signal(SIGALRM, on_alarm);
+	alarm(seconds);
+
+	while (!stop) {
+		/* a new destination port is a new flow */
+		sin.sin_port = htons(1024 + n % flows);
+		if (sendto(fd, &c, 1, 0, (struct sockaddr *)&sin,
+			   sizeof(sin)) < 0) {
+			perror("sendto");
+			return 1;
+		}
+		n++;
+	}
+
+	printf("%lu\n", n / seconds);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s seconds] [-f flows] daddr\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Rate of IPsec policy lookups vs. number of inexact (subnet) policies.
+# In a network namespace with a dummy device, installs the given numbers
+# of outbound policies with /24 and /16 selectors, none of them matching
+# the traffic, and reports how many UDP datagrams per second
+# xfrm_policy_bench gets out over many flows.
+#
+# Needs ip and xfrm_policy_bench from this directory.
+#
+# usage: xfrm_policy_bench.sh [seconds [count...]]
+
+TIME=${1:-5}
+[ $# -gt 0 ] && shift
+COUNTS=${*:-0 100 1000 4000 16000}
+
+NS=xfrmbench
+DIR=$(dirname $0)
+
+if [ $(id -u) != 0 ]; then
+	echo $0 must be run as root >&2
+	exit 0
+fi
+
+if [ ! -x $DIR/xfrm_policy_bench ]; then
+	echo "xfrm_policy_bench: not built [SKIP]"
+	exit 0
+fi
+
+cleanup() {
+	ip netns del $NS 2> /dev/null
+	rm -f /tmp/xfrm_bench.$$
+}
+trap cleanup EXIT
+
+setup() {
+	cleanup
+	ip netns add $NS
+	ip -n $NS link set lo up
+	ip -n $NS link add dummy0 type dummy
+	ip -n $NS link set dummy0 up
+	ip -n $NS addr add 198.18.0.1/15 dev dummy0
+}
+
+# count policies, alternating /24 and /16 selectors
+policies() {
+	i=0
+	while [ $i -lt $1 ]; do
+		a=$((i / 256 % 256))
+		b=$((i % 256))
+		if [ $((i % 2)) = 0 ]; then
+			echo "xfrm policy add src 10.$a.$b.0/24 dst 172.16.$b.0/24" \
+			     "dir out priority $i action allow"
+		else
+			echo "xfrm policy add src 10.$b.0.0/16 dst 172.$((16 + a % 16)).$((a / 16)).0/24" \
+			     "proto udp dir out priority $i action allow"
+		fi
+		i=$((i + 1))
+	done
+}
+
+for count in $COUNTS; do
+	if ! setup; then
+		echo "xfrm_policy_bench: no network namespaces [SKIP]"
+		exit 0
+	fi
+	policies $count > /tmp/xfrm_bench.$$
+	if ! ip -n $NS -batch /tmp/xfrm_bench.$$; then
+		echo "xfrm_policy_bench: can't add policies [SKIP]"
+		exit 0
+	fi
+	rate=$(ip netns exec $NS $DIR/xfrm_policy_bench -s $TIME 198.19.0.1)
+	echo "$count inexact policies: $rate datagrams/s"
+done
@@ -0,0 +1,207 @@
+/*
+ * Self-monitoring counter reads through the perf mmap page.
+ *
+ * Opens a cycle and an instruction counter on the calling task, reads them
+ * directly from the PMU following the protocol documented in
+ * struct perf_event_mmap_page and checks every user space value against
+ * read() values taken right before and after it.  Hog processes on every
+ * CPU and forced migrations make sure the reads are exercised across
+ * preemption and counter reprogramming.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+
+#include <linux/perf_event.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define LOOPS		2000000
+#define MIGRATE_EVERY	1000
+
+#define barrier()	asm volatile("" : : : "memory")
+
+struct counter {
+	const char *name;
+	uint64_t config;
+	int fd;
+	struct perf_event_mmap_page *pc;
+	uint64_t last;
+	unsigned long user_reads;
+};
+
+static struct counter counters[] = {
+	{ .name = "cycles", .config = PERF_COUNT_HW_CPU_CYCLES },
+	{ .name = "instructions", .config = PERF_COUNT_HW_INSTRUCTIONS },
+};
+
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static long sys_perf_event_open(struct perf_event_attr *attr, pid_t pid,
+				int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+/* Index 1 is the cycle counter, n > 1 event counter n - 2. */
+static uint32_t read_pmc(uint32_t idx)
+{
+	uint32_t val;
+
+	if (idx == 1) {
+		asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (val));
+	} else {
+		asm volatile("mcr p15, 0, %0, c9, c12, 5" : : "r" (idx - 2));
+		asm volatile("isb" : : : "memory");
+		asm volatile("mrc p15, 0, %0, c9, c13, 2" : "=r" (val));
+	}
+	return val;
+}
+
+static uint64_t user_read(struct counter *c, int *direct)
+{
+	struct perf_event_mmap_page *pc = c->pc;
+	uint32_t seq, idx, width;
+	uint64_t count;
+	int64_t pmc;
+
+	do {
+		seq = pc->lock;
+		barrier();
+
+		idx = pc->index;
+		count = pc->offset;
+		*direct = pc->cap_usr_rdpmc && idx;
+		if (*direct) {
+			width = pc->pmc_width;
+			pmc = read_pmc(idx);
+			pmc <<= 64 - width;
+			pmc >>= 64 - width;
+			count += pmc;
+		}
+
+		barrier();
+	} while (pc->lock != seq);
+
+	return count;
+}
+
+static uint64_t sys_read(struct counter *c)
+{
+	uint64_t count;
+
+	if (read(c->fd, &count, sizeof(count)) != sizeof(count)) {
+		perror("read");
+		exit(1);
+	}
+	return count;
+}
+
+static int open_counter(struct counter *c)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = c->config;
+	attr.exclude_kernel = 1;
+
+	c->fd = sys_perf_event_open(&attr, 0, -1, -1, 0);
+	if (c->fd < 0) {
+		perror("perf_event_open");
+		return -1;
+	}
+
+	c->pc = mmap(NULL, getpagesize(), PROT_READ, MAP_SHARED, c->fd, 0);
+	if (c->pc == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	return 0;
+}
+
+static void migrate(int nr_cpus, int i)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET((i / MIGRATE_EVERY) % nr_cpus, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+int main(int argc, char **argv)
+{
+	int nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	pid_t hogs[nr_cpus];
+	int i, j, direct, ret = 0;
+	unsigned int c;
+
+	for (c = 0; c < NR_COUNTERS; c++)
+		if (open_counter(&counters[c]))
+			return 0;	/* no PMU, nothing to test */
+
+	if (!counters[0].pc->cap_usr_rdpmc) {
+		printf("rdpmc_test: user counter access not supported [SKIP]\n");
+		return 0;
+	}
+
+	/* Keep every CPU busy so that we get preempted and migrated */
+	for (i = 0; i < nr_cpus; i++) {
+		hogs[i] = fork();
+		if (!hogs[i])
+			for (;;)
+				;
+	}
+
+	for (i = 0; i < LOOPS && !ret; i++) {
+		if (!(i % MIGRATE_EVERY))
+			migrate(nr_cpus, i);
+
+		for (c = 0; c < NR_COUNTERS; c++) {
+			struct counter *cnt = &counters[c];
+			uint64_t before, user, after;
+
+			before = sys_read(cnt);
+			user = user_read(cnt, &direct);
+			after = sys_read(cnt);
+
+			cnt->user_reads += direct;
+			if (user < before || user > after || user < cnt->last) {
+				printf("rdpmc_test: %s: %llu not in [%llu, %llu], last %llu\n",
+				       cnt->name, (unsigned long long)user,
+				       (unsigned long long)before,
+				       (unsigned long long)after,
+				       (unsigned long long)cnt->last);
+				ret = 1;
+				break;
+			}
+			cnt->last = user;
+		}
+	}
+
+	for (j = 0; j < nr_cpus; j++) {
+		kill(hogs[j], SIGKILL);
+		waitpid(hogs[j], NULL, 0);
+	}
+
+	for (c = 0; c < NR_COUNTERS; c++) {
+		printf("rdpmc_test: %s: %lu direct reads out of %d\n",
+		       counters[c].name, counters[c].user_reads, i);
+		if (!counters[c].user_reads)
+			ret = 1;
+	}
+
+	printf("rdpmc_test: [%s]\n", ret ? "FAIL" : "PASS");
+	return ret;
+}